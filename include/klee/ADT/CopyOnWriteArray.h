@@ -0,0 +1,203 @@
+//===-- CopyOnWriteArray.h --------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_COPYONWRITEARRAY_H
+#define KLEE_COPYONWRITEARRAY_H
+
+#include "klee/ADT/Ref.h"
+
+#include "llvm/ADT/SmallVector.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <new>
+
+namespace klee {
+
+/// A fixed-size array stored in chunks of ChunkSize elements. Copying the
+/// array only copies references to its chunks; a chunk is duplicated the
+/// first time it is written through a copy that shares it. Copies and writes
+/// thus cost O(size / ChunkSize) and O(ChunkSize), respectively.
+template <typename T, unsigned ChunkSize = 4096 / sizeof(T)>
+class CopyOnWriteArray {
+  static_assert(ChunkSize > 0, "chunks must not be empty");
+
+  /// A reference counted block of elements allocated together with its
+  /// header.
+  class Chunk {
+  public:
+    /// @brief Required by klee::ref-managed objects
+    class ReferenceCounter _refCount;
+    const unsigned size;
+
+    static Chunk *create(unsigned size, const T &value) {
+      auto *chunk = new (::operator new(sizeof(Chunk) + size * sizeof(T)))
+          Chunk(size);
+      std::uninitialized_fill_n(chunk->begin(), size, value);
+      return chunk;
+    }
+
+    static Chunk *create(const Chunk &other) {
+      auto *chunk = new (::operator new(sizeof(Chunk) + other.size * sizeof(T)))
+          Chunk(other.size);
+      std::uninitialized_copy_n(other.begin(), other.size, chunk->begin());
+      return chunk;
+    }
+
+    ~Chunk() {
+      for (T *it = begin(), *ie = begin() + size; it != ie; ++it)
+        it->~T();
+    }
+
+    static void operator delete(void *ptr) { ::operator delete(ptr); }
+
+    T *begin() { return reinterpret_cast<T *>(this + 1); }
+    const T *begin() const { return reinterpret_cast<const T *>(this + 1); }
+
+  private:
+    explicit Chunk(unsigned size) : size(size) {}
+  };
+  static_assert(sizeof(Chunk) % alignof(T) == 0,
+                "elements following the chunk header would be misaligned");
+
+  llvm::SmallVector<ref<Chunk>, 1> chunks;
+  unsigned size;
+
+  /// Returns the chunk with the given index after making sure that it is not
+  /// shared with any other array.
+  Chunk &getWriteableChunk(unsigned c) {
+    if (chunks[c]->_refCount.getCount() > 1)
+      chunks[c] = Chunk::create(*chunks[c]);
+    return *chunks[c];
+  }
+
+public:
+  explicit CopyOnWriteArray(unsigned size, const T &value = T()) : size(size) {
+    fill(value);
+  }
+
+  unsigned getSize() const { return size; }
+  unsigned getNumChunks() const { return chunks.size(); }
+
+  /// Returns the index of the first element of the given chunk.
+  unsigned getChunkBegin(unsigned c) const { return c * ChunkSize; }
+  /// Returns the number of elements of the given chunk.
+  unsigned getChunkSize(unsigned c) const {
+    return std::min(ChunkSize, size - c * ChunkSize);
+  }
+
+  /// Returns whether the given chunk is referenced by this array only, i.e.
+  /// whether it is freed along with the array.
+  bool isChunkExclusive(unsigned c) const {
+    return chunks[c]->_refCount.getCount() == 1;
+  }
+
+  /// Frees the given chunk, e.g. after its contents were stored elsewhere.
+  /// The array must not be accessed until the chunk is restored.
+  void releaseChunk(unsigned c) { chunks[c] = nullptr; }
+
+  /// Restores a released chunk from the (getChunkSize(c) elements long)
+  /// buffer src.
+  void restoreChunk(unsigned c, const T *src) {
+    assert(chunks[c].isNull() && "chunk was not released");
+    Chunk *chunk = Chunk::create(getChunkSize(c), T());
+    std::copy_n(src, chunk->size, chunk->begin());
+    chunks[c] = chunk;
+  }
+
+  const T &operator[](unsigned idx) const {
+    assert(idx < size && "index out of range");
+    return chunks[idx / ChunkSize]->begin()[idx % ChunkSize];
+  }
+
+  /// Returns a mutable reference to an element, unsharing its chunk.
+  T &getWriteable(unsigned idx) {
+    assert(idx < size && "index out of range");
+    return getWriteableChunk(idx / ChunkSize).begin()[idx % ChunkSize];
+  }
+
+  void set(unsigned idx, const T &value) { getWriteable(idx) = value; }
+
+  /// Set all elements to the given value without copying any chunk.
+  void fill(const T &value) {
+    chunks.clear();
+    for (unsigned base = 0; base < size; base += ChunkSize)
+      chunks.push_back(Chunk::create(std::min(ChunkSize, size - base), value));
+  }
+
+  /// Copy the contents to the (size elements long) buffer dst.
+  void copyTo(T *dst) const {
+    for (const auto &chunk : chunks)
+      dst = std::copy_n(chunk->begin(), chunk->size, dst);
+  }
+
+  /// Compare the contents with the (size elements long) buffer other.
+  bool equals(const T *other) const {
+    for (const auto &chunk : chunks) {
+      if (!std::equal(chunk->begin(), chunk->begin() + chunk->size, other))
+        return false;
+      other += chunk->size;
+    }
+    return true;
+  }
+
+  /// Overwrite the contents with the (size elements long) buffer src. Only
+  /// chunks whose contents differ are written (and thereby unshared).
+  /// \return true iff any element changed.
+  bool copyFrom(const T *src) {
+    bool changed = false;
+    for (unsigned c = 0, e = chunks.size(); c != e; ++c) {
+      const unsigned n = chunks[c]->size;
+      if (!std::equal(src, src + n, chunks[c]->begin())) {
+        std::copy_n(src, n, getWriteableChunk(c).begin());
+        changed = true;
+      }
+      src += n;
+    }
+    return changed;
+  }
+};
+
+/// A bit array with copy-on-write chunks (see CopyOnWriteArray). Setting a
+/// bit to its current value never copies a chunk.
+class CopyOnWriteBitArray {
+  CopyOnWriteArray<std::uint32_t> words;
+
+  static unsigned length(unsigned size) { return (size + 31) / 32; }
+
+public:
+  explicit CopyOnWriteBitArray(unsigned size, bool value = false)
+      : words(length(size), value ? 0xFFFFFFFF : 0) {}
+
+  /// The bits, 32 to a word (e.g. to store the chunks elsewhere).
+  CopyOnWriteArray<std::uint32_t> &getWords() { return words; }
+
+  bool get(unsigned idx) const {
+    return (words[idx / 32] >> (idx & 0x1F)) & 1;
+  }
+  void set(unsigned idx) {
+    if (!get(idx))
+      words.getWriteable(idx / 32) |= 1U << (idx & 0x1F);
+  }
+  void unset(unsigned idx) {
+    if (get(idx))
+      words.getWriteable(idx / 32) &= ~(1U << (idx & 0x1F));
+  }
+  void set(unsigned idx, bool value) {
+    if (value)
+      set(idx);
+    else
+      unset(idx);
+  }
+};
+
+} // namespace klee
+
+#endif /* KLEE_COPYONWRITEARRAY_H */
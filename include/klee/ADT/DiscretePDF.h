@@ -27,6 +27,9 @@ namespace klee {
     bool empty() const;
     void insert(T item, weight_type weight);
     void update(T item, weight_type newWeight);
+    /// Set the weight of every item to newWeight(item) in a single pass
+    /// over the tree, which is cheaper than updating each item on its own.
+    template <class WeightFn> void updateAll(WeightFn newWeight);
     void remove(T item);
     bool inTree(T item);
     weight_type getWeight(T item);
@@ -45,6 +48,7 @@ namespace klee {
     void rotate(Node *node);
     void lengthen(Node *node);
     void propagateSumsUp(Node *n);
+    template <class WeightFn> void updateAll(Node *n, WeightFn &newWeight);
   };
 
 }
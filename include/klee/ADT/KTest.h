@@ -54,6 +54,49 @@ extern "C" {
 
   void  kTest_free(KTest *);
 
+
+  /* A test archive stores many named files (e.g. .ktest files and the
+     other files describing test cases) in a single file. Wherever a .ktest
+     path is accepted, "<archive>:<name>" refers to an archive entry. */
+  typedef struct KTestArchive KTestArchive;
+
+  /* return true iff file at path matches test archive header */
+  int   kTest_isArchive(const char *path);
+
+  /* returns the names of all entries (free with kTest_freeNames), NULL on
+     (unspecified) error */
+  char** kTest_listArchive(const char *path, unsigned *numNames);
+
+  void  kTest_freeNames(char **names, unsigned numNames);
+
+  /* opens an existing archive for reading (close with kTest_closeArchive),
+     returns NULL on (unspecified) error */
+  KTestArchive* kTest_openArchive(const char *path);
+
+  /* returns the number of entries of an archive opened for reading */
+  unsigned kTest_numArchiveEntries(KTestArchive *);
+
+  /* returns the name of the given entry, in the order entries were added */
+  const char* kTest_archiveEntryName(KTestArchive *, unsigned index);
+
+  /* reads the (first) entry of the given name from an archive opened for
+     reading, returns NULL on (unspecified) error */
+  KTest* kTest_fromArchive(KTestArchive *, const char *name);
+
+  /* returns NULL on (unspecified) error */
+  KTestArchive* kTest_createArchive(const char *path);
+
+  /* returns 1 on success, 0 on (unspecified) error */
+  int   kTest_addToArchive(KTestArchive *, const char *name,
+                           const void *data, unsigned size);
+
+  /* returns 1 on success, 0 on (unspecified) error */
+  int   kTest_toArchive(KTest *, KTestArchive *, const char *name);
+
+  /* writes the index (unless opened for reading) and closes the archive,
+     returns 1 on success, 0 on (unspecified) error */
+  int   kTest_closeArchive(KTestArchive *);
+
 #ifdef __cplusplus
 }
 #endif
@@ -61,7 +61,7 @@ public:
 
   /// Returns the number of parallel references of this objects
   /// \return number of references on this object
-  unsigned getCount() {return refCount;}
+  unsigned getCount() const {return refCount;}
 
   // Copy assignment operator
   ReferenceCounter &operator=(const ReferenceCounter &a) {
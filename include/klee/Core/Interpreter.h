@@ -47,6 +47,14 @@ public:
   virtual void processTestCase(const ExecutionState &state,
                                const char *err,
                                const char *suffix) = 0;
+
+  /// Return whether some states should be handed over to another process,
+  /// polled while exploring shared paths (see Interpreter::setSharedPaths).
+  virtual bool shouldShareStates() { return false; }
+
+  /// Receive the paths of the states handed over, which are empty if no
+  /// state could be spared.
+  virtual void shareStates(std::string paths) {}
 };
 
 class Interpreter {
@@ -129,6 +137,12 @@ public:
   // a user specified path. use null to reset.
   virtual void setReplayPath(const std::vector<bool> *path) = 0;
 
+  // supply the paths of states handed over by another process (see
+  // InterpreterHandler::shareStates) to explore, or an empty string to
+  // explore all paths. states are then handed over whenever
+  // InterpreterHandler::shouldShareStates asks for them. use null to reset.
+  virtual void setSharedPaths(const std::string *paths) = 0;
+
   // supply a set of symbolic bindings that will be used as "seeds"
   // for the search. use null to reset.
   virtual void useSeeds(const std::vector<struct KTest *> *seeds) = 0;
@@ -144,6 +158,10 @@ public:
 
   virtual void setInhibitForking(bool value) = 0;
 
+  // resume the exploration from the last checkpoint in the output
+  // directory instead of starting over.
+  virtual void setResumeFromCheckpoint(bool value) = 0;
+
   virtual void prepareForEarlyExit() = 0;
 
   /*** State accessor methods ***/
@@ -0,0 +1,76 @@
+//===-- CompiledExpr.h ------------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_COMPILEDEXPR_H
+#define KLEE_COMPILEDEXPR_H
+
+#include "klee/Expr/Expr.h"
+#include "klee/Expr/ExprHashMap.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace klee {
+class Assignment;
+
+/// An expression compiled for evaluating it under many assignments at once,
+/// e.g. under all seeds of a state.
+///
+/// The expression is flattened into a sequence of operations on 64-bit
+/// values, which are applied to a batch of assignments at a time. The result
+/// under an assignment is only known if Assignment::evaluate would fold the
+/// expression to the same constant, i.e. if every byte that determines it is
+/// bound (or comes from a constant array) and no division by zero is
+/// involved. For the other assignments, the caller has to fall back to
+/// Assignment::evaluate.
+class CompiledExpr {
+  struct Node {
+    Expr::Kind kind;
+    Expr::Width width;
+    /// The width of the first operand (for extensions and comparisons)
+    Expr::Width kidWidth;
+    unsigned kids[3];
+    /// The value of a constant, the bit offset of an extract
+    std::uint64_t value;
+    /// For a read: the array (index into arrays) and its updates (range of
+    /// updates, newest first)
+    unsigned array, firstUpdate, numUpdates;
+  };
+
+  struct Update {
+    unsigned index, value;
+  };
+
+  std::vector<Node> nodes;
+  std::vector<Update> updates;
+  std::vector<const Array *> arrays;
+  bool compiled = true;
+
+  unsigned compile(const ref<Expr> &e, ExprHashMap<unsigned> &ids);
+  void evaluateBatch(const Assignment *const *assignments, unsigned count,
+                     std::uint64_t *values, std::uint64_t &known) const;
+
+public:
+  explicit CompiledExpr(const ref<Expr> &e);
+
+  /// Return whether the expression could be compiled, which requires all
+  /// its subexpressions to be at most 64 bits wide. If not, the result is
+  /// unknown under every assignment.
+  bool isCompiled() const { return compiled; }
+
+  /// Evaluate the expression under each of the given assignments.
+  /// \param values The (zero-extended) value under each assignment
+  /// \param known Whether the value under each assignment is known
+  void evaluate(const std::vector<const Assignment *> &assignments,
+                std::vector<std::uint64_t> &values,
+                std::vector<bool> &known) const;
+};
+} // namespace klee
+
+#endif /* KLEE_COMPILEDEXPR_H */
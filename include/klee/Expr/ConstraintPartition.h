@@ -0,0 +1,82 @@
+//===-- ConstraintPartition.h -----------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_CONSTRAINTPARTITION_H
+#define KLEE_CONSTRAINTPARTITION_H
+
+#include "klee/Expr/Expr.h"
+
+#include "llvm/ADT/DenseMap.h"
+
+#include <cstddef>
+#include <vector>
+
+namespace klee {
+class Array;
+
+/// Partitions a sequence of constraints into independent classes, i.e.
+/// classes of constraints that (transitively) read the same bytes of
+/// symbolic arrays. A read at a symbolic index counts as a read of all bytes
+/// of the array, reads of constant arrays are ignored.
+///
+/// The partition is a union-find over the array bytes read by the
+/// constraints, where every class keeps a list of its constraints. Adding a
+/// constraint takes time roughly linear in the number of reads it contains,
+/// and looking up the constraints an expression depends on takes time linear
+/// in the number of reads of the expression and the size of the result.
+class ConstraintPartition {
+  static constexpr unsigned None = ~0u;
+
+  struct ArrayNodes {
+    /// The node of all bytes, once the array is read at a symbolic index
+    unsigned whole = None;
+    /// The nodes of the bytes read at a constant index, until then
+    llvm::DenseMap<unsigned, unsigned> bytes;
+  };
+
+  llvm::DenseMap<const Array *, ArrayNodes> arrays;
+
+  /// The union-find forest over nodes
+  std::vector<unsigned> parent;
+  std::vector<unsigned> classSize;
+  /// Singly linked list of the constraints of a class, valid for roots
+  std::vector<unsigned> first;
+  std::vector<unsigned> last;
+  /// The next constraint of the same class, per constraint
+  std::vector<unsigned> next;
+
+  unsigned find(unsigned node) const;
+  unsigned findAndCompress(unsigned node);
+  unsigned unite(unsigned a, unsigned b);
+  unsigned getNode(const Array *array, unsigned index);
+  unsigned getWholeNode(const Array *array);
+
+  /// Collect the roots of the classes containing bytes read by e.
+  void findRoots(const ref<Expr> &e, std::vector<unsigned> &roots) const;
+
+public:
+  /// Return the number of constraints that were added.
+  std::size_t size() const { return next.size(); }
+
+  /// Add the next constraint.
+  void add(const ref<Expr> &constraint);
+
+  /// Return the indices of the constraints that (transitively) read a byte
+  /// that e reads, in ascending order.
+  void getDependentConstraints(const ref<Expr> &e,
+                               std::vector<std::size_t> &indices) const;
+
+  /// Return the indices of the constraints of each class, in ascending order.
+  /// Constraints that read no symbolic array are not part of any class.
+  void getClasses(std::vector<std::vector<std::size_t>> &classes) const;
+};
+
+} // namespace klee
+
+#endif /* KLEE_CONSTRAINTPARTITION_H */
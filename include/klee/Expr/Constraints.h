@@ -10,20 +10,117 @@
 #ifndef KLEE_CONSTRAINTS_H
 #define KLEE_CONSTRAINTS_H
 
+#include "klee/Expr/ConstraintPartition.h"
 #include "klee/Expr/Expr.h"
 
+#include <cstddef>
+#include <iterator>
+#include <memory>
+#include <vector>
+
 namespace klee {
 
 /// Resembles a set of constraints that can be passed around
 ///
+/// The constraints are stored in fixed-size chunks, each linked to the
+/// (full) chunk holding the constraints before it. Chunks are shared between
+/// copies of a set: a set only sees a prefix of its last chunk, and appending
+/// to a chunk never changes what other sets see. Copying a set (e.g. when a
+/// state forks) is thus O(1), and appending is O(1) unless another set has
+/// already appended to the shared last chunk, in which case the visible part
+/// of that chunk (less than ChunkSize constraints) is copied.
 class ConstraintSet {
   friend class ConstraintManager;
 
+public:
+  static constexpr unsigned ChunkSize = 32;
+
+private:
+  struct Chunk {
+    /// @brief Required by klee::ref-managed objects
+    class ReferenceCounter _refCount;
+    /// The chunk holding the ChunkSize constraints before this one
+    const ref<Chunk> parent;
+    /// The number of constraints before this chunk
+    const std::size_t offset;
+    /// The number of constraints appended to this chunk by any set
+    unsigned used = 0;
+    ref<Expr> constraints[ChunkSize];
+
+    Chunk(ref<Chunk> parent, std::size_t offset)
+        : parent(std::move(parent)), offset(offset) {}
+  };
+
+  ref<Chunk> tail;
+  std::size_t count = 0;
+  /// XOR of the hashes of all constraints
+  unsigned hashValue = 0;
+  /// Independence partition of a prefix of the constraints, which is
+  /// extended on demand and shared with copies until either extends it
+  mutable std::shared_ptr<ConstraintPartition> partition;
+
 public:
   using constraints_ty = std::vector<ref<Expr>>;
-  using iterator = constraints_ty::iterator;
-  using const_iterator = constraints_ty::const_iterator;
 
+  /// Iterates over the constraints in the order they were added.
+  class const_iterator {
+    friend class ConstraintSet;
+
+    /// The last chunk of the set, from which the others are found
+    const Chunk *tail;
+    /// The chunk holding the constraint at index
+    const Chunk *chunk;
+    std::size_t index;
+
+    const_iterator(const Chunk *tail, std::size_t index)
+        : tail(tail), chunk(findChunk(tail, index)), index(index) {}
+
+    /// Return the chunk holding the constraint at index by walking the
+    /// parent links from the last chunk.
+    static const Chunk *findChunk(const Chunk *tail, std::size_t index) {
+      const Chunk *chunk = tail;
+      while (chunk && chunk->offset > index)
+        chunk = chunk->parent.get();
+      return chunk;
+    }
+
+  public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = ref<Expr>;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const ref<Expr> *;
+    using reference = const ref<Expr> &;
+
+    reference operator*() const {
+      return chunk->constraints[index - chunk->offset];
+    }
+    pointer operator->() const { return &**this; }
+    reference operator[](difference_type n) const {
+      const std::size_t i = index + n;
+      const Chunk *c = i >= chunk->offset && i - chunk->offset < ChunkSize
+                           ? chunk
+                           : findChunk(tail, i);
+      return c->constraints[i - c->offset];
+    }
+    const_iterator &operator++() {
+      // the following chunk is only reachable from the last one
+      if (++index - chunk->offset == ChunkSize)
+        chunk = findChunk(tail, index);
+      return *this;
+    }
+    const_iterator operator++(int) {
+      const_iterator it = *this;
+      ++*this;
+      return it;
+    }
+    bool operator==(const const_iterator &other) const {
+      return index == other.index;
+    }
+    bool operator!=(const const_iterator &other) const {
+      return index != other.index;
+    }
+  };
+  using iterator = const_iterator;
   using constraint_iterator = const_iterator;
 
   bool empty() const;
@@ -31,17 +128,41 @@ public:
   constraint_iterator end() const;
   size_t size() const noexcept;
 
-  explicit ConstraintSet(constraints_ty cs) : constraints(std::move(cs)) {}
+  explicit ConstraintSet(const constraints_ty &cs);
   ConstraintSet() = default;
 
   void push_back(const ref<Expr> &e);
 
-  bool operator==(const ConstraintSet &b) const {
-    return constraints == b.constraints;
+  /// Return the XOR of the hashes of all constraints, which is maintained
+  /// while constraints are added.
+  unsigned hash() const { return hashValue; }
+
+  /// Return the number of leading constraints whose storage this set shares
+  /// with the other one, e.g. with the set of the state it was forked from.
+  /// This is a lower bound on the length of the common prefix that does not
+  /// compare any constraints.
+  std::size_t getSharedPrefixSize(const ConstraintSet &other) const;
+
+  /// Return true iff this set shares the storage of all its constraints with
+  /// the other one and has no further constraints, i.e. both sets are equal
+  /// without comparing any constraints.
+  bool isCopyOf(const ConstraintSet &other) const {
+    return count == other.count && getSharedPrefixSize(other) == count;
   }
 
-private:
-  constraints_ty constraints;
+  /// Return the number of leading constraints whose storage is shared with
+  /// other sets (or otherwise referenced), i.e. that would stay in memory if
+  /// this set were dropped.
+  std::size_t getSharedSize() const;
+
+  /// Return a set of the first n constraints that shares their storage with
+  /// this one.
+  ConstraintSet getPrefix(std::size_t n) const;
+
+  /// Return the independence partition of all constraints.
+  const ConstraintPartition &getPartition() const;
+
+  bool operator==(const ConstraintSet &b) const;
 };
 
 class ExprVisitor;
@@ -12,6 +12,8 @@
 
 #include "klee/Expr/ExprVisitor.h"
 
+#include <cstdint>
+#include <utility>
 #include <vector>
 
 namespace klee {
@@ -40,6 +42,12 @@ namespace klee {
                            InputIterator end,
                            std::vector<const Array*> &results);
 
+  /// Compute a conservative unsigned interval [min, max] containing every
+  /// value the given expression can evaluate to, by inspection of its
+  /// structure only (symbolic reads are unconstrained). Expressions wider
+  /// than 64 bits are never bounded.
+  std::pair<uint64_t, uint64_t> getUnsignedBounds(const ref<Expr> &e);
+
   class ConstantArrayFinder : public ExprVisitor {
   protected:
     ExprVisitor::Action visitRead(const ReadExpr &re);
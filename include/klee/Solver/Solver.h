@@ -10,14 +10,17 @@
 #ifndef KLEE_SOLVER_H
 #define KLEE_SOLVER_H
 
+#include "klee/Expr/Constraints.h"
 #include "klee/Expr/Expr.h"
 #include "klee/System/Time.h"
 #include "klee/Solver/SolverCmdLine.h"
 
 #include <memory>
+#include <string>
 #include <vector>
 
 namespace klee {
+  class Assignment;
   class ConstraintSet;
   class Expr;
   class SolverImpl;
@@ -28,6 +31,13 @@ namespace klee {
   struct SolverQueryMetaData {
     /// @brief Costs for all queries issued for this state
     time::Span queryCost;
+
+    /// @brief Assignments of some arrays that extend to solutions of
+    /// modelConstraints (the constraints of the state), from which queries
+    /// under these constraints are answered where possible: each constraint
+    /// is either true under an assignment or reads none of its arrays
+    std::vector<std::shared_ptr<const Assignment>> models;
+    ConstraintSet modelConstraints;
   };
 
   struct Query {
@@ -163,6 +173,28 @@ namespace klee {
     /// \return True on success.
     bool mayBeFalse(const Query&, bool &result);
 
+    /// mustBeTrue - Determine for each of the given expressions if it is
+    /// provably true under the given constraints. The queries are answered
+    /// together, which lets the underlying solver share work between them.
+    ///
+    /// \param [out] results - On success, the result for each expression
+    ///
+    /// \return True on success.
+    bool mustBeTrue(const ConstraintSet &constraints,
+                    const std::vector<ref<Expr>> &exprs,
+                    std::vector<bool> &results);
+
+    /// mayBeTrue - Determine for each of the given expressions if there is
+    /// a valid assignment in which it evaluates to true. The queries are
+    /// answered together (see the batched mustBeTrue).
+    ///
+    /// \param [out] results - On success, the result for each expression
+    ///
+    /// \return True on success.
+    bool mayBeTrue(const ConstraintSet &constraints,
+                   const std::vector<ref<Expr>> &exprs,
+                   std::vector<bool> &results);
+
     /// getValue - Compute one possible value for the given expression.
     ///
     /// \param [out] result - On success, a value for the expression in some
@@ -190,6 +222,19 @@ namespace klee {
                           const std::vector<const Array*> &objects,
                           std::vector< std::vector<unsigned char> > &result);
 
+    /// getInitialValues - Like getInitialValues above, but tells a query
+    /// without satisfying assignment apart from a failure.
+    ///
+    /// \param [out] hasSolution - On success, true iff there is an
+    /// assignment satisfying the constraints and the negated query
+    /// expression, whose initial values are then in result.
+    ///
+    /// \return True on success.
+    bool getInitialValues(const Query &,
+                          const std::vector<const Array *> &objects,
+                          std::vector<std::vector<unsigned char>> &result,
+                          bool &hasSolution);
+
     /// getRange - Compute a tight range of possible values for a given
     /// expression.
     ///
@@ -232,6 +277,15 @@ namespace klee {
   /// \param s - The underlying solver to use.
   std::unique_ptr<Solver> createCachingSolver(std::unique_ptr<Solver> s);
 
+  /// createPersistentCachingSolver - Create a solver which caches validity
+  /// results and initial values in a file that persists across runs and can
+  /// be shared by concurrently running processes.
+  ///
+  /// \param s - The underlying solver to use.
+  /// \param path - The cache file, created if it does not exist.
+  std::unique_ptr<Solver> createPersistentCachingSolver(std::unique_ptr<Solver> s,
+                                                        std::string path);
+
   /// createCexCachingSolver - Create a counterexample caching solver. This is a
   /// more sophisticated cache which records counterexamples for a constraint
   /// set and uses subset/superset relations among constraints to try and
@@ -270,6 +324,17 @@ namespace klee {
   /// fails.
   std::unique_ptr<Solver> createDummySolver();
 
+  /// createPortfolioSolver - Create a solver which runs every query on all
+  /// of the given core solvers in parallel (in forked processes) and uses
+  /// the first answer. It reports which backend won for each shape of
+  /// query on destruction.
+  ///
+  /// \param backends - The core solvers to race.
+  /// \param names - The names of the core solvers, for reporting.
+  std::unique_ptr<Solver>
+  createPortfolioSolver(std::vector<std::unique_ptr<Solver>> backends,
+                        std::vector<std::string> names);
+
   // Create a solver based on the supplied ``CoreSolverType``.
   std::unique_ptr<Solver> createCoreSolver(CoreSolverType cst);
   } // namespace klee
@@ -94,6 +94,42 @@ namespace klee {
                                         &values,
                                       bool &hasSolution) = 0;
     
+    /// computeTruthBatch - Determine for each expression in \a exprs
+    /// whether it is provably true given the constraints, as computeTruth
+    /// does for a single query.
+    ///
+    /// The expressions are guaranteed to be non-constant and have bool
+    /// type.
+    ///
+    /// SolverImpl provides a default implementation which uses
+    /// computeTruth for every expression. Clients should override this if
+    /// the queries can share work, e.g. a single solver session for the
+    /// common constraints.
+    ///
+    /// \param [out] isValid - On success, the result for each expression.
+    /// \return True on success
+    virtual bool computeTruthBatch(const ConstraintSet &constraints,
+                                   const std::vector<ref<Expr>> &exprs,
+                                   std::vector<bool> &isValid);
+
+    /// computeInitialValuesBatch - Compute initial values for \a objects
+    /// for each query formed by the constraints and one expression in
+    /// \a exprs, as computeInitialValues does for a single query.
+    ///
+    /// SolverImpl provides a default implementation which uses
+    /// computeInitialValues for every expression.
+    ///
+    /// \param [out] values - On success, the values for each expression
+    /// (empty if it has no solution).
+    /// \param [out] hasSolution - On success, whether each query has a
+    /// solution.
+    /// \return True on success
+    virtual bool computeInitialValuesBatch(
+        const ConstraintSet &constraints, const std::vector<ref<Expr>> &exprs,
+        const std::vector<const Array *> &objects,
+        std::vector<std::vector<std::vector<unsigned char>>> &values,
+        std::vector<bool> &hasSolution);
+
     /// getOperationStatusCode - get the status of the last solver operation
     virtual SolverRunStatus getOperationStatusCode() = 0;
 
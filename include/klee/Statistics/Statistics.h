@@ -45,16 +45,21 @@ namespace klee {
     uint64_t *indexedStats;
     StatisticRecord *contextStats;
     unsigned index;
+    unsigned numIndices;
 
   public:
     StatisticManager();
     ~StatisticManager();
 
     void useIndexedStats(unsigned totalIndices);
+    unsigned getNumIndices() const { return indexedStats ? numIndices : 0; }
 
     StatisticRecord *getContext();
     void setContext(StatisticRecord *sr); /* null to reset */
 
+    /// Stop (or resume) counting increments of all statistics.
+    void setEnabled(bool e) { enabled = e; }
+
     void setIndex(unsigned i) { index = i; }
     unsigned getIndex() { return index; }
     unsigned getNumStatistics() { return stats.size(); }
@@ -63,10 +68,16 @@ namespace klee {
     void registerStatistic(Statistic &s);
     void incrementStatistic(Statistic &s, uint64_t addend);
     uint64_t getValue(const Statistic &s) const;
+    void setValue(const Statistic &s, uint64_t value);
     void incrementIndexedValue(const Statistic &s, unsigned index, 
                                uint64_t addend) const;
     uint64_t getIndexedValue(const Statistic &s, unsigned index) const;
     void setIndexedValue(const Statistic &s, unsigned index, uint64_t value);
+    /// Copy the indexed values of the given statistics for all indices, so
+    /// that they can be processed while the statistics keep changing.
+    /// values[index * ids.size() + i] is the value of statistic ids[i].
+    void getIndexedValues(const std::vector<unsigned> &ids,
+                          std::vector<uint64_t> &values) const;
     int getStatisticID(const std::string &name) const;
     Statistic *getStatisticByName(const std::string &name) const;
   };
@@ -133,6 +144,10 @@ namespace klee {
     return globalStats[s.id];
   }
 
+  inline void StatisticManager::setValue(const Statistic &s, uint64_t value) {
+    globalStats[s.id] = value;
+  }
+
   inline void StatisticManager::incrementIndexedValue(const Statistic &s, 
                                                       unsigned index,
                                                       uint64_t addend) const {
@@ -0,0 +1,67 @@
+//===-- BackgroundWorker.h --------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_BACKGROUNDWORKER_H
+#define KLEE_BACKGROUNDWORKER_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+namespace klee {
+
+  /**
+   * A BackgroundWorker runs tasks one after another, in the order they were
+   * posted, on a dedicated thread. It is meant for slow output (e.g. writing
+   * statistics files) that should not stall the interpreter.
+   *
+   * Tasks must only access data they own or that is not modified while they
+   * run, e.g. a snapshot taken by the posting thread.
+   */
+  class BackgroundWorker {
+  public:
+    using Task = std::function<void()>;
+
+  private:
+    mutable std::mutex mutex;
+    std::condition_variable taskPosted;
+    std::condition_variable tasksDone;
+    std::deque<Task> tasks;
+    /// Number of tasks posted but not finished yet
+    std::size_t pending = 0;
+    bool stopping = false;
+    std::thread thread;
+
+    void run();
+
+  public:
+    BackgroundWorker();
+    /// Run all remaining tasks and stop the thread.
+    ~BackgroundWorker();
+
+    BackgroundWorker(const BackgroundWorker &) = delete;
+    BackgroundWorker &operator=(const BackgroundWorker &) = delete;
+
+    /// Queue a task to be run on the background thread.
+    void post(Task task);
+
+    /// Block until at most maxPending posted tasks have not finished yet,
+    /// by default until all of them have.
+    void wait(std::size_t maxPending = 0);
+
+    /// Return the number of posted tasks that have not finished yet.
+    std::size_t getNumPending() const;
+  };
+
+} // namespace klee
+
+#endif /* KLEE_BACKGROUNDWORKER_H */
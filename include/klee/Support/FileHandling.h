@@ -20,8 +20,10 @@ DISABLE_WARNING_POP
 #include <string>
 
 namespace klee {
+/// Open the file at path for writing, truncating it unless append is set.
 std::unique_ptr<llvm::raw_fd_ostream>
-klee_open_output_file(const std::string &path, std::string &error);
+klee_open_output_file(const std::string &path, std::string &error,
+                      bool append = false);
 
 #ifdef HAVE_ZLIB_H
 std::unique_ptr<llvm::raw_ostream>
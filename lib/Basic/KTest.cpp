@@ -8,10 +8,16 @@
 //===----------------------------------------------------------------------===//
 
 #include "klee/ADT/KTest.h"
+#include "klee/Config/config.h"
+
+#ifdef HAVE_ZLIB_H
+#include <zlib.h>
+#endif
 
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <sys/types.h>
 
 #define KTEST_VERSION 3
 #define KTEST_MAGIC_SIZE 5
@@ -20,6 +26,20 @@
 // for compatibility reasons
 #define BOUT_MAGIC "BOUT\n"
 
+#define KTAR_VERSION 1
+#define KTAR_MAGIC_SIZE 4
+#define KTAR_MAGIC "KTAR"
+#define KTAR_INDEX_MAGIC "KIDX"
+// index offset and index magic at the end of a closed archive
+#define KTAR_TRAILER_SIZE (8 + KTAR_MAGIC_SIZE)
+
+// entry storage methods
+#define KTAR_STORED 0
+#define KTAR_DEFLATED 1
+
+// size of the stdio buffer used for writing archives
+#define KTAR_BUFFER_SIZE (1 << 20)
+
 /***/
 
 static int read_uint32(FILE *f, unsigned *value_out) {
@@ -52,6 +72,18 @@ static int read_string(FILE *f, char **value_out) {
   return 1;
 }
 
+static int read_uint64(FILE *f, unsigned long long *value_out) {
+  unsigned hi, lo;
+  if (!read_uint32(f, &hi) || !read_uint32(f, &lo))
+    return 0;
+  *value_out = ((unsigned long long) hi << 32) | lo;
+  return 1;
+}
+
+static int write_uint64(FILE *f, unsigned long long value) {
+  return write_uint32(f, value >> 32) && write_uint32(f, value);
+}
+
 static int write_string(FILE *f, const char *value) {
   unsigned len = strlen(value);
   if (!write_uint32(f, len))
@@ -63,6 +95,336 @@ static int write_string(FILE *f, const char *value) {
 
 /***/
 
+// Test archives
+//
+// An archive starts with a header (magic, version) followed by the entries
+// in the order they were added. Every entry is self-describing (name,
+// storage method, size, stored size, stored bytes), so the entries of an
+// archive that was never closed can still be found by scanning it. Closing
+// the archive appends an index of entry names and offsets and a trailer
+// holding the offset of the index.
+
+struct KTestArchiveEntry {
+  const char *name;
+  unsigned long long offset;
+  unsigned position;
+};
+
+struct KTestArchive {
+  FILE *f;
+  unsigned numEntries;
+  unsigned capacity;
+  char **names;
+  unsigned long long *offsets;
+  // for archives opened for reading: the entries sorted by name (and by
+  // position among entries of the same name)
+  struct KTestArchiveEntry *sorted;
+  int reading;
+};
+
+static int kTest_checkArchiveHeader(FILE *f) {
+  char header[KTAR_MAGIC_SIZE];
+  unsigned version;
+  if (fread(header, KTAR_MAGIC_SIZE, 1, f)!=1)
+    return 0;
+  if (memcmp(header, KTAR_MAGIC, KTAR_MAGIC_SIZE))
+    return 0;
+  if (!read_uint32(f, &version))
+    return 0;
+  return version <= KTAR_VERSION;
+}
+
+static void kTest_freeArchive(KTestArchive *a) {
+  unsigned i;
+  for (i=0; i<a->numEntries; i++)
+    free(a->names[i]);
+  free(a->names);
+  free(a->offsets);
+  free(a->sorted);
+  free(a);
+}
+
+static int kTest_appendEntry(KTestArchive *a, char *name,
+                             unsigned long long offset) {
+  if (a->numEntries == a->capacity) {
+    unsigned capacity = a->capacity ? 2 * a->capacity : 64;
+    char **names = (char**) realloc(a->names, capacity * sizeof(*names));
+    if (!names)
+      return 0;
+    a->names = names;
+    unsigned long long *offsets =
+      (unsigned long long*) realloc(a->offsets, capacity * sizeof(*offsets));
+    if (!offsets)
+      return 0;
+    a->offsets = offsets;
+    a->capacity = capacity;
+  }
+  a->names[a->numEntries] = name;
+  a->offsets[a->numEntries] = offset;
+  a->numEntries++;
+  return 1;
+}
+
+static int kTest_readIndex(KTestArchive *a) {
+  char magic[KTAR_MAGIC_SIZE];
+  unsigned long long indexOffset;
+  unsigned i, numEntries;
+
+  if (fseeko(a->f, -KTAR_TRAILER_SIZE, SEEK_END))
+    return 0;
+  if (!read_uint64(a->f, &indexOffset))
+    return 0;
+  if (fread(magic, KTAR_MAGIC_SIZE, 1, a->f)!=1 ||
+      memcmp(magic, KTAR_INDEX_MAGIC, KTAR_MAGIC_SIZE))
+    return 0;
+
+  if (fseeko(a->f, indexOffset, SEEK_SET))
+    return 0;
+  if (!read_uint32(a->f, &numEntries))
+    return 0;
+  for (i=0; i<numEntries; i++) {
+    char *name;
+    unsigned long long offset;
+    if (!read_string(a->f, &name))
+      return 0;
+    if (!read_uint64(a->f, &offset) || !kTest_appendEntry(a, name, offset)) {
+      free(name);
+      return 0;
+    }
+  }
+  return 1;
+}
+
+// Recover the entries of an archive without (valid) index, up to a
+// truncated last entry
+static int kTest_scanEntries(KTestArchive *a) {
+  off_t offset = KTAR_MAGIC_SIZE + 4, end;
+
+  if (fseeko(a->f, 0, SEEK_END))
+    return 0;
+  end = ftello(a->f);
+
+  while (offset < end && !fseeko(a->f, offset, SEEK_SET)) {
+    char *name;
+    unsigned method, size, storedSize;
+    off_t next;
+    if (!read_string(a->f, &name))
+      break;
+    if (!read_uint32(a->f, &method) || !read_uint32(a->f, &size) ||
+        !read_uint32(a->f, &storedSize) || method > KTAR_DEFLATED ||
+        (next = ftello(a->f) + storedSize) > end ||
+        !kTest_appendEntry(a, name, offset)) {
+      free(name);
+      break;
+    }
+    offset = next;
+  }
+  return 1;
+}
+
+static int kTest_compareEntries(const void *lhs, const void *rhs) {
+  const struct KTestArchiveEntry *l = (const struct KTestArchiveEntry*) lhs;
+  const struct KTestArchiveEntry *r = (const struct KTestArchiveEntry*) rhs;
+  int res = strcmp(l->name, r->name);
+  if (res)
+    return res;
+  return l->position < r->position ? -1 : l->position > r->position;
+}
+
+static int kTest_sortEntries(KTestArchive *a) {
+  unsigned i;
+  a->sorted = (struct KTestArchiveEntry*)
+    malloc((a->numEntries ? a->numEntries : 1) * sizeof(*a->sorted));
+  if (!a->sorted)
+    return 0;
+  for (i=0; i<a->numEntries; i++) {
+    a->sorted[i].name = a->names[i];
+    a->sorted[i].offset = a->offsets[i];
+    a->sorted[i].position = i;
+  }
+  qsort(a->sorted, a->numEntries, sizeof(*a->sorted), kTest_compareEntries);
+  return 1;
+}
+
+// Returns the first entry of the given name
+static struct KTestArchiveEntry *kTest_findEntry(KTestArchive *a,
+                                                 const char *name) {
+  unsigned lo = 0, hi = a->numEntries;
+  while (lo < hi) {
+    unsigned mid = lo + (hi - lo) / 2;
+    if (strcmp(a->sorted[mid].name, name) < 0)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  if (lo == a->numEntries || strcmp(a->sorted[lo].name, name))
+    return 0;
+  return &a->sorted[lo];
+}
+
+KTestArchive *kTest_openArchive(const char *path) {
+  KTestArchive *a = (KTestArchive*) calloc(1, sizeof(*a));
+  if (!a)
+    return 0;
+
+  a->f = fopen(path, "rb");
+  if (!a->f || !kTest_checkArchiveHeader(a->f))
+    goto error;
+
+  if (!kTest_readIndex(a)) {
+    unsigned i;
+    for (i=0; i<a->numEntries; i++)
+      free(a->names[i]);
+    a->numEntries = 0;
+    if (!kTest_scanEntries(a))
+      goto error;
+  }
+  if (!kTest_sortEntries(a))
+    goto error;
+  a->reading = 1;
+
+  return a;
+ error:
+  if (a->f) fclose(a->f);
+  kTest_freeArchive(a);
+  return 0;
+}
+
+// Returns a stream over the (uncompressed) contents of an archive entry
+static FILE *kTest_openEntry(KTestArchive *a, const char *name) {
+  struct KTestArchiveEntry *entry = kTest_findEntry(a, name);
+  unsigned method, size, storedSize;
+  unsigned char *stored = 0;
+  char *entryName = 0;
+  FILE *res = 0;
+
+  if (!entry)
+    return 0;
+
+  if (fseeko(a->f, entry->offset, SEEK_SET))
+    goto error;
+  if (!read_string(a->f, &entryName) || strcmp(entryName, name))
+    goto error;
+  if (!read_uint32(a->f, &method) || !read_uint32(a->f, &size) ||
+      !read_uint32(a->f, &storedSize))
+    goto error;
+
+  stored = (unsigned char*) malloc(storedSize ? storedSize : 1);
+  if (!stored)
+    goto error;
+  if (storedSize && fread(stored, storedSize, 1, a->f)!=1)
+    goto error;
+
+  // the buffer is allocated by fmemopen and released by fclose, the extra
+  // byte keeps fmemopen from truncating a full buffer
+  res = fmemopen(0, size + 1, "w+b");
+  if (!res)
+    goto error;
+
+  if (method == KTAR_STORED) {
+    if (storedSize != size || fwrite(stored, 1, size, res) != size)
+      goto error;
+  } else if (method == KTAR_DEFLATED) {
+#ifdef HAVE_ZLIB_H
+    unsigned char *data = (unsigned char*) malloc(size ? size : 1);
+    uLongf dataSize = size;
+    if (!data)
+      goto error;
+    if (uncompress(data, &dataSize, stored, storedSize) != Z_OK ||
+        dataSize != size || fwrite(data, 1, size, res) != size) {
+      free(data);
+      goto error;
+    }
+    free(data);
+#else
+    goto error;
+#endif
+  } else {
+    goto error;
+  }
+
+  rewind(res);
+  free(stored);
+  free(entryName);
+  return res;
+ error:
+  if (res) fclose(res);
+  free(stored);
+  free(entryName);
+  return 0;
+}
+
+// Opens a plain file or, for paths of the form "<archive>:<name>", an
+// archive entry
+static FILE *kTest_open(const char *path) {
+  FILE *f = fopen(path, "rb");
+  const char *sep;
+  char *archivePath;
+  KTestArchive *a;
+
+  if (f)
+    return f;
+
+  sep = strrchr(path, ':');
+  if (!sep)
+    return 0;
+  archivePath = strndup(path, sep - path);
+  if (!archivePath)
+    return 0;
+  a = kTest_openArchive(archivePath);
+  free(archivePath);
+  if (!a)
+    return 0;
+  f = kTest_openEntry(a, sep + 1);
+  kTest_closeArchive(a);
+  return f;
+}
+
+int kTest_isArchive(const char *path) {
+  FILE *f = fopen(path, "rb");
+  int res;
+
+  if (!f)
+    return 0;
+  res = kTest_checkArchiveHeader(f);
+  fclose(f);
+
+  return res;
+}
+
+char **kTest_listArchive(const char *path, unsigned *numNames) {
+  KTestArchive *a = kTest_openArchive(path);
+  char **res;
+
+  if (!a)
+    return 0;
+  // hand the names over to the caller
+  res = a->names ? a->names : (char**) malloc(sizeof(*res));
+  *numNames = a->numEntries;
+  a->names = 0;
+  a->numEntries = 0;
+  kTest_closeArchive(a);
+
+  return res;
+}
+
+unsigned kTest_numArchiveEntries(KTestArchive *a) {
+  return a->numEntries;
+}
+
+const char *kTest_archiveEntryName(KTestArchive *a, unsigned index) {
+  return a->names[index];
+}
+
+void kTest_freeNames(char **names, unsigned numNames) {
+  unsigned i;
+  for (i=0; i<numNames; i++)
+    free(names[i]);
+  free(names);
+}
+
+/***/
+
 
 unsigned kTest_getCurrentVersion() {
   return KTEST_VERSION;
@@ -80,7 +442,7 @@ static int kTest_checkHeader(FILE *f) {
 }
 
 int kTest_isKTestFile(const char *path) {
-  FILE *f = fopen(path, "rb");
+  FILE *f = kTest_open(path);
   int res;
 
   if (!f)
@@ -91,13 +453,10 @@ int kTest_isKTestFile(const char *path) {
   return res;
 }
 
-KTest *kTest_fromFile(const char *path) {
-  FILE *f = fopen(path, "rb");
+static KTest *kTest_read(FILE *f) {
   KTest *res = 0;
   unsigned i, version;
 
-  if (!f) 
-    goto error;
   if (!kTest_checkHeader(f)) 
     goto error;
 
@@ -146,8 +505,6 @@ KTest *kTest_fromFile(const char *path) {
       goto error;
   }
 
-  fclose(f);
-
   return res;
  error:
   if (res) {
@@ -170,17 +527,12 @@ KTest *kTest_fromFile(const char *path) {
     free(res);
   }
 
-  if (f) fclose(f);
-
   return 0;
 }
 
-int kTest_toFile(KTest *bo, const char *path) {
-  FILE *f = fopen(path, "wb");
+static int kTest_write(KTest *bo, FILE *f) {
   unsigned i;
 
-  if (!f) 
-    goto error;
   if (fwrite(KTEST_MAGIC, strlen(KTEST_MAGIC), 1, f)!=1)
     goto error;
   if (!write_uint32(f, KTEST_VERSION))
@@ -210,15 +562,48 @@ int kTest_toFile(KTest *bo, const char *path) {
       goto error;
   }
 
-  fclose(f);
-
   return 1;
  error:
-  if (f) fclose(f);
-  
   return 0;
 }
 
+KTest *kTest_fromFile(const char *path) {
+  FILE *f = kTest_open(path);
+  KTest *res;
+
+  if (!f)
+    return 0;
+  res = kTest_read(f);
+  fclose(f);
+
+  return res;
+}
+
+KTest *kTest_fromArchive(KTestArchive *a, const char *name) {
+  FILE *f = kTest_openEntry(a, name);
+  KTest *res;
+
+  if (!f)
+    return 0;
+  res = kTest_read(f);
+  fclose(f);
+
+  return res;
+}
+
+int kTest_toFile(KTest *bo, const char *path) {
+  FILE *f = fopen(path, "wb");
+  int res;
+
+  if (!f)
+    return 0;
+  res = kTest_write(bo, f);
+  if (fclose(f))
+    res = 0;
+
+  return res;
+}
+
 unsigned kTest_numBytes(KTest *bo) {
   unsigned i, res = 0;
   for (i=0; i<bo->numObjects; i++)
@@ -238,3 +623,112 @@ void kTest_free(KTest *bo) {
   free(bo->objects);
   free(bo);
 }
+
+/***/
+
+KTestArchive *kTest_createArchive(const char *path) {
+  KTestArchive *a = (KTestArchive*) calloc(1, sizeof(*a));
+  if (!a)
+    return 0;
+
+  a->f = fopen(path, "wb");
+  if (!a->f)
+    goto error;
+  setvbuf(a->f, 0, _IOFBF, KTAR_BUFFER_SIZE);
+  if (fwrite(KTAR_MAGIC, KTAR_MAGIC_SIZE, 1, a->f)!=1)
+    goto error;
+  if (!write_uint32(a->f, KTAR_VERSION))
+    goto error;
+
+  return a;
+ error:
+  if (a->f) fclose(a->f);
+  kTest_freeArchive(a);
+  return 0;
+}
+
+int kTest_addToArchive(KTestArchive *a, const char *name, const void *data,
+                       unsigned size) {
+  const unsigned char *stored = (const unsigned char*) data;
+  unsigned method = KTAR_STORED, storedSize = size;
+  off_t offset = ftello(a->f);
+  char *entryName = strdup(name);
+  int res = 0;
+#ifdef HAVE_ZLIB_H
+  uLongf compressedSize = compressBound(size);
+  unsigned char *compressed = (unsigned char*) malloc(compressedSize);
+
+  // keep whatever is smaller
+  if (compressed &&
+      compress2(compressed, &compressedSize, stored, size,
+                Z_DEFAULT_COMPRESSION) == Z_OK &&
+      compressedSize < size) {
+    method = KTAR_DEFLATED;
+    stored = compressed;
+    storedSize = compressedSize;
+  }
+#endif
+
+  if (!entryName || offset < 0)
+    goto error;
+  if (!write_string(a->f, name) || !write_uint32(a->f, method) ||
+      !write_uint32(a->f, size) || !write_uint32(a->f, storedSize))
+    goto error;
+  if (storedSize && fwrite(stored, storedSize, 1, a->f)!=1)
+    goto error;
+  if (!kTest_appendEntry(a, entryName, offset))
+    goto error;
+  entryName = 0;
+  res = 1;
+ error:
+  free(entryName);
+#ifdef HAVE_ZLIB_H
+  free(compressed);
+#endif
+  return res;
+}
+
+int kTest_toArchive(KTest *bo, KTestArchive *a, const char *name) {
+  char *data = 0;
+  size_t size = 0;
+  FILE *f = open_memstream(&data, &size);
+  int res;
+
+  if (!f)
+    return 0;
+  res = kTest_write(bo, f);
+  if (fclose(f))
+    res = 0;
+  if (res)
+    res = kTest_addToArchive(a, name, data, size);
+  free(data);
+
+  return res;
+}
+
+int kTest_closeArchive(KTestArchive *a) {
+  off_t indexOffset;
+  unsigned i;
+  int res;
+
+  if (a->reading) {
+    fclose(a->f);
+    kTest_freeArchive(a);
+    return 1;
+  }
+
+  indexOffset = ftello(a->f);
+  res = indexOffset >= 0 && write_uint32(a->f, a->numEntries);
+
+  for (i=0; res && i<a->numEntries; i++)
+    res = write_string(a->f, a->names[i]) &&
+          write_uint64(a->f, a->offsets[i]);
+  res = res && write_uint64(a->f, indexOffset) &&
+        fwrite(KTAR_INDEX_MAGIC, KTAR_MAGIC_SIZE, 1, a->f)==1;
+
+  if (fclose(a->f))
+    res = 0;
+  kTest_freeArchive(a);
+
+  return res;
+}
@@ -18,7 +18,8 @@ StatisticManager::StatisticManager()
     globalStats(0),
     indexedStats(0),
     contextStats(0),
-    index(0) {
+    index(0),
+    numIndices(0) {
 }
 
 StatisticManager::~StatisticManager() {
@@ -28,6 +29,7 @@ StatisticManager::~StatisticManager() {
 
 void StatisticManager::useIndexedStats(unsigned totalIndices) {  
   delete[] indexedStats;
+  numIndices = totalIndices;
   indexedStats = new uint64_t[totalIndices * stats.size()];
   memset(indexedStats, 0, sizeof(*indexedStats) * totalIndices * stats.size());
 }
@@ -40,6 +42,21 @@ void StatisticManager::registerStatistic(Statistic &s) {
   memset(globalStats, 0, sizeof(*globalStats)*stats.size());
 }
 
+void StatisticManager::getIndexedValues(const std::vector<unsigned> &ids,
+                                        std::vector<uint64_t> &values) const {
+  if (!indexedStats) {
+    values.assign(numIndices * ids.size(), 0);
+    return;
+  }
+  values.resize(numIndices * ids.size());
+  auto out = values.begin();
+  for (unsigned i = 0; i < numIndices; i++) {
+    const uint64_t *row = &indexedStats[i * stats.size()];
+    for (unsigned id : ids)
+      *out++ = row[id];
+  }
+}
+
 int StatisticManager::getStatisticID(const std::string &name) const {
   for (unsigned i=0; i<stats.size(); i++)
     if (stats[i]->getName() == name)
@@ -11,15 +11,153 @@
 
 #include "ExecutionState.h"
 #include "Memory.h"
+#include "MemoryManager.h"
 #include "TimingSolver.h"
 
 #include "klee/Expr/Expr.h"
+#include "klee/Expr/ExprUtil.h"
 #include "klee/Statistics/TimerStatIncrementer.h"
 
 #include "CoreStats.h"
 
+#include <iterator>
+#include <map>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
 using namespace klee;
 
+namespace {
+/// Returns true iff no pointer in [lo, ...] can point into mo.
+bool isBelow(const MemoryObject *mo, uint64_t lo) {
+  return mo->size ? mo->address + mo->size <= lo : mo->address < lo;
+}
+
+/// Returns true iff no pointer in [lo, ...] can point into any object
+/// preceding oi in the address space.
+bool precedingObjectsBelow(MemoryMap::iterator oi, MemoryMap::iterator begin,
+                           uint64_t lo) {
+  return oi == begin || isBelow((--oi)->first, lo);
+}
+
+/// Stamps identifying the contents of object states (see
+/// AddressSpace::copyOutConcretes)
+uint64_t nextStamp = 1;
+
+/// The contents last copied to (or found at) a range of native memory around
+/// an external call: the object and the stamp of its contents. Native memory
+/// belongs to an address rather than to an object, as forked states may
+/// allocate different objects at the same address.
+struct NativeContents {
+  uint64_t end;
+  const MemoryObject *mo;
+  uint64_t stamp;
+};
+
+/// The ranges of native memory with known contents by their start address,
+/// which do not overlap
+std::map<uint64_t, NativeContents> nativeContents;
+
+/// Finds the pages written since a point in time through the soft-dirty bits
+/// of Linux: writing "4" to /proc/self/clear_refs clears them, and bit 55 of
+/// the /proc/self/pagemap entry of a page is set once it is written again.
+/// Unlike write protection, this also catches writes by system calls.
+///
+/// Clearing is not free: the kernel walks all mappings of the process and
+/// write-protects every page, not only those of the objects, so the first
+/// write to each page of KLEE after an external call takes a minor fault.
+/// These faults also count towards the resident pages that Executor::
+/// callExternalFunction measures around copyOutConcretes.
+class SoftDirtyTracker {
+  int clearRefsFd;
+  int pagemapFd;
+
+  bool isPageDirty(uint64_t page) {
+    uint64_t entry;
+    if (pread(pagemapFd, &entry, sizeof(entry), page * sizeof(entry)) !=
+        sizeof(entry))
+      return true;
+    return (entry >> 55) & 1;
+  }
+
+  /// Check that the kernel sets soft-dirty bits, it may not be configured to.
+  bool selfTest() {
+    const std::size_t pageSize = MemoryManager::pageSize;
+    void *mem = mmap(nullptr, pageSize, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED)
+      return false;
+    auto *page = static_cast<volatile char *>(mem);
+    *page = 1;
+    const uint64_t index = reinterpret_cast<uint64_t>(mem) / pageSize;
+    bool works = clear() && !isPageDirty(index);
+    *page = 2;
+    works = works && isPageDirty(index);
+    munmap(mem, pageSize);
+    return works;
+  }
+
+public:
+  SoftDirtyTracker()
+      : clearRefsFd(open("/proc/self/clear_refs", O_WRONLY | O_CLOEXEC)),
+        pagemapFd(open("/proc/self/pagemap", O_RDONLY | O_CLOEXEC)) {
+    if (clearRefsFd >= 0 && pagemapFd >= 0 && selfTest())
+      return;
+    if (clearRefsFd >= 0)
+      close(clearRefsFd);
+    if (pagemapFd >= 0)
+      close(pagemapFd);
+    clearRefsFd = pagemapFd = -1;
+  }
+
+  ~SoftDirtyTracker() {
+    if (clearRefsFd >= 0) {
+      close(clearRefsFd);
+      close(pagemapFd);
+    }
+  }
+
+  /// Start tracking writes.
+  /// \return false if writes cannot be tracked.
+  bool clear() {
+    return clearRefsFd >= 0 && pwrite(clearRefsFd, "4", 1, 0) == 1;
+  }
+
+  /// \return true if [address, address + size) may have been written since
+  /// the last successful clear().
+  bool isWritten(uint64_t address, uint64_t size) {
+    if (size == 0)
+      return false;
+    const std::size_t pageSize = MemoryManager::pageSize;
+    uint64_t entries[64];
+    for (uint64_t page = address / pageSize,
+                  end = (address + size - 1) / pageSize + 1;
+         page < end; page += 64) {
+      const std::size_t n = std::min<uint64_t>(64, end - page);
+      if (pread(pagemapFd, entries, n * sizeof(entries[0]),
+                page * sizeof(entries[0])) !=
+          static_cast<ssize_t>(n * sizeof(entries[0])))
+        return true;
+      for (std::size_t i = 0; i < n; ++i)
+        if ((entries[i] >> 55) & 1)
+          return true;
+    }
+    return false;
+  }
+};
+
+SoftDirtyTracker &getSoftDirtyTracker() {
+  static SoftDirtyTracker tracker;
+  return tracker;
+}
+
+/// Whether writes to the native memory are tracked since the last
+/// copyOutConcretes
+bool writesTracked = false;
+} // namespace
+
 ///
 
 void AddressSpace::bindObject(const MemoryObject *mo, ObjectState *os) {
@@ -37,6 +175,10 @@ const ObjectState *AddressSpace::findObject(const MemoryObject *mo) const {
   return res ? res->second.get() : nullptr;
 }
 
+bool AddressSpace::isOwned(const ObjectState *os) const {
+  return cowKey == os->copyOnWriteOwner;
+}
+
 ObjectState *AddressSpace::getWriteable(const MemoryObject *mo,
                                         const ObjectState *os) {
   assert(!os->readOnly);
@@ -110,10 +252,15 @@ bool AddressSpace::resolveOne(ExecutionState &state,
     MemoryMap::iterator begin = objects.begin();
     MemoryMap::iterator end = objects.end();
       
+    // objects outside of the bounds of address are never queried
+    const auto bounds = getUnsignedBounds(address);
+
     MemoryMap::iterator start = oi;
     while (oi!=begin) {
       --oi;
       const auto &mo = oi->first;
+      if (isBelow(mo, bounds.first))
+        break;
 
       bool mayBeTrue;
       if (!solver->mayBeTrue(state.constraints,
@@ -126,6 +273,9 @@ bool AddressSpace::resolveOne(ExecutionState &state,
         success = true;
         return true;
       } else {
+        if (bounds.first >= mo->address ||
+            precedingObjectsBelow(oi, begin, bounds.first))
+          break;
         bool mustBeTrue;
         if (!solver->mustBeTrue(state.constraints,
                                 UgeExpr::create(address, mo->getBaseExpr()),
@@ -139,9 +289,12 @@ bool AddressSpace::resolveOne(ExecutionState &state,
     // search forwards
     for (oi=start; oi!=end; ++oi) {
       const auto &mo = oi->first;
+      if (bounds.second < mo->address)
+        break;
 
-      bool mustBeTrue;
-      if (!solver->mustBeTrue(state.constraints,
+      bool mustBeTrue = false;
+      if (bounds.first < mo->address &&
+          !solver->mustBeTrue(state.constraints,
                               UltExpr::create(address, mo->getBaseExpr()),
                               mustBeTrue, state.queryMetaData))
         return false;
@@ -236,6 +389,11 @@ bool AddressSpace::resolve(ExecutionState &state, TimingSolver *solver,
     uint64_t example = cex->getZExtValue();
     MemoryObject hack(example);
 
+    // Objects outside of the bounds derived from the structure of p cannot
+    // be pointed to; they are skipped without consulting the solver, as are
+    // the queries deciding whether to continue the search past them.
+    const auto bounds = getUnsignedBounds(p);
+
     MemoryMap::iterator oi = objects.upper_bound(&hack);
     MemoryMap::iterator begin = objects.begin();
     MemoryMap::iterator end = objects.end();
@@ -247,6 +405,8 @@ bool AddressSpace::resolve(ExecutionState &state, TimingSolver *solver,
     while (oi != begin) {
       --oi;
       const MemoryObject *mo = oi->first;
+      if (isBelow(mo, bounds.first))
+        break;
       if (timeout && timeout < timer.delta())
         return true;
 
@@ -257,6 +417,9 @@ bool AddressSpace::resolve(ExecutionState &state, TimingSolver *solver,
       if (incomplete != 2)
         return incomplete ? true : false;
 
+      if (bounds.first >= mo->address ||
+          precedingObjectsBelow(oi, begin, bounds.first))
+        break;
       bool mustBeTrue;
       if (!solver->mustBeTrue(state.constraints,
                               UgeExpr::create(p, mo->getBaseExpr()), mustBeTrue,
@@ -269,13 +432,16 @@ bool AddressSpace::resolve(ExecutionState &state, TimingSolver *solver,
     // search forwards
     for (oi = start; oi != end; ++oi) {
       const MemoryObject *mo = oi->first;
+      if (bounds.second < mo->address)
+        break;
       if (timeout && timeout < timer.delta())
         return true;
 
-      bool mustBeTrue;
-      if (!solver->mustBeTrue(state.constraints,
-                              UltExpr::create(p, mo->getBaseExpr()), mustBeTrue,
-                              state.queryMetaData))
+      bool mustBeTrue = false;
+      if (bounds.first < mo->address &&
+          !solver->mustBeTrue(state.constraints,
+                              UltExpr::create(p, mo->getBaseExpr()),
+                              mustBeTrue, state.queryMetaData))
         return true;
       if (mustBeTrue)
         break;
@@ -297,7 +463,7 @@ bool AddressSpace::resolve(ExecutionState &state, TimingSolver *solver,
 // transparently avoid screwing up symbolics (if the byte is symbolic
 // then its concrete cache byte isn't being used) but is just a hack.
 
-std::size_t AddressSpace::copyOutConcretes() {
+std::size_t AddressSpace::copyOutConcretes(bool onlyChanged) {
   std::size_t numPages{};
   for (const auto &object : objects) {
     auto &mo = object.first;
@@ -306,27 +472,66 @@ std::size_t AddressSpace::copyOutConcretes() {
       auto size = std::max(os->size, mo->alignment);
       numPages +=
           (size + MemoryManager::pageSize - 1) / MemoryManager::pageSize;
-      copyOutConcrete(mo, os.get());
+      if (!onlyChanged) {
+        copyOutConcrete(mo, os.get());
+      } else if (!isCopied(mo, os.get())) {
+        copyOutConcrete(mo, os.get());
+        markCopied(mo, os.get());
+      }
     }
   }
+  if (onlyChanged)
+    writesTracked = getSoftDirtyTracker().clear();
   return numPages;
 }
 
 void AddressSpace::copyOutConcrete(const MemoryObject *mo,
                                    const ObjectState *os) const {
   auto address = reinterpret_cast<std::uint8_t *>(mo->address);
-  std::memcpy(address, os->concreteStore, mo->size);
+  os->concreteStore.copyTo(address);
 }
 
-bool AddressSpace::copyInConcretes() {
+bool AddressSpace::isCopied(const MemoryObject *mo, const ObjectState *os) {
+  if (!os->concreteStamp)
+    return false;
+  auto it = nativeContents.find(mo->address);
+  return it != nativeContents.end() && it->second.mo == mo &&
+         it->second.end == mo->address + os->size &&
+         it->second.stamp == os->concreteStamp;
+}
+
+void AddressSpace::markCopied(const MemoryObject *mo, const ObjectState *os) {
+  if (!os->concreteStamp)
+    os->concreteStamp = nextStamp++;
+
+  // the contents of any other object in the range are overwritten
+  const uint64_t begin = mo->address, end = begin + os->size;
+  auto it = nativeContents.lower_bound(begin);
+  if (it != nativeContents.begin() && std::prev(it)->second.end > begin)
+    --it;
+  while (it != nativeContents.end() && it->first < end)
+    it = nativeContents.erase(it);
+  nativeContents.emplace(begin, NativeContents{end, mo, os->concreteStamp});
+}
+
+void AddressSpace::forgetCopiedConcretes() { nativeContents.clear(); }
+
+bool AddressSpace::copyInConcretes(bool onlyWritten) {
   for (auto &obj : objects) {
     const MemoryObject *mo = obj.first;
 
     if (!mo->isUserSpecified) {
       const auto &os = obj.second;
 
+      if (onlyWritten && writesTracked &&
+          !getSoftDirtyTracker().isWritten(mo->address, os->size))
+        continue;
+
       if (!copyInConcrete(mo, os.get(), mo->address))
         return false;
+
+      if (onlyWritten)
+        markCopied(mo, findObject(mo));
     }
   }
 
@@ -336,12 +541,14 @@ bool AddressSpace::copyInConcretes() {
 bool AddressSpace::copyInConcrete(const MemoryObject *mo, const ObjectState *os,
                                   uint64_t src_address) {
   auto address = reinterpret_cast<std::uint8_t*>(src_address);
-  if (memcmp(address, os->concreteStore, mo->size) != 0) {
+  if (!os->concreteStore.equals(address)) {
     if (os->readOnly) {
       return false;
     } else {
+      // only the chunks that actually changed are copied
       ObjectState *wos = getWriteable(mo, os);
-      memcpy(wos->concreteStore, address, mo->size);
+      wos->concreteStore.copyFrom(address);
+      wos->concreteStamp = 0;
     }
   }
   return true;
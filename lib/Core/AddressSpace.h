@@ -54,6 +54,14 @@ namespace klee {
                              ref<Expr> p, const ObjectPair &op,
                              ResolutionList &rl, unsigned maxResolutions) const;
 
+    /// Return whether the concrete values of os are known to be at the
+    /// location of mo.
+    static bool isCopied(const MemoryObject *mo, const ObjectState *os);
+
+    /// Record that the concrete values of os are at the location of mo, in
+    /// place of whatever was copied to that memory before.
+    static void markCopied(const MemoryObject *mo, const ObjectState *os);
+
   public:
     /// The MemoryObject -> ObjectState map that constitutes the
     /// address space.
@@ -112,6 +120,10 @@ namespace klee {
     /// Lookup a binding from a MemoryObject.
     const ObjectState *findObject(const MemoryObject *mo) const;
 
+    /// Return true iff this address space owns the ObjectState, in which
+    /// case no other address space references it.
+    bool isOwned(const ObjectState *os) const;
+
     /// \brief Obtain an ObjectState suitable for writing.
     ///
     /// This returns a writeable object state, creating a new copy of
@@ -128,19 +140,32 @@ namespace klee {
     /// actual system memory location they were allocated at.
     /// Returns the (hypothetical) number of pages needed provided each written
     /// object occupies (at least) a single page.
-    std::size_t copyOutConcretes();
+    ///
+    /// \param onlyChanged Skip objects whose current values are known to be
+    /// at their location already, since they were copied there (or back from
+    /// there) by an earlier call and have not changed since. This assumes
+    /// that external code does not write outside the objects of the calling
+    /// state. Also starts tracking the pages written until copyInConcretes.
+    std::size_t copyOutConcretes(bool onlyChanged = false);
 
     void copyOutConcrete(const MemoryObject *mo, const ObjectState *os) const;
 
+    /// Forget which objects copyOutConcretes(true) can skip, e.g. because
+    /// the system memory was discarded.
+    static void forgetCopiedConcretes();
+
     /// Copy the concrete values of all managed ObjectStates back from
     /// the actual system memory location they were allocated
     /// at. ObjectStates will only be written to (and thus,
     /// potentially copied) if the memory values are different from
     /// the current concrete values.
     ///
+    /// \param onlyWritten To be used after copyOutConcretes(true): skip
+    /// objects on pages that were not written since, if the system tracks
+    /// written pages.
     /// \retval true The copy succeeded. 
     /// \retval false The copy failed because a read-only object was modified.
-    bool copyInConcretes();
+    bool copyInConcretes(bool onlyWritten = false);
 
     /// Updates the memory object with the raw memory from the address
     ///
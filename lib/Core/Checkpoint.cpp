@@ -0,0 +1,385 @@
+//===-- Checkpoint.cpp ----------------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "Checkpoint.h"
+
+#include "ExecutionState.h"
+
+#include "klee/Module/InstructionInfoTable.h"
+#include "klee/Module/KInstruction.h"
+#include "klee/Statistics/Statistic.h"
+#include "klee/Statistics/Statistics.h"
+#include "klee/Support/ErrorHandling.h"
+
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include <unistd.h>
+
+using namespace klee;
+using namespace llvm;
+
+// A checkpoint is a sequence of unsigned LEB128 integers (and the bytes of
+// the statistic names) after the magic:
+//
+//   version
+//   number of statistics indices (0 if none are used)
+//   number of statistics, each with:
+//     name length, name, value,
+//     number of nonzero indexed values, each as index delta and value
+//   number of paths
+//   tree of paths in preorder, each node with:
+//     number of children, each as branch instruction id and choice followed
+//     by its subtree
+//
+// The paths handed between processes (Checkpoint::writePaths) consist of the
+// last two parts only.
+
+namespace {
+const char Magic[8] = {'K', 'L', 'E', 'E', 'C', 'K', 'P', 'T'};
+constexpr std::uint64_t Version = 2;
+
+class CheckpointWriter {
+public:
+  std::string buffer;
+
+  void writeInt(std::uint64_t value) {
+    do {
+      std::uint8_t byte = value & 0x7F;
+      value >>= 7;
+      buffer.push_back(static_cast<char>(value ? byte | 0x80 : byte));
+    } while (value);
+  }
+
+  void writeString(const std::string &s) {
+    writeInt(s.size());
+    buffer += s;
+  }
+
+  void writeTree(const CheckpointNode &root);
+};
+
+void CheckpointWriter::writeTree(const CheckpointNode &root) {
+  // paths can be long, so do not recurse
+  std::vector<std::pair<BranchKey, const CheckpointNode *>> worklist;
+  auto pushChildren = [&](const CheckpointNode &node) {
+    writeInt(node.children.size());
+    for (auto it = node.children.rbegin(), ie = node.children.rend();
+         it != ie; ++it)
+      worklist.emplace_back(it->first, it->second.get());
+  };
+
+  pushChildren(root);
+  while (!worklist.empty()) {
+    auto [key, node] = worklist.back();
+    worklist.pop_back();
+    writeInt(key.first);
+    writeInt(key.second);
+    pushChildren(*node);
+  }
+}
+
+class CheckpointReader {
+  const char *pos, *end;
+
+public:
+  explicit CheckpointReader(StringRef buffer)
+      : pos(buffer.begin()), end(buffer.end()) {}
+
+  bool atEnd() const { return pos == end; }
+
+  bool readMagic() {
+    if (end - pos < static_cast<std::ptrdiff_t>(sizeof(Magic)) ||
+        !std::equal(Magic, Magic + sizeof(Magic), pos))
+      return false;
+    pos += sizeof(Magic);
+    return true;
+  }
+
+  bool readInt(std::uint64_t &value) {
+    value = 0;
+    for (unsigned shift = 0; pos != end && shift < 64; shift += 7) {
+      std::uint8_t byte = static_cast<std::uint8_t>(*pos++);
+      value |= static_cast<std::uint64_t>(byte & 0x7F) << shift;
+      if (!(byte & 0x80))
+        return true;
+    }
+    return false;
+  }
+
+  bool readString(std::string &s) {
+    std::uint64_t size;
+    if (!readInt(size) || size > static_cast<std::uint64_t>(end - pos))
+      return false;
+    s.assign(pos, size);
+    pos += size;
+    return true;
+  }
+
+  bool readTree(CheckpointNode &root);
+};
+
+bool CheckpointReader::readTree(CheckpointNode &root) {
+  // the nodes whose children are still being read, with their number
+  std::vector<std::pair<CheckpointNode *, std::uint64_t>> open;
+  std::uint64_t numChildren;
+  if (!readInt(numChildren))
+    return false;
+  open.emplace_back(&root, numChildren);
+  while (!open.empty()) {
+    auto &top = open.back();
+    if (!top.second) {
+      open.pop_back();
+      continue;
+    }
+    --top.second;
+    std::uint64_t site, choice;
+    if (!readInt(site) || site > UINT32_MAX || !readInt(choice) ||
+        choice > UINT32_MAX || !readInt(numChildren))
+      return false;
+    auto &child = top.first->children[BranchKey(site, choice)];
+    if (child)
+      return false;
+    child = std::make_unique<CheckpointNode>();
+    open.emplace_back(child.get(), numChildren);
+  }
+  return true;
+}
+
+/// Copy the subtree below from into to.
+void copyTree(const CheckpointNode &from, CheckpointNode &to) {
+  std::vector<std::pair<const CheckpointNode *, CheckpointNode *>> worklist{
+      {&from, &to}};
+  while (!worklist.empty()) {
+    auto [src, dst] = worklist.back();
+    worklist.pop_back();
+    for (const auto &entry : src->children) {
+      auto &child = dst->children[entry.first];
+      if (!child)
+        child = std::make_unique<CheckpointNode>();
+      worklist.emplace_back(entry.second.get(), child.get());
+    }
+  }
+}
+
+/// Write the number of the given states and the tree of their paths.
+template <typename StateIt>
+void writePathTree(CheckpointWriter &writer, StateIt begin, StateIt end) {
+  CheckpointNode root;
+  std::vector<BranchKey> choices;
+  std::uint64_t numPaths = 0;
+  for (StateIt it = begin; it != end; ++it, ++numPaths) {
+    const ExecutionState *state = *it;
+    choices.clear();
+    for (const BranchChoice *bc = state->branchChoices.get(); bc;
+         bc = bc->previous.get())
+      choices.push_back(bc->key);
+
+    CheckpointNode *node = &root;
+    for (auto ci = choices.rbegin(), ce = choices.rend(); ci != ce; ++ci) {
+      auto &child = node->children[*ci];
+      if (!child)
+        child = std::make_unique<CheckpointNode>();
+      node = child.get();
+    }
+    // a state that is still being resumed keeps its remaining paths
+    if (state->resumeNode)
+      copyTree(*state->resumeNode, *node);
+  }
+
+  writer.writeInt(numPaths);
+  writer.writeTree(root);
+}
+
+/// Read what writePathTree wrote, which must be all that is left.
+bool readPathTree(CheckpointReader &reader, std::uint64_t &numPaths,
+               CheckpointNode &root) {
+  return reader.readInt(numPaths) && reader.readTree(root) && reader.atEnd();
+}
+
+/// Return the decision of taking the given choice at the branch the state
+/// executes.
+BranchKey branchKey(const ExecutionState &state, std::uint32_t choice) {
+  return {state.prevPC->info->id, choice};
+}
+} // namespace
+
+/***/
+
+Checkpoint::Checkpoint(std::string path) : path(std::move(path)) {}
+
+Checkpoint::~Checkpoint() = default;
+
+bool Checkpoint::resume(ExecutionState &initialState) {
+  auto buffer = MemoryBuffer::getFile(path);
+  if (!buffer)
+    klee_error("cannot read checkpoint %s: %s", path.c_str(),
+               buffer.getError().message().c_str());
+
+  CheckpointReader reader((*buffer)->getBuffer());
+  auto corrupt = [this]() {
+    klee_error("%s is not a valid checkpoint", path.c_str());
+  };
+
+  std::uint64_t version, numIndices, numStats;
+  if (!reader.readMagic() || !reader.readInt(version))
+    corrupt();
+  if (version != Version)
+    klee_error("checkpoint %s has unsupported version %lu", path.c_str(),
+               version);
+  if (!reader.readInt(numIndices) || !reader.readInt(numStats))
+    corrupt();
+
+  StatisticManager &sm = *theStatisticManager;
+  const bool restoreIndexed = numIndices && sm.getNumIndices();
+  if (restoreIndexed && numIndices != sm.getNumIndices())
+    klee_error("checkpoint %s was written for a different program",
+               path.c_str());
+
+  for (std::uint64_t i = 0; i < numStats; ++i) {
+    std::string name;
+    std::uint64_t value, numIndexed;
+    if (!reader.readString(name) || !reader.readInt(value) ||
+        !reader.readInt(numIndexed))
+      corrupt();
+    // statistics unknown to this version are skipped
+    Statistic *s = sm.getStatisticByName(name);
+    if (s)
+      sm.setValue(*s, value);
+    for (std::uint64_t j = 0, index = 0; j < numIndexed; ++j) {
+      std::uint64_t delta;
+      if (!reader.readInt(delta) || !reader.readInt(value))
+        corrupt();
+      index += delta;
+      if (index >= numIndices)
+        corrupt();
+      if (s && restoreIndexed)
+        sm.setIndexedValue(*s, index, value);
+    }
+  }
+
+  resumeRoot = std::make_unique<CheckpointNode>();
+  std::uint64_t numPaths;
+  if (!readPathTree(reader, numPaths, *resumeRoot))
+    corrupt();
+
+  klee_message("resuming %lu states from checkpoint %s", numPaths,
+               path.c_str());
+  return startPaths(initialState, numPaths);
+}
+
+bool Checkpoint::resumePaths(ExecutionState &initialState,
+                             const std::string &paths) {
+  if (paths.empty()) {
+    resumeRoot = nullptr;
+    return true;
+  }
+
+  CheckpointReader reader(paths);
+  resumeRoot = std::make_unique<CheckpointNode>();
+  std::uint64_t numPaths;
+  if (!readPathTree(reader, numPaths, *resumeRoot))
+    klee_error("invalid paths to resume");
+  return startPaths(initialState, numPaths);
+}
+
+bool Checkpoint::startPaths(ExecutionState &initialState,
+                            std::uint64_t numPaths) {
+  if (!numPaths)
+    return false;
+
+  if (!resumeRoot->children.empty())
+    initialState.resumeNode = resumeRoot.get();
+  return true;
+}
+
+bool Checkpoint::isResuming(const ExecutionState &state) {
+  return state.resumeNode;
+}
+
+bool Checkpoint::mayChoose(const ExecutionState &state,
+                           std::uint32_t choice) const {
+  return !state.resumeNode ||
+         state.resumeNode->children.count(branchKey(state, choice));
+}
+
+void Checkpoint::choose(ExecutionState &state, std::uint32_t choice) const {
+  const BranchKey key = branchKey(state, choice);
+  state.branchChoices = std::make_shared<const BranchChoice>(
+      BranchChoice{std::move(state.branchChoices), key});
+
+  if (state.resumeNode) {
+    const auto &child = state.resumeNode->children.at(key);
+    state.resumeNode = child->children.empty() ? nullptr : child.get();
+  }
+}
+
+void Checkpoint::write(
+    const std::set<ExecutionState *, ExecutionStateIDCompare> &states) const {
+  CheckpointWriter writer;
+  writer.buffer.append(Magic, sizeof(Magic));
+  writer.writeInt(Version);
+
+  StatisticManager &sm = *theStatisticManager;
+  const unsigned numIndices = sm.getNumIndices();
+  writer.writeInt(numIndices);
+  writer.writeInt(sm.getNumStatistics());
+  std::vector<std::pair<unsigned, std::uint64_t>> indexed;
+  for (unsigned i = 0, n = sm.getNumStatistics(); i != n; ++i) {
+    const Statistic &s = sm.getStatistic(i);
+    writer.writeString(s.getName());
+    writer.writeInt(sm.getValue(s));
+
+    indexed.clear();
+    for (unsigned index = 0; index != numIndices; ++index)
+      if (std::uint64_t value = sm.getIndexedValue(s, index))
+        indexed.emplace_back(index, value);
+    writer.writeInt(indexed.size());
+    unsigned last = 0;
+    for (const auto &entry : indexed) {
+      writer.writeInt(entry.first - last);
+      writer.writeInt(entry.second);
+      last = entry.first;
+    }
+  }
+
+  writePathTree(writer, states.begin(), states.end());
+
+  // replace the previous checkpoint only once this one is complete
+  std::string tmpPath = path + "." + std::to_string(getpid());
+  std::error_code ec;
+  {
+    raw_fd_ostream os(tmpPath, ec, sys::fs::OF_None);
+    if (!ec) {
+      os << writer.buffer;
+      os.close();
+      if (os.has_error())
+        ec = os.error();
+    }
+  }
+  if (!ec)
+    ec = sys::fs::rename(tmpPath, path);
+  if (ec) {
+    klee_warning("unable to write checkpoint %s: %s", path.c_str(),
+                 ec.message().c_str());
+    sys::fs::remove(tmpPath);
+  }
+}
+
+std::string
+Checkpoint::writePaths(const std::vector<ExecutionState *> &states) const {
+  CheckpointWriter writer;
+  writePathTree(writer, states.begin(), states.end());
+  return std::move(writer.buffer);
+}
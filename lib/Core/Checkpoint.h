@@ -0,0 +1,111 @@
+//===-- Checkpoint.h --------------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_CHECKPOINT_H
+#define KLEE_CHECKPOINT_H
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace klee {
+class ExecutionState;
+struct ExecutionStateIDCompare;
+
+/// A decision between the feasible successors of a branch, identified by
+/// the instruction it was made at and the successor taken.
+using BranchKey = std::pair<std::uint32_t, std::uint32_t>;
+
+/// A decision taken by a state at a branch with several feasible successors
+/// (see Executor::fork and Executor::branch), whether the state split there
+/// or was forced to one side, linked to the decision before it on the path
+/// of the state.
+struct BranchChoice {
+  std::shared_ptr<const BranchChoice> previous;
+  BranchKey key;
+};
+
+/// The paths of a checkpoint as a tree of branch decisions. A leaf is the
+/// end of a path, from where the state explores freely.
+struct CheckpointNode {
+  std::map<BranchKey, std::unique_ptr<CheckpointNode>> children;
+};
+
+/// Writes checkpoints of an exploration run and resumes runs from them.
+///
+/// The states themselves are not written: their memory, expressions and
+/// instructions are only meaningful in the process that created them.
+/// Instead, a checkpoint holds the branch decisions on the path of each live
+/// state, together with all statistics (including coverage). A resumed run
+/// starts over, but its states only take the branch decisions on these paths
+/// until they reach the end of their path, so that the states of the
+/// checkpoint are recreated and explore on from there. Statistics are not
+/// counted while a state follows its path of a checkpoint (see
+/// Executor::executeStep), as that work is already part of the restored
+/// ones. The process tree and
+/// searchers are rebuilt along the way; the solver caches are not part of
+/// the checkpoint (see -persistent-query-cache).
+///
+/// This relies on the run being deterministic: a state that meets a branch
+/// not on its paths, or takes a choice not on them (e.g. because a solver
+/// returned different values for a concretization), is dropped.
+class Checkpoint {
+  std::string path;
+
+  /// The paths that remain to be resumed, null if not resuming
+  std::unique_ptr<CheckpointNode> resumeRoot;
+
+  /// Let the initial state follow the paths read into resumeRoot.
+  bool startPaths(ExecutionState &initialState, std::uint64_t numPaths);
+
+public:
+  /// \param path The checkpoint file
+  explicit Checkpoint(std::string path);
+  ~Checkpoint();
+
+  Checkpoint(const Checkpoint &) = delete;
+  Checkpoint &operator=(const Checkpoint &) = delete;
+
+  /// Read the checkpoint to resume from and restore its statistics. The
+  /// initial state then follows its paths.
+  /// \return false if the checkpoint has no paths left to explore
+  bool resume(ExecutionState &initialState);
+
+  /// Let the initial state follow the paths returned by writePaths() (in
+  /// this or another process), or explore freely if paths is empty.
+  /// \return false if there are no paths to explore
+  bool resumePaths(ExecutionState &initialState, const std::string &paths);
+
+  /// Return whether the state still follows the paths of a checkpoint.
+  static bool isResuming(const ExecutionState &state);
+
+  /// Return whether the state may take the given choice at the branch it
+  /// executes.
+  bool mayChoose(const ExecutionState &state, std::uint32_t choice) const;
+
+  /// Record that the state takes the given choice at the branch it executes,
+  /// which must be allowed by mayChoose.
+  void choose(ExecutionState &state, std::uint32_t choice) const;
+
+  /// Write a checkpoint with the paths of the given states and the current
+  /// statistics. Failures are reported as warnings.
+  void write(
+      const std::set<ExecutionState *, ExecutionStateIDCompare> &states) const;
+
+  /// Return the paths of the given states without statistics, in the format
+  /// read by resumePaths().
+  std::string writePaths(const std::vector<ExecutionState *> &states) const;
+};
+} // namespace klee
+
+#endif /* KLEE_CHECKPOINT_H */
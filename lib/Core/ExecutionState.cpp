@@ -11,7 +11,9 @@
 
 #include "Memory.h"
 
+#include "klee/Expr/Assignment.h"
 #include "klee/Expr/Expr.h"
+#include "klee/Expr/ExprUtil.h"
 #include "klee/Module/Cell.h"
 #include "klee/Module/InstructionInfoTable.h"
 #include "klee/Module/KInstruction.h"
@@ -23,6 +25,7 @@
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/raw_ostream.h"
 
+#include <algorithm>
 #include <cassert>
 #include <iomanip>
 #include <map>
@@ -100,6 +103,8 @@ ExecutionState::ExecutionState(const ExecutionState& state):
     constraints(state.constraints),
     pathOS(state.pathOS),
     symPathOS(state.symPathOS),
+    branchChoices(state.branchChoices),
+    resumeNode(state.resumeNode),
     coveredLines(state.coveredLines),
     symbolics(state.symbolics),
     cexPreferences(state.cexPreferences),
@@ -114,6 +119,10 @@ ExecutionState::ExecutionState(const ExecutionState& state):
     forkDisabled(state.forkDisabled) {
   for (const auto &cur_mergehandler: openMergeStack)
     cur_mergehandler->addOpenState(this);
+
+  // the query costs start over, but the models are shared
+  queryMetaData.models = state.queryMetaData.models;
+  queryMetaData.modelConstraints = state.queryMetaData.modelConstraints;
 }
 
 ExecutionState *ExecutionState::branch() {
@@ -330,6 +339,7 @@ bool ExecutionState::merge(const ExecutionState &b) {
   for (const auto &constraint : commonConstraints)
     m.addConstraint(constraint);
   m.addConstraint(OrExpr::create(inA, inB));
+  resetModelConstraints(false);
 
   return true;
 }
@@ -373,8 +383,42 @@ void ExecutionState::dumpStack(llvm::raw_ostream &out) const {
 }
 
 void ExecutionState::addConstraint(ref<Expr> e) {
+  const bool keepModels = constraints.isCopyOf(queryMetaData.modelConstraints);
+
   ConstraintManager c(constraints);
   c.addConstraint(e);
+
+  if (!keepModels) {
+    resetModelConstraints(false);
+    return;
+  }
+
+  // keep the models that satisfy the new constraint as well, and those that
+  // assign none of its arrays
+  std::vector<const Array *> arrays;
+  findSymbolicObjects(e, arrays);
+  auto &models = queryMetaData.models;
+  models.erase(std::remove_if(models.begin(), models.end(),
+                              [&](const auto &model) {
+                                return std::any_of(
+                                           arrays.begin(), arrays.end(),
+                                           [&model](const Array *array) {
+                                             return model->bindings.count(
+                                                 array);
+                                           }) &&
+                                       !AssignmentEvaluator(*model)
+                                            .visit(e)
+                                            ->isTrue();
+                              }),
+               models.end());
+
+  queryMetaData.modelConstraints = constraints;
+}
+
+void ExecutionState::resetModelConstraints(bool keepModels) {
+  queryMetaData.modelConstraints = constraints;
+  if (!keepModels)
+    queryMetaData.models.clear();
 }
 
 void ExecutionState::addCexPreference(const ref<Expr> &cond) {
@@ -11,6 +11,7 @@
 #define KLEE_EXECUTIONSTATE_H
 
 #include "AddressSpace.h"
+#include "Checkpoint.h"
 #include "MemoryManager.h"
 #include "MergeHandler.h"
 
@@ -204,6 +205,14 @@ public:
   /// taken to reach/create this state
   TreeOStream symPathOS;
 
+  /// @brief The last choice taken at a branch, only recorded for
+  /// checkpoints (see Checkpoint)
+  std::shared_ptr<const BranchChoice> branchChoices;
+
+  /// @brief The remaining paths of this state in the checkpoint it is
+  /// resumed from, null if it explores freely
+  const CheckpointNode *resumeNode = nullptr;
+
   /// @brief Set containing which lines in which files are covered by this state
   std::map<const std::string *, std::set<std::uint32_t>> coveredLines;
 
@@ -276,6 +285,10 @@ public:
   void addConstraint(ref<Expr> e);
   void addCexPreference(const ref<Expr> &cond);
 
+  /// Update the models in queryMetaData after constraints were replaced.
+  /// \param keepModels whether the models satisfy the new constraints
+  void resetModelConstraints(bool keepModels);
+
   bool merge(const ExecutionState &b);
   void dumpStack(llvm::raw_ostream &out) const;
 
@@ -10,6 +10,7 @@
 #include "Executor.h"
 
 #include "AddressSpace.h"
+#include "Checkpoint.h"
 #include "Context.h"
 #include "CoreStats.h"
 #include "ExecutionState.h"
@@ -22,6 +23,7 @@
 #include "Searcher.h"
 #include "SeedInfo.h"
 #include "SpecialFunctionHandler.h"
+#include "StateSwapper.h"
 #include "StatsTracker.h"
 #include "TimingSolver.h"
 #include "UserSearcher.h"
@@ -32,6 +34,7 @@
 #include "klee/Core/Interpreter.h"
 #include "klee/Expr/ArrayExprOptimizer.h"
 #include "klee/Expr/Assignment.h"
+#include "klee/Expr/CompiledExpr.h"
 #include "klee/Expr/Expr.h"
 #include "klee/Expr/ExprPPrinter.h"
 #include "klee/Expr/ExprSMTLIBPrinter.h"
@@ -171,6 +174,13 @@ cl::opt<bool>
                                   "querying the solver (default=true)"),
                          cl::cat(SolvingCat));
 
+cl::opt<bool> NativeMemoryFunctions(
+    "native-memory-functions", cl::init(true),
+    cl::desc("Execute memcpy, memmove and memset with concrete arguments "
+             "within single objects directly instead of interpreting their "
+             "definitions (default=true)"),
+    cl::cat(MemoryCat));
+
 
 /*** External call policy options ***/
 
@@ -230,6 +240,18 @@ cl::opt<std::size_t> ExternalPageThreshold(
         "used for external calls is above the given threshold (default=1024)."),
     cl::cat(ExtCallsCat));
 
+cl::opt<bool> ExternalCallsCopyChanged(
+    "external-calls-copy-changed", cl::init(false),
+    cl::desc("Only copy memory objects that changed since the previous "
+             "external call to their addresses before an external call, and "
+             "only compare objects on pages written by the call afterwards, "
+             "if the kernel tracks soft-dirty pages. Assumes that external "
+             "functions do not write outside the objects of the calling "
+             "state. Tracking written pages makes the first write to each "
+             "page of the process after an external call fault "
+             "(default=false)."),
+    cl::cat(ExtCallsCat));
+
 /*** Seeding options ***/
 
 cl::opt<bool> AlwaysOutputSeeds(
@@ -366,6 +388,21 @@ cl::opt<bool> MaxMemoryInhibit(
     cl::init(true),
     cl::cat(TerminationCat));
 
+cl::opt<std::string> CheckpointInterval(
+    "checkpoint-interval",
+    cl::desc("Write a checkpoint of the run to the output directory at this "
+             "interval and when execution halts, from which a later run "
+             "continues with -resume. Set to 0s to disable (default=0s)"),
+    cl::init("0s"),
+    cl::cat(TerminationCat));
+
+cl::opt<bool> SwapStates(
+    "swap-states",
+    cl::desc("Swap idle states out to disk instead of terminating them when "
+             "above memory cap (see -max-memory) (default=false)"),
+    cl::init(false),
+    cl::cat(TerminationCat));
+
 cl::opt<unsigned> RuntimeMaxStackFrames(
     "max-stack-frames",
     cl::desc("Terminate a state after this many stack frames.  Set to 0 to "
@@ -479,6 +516,7 @@ Executor::Executor(LLVMContext &ctx, const InterpreterOptions &opts,
       pathWriter(0), symPathWriter(0), specialFunctionHandler(0), timers{time::Span(TimerInterval)},
       replayKTest(0), replayPath(0), usingSeeds(0),
       atMemoryLimit(false), inhibitForking(false), haltExecution(false),
+      resumeFromCheckpoint(false), checkpointDue(false), sharedPaths(nullptr),
       ivcEnabled(false), debugLogBuffer(debugBufferString) {
 
 
@@ -505,6 +543,17 @@ Executor::Executor(LLVMContext &ctx, const InterpreterOptions &opts,
 
   this->solver = std::make_unique<TimingSolver>(std::move(solver), EqualitySubstitution);
   memory = std::make_unique<MemoryManager>(&arrayCache);
+  if (SwapStates)
+    swapper = std::make_unique<StateSwapper>(
+        interpreterHandler->getOutputFilename("states.swap"));
+
+  const time::Span checkpointInterval{CheckpointInterval};
+  if (checkpointInterval) {
+    checkpoint = std::make_unique<Checkpoint>(
+        interpreterHandler->getOutputFilename("checkpoint"));
+    timers.add(std::make_unique<Timer>(checkpointInterval,
+                                       [&] { checkpointDue = true; }));
+  }
 
   initializeSearchOptions();
 
@@ -897,7 +946,9 @@ void Executor::branch(ExecutionState &state,
   unsigned N = conditions.size();
   assert(N);
 
-  if (!branchingPermitted(state)) {
+  // a resumed state splits wherever its paths do
+  if (!branchingPermitted(state) &&
+      !(checkpoint && Checkpoint::isResuming(state))) {
     unsigned next = theRNG.getInt32() % N;
     for (unsigned i=0; i<N; ++i) {
       if (i == next) {
@@ -907,6 +958,8 @@ void Executor::branch(ExecutionState &state,
       }
     }
     stats::inhibitedForks += N - 1;
+    if (checkpoint)
+      checkpoint->choose(state, next);
   } else {
     stats::forks += N-1;
     stats::incBranchStat(reason, N-1);
@@ -920,6 +973,22 @@ void Executor::branch(ExecutionState &state,
       result.push_back(ns);
       processTree->attach(es->ptreeNode, ns, es, reason);
     }
+
+    if (checkpoint) {
+      // a resumed state only takes the choices on its remaining paths
+      bool diverged = true;
+      for (unsigned i=0; i<N; ++i) {
+        if (checkpoint->mayChoose(*result[i], i)) {
+          checkpoint->choose(*result[i], i);
+          diverged = false;
+        } else {
+          terminateState(*result[i]);
+          result[i] = nullptr;
+        }
+      }
+      if (diverged)
+        klee_warning_once(0, "dropping state that diverged from checkpoint");
+    }
   }
 
   // If necessary redistribute seeds to match conditions, killing
@@ -935,20 +1004,22 @@ void Executor::branch(ExecutionState &state,
     // Assume each seed only satisfies one condition (necessarily true
     // when conditions are mutually exclusive and their conjunction is
     // a tautology).
-    for (std::vector<SeedInfo>::iterator siit = seeds.begin(), 
-           siie = seeds.end(); siit != siie; ++siit) {
-      unsigned i;
-      for (i=0; i<N; ++i) {
-        ref<ConstantExpr> res;
-        bool success = solver->getValue(
-            state.constraints, siit->assignment.evaluate(conditions[i]), res,
-            state.queryMetaData);
-        assert(success && "FIXME: Unhandled solver failure");
-        (void) success;
-        if (res->isTrue())
-          break;
+    std::vector<unsigned> satisfied(seeds.size(), N);
+    std::vector<bool> decided(seeds.size(), false);
+    std::vector<ref<ConstantExpr>> values;
+    for (unsigned i=0; i<N; ++i) {
+      getSeedValues(state, seeds, conditions[i], values, &decided);
+      for (unsigned j=0; j<seeds.size(); ++j) {
+        if (!decided[j] && values[j]->isTrue()) {
+          satisfied[j] = i;
+          decided[j] = true;
+        }
       }
-      
+    }
+
+    for (unsigned j=0; j<seeds.size(); ++j) {
+      unsigned i = satisfied[j];
+
       // If we didn't find a satisfying condition randomly pick one
       // (the seed will be patched).
       if (i==N)
@@ -956,7 +1027,7 @@ void Executor::branch(ExecutionState &state,
 
       // Extra check in case we're replaying seeds with a max-fork
       if (result[i])
-        seedMap[result[i]].push_back(*siit);
+        seedMap[result[i]].push_back(seeds[j]);
     }
 
     if (OnlyReplaySeeds) {
@@ -1052,6 +1123,7 @@ Executor::StatePair Executor::fork(ExecutionState &current, ref<Expr> condition,
     terminateStateOnSolverError(current, "Query timed out (fork).");
     return StatePair(nullptr, nullptr);
   }
+  const bool bothFeasible = res == Solver::Unknown;
 
   if (!isSeeding) {
     if (replayPath && !isInternal) {
@@ -1076,7 +1148,9 @@ Executor::StatePair Executor::fork(ExecutionState &current, ref<Expr> condition,
     } else if (res==Solver::Unknown) {
       assert(!replayKTest && "in replay mode, only one branch can be true.");
       
-      if (!branchingPermitted(current)) {
+      // a resumed state splits wherever its paths do
+      if (!branchingPermitted(current) &&
+          !(checkpoint && Checkpoint::isResuming(current))) {
         TimerStatIncrementer timer(stats::forkTime);
         if (theRNG.getBool()) {
           addConstraint(current, condition);
@@ -1097,15 +1171,10 @@ Executor::StatePair Executor::fork(ExecutionState &current, ref<Expr> condition,
       res == Solver::Unknown) {
     bool trueSeed=false, falseSeed=false;
     // Is seed extension still ok here?
-    for (std::vector<SeedInfo>::iterator siit = it->second.begin(), 
-           siie = it->second.end(); siit != siie; ++siit) {
-      ref<ConstantExpr> res;
-      bool success = solver->getValue(current.constraints,
-                                      siit->assignment.evaluate(condition), res,
-                                      current.queryMetaData);
-      assert(success && "FIXME: Unhandled solver failure");
-      (void) success;
-      if (res->isTrue()) {
+    std::vector<ref<ConstantExpr>> values;
+    getSeedValues(current, it->second, condition, values);
+    for (const auto &value : values) {
+      if (value->isTrue()) {
         trueSeed = true;
       } else {
         falseSeed = true;
@@ -1122,6 +1191,29 @@ Executor::StatePair Executor::fork(ExecutionState &current, ref<Expr> condition,
   }
 
 
+  // Every decision between two feasible sides is part of the path of the
+  // state, also when it was forced to one side above, and a resumed state
+  // only takes the choices on its remaining paths.
+  if (checkpoint && bothFeasible) {
+    const bool mayTrue =
+        res != Solver::False && checkpoint->mayChoose(current, 1);
+    const bool mayFalse =
+        res != Solver::True && checkpoint->mayChoose(current, 0);
+    if (!mayTrue && !mayFalse) {
+      klee_warning_once(0, "dropping state that diverged from checkpoint");
+      terminateState(current);
+      return StatePair(nullptr, nullptr);
+    }
+    if (!mayTrue || !mayFalse) {
+      checkpoint->choose(current, mayTrue ? 1 : 0);
+      if (res == Solver::Unknown) {
+        res = mayTrue ? Solver::True : Solver::False;
+        addConstraint(current, mayTrue ? condition
+                                       : Expr::createIsZero(condition));
+      }
+    }
+  }
+
   // XXX - even if the constraint is provable one way or the other we
   // can probably benefit by adding this constraint and allowing it to
   // reduce the other constraints. For example, if we do a binary
@@ -1157,20 +1249,15 @@ Executor::StatePair Executor::fork(ExecutionState &current, ref<Expr> condition,
     if (it != seedMap.end()) {
       std::vector<SeedInfo> seeds = it->second;
       it->second.clear();
+      std::vector<ref<ConstantExpr>> values;
+      getSeedValues(current, seeds, condition, values);
       std::vector<SeedInfo> &trueSeeds = seedMap[trueState];
       std::vector<SeedInfo> &falseSeeds = seedMap[falseState];
-      for (std::vector<SeedInfo>::iterator siit = seeds.begin(), 
-             siie = seeds.end(); siit != siie; ++siit) {
-        ref<ConstantExpr> res;
-        bool success = solver->getValue(current.constraints,
-                                        siit->assignment.evaluate(condition),
-                                        res, current.queryMetaData);
-        assert(success && "FIXME: Unhandled solver failure");
-        (void) success;
-        if (res->isTrue()) {
-          trueSeeds.push_back(*siit);
+      for (unsigned i = 0; i != seeds.size(); ++i) {
+        if (values[i]->isTrue()) {
+          trueSeeds.push_back(seeds[i]);
         } else {
-          falseSeeds.push_back(*siit);
+          falseSeeds.push_back(seeds[i]);
         }
       }
       
@@ -1192,6 +1279,11 @@ Executor::StatePair Executor::fork(ExecutionState &current, ref<Expr> condition,
     processTree->attach(current.ptreeNode, falseState, trueState, reason);
     stats::incBranchStat(reason, 1);
 
+    if (checkpoint) {
+      checkpoint->choose(*trueState, 1);
+      checkpoint->choose(*falseState, 0);
+    }
+
     if (pathWriter) {
       // Need to update the pathOS.id field of falseState, otherwise the same id
       // is used for both falseState and trueState.
@@ -1234,17 +1326,26 @@ void Executor::addConstraint(ExecutionState &state, ref<Expr> condition) {
   std::map< ExecutionState*, std::vector<SeedInfo> >::iterator it = 
     seedMap.find(&state);
   if (it != seedMap.end()) {
+    std::vector<SeedInfo> &seeds = it->second;
+    std::vector<const Assignment *> assignments;
+    for (const SeedInfo &si : seeds)
+      assignments.push_back(&si.assignment);
+    std::vector<std::uint64_t> values;
+    std::vector<bool> known;
+    CompiledExpr(condition).evaluate(assignments, values, known);
+
     bool warn = false;
-    for (std::vector<SeedInfo>::iterator siit = it->second.begin(), 
-           siie = it->second.end(); siit != siie; ++siit) {
-      bool res;
-      bool success = solver->mustBeFalse(state.constraints,
-                                         siit->assignment.evaluate(condition),
-                                         res, state.queryMetaData);
-      assert(success && "FIXME: Unhandled solver failure");
-      (void) success;
+    for (unsigned i = 0; i != seeds.size(); ++i) {
+      bool res = known[i] && !values[i];
+      if (!known[i]) {
+        bool success = solver->mustBeFalse(
+            state.constraints, seeds[i].assignment.evaluate(condition), res,
+            state.queryMetaData);
+        assert(success && "FIXME: Unhandled solver failure");
+        (void) success;
+      }
       if (res) {
-        siit->patchSeed(state, condition, solver.get());
+        seeds[i].patchSeed(state, condition, solver.get());
         warn = true;
       }
     }
@@ -1258,6 +1359,39 @@ void Executor::addConstraint(ExecutionState &state, ref<Expr> condition) {
                                  ConstantExpr::alloc(1, Expr::Bool));
 }
 
+void Executor::getSeedValues(ExecutionState &state,
+                             std::vector<SeedInfo> &seeds, ref<Expr> e,
+                             std::vector<ref<ConstantExpr>> &values,
+                             const std::vector<bool> *skip, bool optimize) {
+  std::vector<unsigned> evaluated;
+  std::vector<const Assignment *> assignments;
+  for (unsigned i = 0; i != seeds.size(); ++i) {
+    if (skip && (*skip)[i])
+      continue;
+    evaluated.push_back(i);
+    assignments.push_back(&seeds[i].assignment);
+  }
+  std::vector<std::uint64_t> concrete;
+  std::vector<bool> known;
+  CompiledExpr(e).evaluate(assignments, concrete, known);
+
+  values.assign(seeds.size(), nullptr);
+  for (unsigned j = 0; j != evaluated.size(); ++j) {
+    const unsigned i = evaluated[j];
+    if (known[j]) {
+      values[i] = ConstantExpr::create(concrete[j], e->getWidth());
+      continue;
+    }
+    ref<Expr> cond = seeds[i].assignment.evaluate(e);
+    if (optimize)
+      cond = optimizer.optimizeExpr(cond, true);
+    bool success = solver->getValue(state.constraints, cond, values[i],
+                                    state.queryMetaData);
+    assert(success && "FIXME: Unhandled solver failure");
+    (void) success;
+  }
+}
+
 const Cell& Executor::eval(KInstruction *ki, unsigned index, 
                            ExecutionState &state) const {
   assert(index < ki->inst->getNumOperands());
@@ -1358,18 +1492,10 @@ void Executor::executeGetValue(ExecutionState &state,
     (void) success;
     bindLocal(target, state, value);
   } else {
-    std::set< ref<Expr> > values;
-    for (std::vector<SeedInfo>::iterator siit = it->second.begin(), 
-           siie = it->second.end(); siit != siie; ++siit) {
-      ref<Expr> cond = siit->assignment.evaluate(e);
-      cond = optimizer.optimizeExpr(cond, true);
-      ref<ConstantExpr> value;
-      bool success =
-          solver->getValue(state.constraints, cond, value, state.queryMetaData);
-      assert(success && "FIXME: Unhandled solver failure");
-      (void) success;
-      values.insert(value);
-    }
+    std::vector<ref<ConstantExpr>> seedValues;
+    getSeedValues(state, it->second, e, seedValues, nullptr,
+                  /*optimize=*/true);
+    std::set< ref<Expr> > values(seedValues.begin(), seedValues.end());
     
     std::vector< ref<Expr> > conditions;
     for (std::set< ref<Expr> >::iterator vit = values.begin(), 
@@ -1441,7 +1567,7 @@ void Executor::stepInstruction(ExecutionState &state) {
   state.prevPC = state.pc;
   ++state.pc;
 
-  if (stats::instructions == MaxInstructions)
+  if (MaxInstructions && stats::instructions == MaxInstructions)
     haltExecution = true;
 }
 
@@ -1686,6 +1812,67 @@ ref<klee::ConstantExpr> Executor::getEhTypeidFor(ref<Expr> type_info) {
   return res;
 }
 
+bool Executor::executeMemoryFunction(ExecutionState &state, KInstruction *ki,
+                                     Function *f,
+                                     std::vector<ref<Expr>> &arguments) {
+  enum { Copy, Fill } kind;
+  const StringRef name = f->getName();
+  if (name == "memcpy" || name == "memmove")
+    kind = Copy;
+  else if (name == "memset")
+    kind = Fill;
+  else
+    return false;
+  if (arguments.size() != 3)
+    return false;
+
+  // Anything that may fail or fork is left to the definition.
+  auto dst = dyn_cast<ConstantExpr>(arguments[0]);
+  auto src = dyn_cast<ConstantExpr>(arguments[1]);
+  auto size = dyn_cast<ConstantExpr>(arguments[2]);
+  if (!dst || !size || (kind == Copy && !src) || size->getWidth() > 64)
+    return false;
+  const uint64_t n = size->getZExtValue();
+
+  // Find the object containing [address, address + n).
+  auto resolve = [&](ConstantExpr *address, ObjectPair &op) {
+    if (!state.addressSpace.resolveOne(address, op))
+      return false;
+    const uint64_t offset = address->getZExtValue() - op.first->address;
+    return offset <= op.first->size && n <= op.first->size - offset;
+  };
+
+  if (n) {
+    ObjectPair dstOp;
+    if (!resolve(dst, dstOp) || dstOp.second->readOnly)
+      return false;
+    const unsigned dstOffset = dst->getZExtValue() - dstOp.first->address;
+
+    if (kind == Copy) {
+      ObjectPair srcOp;
+      if (!resolve(src, srcOp))
+        return false;
+      const unsigned srcOffset = src->getZExtValue() - srcOp.first->address;
+      ObjectState *wos =
+          state.addressSpace.getWriteable(dstOp.first, dstOp.second);
+      // the source may have been the object made writeable
+      const ObjectState *ros = srcOp.first == dstOp.first ? wos : srcOp.second;
+      wos->copy(dstOffset, *ros, srcOffset, n);
+    } else {
+      ObjectState *wos =
+          state.addressSpace.getWriteable(dstOp.first, dstOp.second);
+      wos->fill(dstOffset, ExtractExpr::create(arguments[1], 0, Expr::Int8),
+                n);
+    }
+  }
+
+  if (!f->getReturnType()->isVoidTy())
+    bindLocal(ki, state, arguments[0]);
+  if (InvokeInst *ii = dyn_cast<InvokeInst>(ki->inst))
+    transferToBasicBlock(ii->getNormalDest(), ki->inst->getParent(), state);
+  return true;
+}
+
 void Executor::executeCall(ExecutionState &state, KInstruction *ki, Function *f,
                            std::vector<ref<Expr>> &arguments) {
   Instruction *i = ki->inst;
@@ -1910,6 +2097,9 @@ void Executor::executeCall(ExecutionState &state, KInstruction *ki, Function *f,
       transferToBasicBlock(ii->getNormalDest(), i->getParent(), state);
     }
   } else {
+    if (NativeMemoryFunctions && executeMemoryFunction(state, ki, f, arguments))
+      return;
+
     // Check if maximum stack size was reached.
     // We currently only count the number of stack frames
     if (RuntimeMaxStackFrames && state.stack.size() > RuntimeMaxStackFrames) {
@@ -2248,7 +2438,9 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
 
     ref<Expr> errorCase = ConstantExpr::alloc(1, Expr::Bool);
     SmallPtrSet<BasicBlock *, 5> destinations;
-    // collect and check destinations from label list
+    std::vector<BasicBlock *> candidates;
+    std::vector<ref<Expr>> candidateExpressions;
+    // collect destinations from label list
     for (unsigned k = 0; k < numDestinations; ++k) {
       // filter duplicates
       const auto d = bi->getDestination(k);
@@ -2262,21 +2454,23 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
       // exclude address from errorCase
       errorCase = AndExpr::create(errorCase, Expr::createIsZero(e));
 
-      // check feasibility
-      bool result;
-      bool success __attribute__((unused)) =
-          solver->mayBeTrue(state.constraints, e, result, state.queryMetaData);
-      assert(success && "FIXME: Unhandled solver failure");
-      if (result) {
-        targets.push_back(d);
-        expressions.push_back(e);
-      }
+      candidates.push_back(d);
+      candidateExpressions.push_back(e);
     }
-    // check errorCase feasibility
-    bool result;
+    candidateExpressions.push_back(errorCase);
+
+    // check feasibility of all destinations and the errorCase together
+    std::vector<bool> feasible;
     bool success __attribute__((unused)) = solver->mayBeTrue(
-        state.constraints, errorCase, result, state.queryMetaData);
+        state.constraints, candidateExpressions, feasible, state.queryMetaData);
     assert(success && "FIXME: Unhandled solver failure");
+    for (std::size_t k = 0; k < candidates.size(); ++k) {
+      if (feasible[k]) {
+        targets.push_back(candidates[k]);
+        expressions.push_back(candidateExpressions[k]);
+      }
+    }
+    const bool result = feasible.back();
     if (result) {
       expressions.push_back(errorCase);
     }
@@ -2337,6 +2531,11 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
       // Track default branch values
       ref<Expr> defaultValue = ConstantExpr::alloc(1, Expr::Bool);
 
+      // Collect the conditions of all cases (and the default case last) to
+      // check their feasibility together
+      std::vector<ref<Expr>> matches;
+      std::vector<BasicBlock *> matchSuccessors;
+
       // iterate through all non-default cases but in order of the expressions
       for (std::map<ref<Expr>, BasicBlock *>::iterator
                it = expressionOrder.begin(),
@@ -2351,15 +2550,23 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
         // Make sure that the default value does not contain this target's value
         defaultValue = AndExpr::create(defaultValue, Expr::createIsZero(match));
 
-        // Check if control flow could take this case
-        bool result;
-        match = optimizer.optimizeExpr(match, false);
-        bool success = solver->mayBeTrue(state.constraints, match, result,
-                                         state.queryMetaData);
-        assert(success && "FIXME: Unhandled solver failure");
-        (void) success;
-        if (result) {
-          BasicBlock *caseSuccessor = it->second;
+        matches.push_back(optimizer.optimizeExpr(match, false));
+        matchSuccessors.push_back(it->second);
+      }
+
+      defaultValue = optimizer.optimizeExpr(defaultValue, false);
+      matches.push_back(defaultValue);
+
+      // Check if control flow could take each case
+      std::vector<bool> feasible;
+      bool success = solver->mayBeTrue(state.constraints, matches, feasible,
+                                       state.queryMetaData);
+      assert(success && "FIXME: Unhandled solver failure");
+      (void) success;
+
+      for (std::size_t k = 0; k < matchSuccessors.size(); ++k) {
+        if (feasible[k]) {
+          BasicBlock *caseSuccessor = matchSuccessors[k];
 
           // Handle the case that a basic block might be the target of multiple
           // switch cases.
@@ -2371,7 +2578,7 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
               branchTargets.insert(std::make_pair(
                   caseSuccessor, ConstantExpr::alloc(0, Expr::Bool)));
 
-          res.first->second = OrExpr::create(match, res.first->second);
+          res.first->second = OrExpr::create(matches[k], res.first->second);
 
           // Only add basic blocks which have not been target of a branch yet
           if (res.second) {
@@ -2381,13 +2588,7 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
       }
 
       // Check if control could take the default case
-      defaultValue = optimizer.optimizeExpr(defaultValue, false);
-      bool res;
-      bool success = solver->mayBeTrue(state.constraints, defaultValue, res,
-                                       state.queryMetaData);
-      assert(success && "FIXME: Unhandled solver failure");
-      (void) success;
-      if (res) {
+      if (feasible.back()) {
         std::pair<std::map<BasicBlock *, ref<Expr> >::iterator, bool> ret =
             branchTargets.insert(
                 std::make_pair(si->getDefaultDest(), defaultValue));
@@ -3344,23 +3545,84 @@ void Executor::updateStates(ExecutionState *current) {
   states.insert(addedStates.begin(), addedStates.end());
   addedStates.clear();
 
-  for (std::vector<ExecutionState *>::iterator it = removedStates.begin(),
-                                               ie = removedStates.end();
-       it != ie; ++it) {
-    ExecutionState *es = *it;
-    std::set<ExecutionState*>::iterator it2 = states.find(es);
-    assert(it2!=states.end());
-    states.erase(it2);
-    std::map<ExecutionState*, std::vector<SeedInfo> >::iterator it3 = 
-      seedMap.find(es);
-    if (it3 != seedMap.end())
-      seedMap.erase(it3);
+  for (ExecutionState *es : removedStates) {
+    [[maybe_unused]] const auto erased = states.erase(es);
+    assert(erased == 1 && "removed state is not a known state");
+    if (!seedMap.empty())
+      seedMap.erase(es);
+    if (swapper)
+      swapper->forget(*es);
     processTree->remove(es->ptreeNode);
     delete es;
   }
   removedStates.clear();
 }
 
+void Executor::executeStep(ExecutionState &state) {
+  if (swapper)
+    swapper->swapIn(state);
+
+  KInstruction *ki = state.pc;
+
+  // the work of a state following the path of a checkpoint is already part
+  // of the restored statistics (and must not hit -max-instructions etc.),
+  // unlike that of paths handed over by another process
+  const bool resuming =
+      resumeFromCheckpoint && Checkpoint::isResuming(state);
+  if (resuming)
+    theStatisticManager->setEnabled(false);
+
+  stepInstruction(state);
+  executeInstruction(state, ki);
+
+  if (resuming)
+    theStatisticManager->setEnabled(true);
+
+  timers.invoke();
+  if (::dumpStates) dumpStates();
+  if (::dumpPTree) dumpPTree();
+
+  updateStates(&state);
+
+  if (checkpointDue) {
+    checkpointDue = false;
+    checkpoint->write(states);
+  }
+
+  if (sharedPaths && interpreterHandler->shouldShareStates())
+    shareStates();
+}
+
+void Executor::shareStates() {
+  // Hand over half of the states, those closest to the root, as they
+  // probably have the most paths left to explore. Seeds and merges are
+  // bound to this process, but swapped-out states can be handed over like
+  // the others, as only their branch choices are written (and their swap
+  // records are dropped in updateStates).
+  std::vector<ExecutionState *> shared;
+  for (ExecutionState *es : states) {
+    if (seedMap.count(es) || !es->openMergeStack.empty() ||
+        (mergingSearcher && mergingSearcher->inCloseMerge.count(es)))
+      continue;
+    shared.push_back(es);
+  }
+  const auto middle = shared.begin() + shared.size() / 2;
+  std::nth_element(shared.begin(), middle, shared.end(),
+                   [](const ExecutionState *a, const ExecutionState *b) {
+                     return a->depth < b->depth;
+                   });
+  shared.erase(middle, shared.end());
+  if (shared.empty()) {
+    interpreterHandler->shareStates({});
+    return;
+  }
+
+  interpreterHandler->shareStates(checkpoint->writePaths(shared));
+  for (ExecutionState *state : shared)
+    removeState(*state);
+  updateStates(nullptr);
+}
+
 template <typename TypeIt>
 void Executor::computeOffsetsSeqTy(KGEPInstruction *kgepi,
                                    ref<ConstantExpr> &constantOffset,
@@ -3383,6 +3645,8 @@ void Executor::computeOffsetsSeqTy(KGEPInstruction *kgepi,
 
 template <typename TypeIt>
 void Executor::computeOffsets(KGEPInstruction *kgepi, TypeIt ib, TypeIt ie) {
+  // constants are bound again for every run
+  kgepi->indices.clear();
   ref<ConstantExpr> constantOffset =
     ConstantExpr::alloc(0, Context::get().getPointerWidth());
   uint64_t index = 1;
@@ -3438,7 +3702,7 @@ bool Executor::checkMemoryUsage() {
   // We need to avoid calling GetTotalMallocUsage() often because it
   // is O(elts on freelist). This is really bad since we start
   // to pummel the freelist once we hit the memory cap.
-  if ((stats::instructions & 0xFFFFU) != 0) // every 65536 instructions
+  if ((++memoryCheckSteps & 0xFFFFU) != 0) // every 65536 steps
     return true;
 
   // check memory limit
@@ -3453,6 +3717,10 @@ bool Executor::checkMemoryUsage() {
   if (totalUsage <= MaxMemory + 100)
     return true;
 
+  // swap idle states out instead of terminating them while there are any
+  if (swapper && swapOutStates(totalUsage))
+    return true;
+
   // just guess at how many to kill
   const auto numStates = states.size();
   auto toKill = std::max(1UL, numStates - numStates * MaxMemory / totalUsage);
@@ -3474,15 +3742,56 @@ bool Executor::checkMemoryUsage() {
   return false;
 }
 
+bool Executor::swapOutStates(std::uint64_t totalUsage) {
+  std::vector<ExecutionState *> candidates;
+  for (ExecutionState *es : states) {
+    // merging accesses the contents of the states waiting to be merged
+    if (swapper->isSwappedOut(*es) || !es->openMergeStack.empty() ||
+        (mergingSearcher && mergingSearcher->inCloseMerge.count(es)))
+      continue;
+    candidates.push_back(es);
+  }
+  if (candidates.empty())
+    return false;
+
+  // just guess at how many to swap out
+  const auto numResident = states.size() - swapper->getNumSwappedOut();
+  auto toSwap =
+      std::max(1UL, numResident - numResident * MaxMemory / totalUsage);
+  klee_warning("swapping out %lu states (over memory cap: %luMB)", toSwap,
+               totalUsage);
+
+  // randomly select states to swap out
+  unsigned swapped = 0;
+  for (unsigned N = candidates.size(); N && swapped < toSwap; --N) {
+    unsigned idx = theRNG.getInt32() % N;
+    std::swap(candidates[idx], candidates[N - 1]);
+    if (!swapper->swapOut(*candidates[N - 1]))
+      break;
+    ++swapped;
+  }
+
+  return swapped > 0;
+}
+
 void Executor::doDumpStates() {
+  // the remaining states (if any) can be resumed from here
+  if (checkpoint)
+    checkpoint->write(states);
+
   if (!DumpStatesOnHalt || states.empty()) {
     interpreterHandler->incPathsExplored(states.size());
     return;
   }
 
   klee_message("halting execution, dumping remaining states");
-  for (const auto &state : states)
+  const std::vector<ExecutionState *> remaining(states.begin(), states.end());
+  for (ExecutionState *state : remaining) {
     terminateStateEarly(*state, "Execution halting.", StateTerminationType::Interrupted);
+    // release swapped in states one at a time to stay below the memory cap
+    if (swapper)
+      updateStates(nullptr);
+  }
   updateStates(nullptr);
 }
 
@@ -3515,24 +3824,12 @@ void Executor::run(ExecutionState &initialState) {
       if (it == seedMap.end())
         it = seedMap.begin();
       lastState = it->first;
-      ExecutionState &state = *lastState;
-      KInstruction *ki = state.pc;
-      stepInstruction(state);
-
-      executeInstruction(state, ki);
-      timers.invoke();
-      if (::dumpStates) dumpStates();
-      if (::dumpPTree) dumpPTree();
-      updateStates(&state);
+      executeStep(*lastState);
 
       if ((stats::instructions % 1000) == 0) {
-        int numSeeds = 0, numStates = 0;
-        for (std::map<ExecutionState*, std::vector<SeedInfo> >::iterator
-               it = seedMap.begin(), ie = seedMap.end();
-             it != ie; ++it) {
-          numSeeds += it->second.size();
-          numStates++;
-        }
+        int numSeeds = 0, numStates = seedMap.size();
+        for (const auto &entry : seedMap)
+          numSeeds += entry.second.size();
         const auto time = time::getWallTime();
         const time::Span seedTime(SeedTime);
         if (seedTime && time > startTime + seedTime) {
@@ -3564,16 +3861,7 @@ void Executor::run(ExecutionState &initialState) {
 
   // main interpreter loop
   while (!states.empty() && !haltExecution) {
-    ExecutionState &state = searcher->selectState();
-    KInstruction *ki = state.pc;
-    stepInstruction(state);
-
-    executeInstruction(state, ki);
-    timers.invoke();
-    if (::dumpStates) dumpStates();
-    if (::dumpPTree) dumpPTree();
-
-    updateStates(&state);
+    executeStep(searcher->selectState());
 
     if (!checkMemoryUsage()) {
       // update searchers when states were terminated early due to memory pressure
@@ -3647,7 +3935,10 @@ void Executor::terminateState(ExecutionState &state) {
   }
 
   interpreterHandler->incPathsExplored();
+  removeState(state);
+}
 
+void Executor::removeState(ExecutionState &state) {
   std::vector<ExecutionState *>::iterator it =
       std::find(addedStates.begin(), addedStates.end(), &state);
   if (it==addedStates.end()) {
@@ -3695,6 +3986,10 @@ void Executor::terminateStateOnExit(ExecutionState &state) {
 
 void Executor::terminateStateEarly(ExecutionState &state, const Twine &message,
                                    StateTerminationType reason) {
+  // states terminated while idle may be swapped out
+  if (swapper)
+    swapper->swapIn(state);
+
   if (reason <= StateTerminationType::EARLY) {
     assert(reason > StateTerminationType::EXIT);
     ++stats::terminationEarly;
@@ -3938,7 +4233,8 @@ void Executor::callExternalFunction(ExecutionState &state,
     };
 
     auto tmp = minflt();
-    std::size_t neededPages = state.addressSpace.copyOutConcretes();
+    std::size_t neededPages =
+        state.addressSpace.copyOutConcretes(ExternalCallsCopyChanged);
     auto newPages = minflt() - tmp;
     assert(newPages >= 0);
     residentPages += newPages;
@@ -3952,7 +4248,7 @@ void Executor::callExternalFunction(ExecutionState &state,
     avgNeededPages_ = (3.0 * avgNeededPages_ + neededPages) / 4.0;
     avgNeededPages = avgNeededPages_;
   } else {
-    state.addressSpace.copyOutConcretes();
+    state.addressSpace.copyOutConcretes(ExternalCallsCopyChanged);
   }
 
 #ifndef WINDOWS
@@ -4001,7 +4297,7 @@ void Executor::callExternalFunction(ExecutionState &state,
     return;
   }
 
-  if (!state.addressSpace.copyInConcretes()) {
+  if (!state.addressSpace.copyInConcretes(ExternalCallsCopyChanged)) {
     terminateStateOnExecError(state, "external modified read-only object",
                               StateTerminationType::External);
     return;
@@ -4011,6 +4307,7 @@ void Executor::callExternalFunction(ExecutionState &state,
       residentPages > 2 * avgNeededPages) {
     if (memory->markMappingsAsUnneeded()) {
       residentPages = 0;
+      AddressSpace::forgetCopiedConcretes();
     }
   }
 
@@ -4517,6 +4814,10 @@ void Executor::runFunctionAsMain(Function *f,
   // force deterministic initialization of memory objects
   srand(1);
   srandom(1);
+
+  // a memory manager for a further run (replayed tests, shared paths)
+  if (!memory)
+    memory = std::make_unique<MemoryManager>(&arrayCache);
   
   MemoryObject *argvMO = 0;
 
@@ -4601,9 +4902,31 @@ void Executor::runFunctionAsMain(Function *f,
   
   initializeGlobals(*state);
 
-  processTree = std::make_unique<PTree>(state);
-  run(*state);
-  processTree = nullptr;
+  bool explore = true;
+  if (resumeFromCheckpoint) {
+    // a resumed run always records, so that its end is a checkpoint too
+    if (!checkpoint)
+      checkpoint = std::make_unique<Checkpoint>(
+          interpreterHandler->getOutputFilename("checkpoint"));
+    explore = checkpoint->resume(*state);
+    if (statsTracker)
+      statsTracker->statisticsRestored();
+  } else if (sharedPaths) {
+    // record branch choices to be able to hand over states
+    if (!checkpoint)
+      checkpoint = std::make_unique<Checkpoint>(
+          interpreterHandler->getOutputFilename("checkpoint"));
+    explore = checkpoint->resumePaths(*state, *sharedPaths);
+  }
+
+  if (explore) {
+    processTree = std::make_unique<PTree>(state);
+    run(*state);
+    processTree = nullptr;
+  } else {
+    klee_message("the checkpoint has no states left to explore");
+    delete state;
+  }
 
   // hack to clear memory objects
   memory = nullptr;
@@ -60,6 +60,7 @@ namespace llvm {
 namespace klee {  
   class Array;
   struct Cell;
+  class Checkpoint;
   class ExecutionState;
   class ExternalDispatcher;
   class Expr;
@@ -76,6 +77,7 @@ namespace klee {
   class Searcher;
   class SeedInfo;
   class SpecialFunctionHandler;
+  class StateSwapper;
   struct StackFrame;
   class StatsTracker;
   class TimingSolver;
@@ -112,6 +114,12 @@ private:
   ExternalDispatcher *externalDispatcher;
   std::unique_ptr<TimingSolver> solver;
   std::unique_ptr<MemoryManager> memory;
+  /// Holds the contents of states swapped out under memory pressure
+  /// (-swap-states), null otherwise
+  std::unique_ptr<StateSwapper> swapper;
+  /// Writes checkpoints (-checkpoint-interval) and resumes from them
+  /// (setResumeFromCheckpoint()), null if neither is used
+  std::unique_ptr<Checkpoint> checkpoint;
   std::set<ExecutionState*, ExecutionStateIDCompare> states;
   StatsTracker *statsTracker;
   TreeStreamWriter *pathWriter, *symPathWriter;
@@ -176,6 +184,23 @@ private:
   /// step.
   bool haltExecution;  
 
+  /// Whether to resume from the checkpoint in the output directory.
+  /// \see setResumeFromCheckpoint()
+  bool resumeFromCheckpoint;
+
+  /// Set by a timer when a checkpoint is to be written after the current
+  /// instruction step
+  bool checkpointDue;
+
+  /// When non-null the paths to explore, handed over by another process.
+  /// \see setSharedPaths()
+  const std::string *sharedPaths;
+
+  /// Number of calls to checkMemoryUsage(), which only checks every so many
+  /// steps. Not the instruction statistic, which does not advance while a
+  /// checkpoint is replayed.
+  std::uint64_t memoryCheckSteps = 0;
+
   /// Whether implied-value concretization is enabled. Currently
   /// false, it is buggy (it needs to validate its writes).
   bool ivcEnabled;
@@ -234,6 +259,13 @@ private:
 
   void stepInstruction(ExecutionState &state);
   void updateStates(ExecutionState *current);
+  /// Execute the next instruction of the given state and commit the
+  /// resulting added/removed states (shared by the seeding and main loops).
+  /// This is also where a worker of a parallel run (-parallel-workers)
+  /// hands over states. Parallel exploration uses one process per worker,
+  /// because the expressions, array cache, statistics and solver chain of
+  /// an Executor are not thread-safe.
+  void executeStep(ExecutionState &state);
   void transferToBasicBlock(llvm::BasicBlock *dst, 
 			    llvm::BasicBlock *src,
 			    ExecutionState &state);
@@ -311,6 +343,13 @@ private:
                    KInstruction *ki,
                    llvm::Function *f,
                    std::vector< ref<Expr> > &arguments);
+
+  /// Execute a call to memcpy, memmove or memset with concrete arguments
+  /// that stay within single objects directly on their object states.
+  /// \return false if the call has to be executed by the function itself.
+  bool executeMemoryFunction(ExecutionState &state, KInstruction *ki,
+                             llvm::Function *f,
+                             std::vector<ref<Expr>> &arguments);
                    
   // do address resolution / object binding / out of bounds checking
   // and perform the operation
@@ -346,6 +385,18 @@ private:
   /// validity checks, and seed patching.
   void addConstraint(ExecutionState &state, ref<Expr> condition);
 
+  /// Compute the value of e under each of the given seeds of state. The
+  /// seeds are evaluated together on a compiled form of e (see
+  /// CompiledExpr), and the solver is only queried for the seeds that do
+  /// not determine the value on their own.
+  /// \param skip If given, the seeds to leave out, whose values stay null
+  /// \param optimize Whether to optimize the expressions the solver is
+  /// queried for
+  void getSeedValues(ExecutionState &state, std::vector<SeedInfo> &seeds,
+                     ref<Expr> e, std::vector<ref<ConstantExpr>> &values,
+                     const std::vector<bool> *skip = nullptr,
+                     bool optimize = false);
+
   // Called on [for now] concrete reads, replaces constant with a symbolic
   // Used for testing.
   ref<Expr> replaceReadWithSymbolic(ExecutionState &state, ref<Expr> e);
@@ -414,6 +465,14 @@ private:
   /// used in the termination functions below.
   void terminateState(ExecutionState &state);
 
+  /// Remove state from queue and delete state without counting its path as
+  /// explored, as another process explores it.
+  void removeState(ExecutionState &state);
+
+  /// Hand over some states to another process.
+  /// \see InterpreterHandler::shareStates()
+  void shareStates();
+
   /// Call exit handler and terminate state normally
   /// (end of execution path)
   void terminateStateOnExit(ExecutionState &state);
@@ -488,10 +547,15 @@ private:
                                     ref<Expr> e,
                                     ref<ConstantExpr> value);
 
-  /// check memory usage and terminate states when over threshold of -max-memory + 100MB
-  /// \return true if below threshold, false otherwise (states were terminated)
+  /// check memory usage and terminate (or swap out, see -swap-states) states
+  /// when over threshold of -max-memory + 100MB
+  /// \return false if states were terminated, true otherwise
   bool checkMemoryUsage();
 
+  /// swap out randomly selected idle states to reduce memory usage
+  /// \return true if any state was swapped out
+  bool swapOutStates(std::uint64_t totalUsage);
+
   /// check if branching/forking is allowed
   bool branchingPermitted(const ExecutionState &state) const;
 
@@ -532,6 +596,10 @@ public:
   llvm::Module *setModule(std::vector<std::unique_ptr<llvm::Module>> &modules,
                           const ModuleOptions &opts) override;
 
+  void setSharedPaths(const std::string *paths) override {
+    sharedPaths = paths;
+  }
+
   void useSeeds(const std::vector<struct KTest *> *seeds) override {
     usingSeeds = seeds;
   }
@@ -545,6 +613,10 @@ public:
 
   void setInhibitForking(bool value) override { inhibitForking = value; }
 
+  void setResumeFromCheckpoint(bool value) override {
+    resumeFromCheckpoint = value;
+  }
+
   void prepareForEarlyExit() override;
 
   /*** State accessor methods ***/
@@ -13,10 +13,13 @@
 #include "klee/Config/Version.h"
 #include "klee/Module/KCallable.h"
 #include "klee/Module/KModule.h"
+#include "klee/Support/ErrorHandling.h"
+#include "klee/Support/OptionCategories.h"
 
 #include "klee/Support/CompilerWarning.h"
 DISABLE_WARNING_PUSH
 DISABLE_WARNING_DEPRECATED_DECLARATIONS
+#include "llvm/Config/llvm-config.h"
 #include "llvm/IR/Constants.h"
 #include "llvm/IR/DerivedTypes.h"
 #include "llvm/IR/IRBuilder.h"
@@ -24,19 +27,92 @@ DISABLE_WARNING_DEPRECATED_DECLARATIONS
 #include "llvm/IR/Instructions.h"
 #include "llvm/IR/LLVMContext.h"
 #include "llvm/IR/Module.h"
-#include "llvm/ExecutionEngine/GenericValue.h"
 #include "llvm/ExecutionEngine/MCJIT.h"
+#include "llvm/ExecutionEngine/ObjectCache.h"
+#include "llvm/Support/CommandLine.h"
 #include "llvm/Support/DynamicLibrary.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Host.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/Support/TargetSelect.h"
 DISABLE_WARNING_POP
 
 #include <csetjmp>
 #include <csignal>
+#include <unistd.h>
 
 using namespace llvm;
 using namespace klee;
 
+namespace {
+cl::opt<std::string> ExternalCallCacheDir(
+    "external-call-cache-dir",
+    cl::desc("Keep the compiled external call stubs in this directory and "
+             "reuse them in later runs (default=none)"),
+    cl::cat(ExtCallsCat));
+
+/// Prefix of the names of the generated stubs and of their modules
+const char stubPrefix[] = "klee_dispatch_";
+
+/// Stores the objects MCJIT compiles for the stub modules in a directory,
+/// one file per module named after the module identifier.
+class DispatcherObjectCache : public ObjectCache {
+  std::string directory;
+
+  bool getPath(const Module *m, SmallVectorImpl<char> &path) {
+    StringRef id = m->getModuleIdentifier();
+    if (!id.startswith(stubPrefix))
+      return false;
+    path.assign(directory.begin(), directory.end());
+    sys::path::append(path, id + ".o");
+    return true;
+  }
+
+public:
+  explicit DispatcherObjectCache(const std::string &directory)
+      : directory(directory) {}
+
+  void notifyObjectCompiled(const Module *m, MemoryBufferRef obj) override {
+    SmallString<128> path;
+    if (!getPath(m, path))
+      return;
+
+    // write to a temporary file first, other runs may read the cache
+    std::string tmpPath = (path + "." + Twine(getpid())).str();
+    std::error_code ec;
+    {
+      raw_fd_ostream os(tmpPath, ec, sys::fs::OF_None);
+      if (!ec) {
+        os << obj.getBuffer();
+        os.close();
+        if (os.has_error())
+          ec = os.error();
+      }
+    }
+    if (!ec)
+      ec = sys::fs::rename(tmpPath, path);
+    if (ec) {
+      klee_warning_once(0, "unable to write external call stub to %s: %s",
+                        path.c_str(), ec.message().c_str());
+      sys::fs::remove(tmpPath);
+    }
+  }
+
+  std::unique_ptr<MemoryBuffer> getObject(const Module *m) override {
+    SmallString<128> path;
+    if (!getPath(m, path))
+      return nullptr;
+    auto buffer = MemoryBuffer::getFile(path);
+    if (!buffer)
+      return nullptr;
+    return std::move(*buffer);
+  }
+};
+} // namespace
+
 /***/
 
 static sigjmp_buf escapeCallJmpBuf;
@@ -52,14 +128,29 @@ namespace klee {
 
 class ExternalDispatcherImpl {
 private:
-  typedef std::map<const llvm::Instruction *, llvm::Function *> dispatchers_ty;
+  /// A compiled stub reads the arguments of a call from args[1], args[2],
+  /// ... (see createDispatcher), calls target and writes the result into
+  /// args[0]. Stubs for inline assembly ignore target.
+  typedef void (*stub_ty)(uint64_t *args, void *target);
+  struct Dispatcher {
+    stub_ty stub;
+    void *target;
+  };
+  /// The dispatcher of each call site, a null stub if the call cannot be made
+  typedef std::map<const llvm::Instruction *, Dispatcher> dispatchers_ty;
   dispatchers_ty dispatchers;
+  /// The compiled stubs by name, shared by all call sites with the same
+  /// signature
+  std::map<std::string, stub_ty> stubs;
+  std::string getStubName(KCallable *target, llvm::Instruction *i);
+  stub_ty getStub(KCallable *target, llvm::Instruction *i);
   llvm::Function *createDispatcher(KCallable *target, llvm::Instruction *i,
                                    llvm::Module *module);
   llvm::ExecutionEngine *executionEngine;
+  std::unique_ptr<DispatcherObjectCache> objectCache;
   LLVMContext &ctx;
   std::map<std::string, void *> preboundFunctions;
-  bool runProtectedCall(llvm::Function *f, uint64_t *args);
+  bool runProtectedCall(const Dispatcher &dispatcher, uint64_t *args);
   llvm::Module *singleDispatchModule;
   std::vector<std::string> moduleIDs;
   std::string &getFreshModuleID();
@@ -147,6 +238,17 @@ ExternalDispatcherImpl::ExternalDispatcherImpl(LLVMContext &ctx)
     sys::DynamicLibrary::LoadLibraryPermanently(0);
   }
 
+  if (!ExternalCallCacheDir.empty()) {
+    if (std::error_code ec =
+            sys::fs::create_directories(ExternalCallCacheDir)) {
+      klee_warning("unable to create external call cache directory %s: %s",
+                   ExternalCallCacheDir.c_str(), ec.message().c_str());
+    } else {
+      objectCache.reset(new DispatcherObjectCache(ExternalCallCacheDir));
+      executionEngine->setObjectCache(objectCache.get());
+    }
+  }
+
 #ifdef WINDOWS
   preboundFunctions["getpid"] = (void *)(long)getpid;
   preboundFunctions["putchar"] = (void *)(long)putchar;
@@ -167,67 +269,106 @@ bool ExternalDispatcherImpl::executeCall(KCallable *callable, Instruction *i,
   ++stats::externalCalls;
   dispatchers_ty::iterator it = dispatchers.find(i);
   if (it != dispatchers.end()) {
-    // Code already JIT'ed for this
+    // Dispatcher already resolved for this call site
     return runProtectedCall(it->second, args);
   }
 
-  // Code for this not JIT'ed. Do this now.
-  Function *dispatcher;
-#ifdef WINDOWS
-  std::map<std::string, void *>::iterator it2 =
-      preboundFunctions.find(f->getName());
-
-  if (it2 != preboundFunctions.end()) {
-    // only bind once
-    if (it2->second) {
-      executionEngine->addGlobalMapping(f, it2->second);
-      it2->second = 0;
-    }
+  Dispatcher dispatcher = {nullptr, nullptr};
+  if (isa<KFunction>(callable)) {
+    std::string name = callable->getName().str();
+    std::map<std::string, void *>::iterator it2 = preboundFunctions.find(name);
+    dispatcher.target =
+        it2 != preboundFunctions.end() ? it2->second : resolveSymbol(name);
+    if (dispatcher.target)
+      dispatcher.stub = getStub(callable, i);
+  } else {
+    dispatcher.stub = getStub(callable, i);
   }
-#endif
-
-  Module *dispatchModule = NULL;
-  // The MCJIT generates whole modules at a time so for every call that we
-  // haven't made before we need to create a new Module.
-  dispatchModule = new Module(getFreshModuleID(), ctx);
-  dispatcher = createDispatcher(callable, i, dispatchModule);
   dispatchers.insert(std::make_pair(i, dispatcher));
 
-  // Force the JIT execution engine to go ahead and build the function. This
+  return runProtectedCall(dispatcher, args);
+}
+
+std::string ExternalDispatcherImpl::getStubName(KCallable *target,
+                                                Instruction *inst) {
+  // Everything the generated code depends on: the target platform, the
+  // types the arguments are passed as, the attributes of the callee (which
+  // affect the calling convention) and, for inline assembly, the assembly
+  // itself. The address of the callee is passed to the stub, so stubs do not
+  // depend on the process and can be cached between runs.
+  const CallBase &cb = cast<CallBase>(*inst);
+  FunctionType *FTy = target->getFunctionType();
+
+  std::string key;
+  llvm::raw_string_ostream ss(key);
+  ss << LLVM_VERSION_STRING << ' ' << sys::getProcessTriple() << ' ' << *FTy
+     << " args:";
+  for (unsigned i = 0; i < cb.arg_size(); ++i) {
+    ss << ' '
+       << *(i < FTy->getNumParams() ? FTy->getParamType(i)
+                                    : cb.getArgOperand(i)->getType());
+  }
+
+  if (auto *func = dyn_cast<KFunction>(target)) {
+    const AttributeList &attrs = func->function->getAttributes();
+    ss << " ret: " << attrs.getAsString(AttributeList::ReturnIndex)
+       << " fn: " << attrs.getAsString(AttributeList::FunctionIndex);
+    for (unsigned i = 0; i < FTy->getNumParams(); ++i)
+      ss << ' ' << i << ": "
+         << attrs.getAsString(AttributeList::FirstArgIndex + i);
+  } else if (auto *asmValue = dyn_cast<KInlineAsm>(target)) {
+    InlineAsm *ia = asmValue->getInlineAsm();
+    ss << " asm: " << ia->getAsmString()
+       << " constraints: " << ia->getConstraintString()
+       << " flags: " << ia->hasSideEffects() << ia->isAlignStack()
+       << ia->getDialect();
+  }
+
+  MD5 hash;
+  hash.update(ss.str());
+  MD5::MD5Result result;
+  hash.final(result);
+  SmallString<32> digest;
+  MD5::stringifyResult(result, digest);
+  return stubPrefix + digest.str().str();
+}
+
+ExternalDispatcherImpl::stub_ty
+ExternalDispatcherImpl::getStub(KCallable *target, Instruction *inst) {
+  std::string name = getStubName(target, inst);
+  auto it = stubs.find(name);
+  if (it != stubs.end())
+    return it->second;
+
+  // The MCJIT generates whole modules at a time so every stub gets its own
+  // module. Its identifier is the stub name, which is the key of the object
+  // cache.
+  auto dispatchModule = std::make_unique<Module>(name, ctx);
+  Function *dispatcher = createDispatcher(target, inst, dispatchModule.get());
+  executionEngine->addModule(std::move(dispatchModule)); // MCJIT takes ownership
+
+  // Force code generation (or loading from the object cache) now. This
   // ensures that any errors or assertions in the compilation process will
   // trigger crashes instead of being caught as aborts in the external
   // function.
-  if (dispatcher) {
-    // The dispatchModule is now ready so tell MCJIT to generate the code for
-    // it.
-    auto dispatchModuleUniq = std::unique_ptr<Module>(dispatchModule);
-    executionEngine->addModule(
-        std::move(dispatchModuleUniq)); // MCJIT takes ownership
-    // Force code generation
-    uint64_t fnAddr =
-        executionEngine->getFunctionAddress(dispatcher->getName().str());
-    executionEngine->finalizeObject();
-    assert(fnAddr && "failed to get function address");
-    (void)fnAddr;
-  } else {
-    // MCJIT didn't take ownership of the module so delete it.
-    delete dispatchModule;
-  }
-  return runProtectedCall(dispatcher, args);
+  uint64_t fnAddr =
+      executionEngine->getFunctionAddress(dispatcher->getName().str());
+  executionEngine->finalizeObject();
+  assert(fnAddr && "failed to get function address");
+
+  stub_ty stub = reinterpret_cast<stub_ty>(fnAddr);
+  stubs.insert(std::make_pair(name, stub));
+  return stub;
 }
 
-// FIXME: This is not reentrant.
-static uint64_t *gTheArgsP;
-bool ExternalDispatcherImpl::runProtectedCall(Function *f, uint64_t *args) {
+bool ExternalDispatcherImpl::runProtectedCall(const Dispatcher &dispatcher,
+                                              uint64_t *args) {
   struct sigaction segvAction, segvActionOld;
   bool res;
 
-  if (!f)
+  if (!dispatcher.stub)
     return false;
 
-  std::vector<GenericValue> gvArgs;
-  gTheArgsP = args;
-
   segvAction.sa_handler = nullptr;
   sigemptyset(&(segvAction.sa_mask));
   sigaddset(&(segvAction.sa_mask), SIGSEGV);
@@ -239,7 +380,7 @@ bool ExternalDispatcherImpl::runProtectedCall(Function *f, uint64_t *args) {
     res = false;
   } else {
     errno = lastErrno;
-    executionEngine->runFunction(f, gvArgs);
+    dispatcher.stub(args, dispatcher.target);
     // Explicitly acquire errno information
     lastErrno = errno;
     res = true;
@@ -249,51 +390,33 @@ bool ExternalDispatcherImpl::runProtectedCall(Function *f, uint64_t *args) {
   return res;
 }
 
-// FIXME: This might have been relevant for the old JIT but the MCJIT
-// has a completly different implementation so this comment below is
-// likely irrelevant and misleading.
-//
-// For performance purposes we construct the stub in such a way that the
-// arguments pointer is passed through the static global variable gTheArgsP in
-// this file. This is done so that the stub function prototype trivially matches
-// the special cases that the JIT knows how to directly call. If this is not
-// done, then the jit will end up generating a nullary stub just to call our
-// stub, for every single function call.
+// The stub is named after its signature (see getStubName) and takes the
+// arguments array and the address of the callee as parameters, so that it
+// contains no addresses of this process.
 Function *ExternalDispatcherImpl::createDispatcher(KCallable *target,
                                                    Instruction *inst,
                                                    Module *module) {
-  if (isa<KFunction>(target) && !resolveSymbol(target->getName().str()))
-    return 0;
-
   const CallBase &cb = cast<CallBase>(*inst);
   Value **args = new Value *[cb.arg_size()];
 
-  std::vector<Type *> nullary;
-
-  // MCJIT functions need unique names, or wrong function can be called.
-  // The module identifier is included because for the MCJIT we need
-  // unique function names across all `llvm::Modules`s.
-  std::string fnName =
-      "dispatcher_" + target->getName().str() + module->getModuleIdentifier();
-  Function *dispatcher =
-      Function::Create(FunctionType::get(Type::getVoidTy(ctx), nullary, false),
-                       GlobalVariable::ExternalLinkage, fnName, module);
+  Type *argsTy = PointerType::getUnqual(Type::getInt64Ty(ctx));
+  Type *targetTy = PointerType::getUnqual(Type::getInt8Ty(ctx));
+  Function *dispatcher = Function::Create(
+      FunctionType::get(Type::getVoidTy(ctx), {argsTy, targetTy}, false),
+      GlobalVariable::ExternalLinkage, module->getModuleIdentifier(), module);
+  Argument *argI64s = &*dispatcher->arg_begin();
+  argI64s->setName("args");
+  Argument *targetp = &*std::next(dispatcher->arg_begin());
+  targetp->setName("target");
 
   BasicBlock *dBB = BasicBlock::Create(ctx, "entry", dispatcher);
 
   llvm::IRBuilder<> Builder(dBB);
-  // Get a Value* for &gTheArgsP, as an i64**.
-  auto argI64sp = Builder.CreateIntToPtr(
-      ConstantInt::get(Type::getInt64Ty(ctx), (uintptr_t)(void *)&gTheArgsP),
-      PointerType::getUnqual(PointerType::getUnqual(Type::getInt64Ty(ctx))),
-      "argsp");
-  auto argI64s = Builder.CreateLoad(
-      argI64sp->getType()->getPointerElementType(), argI64sp, "args");
 
   // Get the target function type.
   FunctionType *FTy = target->getFunctionType();
 
-  // Each argument will be passed by writing it into gTheArgsP[i].
+  // Each argument will be passed by writing it into args[i].
   unsigned i = 0, idx = 2;
   for (auto ai = cb.arg_begin(), ae = cb.arg_end(); ai != ae; ++ai, ++i) {
     // Determine the type the argument will be passed as. This accommodates for
@@ -307,12 +430,11 @@ Function *ExternalDispatcherImpl::createDispatcher(KCallable *target,
       idx++;
 
     auto argI64p =
-        Builder.CreateGEP(argI64s->getType()->getPointerElementType(), argI64s,
+        Builder.CreateGEP(Type::getInt64Ty(ctx), argI64s,
                           ConstantInt::get(Type::getInt32Ty(ctx), idx));
 
     auto argp = Builder.CreateBitCast(argI64p, PointerType::getUnqual(argTy));
-    args[i] =
-        Builder.CreateLoad(argp->getType()->getPointerElementType(), argp);
+    args[i] = Builder.CreateLoad(argTy, argp);
 
     unsigned argSize = argTy->getPrimitiveSizeInBits();
     idx += ((!!argSize ? argSize : 64) + 63) / 64;
@@ -320,10 +442,10 @@ Function *ExternalDispatcherImpl::createDispatcher(KCallable *target,
 
   llvm::CallInst *result;
   if (auto* func = dyn_cast<KFunction>(target)) {
-    auto dispatchTarget = module->getOrInsertFunction(target->getName(), FTy,
-                                                      func->function->getAttributes());
-    result = Builder.CreateCall(dispatchTarget,
+    auto fnp = Builder.CreateBitCast(targetp, PointerType::getUnqual(FTy));
+    result = Builder.CreateCall(FTy, fnp,
                                 llvm::ArrayRef<Value *>(args, args + i));
+    result->setAttributes(func->function->getAttributes());
   } else if (auto* asmValue = dyn_cast<KInlineAsm>(target)) {
     result = Builder.CreateCall(asmValue->getInlineAsm(),
                                 llvm::ArrayRef<Value *>(args, args + i));
@@ -13,7 +13,6 @@
 #include "ExecutionState.h"
 #include "MemoryManager.h"
 
-#include "klee/ADT/BitArray.h"
 #include "klee/Expr/ArrayCache.h"
 #include "klee/Expr/Expr.h"
 #include "klee/Support/OptionCategories.h"
@@ -31,6 +30,7 @@ DISABLE_WARNING_DEPRECATED_DECLARATIONS
 DISABLE_WARNING_POP
 
 #include <cassert>
+#include <map>
 #include <sstream>
 
 using namespace llvm;
@@ -42,6 +42,18 @@ namespace {
                     cl::desc("Use constant arrays instead of updates when possible (default=true)\n"),
                     cl::init(true),
                     cl::cat(SolvingCat));
+
+  cl::opt<unsigned>
+  CompactUpdatesThreshold("compact-updates-threshold",
+                          cl::desc("Compact the update list of an object once "
+                                   "it holds this many updates, folding "
+                                   "concrete writes into a new constant array "
+                                   "where possible. Set to 0 to disable "
+                                   "(default=256)"),
+                          cl::init(256),
+                          cl::cat(SolvingCat));
+
+  unsigned constantArrayCounter = 0;
 }
 
 /***/
@@ -80,10 +92,7 @@ void MemoryObject::getAllocInfo(std::string &result) const {
 ObjectState::ObjectState(const MemoryObject *mo)
   : copyOnWriteOwner(0),
     object(mo),
-    concreteStore(new uint8_t[mo->size]),
-    concreteMask(nullptr),
-    knownSymbolics(nullptr),
-    unflushedMask(nullptr),
+    concreteStore(mo->size),
     updates(nullptr, nullptr),
     size(mo->size),
     readOnly(false) {
@@ -93,50 +102,50 @@ ObjectState::ObjectState(const MemoryObject *mo)
         getArrayCache()->CreateArray("tmp_arr" + llvm::utostr(++id), size);
     updates = UpdateList(array, 0);
   }
-  memset(concreteStore, 0, size);
 }
 
 
 ObjectState::ObjectState(const MemoryObject *mo, const Array *array)
   : copyOnWriteOwner(0),
     object(mo),
-    concreteStore(new uint8_t[mo->size]),
-    concreteMask(nullptr),
-    knownSymbolics(nullptr),
-    unflushedMask(nullptr),
+    concreteStore(mo->size),
     updates(array, nullptr),
     size(mo->size),
     readOnly(false) {
   makeSymbolic();
-  memset(concreteStore, 0, size);
 }
 
-ObjectState::ObjectState(const ObjectState &os) 
+ObjectState::ObjectState(const MemoryObject *mo, const UpdateList &updates)
+  : copyOnWriteOwner(0),
+    object(mo),
+    concreteStore(mo->size),
+    updates(updates),
+    size(mo->size),
+    readOnly(false) {}
+
+ObjectState::ObjectState(const ObjectState &os)
   : copyOnWriteOwner(0),
     object(os.object),
-    concreteStore(new uint8_t[os.size]),
-    concreteMask(os.concreteMask ? new BitArray(*os.concreteMask, os.size) : nullptr),
-    knownSymbolics(nullptr),
-    unflushedMask(os.unflushedMask ? new BitArray(*os.unflushedMask, os.size) : nullptr),
+    concreteStore(os.concreteStore),
+    concreteStamp(os.concreteStamp),
+    concreteMask(os.concreteMask
+                     ? std::make_unique<CopyOnWriteBitArray>(*os.concreteMask)
+                     : nullptr),
+    knownSymbolics(os.knownSymbolics
+                       ? std::make_unique<CopyOnWriteArray<ref<Expr>>>(
+                             *os.knownSymbolics)
+                       : nullptr),
+    unflushedMask(os.unflushedMask
+                      ? std::make_unique<CopyOnWriteBitArray>(*os.unflushedMask)
+                      : nullptr),
     updates(os.updates),
+    compactedUpdatesSize(os.compactedUpdatesSize),
     size(os.size),
     readOnly(false) {
   assert(!os.readOnly && "no need to copy read only object?");
-  if (os.knownSymbolics) {
-    knownSymbolics = new ref<Expr>[size];
-    for (unsigned i=0; i<size; i++)
-      knownSymbolics[i] = os.knownSymbolics[i];
-  }
-
-  memcpy(concreteStore, os.concreteStore, size*sizeof(*concreteStore));
 }
 
-ObjectState::~ObjectState() {
-  delete concreteMask;
-  delete unflushedMask;
-  delete[] knownSymbolics;
-  delete[] concreteStore;
-}
+ObjectState::~ObjectState() = default;
 
 ArrayCache *ObjectState::getArrayCache() const {
   assert(object && "object was NULL");
@@ -182,9 +191,8 @@ const UpdateList &ObjectState::getUpdates() const {
       Contents[Index->getZExtValue()] = Value;
     }
 
-    static unsigned id = 0;
     const Array *array = getArrayCache()->CreateArray(
-        "const_arr" + llvm::utostr(++id), size, &Contents[0],
+        "const_arr" + llvm::utostr(++constantArrayCounter), size, &Contents[0],
         &Contents[0] + Contents.size());
     updates = UpdateList(array, 0);
 
@@ -193,9 +201,77 @@ const UpdateList &ObjectState::getUpdates() const {
       updates.extend(Writes[Begin].first, Writes[Begin].second);
   }
 
+  // Compact again only once the list has doubled, so that lists which can
+  // not be shortened are not scanned on every read.
+  if (CompactUpdatesThreshold && updates.head &&
+      updates.getSize() >= CompactUpdatesThreshold &&
+      updates.getSize() >= 2 * compactedUpdatesSize)
+    compactUpdates();
+
   return updates;
 }
 
+void ObjectState::compactUpdates() const {
+  // Collect the list of writes, with the oldest writes first.
+  unsigned NumWrites = updates.getSize();
+  std::vector< std::pair< ref<Expr>, ref<Expr> > > Writes(NumWrites);
+  const auto *un = updates.head.get();
+  for (unsigned i = NumWrites; i != 0; un = un->next.get()) {
+    --i;
+    Writes[i] = std::make_pair(un->index, un->value);
+  }
+
+  const Array *root = updates.root;
+  std::vector< ref<ConstantExpr> > Contents;
+  if (root->isConstantArray())
+    Contents = root->constantValues;
+  bool ChangedRoot = false;
+
+  std::vector< std::pair< ref<Expr>, ref<Expr> > > Compacted;
+  for (unsigned Begin = 0, End = Writes.size(); Begin != End;) {
+    // Writes to distinct concrete indices commute, so of a run of writes at
+    // concrete indices only the last one to each index matters.
+    std::map<uint64_t, ref<Expr> > LastWrites;
+    unsigned RunEnd = Begin;
+    for (; RunEnd != End; ++RunEnd) {
+      ConstantExpr *Index = dyn_cast<ConstantExpr>(Writes[RunEnd].first);
+      if (!Index)
+        break;
+      LastWrites[Index->getZExtValue()] = Writes[RunEnd].second;
+    }
+
+    for (const auto &W : LastWrites) {
+      // Nothing precedes the first run but the root.
+      ConstantExpr *Value = dyn_cast<ConstantExpr>(W.second);
+      if (Begin == 0 && Value && !Contents.empty()) {
+        Contents[W.first] = Value;
+        ChangedRoot = true;
+      } else {
+        Compacted.emplace_back(ConstantExpr::create(W.first, Expr::Int32),
+                               W.second);
+      }
+    }
+
+    // Writes at symbolic indices are kept as they are.
+    for (; RunEnd != End && !isa<ConstantExpr>(Writes[RunEnd].first); ++RunEnd)
+      Compacted.push_back(Writes[RunEnd]);
+
+    Begin = RunEnd;
+  }
+
+  if (ChangedRoot)
+    root = getArrayCache()->CreateArray(
+        "const_arr" + llvm::utostr(++constantArrayCounter), size, &Contents[0],
+        &Contents[0] + Contents.size());
+
+  if (ChangedRoot || Compacted.size() != Writes.size()) {
+    updates = UpdateList(root, 0);
+    for (const auto &W : Compacted)
+      updates.extend(W.first, W.second);
+  }
+  compactedUpdatesSize = updates.getSize();
+}
+
 void ObjectState::flushToConcreteStore(TimingSolver *solver,
                                        const ExecutionState &state) const {
   for (unsigned i = 0; i < size; i++) {
@@ -207,19 +283,18 @@ void ObjectState::flushToConcreteStore(TimingSolver *solver,
         klee_warning("Solver timed out when getting a value for external call, "
                      "byte %p+%u will have random value",
                      (void *)object->address, i);
-      else
-        ce->toMemory(concreteStore + i);
+      else {
+        ce->toMemory(&concreteStore.getWriteable(i));
+        concreteStamp = 0;
+      }
     }
   }
 }
 
 void ObjectState::makeConcrete() {
-  delete concreteMask;
-  delete unflushedMask;
-  delete[] knownSymbolics;
-  concreteMask = nullptr;
-  unflushedMask = nullptr;
-  knownSymbolics = nullptr;
+  concreteMask.reset();
+  unflushedMask.reset();
+  knownSymbolics.reset();
 }
 
 void ObjectState::makeSymbolic() {
@@ -236,15 +311,15 @@ void ObjectState::makeSymbolic() {
 
 void ObjectState::initializeToZero() {
   makeConcrete();
-  memset(concreteStore, 0, size);
+  concreteStore.fill(0);
+  concreteStamp = 0;
 }
 
 void ObjectState::initializeToRandom() {  
   makeConcrete();
-  for (unsigned i=0; i<size; i++) {
-    // randomly selected by 256 sided die
-    concreteStore[i] = 0xAB;
-  }
+  // randomly selected by 256 sided die
+  concreteStore.fill(0xAB);
+  concreteStamp = 0;
 }
 
 /*
@@ -265,7 +340,7 @@ void ObjectState::fastRangeCheckOffset(ref<Expr> offset,
 void ObjectState::flushRangeForRead(unsigned rangeBase,
                                     unsigned rangeSize) const {
   if (!unflushedMask)
-    unflushedMask = new BitArray(size, true);
+    unflushedMask = std::make_unique<CopyOnWriteBitArray>(size, true);
 
   for (unsigned offset = rangeBase; offset < rangeBase + rangeSize; offset++) {
     if (isByteUnflushed(offset)) {
@@ -276,7 +351,7 @@ void ObjectState::flushRangeForRead(unsigned rangeBase,
         assert(isByteKnownSymbolic(offset) &&
                "invalid bit set in unflushedMask");
         updates.extend(ConstantExpr::create(offset, Expr::Int32),
-                       knownSymbolics[offset]);
+                       (*knownSymbolics)[offset]);
       }
 
       unflushedMask->unset(offset);
@@ -286,7 +361,7 @@ void ObjectState::flushRangeForRead(unsigned rangeBase,
 
 void ObjectState::flushRangeForWrite(unsigned rangeBase, unsigned rangeSize) {
   if (!unflushedMask)
-    unflushedMask = new BitArray(size, true);
+    unflushedMask = std::make_unique<CopyOnWriteBitArray>(size, true);
 
   for (unsigned offset = rangeBase; offset < rangeBase + rangeSize; offset++) {
     if (isByteUnflushed(offset)) {
@@ -298,7 +373,7 @@ void ObjectState::flushRangeForWrite(unsigned rangeBase, unsigned rangeSize) {
         assert(isByteKnownSymbolic(offset) &&
                "invalid bit set in unflushedMask");
         updates.extend(ConstantExpr::create(offset, Expr::Int32),
-                       knownSymbolics[offset]);
+                       (*knownSymbolics)[offset]);
         setKnownSymbolic(offset, 0);
       }
 
@@ -324,7 +399,7 @@ bool ObjectState::isByteUnflushed(unsigned offset) const {
 }
 
 bool ObjectState::isByteKnownSymbolic(unsigned offset) const {
-  return knownSymbolics && knownSymbolics[offset].get();
+  return knownSymbolics && (*knownSymbolics)[offset].get();
 }
 
 void ObjectState::markByteConcrete(unsigned offset) {
@@ -334,7 +409,7 @@ void ObjectState::markByteConcrete(unsigned offset) {
 
 void ObjectState::markByteSymbolic(unsigned offset) {
   if (!concreteMask)
-    concreteMask = new BitArray(size, true);
+    concreteMask = std::make_unique<CopyOnWriteBitArray>(size, true);
   concreteMask->unset(offset);
 }
 
@@ -345,7 +420,7 @@ void ObjectState::markByteUnflushed(unsigned offset) {
 
 void ObjectState::markByteFlushed(unsigned offset) {
   if (!unflushedMask) {
-    unflushedMask = new BitArray(size, false);
+    unflushedMask = std::make_unique<CopyOnWriteBitArray>(size, false);
   } else {
     unflushedMask->unset(offset);
   }
@@ -354,11 +429,13 @@ void ObjectState::markByteFlushed(unsigned offset) {
 void ObjectState::setKnownSymbolic(unsigned offset, 
                                    Expr *value /* can be null */) {
   if (knownSymbolics) {
-    knownSymbolics[offset] = value;
+    // avoid unsharing a chunk for a no-op
+    if (value || (*knownSymbolics)[offset].get())
+      knownSymbolics->set(offset, value);
   } else {
     if (value) {
-      knownSymbolics = new ref<Expr>[size];
-      knownSymbolics[offset] = value;
+      knownSymbolics = std::make_unique<CopyOnWriteArray<ref<Expr>>>(size);
+      knownSymbolics->set(offset, value);
     }
   }
 }
@@ -369,7 +446,7 @@ ref<Expr> ObjectState::read8(unsigned offset) const {
   if (isByteConcrete(offset)) {
     return ConstantExpr::create(concreteStore[offset], Expr::Int8);
   } else if (isByteKnownSymbolic(offset)) {
-    return knownSymbolics[offset];
+    return (*knownSymbolics)[offset];
   } else {
     assert(!isByteUnflushed(offset) && "unflushed byte without cache value");
     
@@ -401,7 +478,10 @@ ref<Expr> ObjectState::read8(ref<Expr> offset) const {
 
 void ObjectState::write8(unsigned offset, uint8_t value) {
   //assert(read_only == false && "writing to read-only object!");
-  concreteStore[offset] = value;
+  if (concreteStore[offset] != value) {
+    concreteStore.set(offset, value);
+    concreteStamp = 0;
+  }
   setKnownSymbolic(offset, 0);
 
   markByteConcrete(offset);
@@ -572,6 +652,41 @@ void ObjectState::write64(unsigned offset, uint64_t value) {
   }
 }
 
+void ObjectState::copy(unsigned offset, const ObjectState &src,
+                       unsigned srcOffset, unsigned size) {
+  bool concrete = true;
+  for (unsigned i = 0; i != size && concrete; ++i)
+    concrete = src.isByteConcrete(srcOffset + i);
+
+  if (concrete) {
+    std::vector<uint8_t> bytes(size);
+    for (unsigned i = 0; i != size; ++i)
+      bytes[i] = src.concreteStore[srcOffset + i];
+    for (unsigned i = 0; i != size; ++i)
+      write8(offset + i, bytes[i]);
+    return;
+  }
+
+  std::vector<ref<Expr>> bytes;
+  bytes.reserve(size);
+  for (unsigned i = 0; i != size; ++i)
+    bytes.push_back(src.read8(srcOffset + i));
+  for (unsigned i = 0; i != size; ++i)
+    write8(offset + i, bytes[i]);
+}
+
+void ObjectState::fill(unsigned offset, ref<Expr> value, unsigned size) {
+  assert(value->getWidth() == Expr::Int8 && "Invalid fill value!");
+  if (ConstantExpr *CE = dyn_cast<ConstantExpr>(value)) {
+    const uint8_t byte = CE->getZExtValue(8);
+    for (unsigned i = 0; i != size; ++i)
+      write8(offset + i, byte);
+  } else {
+    for (unsigned i = 0; i != size; ++i)
+      write8(offset + i, value);
+  }
+}
+
 void ObjectState::print() const {
   llvm::errs() << "-- ObjectState --\n";
   llvm::errs() << "\tMemoryObject ID: " << object->id << "\n";
@@ -13,10 +13,12 @@
 #include "Context.h"
 #include "TimingSolver.h"
 
+#include "klee/ADT/CopyOnWriteArray.h"
 #include "klee/Expr/Expr.h"
 
 #include "llvm/ADT/StringExtras.h"
 
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -27,7 +29,6 @@ namespace llvm {
 namespace klee {
 
 class ArrayCache;
-class BitArray;
 class ExecutionState;
 class MemoryManager;
 class Solver;
@@ -166,6 +167,7 @@ public:
 class ObjectState {
 private:
   friend class AddressSpace;
+  friend class StateSwapper;
   friend class ref<ObjectState>;
 
   unsigned copyOnWriteOwner; // exclusively for AddressSpace
@@ -175,23 +177,35 @@ private:
 
   ref<const MemoryObject> object;
 
+  // The per-byte contents below are split into copy-on-write chunks, so
+  // that a state writing to an object it shares with its forks only copies
+  // the chunks it touches.
+
   /// @brief Holds all known concrete bytes
-  uint8_t *concreteStore;
+  /// mutable because flushToConcreteStore updates it for a const object
+  mutable CopyOnWriteArray<uint8_t> concreteStore;
+
+  /// Identifies the contents of concreteStore, reset to 0 whenever they
+  /// change (exclusively for AddressSpace::copyOutConcretes)
+  mutable uint64_t concreteStamp = 0;
 
   /// @brief concreteMask[byte] is set if byte is known to be concrete
-  BitArray *concreteMask;
+  std::unique_ptr<CopyOnWriteBitArray> concreteMask;
 
   /// knownSymbolics[byte] holds the symbolic expression for byte,
   /// if byte is known to be symbolic
-  ref<Expr> *knownSymbolics;
+  std::unique_ptr<CopyOnWriteArray<ref<Expr>>> knownSymbolics;
 
   /// unflushedMask[byte] is set if byte is unflushed
   /// mutable because may need flushed during read of const
-  mutable BitArray *unflushedMask;
+  mutable std::unique_ptr<CopyOnWriteBitArray> unflushedMask;
 
   // mutable because we may need flush during read of const
   mutable UpdateList updates;
 
+  /// The size of the update list after it was last compacted
+  mutable unsigned compactedUpdatesSize = 0;
+
 public:
   unsigned size;
 
@@ -231,6 +245,17 @@ public:
   void write16(unsigned offset, uint16_t value);
   void write32(unsigned offset, uint32_t value);
   void write64(unsigned offset, uint64_t value);
+
+  /// Copy size bytes of src starting at srcOffset to offset, as if they were
+  /// all read before any is written (src may be this object). Symbolic bytes
+  /// are copied as their byte expressions. The ranges must be in bounds.
+  void copy(unsigned offset, const ObjectState &src, unsigned srcOffset,
+            unsigned size);
+
+  /// Set size bytes starting at offset to the byte value.
+  /// The range must be in bounds.
+  void fill(unsigned offset, ref<Expr> value, unsigned size);
+
   void print() const;
 
   /*
@@ -241,8 +266,18 @@ public:
                             const ExecutionState &state) const;
 
 private:
+  /// Create an object state with the given updates and no other contents,
+  /// used to restore swapped out objects.
+  ObjectState(const MemoryObject *mo, const UpdateList &updates);
+
   const UpdateList &getUpdates() const;
 
+  /// Shorten a long update list: writes at concrete indices before the
+  /// first write at a symbolic index are folded into a new constant root
+  /// array (if the root is constant), and of consecutive writes at concrete
+  /// indices only the last one to each index is kept.
+  void compactUpdates() const;
+
   void makeConcrete();
 
   void makeSymbolic();
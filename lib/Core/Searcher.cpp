@@ -174,9 +174,36 @@ WeightedRandomSearcher::WeightedRandomSearcher(WeightType type, RNG &rng)
 }
 
 ExecutionState &WeightedRandomSearcher::selectState() {
+  refreshWeights();
   return *states->choose(theRNG.getDoubleL());
 }
 
+void WeightedRandomSearcher::refreshWeights() {
+  switch (type) {
+  case MinDistToUncovered:
+  case CoveringNew:
+    // distances only change in computeReachableUncovered
+    if (weightsEpoch == getMinDistToUncoveredEpoch())
+      return;
+    break;
+  case InstCount:
+  case CPInstCount:
+    // instruction counts change with every step of any state, refreshing
+    // once every numStates updates keeps the amortised cost per update
+    // constant
+    if (updatesSinceRefresh < numStates)
+      return;
+    break;
+  default:
+    // the weights of states only change when they are executed
+    return;
+  }
+
+  states->updateAll([this](ExecutionState *es) { return getWeight(es); });
+  weightsEpoch = getMinDistToUncoveredEpoch();
+  updatesSinceRefresh = 0;
+}
+
 double WeightedRandomSearcher::getWeight(ExecutionState *es) {
   switch(type) {
     default:
@@ -234,6 +261,10 @@ void WeightedRandomSearcher::update(ExecutionState *current,
   // remove states
   for (const auto state : removedStates)
     states->remove(state);
+
+  numStates += addedStates.size();
+  numStates -= removedStates.size();
+  ++updatesSinceRefresh;
 }
 
 bool WeightedRandomSearcher::empty() {
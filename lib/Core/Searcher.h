@@ -139,8 +139,17 @@ namespace klee {
     RNG &theRNG;
     WeightType type;
     bool updateWeights;
-    
+    /// Number of states in the searcher
+    std::size_t numStates = 0;
+    /// The getMinDistToUncoveredEpoch() the weights were computed in
+    std::uint64_t weightsEpoch = 0;
+    /// Number of updates since all weights were last computed
+    std::size_t updatesSinceRefresh = 0;
+
     double getWeight(ExecutionState*);
+    /// Recompute the weights of all states if they may have gone stale
+    /// since they were computed.
+    void refreshWeights();
 
   public:
     /// \param type The WeightType that determines the underlying heuristic.
@@ -0,0 +1,656 @@
+//===-- StateSwapper.cpp --------------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "StateSwapper.h"
+
+#include "ExecutionState.h"
+#include "Memory.h"
+
+#include "klee/ADT/CopyOnWriteArray.h"
+#include "klee/Expr/Constraints.h"
+#include "klee/Expr/Expr.h"
+#include "klee/Module/Cell.h"
+#include "klee/Module/KModule.h"
+#include "klee/Support/ErrorHandling.h"
+
+#include "llvm/ADT/APInt.h"
+#include "llvm/Support/Errno.h"
+
+#include <cassert>
+#include <cerrno>
+#include <unordered_map>
+#include <utility>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace klee;
+
+namespace {
+
+/// Finds the expressions and update nodes that are referenced only by the
+/// roots of a record and by each other, i.e. that are freed along with the
+/// roots. All others stay in memory anyway and are kept by reference.
+class Exclusivity {
+  struct Info {
+    /// the number of references from the roots and from exclusive nodes
+    unsigned refs = 0;
+    bool shared = false;
+  };
+
+  std::unordered_map<const Expr *, Info> exprs;
+  std::unordered_map<const UpdateNode *, Info> nodes;
+  std::vector<const Expr *> exprQueue;
+  std::vector<const UpdateNode *> nodeQueue;
+
+  /// Calls f for each (non-null) node the expression references. The
+  /// references are passed as raw pointers, so that the reference counts
+  /// are not changed by temporaries.
+  template <typename ExprFn, typename NodeFn>
+  static void forEachKid(const Expr *e, ExprFn exprFn, NodeFn nodeFn) {
+    for (unsigned i = 0, n = e->getNumKids(); i != n; ++i) {
+      const Expr *kid = e->getKid(i).get();
+      exprFn(kid);
+    }
+    if (const ReadExpr *re = dyn_cast<ReadExpr>(e))
+      if (const UpdateNode *head = re->updates.head.get())
+        nodeFn(head);
+  }
+
+  template <typename ExprFn, typename NodeFn>
+  static void forEachKid(const UpdateNode *un, ExprFn exprFn, NodeFn nodeFn) {
+    if (const UpdateNode *next = un->next.get())
+      nodeFn(next);
+    exprFn(un->index.get());
+    exprFn(un->value.get());
+  }
+
+  void reference(const Expr *e) {
+    if (exprs[e].refs++ == 0)
+      exprQueue.push_back(e);
+  }
+  void reference(const UpdateNode *un) {
+    if (nodes[un].refs++ == 0)
+      nodeQueue.push_back(un);
+  }
+
+  /// Mark a node as shared if it is referenced from outside the roots.
+  template <typename T>
+  static void check(const T *node, Info &info, std::vector<const T *> &queue) {
+    if (!info.shared && node->_refCount.getCount() > info.refs)
+      queue.push_back(node);
+  }
+
+public:
+  void addRoot(const ref<Expr> &e) {
+    if (!e.isNull())
+      reference(e.get());
+  }
+  void addRoot(const UpdateList &updates) {
+    if (!updates.head.isNull())
+      reference(updates.head.get());
+  }
+
+  /// Determine the exclusive nodes, after all roots have been added.
+  void finish();
+
+  bool isExclusive(const Expr *e) const {
+    auto it = exprs.find(e);
+    return it != exprs.end() && !it->second.shared;
+  }
+  bool isExclusive(const UpdateNode *un) const {
+    auto it = nodes.find(un);
+    return it != nodes.end() && !it->second.shared;
+  }
+};
+
+void Exclusivity::finish() {
+  auto referenceExpr = [this](const Expr *e) { reference(e); };
+  auto referenceNode = [this](const UpdateNode *un) { reference(un); };
+  while (!exprQueue.empty() || !nodeQueue.empty()) {
+    if (!exprQueue.empty()) {
+      const Expr *e = exprQueue.back();
+      exprQueue.pop_back();
+      forEachKid(e, referenceExpr, referenceNode);
+    } else {
+      const UpdateNode *un = nodeQueue.back();
+      nodeQueue.pop_back();
+      forEachKid(un, referenceExpr, referenceNode);
+    }
+  }
+
+  // A shared node keeps everything it references alive as well.
+  for (auto &entry : exprs)
+    check(entry.first, entry.second, exprQueue);
+  for (auto &entry : nodes)
+    check(entry.first, entry.second, nodeQueue);
+  auto releaseExpr = [this](const Expr *e) {
+    Info &info = exprs[e];
+    --info.refs;
+    check(e, info, exprQueue);
+  };
+  auto releaseNode = [this](const UpdateNode *un) {
+    Info &info = nodes[un];
+    --info.refs;
+    check(un, info, nodeQueue);
+  };
+  while (!exprQueue.empty() || !nodeQueue.empty()) {
+    if (!exprQueue.empty()) {
+      const Expr *e = exprQueue.back();
+      exprQueue.pop_back();
+      Info &info = exprs[e];
+      if (info.shared)
+        continue;
+      info.shared = true;
+      forEachKid(e, releaseExpr, releaseNode);
+    } else {
+      const UpdateNode *un = nodeQueue.back();
+      nodeQueue.pop_back();
+      Info &info = nodes[un];
+      if (info.shared)
+        continue;
+      info.shared = true;
+      forEachKid(un, releaseExpr, releaseNode);
+    }
+  }
+}
+
+/// Serializes expressions into a byte buffer. Expressions and update nodes
+/// are numbered in the order they are defined or pinned; a reference is
+/// encoded as 0 followed by the definition for a new exclusive node, as 1
+/// for a new shared node (which is pinned instead) and as id + 2 otherwise.
+class SwapWriter {
+  const Exclusivity &exclusivity;
+  std::unordered_map<const Expr *, std::uint64_t> exprIds;
+  std::unordered_map<const UpdateNode *, std::uint64_t> nodeIds;
+
+public:
+  std::string buffer;
+  std::vector<ref<Expr>> pinned;
+  std::vector<ref<UpdateNode>> pinnedNodes;
+
+  explicit SwapWriter(const Exclusivity &exclusivity)
+      : exclusivity(exclusivity) {}
+
+  void writeInt(std::uint64_t value) {
+    do {
+      std::uint8_t byte = value & 0x7F;
+      value >>= 7;
+      buffer.push_back(static_cast<char>(value ? byte | 0x80 : byte));
+    } while (value);
+  }
+
+  void writePointer(const void *ptr) {
+    writeInt(reinterpret_cast<std::uintptr_t>(ptr));
+  }
+
+  void writeUpdates(const UpdateList &updates);
+  void writeExpr(const ref<Expr> &e);
+
+  /// Write a root, which may be null.
+  void writeRoot(const ref<Expr> &e) {
+    writeInt(!e.isNull());
+    if (!e.isNull())
+      writeExpr(e);
+  }
+};
+
+void SwapWriter::writeUpdates(const UpdateList &updates) {
+  writePointer(updates.root);
+
+  // Update lists share their tails, so only the exclusive nodes in front of
+  // the first one already written (or shared) are new. They are defined
+  // oldest first.
+  std::vector<const UpdateNode *> fresh;
+  const UpdateNode *un = updates.head.get();
+  for (; un && !nodeIds.count(un) && exclusivity.isExclusive(un);
+       un = un->next.get())
+    fresh.push_back(un);
+  if (!un) {
+    writeInt(0);
+  } else if (auto it = nodeIds.find(un); it != nodeIds.end()) {
+    writeInt(it->second + 2);
+  } else {
+    writeInt(1);
+    pinnedNodes.emplace_back(const_cast<UpdateNode *>(un));
+    nodeIds.emplace(un, nodeIds.size());
+  }
+  writeInt(fresh.size());
+  for (auto it = fresh.rbegin(), ie = fresh.rend(); it != ie; ++it) {
+    writeExpr((*it)->index);
+    writeExpr((*it)->value);
+    nodeIds.emplace(*it, nodeIds.size());
+  }
+}
+
+void SwapWriter::writeExpr(const ref<Expr> &e) {
+  auto it = exprIds.find(e.get());
+  if (it != exprIds.end()) {
+    writeInt(it->second + 2);
+    return;
+  }
+  if (!exclusivity.isExclusive(e.get())) {
+    writeInt(1);
+    pinned.push_back(e);
+    exprIds.emplace(e.get(), exprIds.size());
+    return;
+  }
+
+  writeInt(0);
+  writeInt(e->getKind());
+  switch (e->getKind()) {
+  case Expr::Constant: {
+    const llvm::APInt &value = cast<ConstantExpr>(e)->getAPValue();
+    writeInt(value.getBitWidth());
+    for (unsigned i = 0, n = value.getNumWords(); i != n; ++i)
+      writeInt(value.getRawData()[i]);
+    break;
+  }
+  case Expr::Read: {
+    const ReadExpr *re = cast<ReadExpr>(e);
+    writeUpdates(re->updates);
+    writeExpr(re->index);
+    break;
+  }
+  case Expr::Extract: {
+    const ExtractExpr *ee = cast<ExtractExpr>(e);
+    writeExpr(ee->expr);
+    writeInt(ee->offset);
+    writeInt(ee->width);
+    break;
+  }
+  case Expr::ZExt:
+  case Expr::SExt: {
+    const CastExpr *ce = cast<CastExpr>(e);
+    writeExpr(ce->src);
+    writeInt(ce->width);
+    break;
+  }
+  default:
+    for (unsigned i = 0, n = e->getNumKids(); i != n; ++i)
+      writeExpr(e->getKid(i));
+    break;
+  }
+  exprIds.emplace(e.get(), exprIds.size());
+}
+
+/// Deserializes what a SwapWriter wrote. Expressions are rebuilt with the
+/// alloc functions so that they are structurally identical to the originals.
+class SwapReader {
+  const char *pos, *end;
+  std::vector<ref<Expr>> exprs;
+  std::vector<ref<UpdateNode>> nodes;
+  std::vector<ref<Expr>>::const_iterator pinned;
+  std::vector<ref<UpdateNode>>::const_iterator pinnedNodes;
+
+public:
+  SwapReader(const std::string &buffer, const std::vector<ref<Expr>> &pinned,
+             const std::vector<ref<UpdateNode>> &pinnedNodes)
+      : pos(buffer.data()), end(buffer.data() + buffer.size()),
+        pinned(pinned.begin()), pinnedNodes(pinnedNodes.begin()) {}
+
+  std::uint64_t readInt() {
+    std::uint64_t value = 0;
+    for (unsigned shift = 0;; shift += 7) {
+      const std::uint8_t byte = readByte();
+      value |= static_cast<std::uint64_t>(byte & 0x7F) << shift;
+      if (!(byte & 0x80))
+        return value;
+    }
+  }
+
+  std::uint8_t readByte() {
+    assert(pos != end && "truncated swap record");
+    return *pos++;
+  }
+
+  template <typename T> T *readPointer() {
+    return reinterpret_cast<T *>(static_cast<std::uintptr_t>(readInt()));
+  }
+
+  UpdateList readUpdates();
+  ref<Expr> readExpr();
+
+  ref<Expr> readRoot() { return readInt() ? readExpr() : nullptr; }
+};
+
+UpdateList SwapReader::readUpdates() {
+  const Array *root = readPointer<const Array>();
+  ref<UpdateNode> head;
+  if (const std::uint64_t base = readInt(); base == 1) {
+    head = *pinnedNodes++;
+    nodes.push_back(head);
+  } else if (base) {
+    head = nodes[base - 2];
+  }
+  for (std::uint64_t i = 0, n = readInt(); i != n; ++i) {
+    ref<Expr> index = readExpr();
+    ref<Expr> value = readExpr();
+    head = new UpdateNode(head, index, value);
+    nodes.push_back(head);
+  }
+  return UpdateList(root, head);
+}
+
+ref<Expr> SwapReader::readExpr() {
+  if (const std::uint64_t id = readInt(); id == 1) {
+    exprs.push_back(*pinned++);
+    return exprs.back();
+  } else if (id) {
+    return exprs[id - 2];
+  }
+
+  ref<Expr> e;
+  const auto kind = static_cast<Expr::Kind>(readInt());
+  switch (kind) {
+  case Expr::Constant: {
+    const unsigned width = readInt();
+    std::vector<std::uint64_t> words((width + 63) / 64);
+    for (auto &word : words)
+      word = readInt();
+    e = ConstantExpr::alloc(llvm::APInt(width, words));
+    break;
+  }
+  case Expr::NotOptimized:
+    e = NotOptimizedExpr::alloc(readExpr());
+    break;
+  case Expr::Read: {
+    UpdateList updates = readUpdates();
+    e = ReadExpr::alloc(updates, readExpr());
+    break;
+  }
+  case Expr::Select: {
+    ref<Expr> cond = readExpr();
+    ref<Expr> trueExpr = readExpr();
+    e = SelectExpr::alloc(cond, trueExpr, readExpr());
+    break;
+  }
+  case Expr::Concat: {
+    ref<Expr> left = readExpr();
+    e = ConcatExpr::alloc(left, readExpr());
+    break;
+  }
+  case Expr::Extract: {
+    ref<Expr> expr = readExpr();
+    const unsigned offset = readInt();
+    e = ExtractExpr::alloc(expr, offset, readInt());
+    break;
+  }
+  case Expr::ZExt: {
+    ref<Expr> src = readExpr();
+    e = ZExtExpr::alloc(src, readInt());
+    break;
+  }
+  case Expr::SExt: {
+    ref<Expr> src = readExpr();
+    e = SExtExpr::alloc(src, readInt());
+    break;
+  }
+  case Expr::Not:
+    e = NotExpr::alloc(readExpr());
+    break;
+
+#define BINARY_EXPR_CASE(T)                                                    \
+  case Expr::T: {                                                              \
+    ref<Expr> left = readExpr();                                               \
+    e = T##Expr::alloc(left, readExpr());                                      \
+    break;                                                                     \
+  }
+
+    BINARY_EXPR_CASE(Add)
+    BINARY_EXPR_CASE(Sub)
+    BINARY_EXPR_CASE(Mul)
+    BINARY_EXPR_CASE(UDiv)
+    BINARY_EXPR_CASE(SDiv)
+    BINARY_EXPR_CASE(URem)
+    BINARY_EXPR_CASE(SRem)
+    BINARY_EXPR_CASE(And)
+    BINARY_EXPR_CASE(Or)
+    BINARY_EXPR_CASE(Xor)
+    BINARY_EXPR_CASE(Shl)
+    BINARY_EXPR_CASE(LShr)
+    BINARY_EXPR_CASE(AShr)
+    BINARY_EXPR_CASE(Eq)
+    BINARY_EXPR_CASE(Ne)
+    BINARY_EXPR_CASE(Ult)
+    BINARY_EXPR_CASE(Ule)
+    BINARY_EXPR_CASE(Ugt)
+    BINARY_EXPR_CASE(Uge)
+    BINARY_EXPR_CASE(Slt)
+    BINARY_EXPR_CASE(Sle)
+    BINARY_EXPR_CASE(Sgt)
+    BINARY_EXPR_CASE(Sge)
+#undef BINARY_EXPR_CASE
+
+  default:
+    assert(0 && "invalid expression kind in swap record");
+  }
+  exprs.push_back(e);
+  return e;
+}
+
+/// Write the chunks of the array no other array shares, each as a flag
+/// followed by its elements.
+template <typename T, unsigned ChunkSize, typename WriteFn>
+void writeChunks(SwapWriter &writer, const CopyOnWriteArray<T, ChunkSize> &array,
+                 WriteFn write) {
+  for (unsigned c = 0, n = array.getNumChunks(); c != n; ++c) {
+    const bool exclusive = array.isChunkExclusive(c);
+    writer.writeInt(exclusive);
+    if (!exclusive)
+      continue;
+    const unsigned begin = array.getChunkBegin(c);
+    for (unsigned i = begin, e = begin + array.getChunkSize(c); i != e; ++i)
+      write(array[i]);
+  }
+}
+
+template <typename T, unsigned ChunkSize>
+void releaseChunks(CopyOnWriteArray<T, ChunkSize> &array) {
+  for (unsigned c = 0, n = array.getNumChunks(); c != n; ++c)
+    if (array.isChunkExclusive(c))
+      array.releaseChunk(c);
+}
+
+/// Restore the chunks written by writeChunks.
+template <typename T, unsigned ChunkSize, typename ReadFn>
+void readChunks(SwapReader &reader, CopyOnWriteArray<T, ChunkSize> &array,
+                ReadFn read) {
+  std::vector<T> elements;
+  for (unsigned c = 0, n = array.getNumChunks(); c != n; ++c) {
+    if (!reader.readInt())
+      continue;
+    elements.resize(array.getChunkSize(c));
+    for (auto &element : elements)
+      element = read();
+    array.restoreChunk(c, elements.data());
+  }
+}
+
+} // namespace
+
+StateSwapper::StateSwapper(std::string path) : path(std::move(path)) {
+  fd = ::open(this->path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0)
+    klee_error("unable to open swap file %s: %s", this->path.c_str(),
+               llvm::sys::StrError(errno).c_str());
+}
+
+StateSwapper::~StateSwapper() {
+  ::close(fd);
+  ::unlink(path.c_str());
+}
+
+bool StateSwapper::swapOut(ExecutionState &state) {
+  assert(!isSwappedOut(state) && "state already swapped out");
+
+  Record record;
+  // The models trivially satisfy no constraints, so the copy of the
+  // constraints they are known to satisfy can be dropped (it would keep all
+  // constraint chunks referenced).
+  record.keepModels =
+      state.constraints.isCopyOf(state.queryMetaData.modelConstraints);
+  state.queryMetaData.modelConstraints = ConstraintSet();
+
+  const std::size_t numSharedConstraints = state.constraints.getSharedSize();
+  for (const auto &entry : state.addressSpace.objects)
+    if (state.addressSpace.isOwned(entry.second.get()))
+      record.objects.push_back(entry.second);
+
+  Exclusivity exclusivity;
+  std::size_t index = 0;
+  for (const auto &constraint : state.constraints)
+    if (index++ >= numSharedConstraints)
+      exclusivity.addRoot(constraint);
+  for (const auto &frame : state.stack)
+    for (unsigned i = 0, n = frame.kf->numRegisters; i != n; ++i)
+      exclusivity.addRoot(frame.locals[i].value);
+  for (const auto &os : record.objects) {
+    exclusivity.addRoot(os->updates);
+    if (const auto &symbolics = os->knownSymbolics)
+      for (unsigned c = 0, n = symbolics->getNumChunks(); c != n; ++c)
+        if (symbolics->isChunkExclusive(c))
+          for (unsigned i = symbolics->getChunkBegin(c),
+                        e = i + symbolics->getChunkSize(c);
+               i != e; ++i)
+            exclusivity.addRoot((*symbolics)[i]);
+  }
+  exclusivity.finish();
+
+  SwapWriter writer(exclusivity);
+  writer.writeInt(state.constraints.size() - numSharedConstraints);
+  index = 0;
+  for (const auto &constraint : state.constraints)
+    if (index++ >= numSharedConstraints)
+      writer.writeRoot(constraint);
+
+  for (const auto &frame : state.stack)
+    for (unsigned i = 0, n = frame.kf->numRegisters; i != n; ++i)
+      writer.writeRoot(frame.locals[i].value);
+
+  auto writeWord = [&writer](std::uint32_t word) { writer.writeInt(word); };
+  writer.writeInt(record.objects.size());
+  for (const auto &os : record.objects) {
+    writer.writeUpdates(os->updates);
+    writeChunks(writer, os->concreteStore, [&writer](std::uint8_t byte) {
+      writer.buffer.push_back(static_cast<char>(byte));
+    });
+    if (os->concreteMask)
+      writeChunks(writer, os->concreteMask->getWords(), writeWord);
+    if (os->unflushedMask)
+      writeChunks(writer, os->unflushedMask->getWords(), writeWord);
+    if (os->knownSymbolics)
+      writeChunks(writer, *os->knownSymbolics,
+                  [&writer](const ref<Expr> &e) { writer.writeRoot(e); });
+  }
+
+  record.offset = fileSize;
+  record.length = writer.buffer.size();
+  const char *data = writer.buffer.data();
+  for (std::uint64_t written = 0; written < record.length;) {
+    ssize_t n = ::pwrite(fd, data + written, record.length - written,
+                         record.offset + written);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0) {
+      klee_warning("unable to write swap file %s: %s", path.c_str(),
+                   llvm::sys::StrError(errno).c_str());
+      if (record.keepModels)
+        state.resetModelConstraints(true);
+      return false;
+    }
+    written += n;
+  }
+  fileSize += record.length;
+
+  // Drop the contents now that they are safely on disk.
+  record.sharedConstraints = state.constraints.getPrefix(numSharedConstraints);
+  state.constraints = ConstraintSet();
+  for (auto &frame : state.stack)
+    for (unsigned i = 0, n = frame.kf->numRegisters; i != n; ++i)
+      frame.locals[i].value = nullptr;
+  for (const auto &os : record.objects) {
+    os->updates.head = nullptr;
+    releaseChunks(os->concreteStore);
+    if (os->concreteMask)
+      releaseChunks(os->concreteMask->getWords());
+    if (os->unflushedMask)
+      releaseChunks(os->unflushedMask->getWords());
+    if (os->knownSymbolics)
+      releaseChunks(*os->knownSymbolics);
+    state.addressSpace.unbindObject(os->getObject());
+  }
+  record.pinned = std::move(writer.pinned);
+  record.pinnedNodes = std::move(writer.pinnedNodes);
+
+  records.emplace(&state, std::move(record));
+  return true;
+}
+
+void StateSwapper::swapIn(ExecutionState &state) {
+  auto it = records.find(&state);
+  if (it == records.end())
+    return;
+  const Record &record = it->second;
+
+  std::string buffer(record.length, '\0');
+  for (std::uint64_t read = 0; read < record.length;) {
+    ssize_t n = ::pread(fd, &buffer[read], record.length - read,
+                        record.offset + read);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      klee_error("unable to read swap file %s: %s", path.c_str(),
+                 llvm::sys::StrError(errno).c_str());
+    read += n;
+  }
+
+  SwapReader reader(buffer, record.pinned, record.pinnedNodes);
+  ConstraintSet constraints = record.sharedConstraints;
+  for (std::uint64_t i = 0, n = reader.readInt(); i != n; ++i)
+    constraints.push_back(reader.readRoot());
+  state.constraints = std::move(constraints);
+  state.resetModelConstraints(record.keepModels);
+
+  for (auto &frame : state.stack)
+    for (unsigned i = 0, n = frame.kf->numRegisters; i != n; ++i)
+      frame.locals[i].value = reader.readRoot();
+
+  auto readWord = [&reader]() {
+    return static_cast<std::uint32_t>(reader.readInt());
+  };
+  [[maybe_unused]] const std::uint64_t numObjects = reader.readInt();
+  assert(numObjects == record.objects.size());
+  for (const auto &os : record.objects) {
+    os->updates = reader.readUpdates();
+    readChunks(reader, os->concreteStore,
+               [&reader]() { return reader.readByte(); });
+    if (os->concreteMask)
+      readChunks(reader, os->concreteMask->getWords(), readWord);
+    if (os->unflushedMask)
+      readChunks(reader, os->unflushedMask->getWords(), readWord);
+    if (os->knownSymbolics)
+      readChunks(reader, *os->knownSymbolics,
+                 [&reader]() { return reader.readRoot(); });
+
+    os->copyOnWriteOwner = 0;
+    state.addressSpace.bindObject(os->getObject(), os.get());
+  }
+
+  forget(state);
+}
+
+void StateSwapper::forget(const ExecutionState &state) {
+  if (!records.erase(&state) || !records.empty())
+    return;
+
+  // Space of swapped in records is only reclaimed once none is left.
+  if (::ftruncate(fd, 0) == 0)
+    fileSize = 0;
+}
@@ -0,0 +1,91 @@
+//===-- StateSwapper.h ------------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_STATESWAPPER_H
+#define KLEE_STATESWAPPER_H
+
+#include "klee/ADT/Ref.h"
+#include "klee/Expr/Constraints.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace klee {
+class ExecutionState;
+class Expr;
+class ObjectState;
+class UpdateNode;
+
+/// Moves the contents of idle execution states into a swap file and back,
+/// so that states need not be terminated when memory runs short.
+///
+/// Only what is freed along with the state is swapped out: the constraint
+/// chunks, objects (and chunks of their contents) and stack values no other
+/// state shares, and the expressions and update nodes referenced from
+/// nowhere else. Everything shared stays in memory anyway, so it is kept by
+/// reference and linked back on swap-in rather than duplicated. The
+/// remaining shell of the state (stack frames, symbolics, allocators, ...)
+/// stays in memory, so that searchers and the process tree can keep using
+/// it.
+///
+/// Arrays are referenced by their in-process address, they live as long as
+/// the ArrayCache.
+class StateSwapper {
+  struct Record {
+    std::uint64_t offset;
+    std::uint64_t length;
+    /// the leading constraints shared with other states
+    ConstraintSet sharedConstraints;
+    /// whether the models of the state satisfied all its constraints
+    bool keepModels;
+    /// shared expressions and update nodes, in the order they are referenced
+    /// by the record
+    std::vector<ref<Expr>> pinned;
+    std::vector<ref<UpdateNode>> pinnedNodes;
+    /// swapped out objects (with their exclusive chunks released), in the
+    /// order they are written to the record
+    std::vector<ref<ObjectState>> objects;
+  };
+
+  std::string path;
+  int fd;
+  std::uint64_t fileSize = 0;
+  std::unordered_map<const ExecutionState *, Record> records;
+
+public:
+  /// Creates (or truncates) the swap file at the given path.
+  explicit StateSwapper(std::string path);
+  ~StateSwapper();
+
+  StateSwapper(const StateSwapper &) = delete;
+  StateSwapper &operator=(const StateSwapper &) = delete;
+
+  bool isSwappedOut(const ExecutionState &state) const {
+    return !records.empty() && records.count(&state);
+  }
+  std::size_t getNumSwappedOut() const { return records.size(); }
+
+  /// Write the exclusive contents of the state to the swap file and drop
+  /// them from memory. The state must not be executed until swapped in.
+  /// \return false if the swap file could not be written, in which case the
+  /// state is left unchanged.
+  bool swapOut(ExecutionState &state);
+
+  /// Restore a swapped out state (nothing happens for resident states).
+  void swapIn(ExecutionState &state);
+
+  /// Drop the swapped out contents of a state that is about to be deleted.
+  void forget(const ExecutionState &state);
+};
+} // namespace klee
+
+#endif /* KLEE_STATESWAPPER_H */
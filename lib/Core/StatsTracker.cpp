@@ -26,6 +26,7 @@
 #include "CoreStats.h"
 #include "Executor.h"
 #include "MemoryManager.h"
+#include "UncoveredDistance.h"
 #include "UserSearcher.h"
 
 #include "klee/Support/CompilerWarning.h"
@@ -36,6 +37,7 @@ DISABLE_WARNING_DEPRECATED_DECLARATIONS
 #include "llvm/IR/CFG.h"
 #include "llvm/IR/Function.h"
 #include "llvm/IR/InlineAsm.h"
+#include "llvm/IR/InstIterator.h"
 #include "llvm/IR/Instructions.h"
 #include "llvm/IR/IntrinsicInst.h"
 #include "llvm/IR/Module.h"
@@ -46,7 +48,9 @@ DISABLE_WARNING_DEPRECATED_DECLARATIONS
 #include "llvm/Support/Process.h"
 DISABLE_WARNING_POP
 
+#include <algorithm>
 #include <fstream>
+#include <map>
 #include <unistd.h>
 
 using namespace klee;
@@ -159,6 +163,42 @@ std::string sqlite3ErrToStringAndFree(const std::string& prefix , char* sqlite3E
   return sstream.str();
 }
 
+/// A defined function of the module as written to run.istats.
+struct IStatsFunctionInfo {
+  struct Instr {
+    const InstructionInfo *info;
+    /// The instruction if it is a call site, null otherwise
+    const Instruction *callSite;
+  };
+
+  const std::string *file;
+  std::string name;
+  std::vector<Instr> instructions;
+};
+
+struct StatsTracker::IStatsLayout {
+  std::string moduleIdentifier;
+  std::vector<IStatsFunctionInfo> functions;
+};
+
+/// The statistics of a run.istats write, taken on the interpreter thread.
+struct StatsTracker::IStatsSnapshot {
+  /// Statistics of a callee called at a call site
+  struct Call {
+    const std::string *file;
+    std::string name;
+    unsigned count;
+    uint64_t assemblyLine;
+    unsigned line;
+    std::vector<uint64_t> values;
+  };
+
+  /// values[id * istatsIDs.size() + i] is statistic istatsIDs[i] of the
+  /// instruction with the given id
+  std::vector<uint64_t> values;
+  std::map<const Instruction *, std::vector<Call>> calls;
+};
+
 StatsTracker::StatsTracker(Executor &_executor, std::string _objectFilename,
                            bool _updateMinDistToUncovered)
   : executor(_executor),
@@ -224,7 +264,11 @@ StatsTracker::StatsTracker(Executor &_executor, std::string _objectFilename,
     }
   }
 
+  if (useStatistics())
+    writer = std::make_unique<BackgroundWorker>();
+
   if (OutputStats) {
+    // the database is only used by one thread at a time
     sqlite3_config(SQLITE_CONFIG_SINGLETHREAD);
 
     // open database
@@ -283,6 +327,32 @@ StatsTracker::StatsTracker(Executor &_executor, std::string _objectFilename,
   }
 
   if (OutputIStats) {
+    StatisticManager &sm = *theStatisticManager;
+    for (const char *name :
+         {"Queries", "QueriesValid", "QueriesInvalid", "QueryTime",
+          "ResolveTime", "Instructions", "InstructionTimes",
+          "InstructionRealTimes", "Forks", "CoveredInstructions",
+          "UncoveredInstructions", "States", "MinDistToUncovered"})
+      istatsIDs.push_back(sm.getStatisticID(name));
+    std::sort(istatsIDs.begin(), istatsIDs.end());
+
+    istatsLayout = std::make_unique<IStatsLayout>();
+    const auto m = km->module.get();
+    istatsLayout->moduleIdentifier = m->getModuleIdentifier();
+    for (Function &fn : *m) {
+      if (fn.isDeclaration())
+        continue;
+      IStatsFunctionInfo fi;
+      fi.file = &km->infos->getFunctionInfo(fn).file;
+      fi.name = fn.getName().str();
+      for (Instruction &instr : instructions(fn)) {
+        const bool isCall = isa<CallInst>(instr) || isa<InvokeInst>(instr);
+        fi.instructions.push_back(
+            {&km->infos->getInfo(instr), isCall ? &instr : nullptr});
+      }
+      istatsLayout->functions.push_back(std::move(fi));
+    }
+
     istatsFile = executor.interpreterHandler->openOutputFile("run.istats");
     if (istatsFile) {
       if (iStatsWriteInterval)
@@ -295,7 +365,10 @@ StatsTracker::StatsTracker(Executor &_executor, std::string _objectFilename,
   }
 }
 
-StatsTracker::~StatsTracker() {  
+StatsTracker::~StatsTracker() {
+  // finish all pending writes
+  writer.reset();
+
   if (statsFile) {
     auto rc = sqlite3_step(transactionEndStmt);
     if (rc != SQLITE_DONE) {
@@ -316,9 +389,15 @@ void StatsTracker::done() {
   if (OutputIStats) {
     if (updateMinDistToUncovered)
       computeReachableUncovered();
-    if (istatsFile)
+    if (istatsFile) {
+      // do not skip the final write because of an earlier pending one
+      writer->wait();
       writeIStats();
+    }
   }
+
+  if (writer)
+    writer->wait();
 }
 
 void StatsTracker::stepInstruction(ExecutionState &es) {
@@ -363,6 +442,8 @@ void StatsTracker::stepInstruction(ExecutionState &es) {
         es.instsSinceCovNew = 1;
 	++stats::coveredInstructions;
 	stats::uncoveredInstructions += (uint64_t)-1;
+        if (uncoveredDistance)
+          uncoveredDistance->markCovered(ii.id);
       }
     }
   }
@@ -440,7 +521,8 @@ void StatsTracker::writeStatsHeader() {
   #undef TCLASS
   #define TCLASS(Name,I) << "Termination" #Name " INTEGER,"
   std::ostringstream create, insert;
-  create << "CREATE TABLE stats ("
+  // a resumed run (see Checkpoint) appends to the table of the run before
+  create << "CREATE TABLE IF NOT EXISTS stats ("
          << "Instructions INTEGER,"
          << "FullBranches INTEGER,"
          << "PartialBranches INTEGER,"
@@ -463,6 +545,7 @@ void StatsTracker::writeStatsHeader() {
          << "QueryCacheHits INTEGER,"
          << "QueryCexCacheMisses INTEGER,"
          << "QueryCexCacheHits INTEGER,"
+         << "QueryModelHits INTEGER,"
          << "InhibitedForks INTEGER,"
          << "ExternalCalls INTEGER,"
          << "Allocations INTEGER,"
@@ -509,6 +592,7 @@ void StatsTracker::writeStatsHeader() {
          << "QueryCacheHits,"
          << "QueryCexCacheMisses,"
          << "QueryCexCacheHits,"
+         << "QueryModelHits,"
          << "InhibitedForks,"
          << "ExternalCalls,"
          << "Allocations,"
@@ -548,6 +632,7 @@ void StatsTracker::writeStatsHeader() {
          << "?,"
          << "?,"
          << "?,"
+         << "?,"
          BRANCH_TYPES
          TERMINATION_CLASSES
          << "? "
@@ -564,43 +649,52 @@ time::Span StatsTracker::elapsed() {
 
 void StatsTracker::writeStatsLine() {
   #undef BTYPE
-  #define BTYPE(Name,I) sqlite3_bind_int64(insertStmt, arg++, stats::branches ## Name);
+  #define BTYPE(Name,I) row.push_back(stats::branches ## Name);
   #undef TCLASS
-  #define TCLASS(Name,I) sqlite3_bind_int64(insertStmt, arg++, stats::termination ## Name);
-  int arg = 1;
-  sqlite3_bind_int64(insertStmt, arg++, stats::instructions);
-  sqlite3_bind_int64(insertStmt, arg++, fullBranches);
-  sqlite3_bind_int64(insertStmt, arg++, partialBranches);
-  sqlite3_bind_int64(insertStmt, arg++, numBranches);
-  sqlite3_bind_int64(insertStmt, arg++, time::getUserTime().toMicroseconds());
-  sqlite3_bind_int64(insertStmt, arg++, executor.states.size());
-  sqlite3_bind_int64(insertStmt, arg++, util::GetTotalMallocUsage() + executor.memory->getUsedDeterministicSize());
-  sqlite3_bind_int64(insertStmt, arg++, stats::queries);
-  sqlite3_bind_int64(insertStmt, arg++, stats::solverQueries);
-  sqlite3_bind_int64(insertStmt, arg++, stats::queryConstructs);
-  sqlite3_bind_int64(insertStmt, arg++, elapsed().toMicroseconds());
-  sqlite3_bind_int64(insertStmt, arg++, stats::coveredInstructions);
-  sqlite3_bind_int64(insertStmt, arg++, stats::uncoveredInstructions);
-  sqlite3_bind_int64(insertStmt, arg++, stats::queryTime);
-  sqlite3_bind_int64(insertStmt, arg++, stats::solverTime);
-  sqlite3_bind_int64(insertStmt, arg++, stats::cexCacheTime);
-  sqlite3_bind_int64(insertStmt, arg++, stats::forkTime);
-  sqlite3_bind_int64(insertStmt, arg++, stats::resolveTime);
-  sqlite3_bind_int64(insertStmt, arg++, stats::queryCacheMisses);
-  sqlite3_bind_int64(insertStmt, arg++, stats::queryCacheHits);
-  sqlite3_bind_int64(insertStmt, arg++, stats::queryCexCacheMisses);
-  sqlite3_bind_int64(insertStmt, arg++, stats::queryCexCacheHits);
-  sqlite3_bind_int64(insertStmt, arg++, stats::inhibitedForks);
-  sqlite3_bind_int64(insertStmt, arg++, stats::externalCalls);
-  sqlite3_bind_int64(insertStmt, arg++, stats::allocations);
-  sqlite3_bind_int64(insertStmt, arg++, ExecutionState::getLastID());
+  #define TCLASS(Name,I) row.push_back(stats::termination ## Name);
+  std::vector<std::int64_t> row;
+  row.push_back(stats::instructions);
+  row.push_back(fullBranches);
+  row.push_back(partialBranches);
+  row.push_back(numBranches);
+  row.push_back(time::getUserTime().toMicroseconds());
+  row.push_back(executor.states.size());
+  row.push_back(util::GetTotalMallocUsage() + executor.memory->getUsedDeterministicSize());
+  row.push_back(stats::queries);
+  row.push_back(stats::solverQueries);
+  row.push_back(stats::queryConstructs);
+  row.push_back(elapsed().toMicroseconds());
+  row.push_back(stats::coveredInstructions);
+  row.push_back(stats::uncoveredInstructions);
+  row.push_back(stats::queryTime);
+  row.push_back(stats::solverTime);
+  row.push_back(stats::cexCacheTime);
+  row.push_back(stats::forkTime);
+  row.push_back(stats::resolveTime);
+  row.push_back(stats::queryCacheMisses);
+  row.push_back(stats::queryCacheHits);
+  row.push_back(stats::queryCexCacheMisses);
+  row.push_back(stats::queryCexCacheHits);
+  row.push_back(stats::queryModelHits);
+  row.push_back(stats::inhibitedForks);
+  row.push_back(stats::externalCalls);
+  row.push_back(stats::allocations);
+  row.push_back(ExecutionState::getLastID());
   BRANCH_TYPES
   TERMINATION_CLASSES
 #ifdef KLEE_ARRAY_DEBUG
-  sqlite3_bind_int64(insertStmt, arg++, stats::arrayHashTime);
+  row.push_back(stats::arrayHashTime);
 #else
-  sqlite3_bind_int64(insertStmt, arg++, -1LL);
+  row.push_back(-1LL);
 #endif
+
+  writer->post([this, row = std::move(row)]() { insertStatsLine(row); });
+}
+
+void StatsTracker::insertStatsLine(const std::vector<std::int64_t> &row) {
+  int arg = 1;
+  for (std::int64_t value : row)
+    sqlite3_bind_int64(insertStmt, arg++, value);
   int errCode = sqlite3_step(insertStmt);
   if(errCode != SQLITE_DONE) klee_error("Error writing stats data: %s", sqlite3_errmsg(statsFile));
   sqlite3_reset(insertStmt);
@@ -630,7 +724,59 @@ void StatsTracker::updateStateStatistics(uint64_t addend) {
 }
 
 void StatsTracker::writeIStats() {
-  const auto m = executor.kmodule->module.get();
+  // Writing a snapshot takes long on big modules; rather skip a write than
+  // pile up snapshots.
+  if (istatsPending.exchange(true))
+    return;
+
+  auto snapshot = std::make_shared<IStatsSnapshot>();
+  StatisticManager &sm = *theStatisticManager;
+
+  // set state counts, decremented after we process so that we don't
+  // have to zero all records each time.
+  const bool trackStates = std::binary_search(
+      istatsIDs.begin(), istatsIDs.end(), stats::states.getID());
+  if (trackStates)
+    updateStateStatistics(1);
+
+  sm.getIndexedValues(istatsIDs, snapshot->values);
+
+  if (UseCallPaths) {
+    CallSiteSummaryTable callSiteStats;
+    callPathManager.getSummaryStatistics(callSiteStats);
+    for (auto &site : callSiteStats) {
+      auto &calls = snapshot->calls[site.first];
+      for (auto &callee : site.second) {
+        const FunctionInfo &fii =
+            executor.kmodule->infos->getFunctionInfo(*callee.first);
+        IStatsSnapshot::Call call{&fii.file,
+                                  callee.first->getName().str(),
+                                  callee.second.count,
+                                  fii.assemblyLine,
+                                  fii.line,
+                                  {}};
+        for (unsigned id : istatsIDs) {
+          Statistic &s = sm.getStatistic(id);
+          // Hack, ignore things that don't make sense on call paths.
+          call.values.push_back(&s == &stats::uncoveredInstructions
+                                    ? 0
+                                    : callee.second.statistics.getValue(s));
+        }
+        calls.push_back(std::move(call));
+      }
+    }
+  }
+
+  if (trackStates)
+    updateStateStatistics((uint64_t)-1);
+
+  writer->post([this, snapshot]() {
+    writeIStatsSnapshot(*snapshot);
+    istatsPending = false;
+  });
+}
+
+void StatsTracker::writeIStatsSnapshot(const IStatsSnapshot &snapshot) {
   llvm::raw_fd_ostream &of = *istatsFile;
   
   // We assume that we didn't move the file pointer
@@ -641,137 +787,73 @@ void StatsTracker::writeIStats() {
   of << "version: 1\n";
   of << "creator: klee\n";
   of << "pid: " << getpid() << "\n";
-  of << "cmd: " << m->getModuleIdentifier() << "\n\n";
+  of << "cmd: " << istatsLayout->moduleIdentifier << "\n\n";
   of << "\n";
 
   StatisticManager &sm = *theStatisticManager;
-  unsigned nStats = sm.getNumStatistics();
-  llvm::SmallBitVector istatsMask(nStats);
-
-  istatsMask.set(sm.getStatisticID("Queries"));
-  istatsMask.set(sm.getStatisticID("QueriesValid"));
-  istatsMask.set(sm.getStatisticID("QueriesInvalid"));
-  istatsMask.set(sm.getStatisticID("QueryTime"));
-  istatsMask.set(sm.getStatisticID("ResolveTime"));
-  istatsMask.set(sm.getStatisticID("Instructions"));
-  istatsMask.set(sm.getStatisticID("InstructionTimes"));
-  istatsMask.set(sm.getStatisticID("InstructionRealTimes"));
-  istatsMask.set(sm.getStatisticID("Forks"));
-  istatsMask.set(sm.getStatisticID("CoveredInstructions"));
-  istatsMask.set(sm.getStatisticID("UncoveredInstructions"));
-  istatsMask.set(sm.getStatisticID("States"));
-  istatsMask.set(sm.getStatisticID("MinDistToUncovered"));
+  const unsigned nStats = istatsIDs.size();
 
   of << "positions: instr line\n";
 
-  for (unsigned i=0; i<nStats; i++) {
-    if (istatsMask.test(i)) {
-      Statistic &s = sm.getStatistic(i);
-      of << "event: " << s.getShortName() << " : " 
-         << s.getName() << "\n";
-    }
+  for (unsigned id : istatsIDs) {
+    Statistic &s = sm.getStatistic(id);
+    of << "event: " << s.getShortName() << " : " 
+       << s.getName() << "\n";
   }
 
   of << "events: ";
-  for (unsigned i=0; i<nStats; i++) {
-    if (istatsMask.test(i))
-      of << sm.getStatistic(i).getShortName() << " ";
-  }
+  for (unsigned id : istatsIDs)
+    of << sm.getStatistic(id).getShortName() << " ";
   of << "\n";
   
-  // set state counts, decremented after we process so that we don't
-  // have to zero all records each time.
-  if (istatsMask.test(stats::states.getID()))
-    updateStateStatistics(1);
-
   std::string sourceFile = "";
 
-  CallSiteSummaryTable callSiteStats;
-  if (UseCallPaths)
-    callPathManager.getSummaryStatistics(callSiteStats);
-
   of << "ob=" << llvm::sys::path::filename(objectFilename).str() << "\n";
 
-  for (Module::iterator fnIt = m->begin(), fn_ie = m->end(); 
-       fnIt != fn_ie; ++fnIt) {
-    if (!fnIt->isDeclaration()) {
-      // Always try to write the filename before the function name, as otherwise
-      // KCachegrind can create two entries for the function, one with an
-      // unnamed file and one without.
-      Function *fn = &*fnIt;
-      const FunctionInfo &ii = executor.kmodule->infos->getFunctionInfo(*fn);
-      if (ii.file != sourceFile) {
+  for (const auto &fn : istatsLayout->functions) {
+    // Always try to write the filename before the function name, as otherwise
+    // KCachegrind can create two entries for the function, one with an
+    // unnamed file and one without.
+    if (*fn.file != sourceFile) {
+      of << "fl=" << *fn.file << "\n";
+      sourceFile = *fn.file;
+    }
+      
+    of << "fn=" << fn.name << "\n";
+    for (const auto &instr : fn.instructions) {
+      const InstructionInfo &ii = *instr.info;
+      if (ii.file!=sourceFile) {
         of << "fl=" << ii.file << "\n";
         sourceFile = ii.file;
       }
-      
-      of << "fn=" << fnIt->getName().str() << "\n";
-      for (Function::iterator bbIt = fnIt->begin(), bb_ie = fnIt->end(); 
-           bbIt != bb_ie; ++bbIt) {
-        for (BasicBlock::iterator it = bbIt->begin(), ie = bbIt->end(); 
-             it != ie; ++it) {
-          Instruction *instr = &*it;
-          const InstructionInfo &ii = executor.kmodule->infos->getInfo(*instr);
-          unsigned index = ii.id;
-          if (ii.file!=sourceFile) {
-            of << "fl=" << ii.file << "\n";
-            sourceFile = ii.file;
-          }
-          of << ii.assemblyLine << " ";
-          of << ii.line << " ";
-          for (unsigned i=0; i<nStats; i++)
-            if (istatsMask.test(i))
-              of << sm.getIndexedValue(sm.getStatistic(i), index) << " ";
-          of << "\n";
-
-          if (UseCallPaths && 
-              (isa<CallInst>(instr) || isa<InvokeInst>(instr))) {
-            CallSiteSummaryTable::iterator it = callSiteStats.find(instr);
-            if (it!=callSiteStats.end()) {
-              for (auto fit = it->second.begin(), fie = it->second.end();
-                   fit != fie; ++fit) {
-                const Function *f = fit->first;
-                CallSiteInfo &csi = fit->second;
-                const FunctionInfo &fii =
-                    executor.kmodule->infos->getFunctionInfo(*f);
-
-                if (fii.file!="" && fii.file!=sourceFile)
-                  of << "cfl=" << fii.file << "\n";
-                of << "cfn=" << f->getName().str() << "\n";
-                of << "calls=" << csi.count << " ";
-                of << fii.assemblyLine << " ";
-                of << fii.line << "\n";
-
-                of << ii.assemblyLine << " ";
-                of << ii.line << " ";
-                for (unsigned i=0; i<nStats; i++) {
-                  if (istatsMask.test(i)) {
-                    Statistic &s = sm.getStatistic(i);
-                    uint64_t value;
-
-                    // Hack, ignore things that don't make sense on
-                    // call paths.
-                    if (&s == &stats::uncoveredInstructions) {
-                      value = 0;
-                    } else {
-                      value = csi.statistics.getValue(s);
-                    }
-
-                    of << value << " ";
-                  }
-                }
-                of << "\n";
-              }
-            }
-          }
-        }
+      of << ii.assemblyLine << " ";
+      of << ii.line << " ";
+      for (unsigned i=0; i<nStats; i++)
+        of << snapshot.values[ii.id * nStats + i] << " ";
+      of << "\n";
+
+      if (!instr.callSite)
+        continue;
+      auto it = snapshot.calls.find(instr.callSite);
+      if (it == snapshot.calls.end())
+        continue;
+      for (const auto &call : it->second) {
+        if (*call.file!="" && *call.file!=sourceFile)
+          of << "cfl=" << *call.file << "\n";
+        of << "cfn=" << call.name << "\n";
+        of << "calls=" << call.count << " ";
+        of << call.assemblyLine << " ";
+        of << call.line << "\n";
+
+        of << ii.assemblyLine << " ";
+        of << ii.line << " ";
+        for (uint64_t value : call.values)
+          of << value << " ";
+        of << "\n";
       }
     }
   }
 
-  if (istatsMask.test(stats::states.getID()))
-    updateStateStatistics((uint64_t)-1);
-  
   // Clear then end of the file if necessary (no truncate op?).
   unsigned pos = of.tell();
   for (unsigned i=pos; i<istatsSize; ++i)
@@ -782,26 +864,6 @@ void StatsTracker::writeIStats() {
 
 ///
 
-typedef std::map<Instruction*, std::vector<Function*> > calltargets_ty;
-
-static calltargets_ty callTargets;
-static std::map<Function*, std::vector<Instruction*> > functionCallers;
-static std::map<Function*, unsigned> functionShortestPath;
-
-static std::vector<Instruction*> getSuccs(Instruction *i) {
-  BasicBlock *bb = i->getParent();
-  std::vector<Instruction*> res;
-
-  if (i==bb->getTerminator()) {
-    for (succ_iterator it = succ_begin(bb), ie = succ_end(bb); it != ie; ++it)
-      res.push_back(&*(it->begin()));
-  } else {
-    res.push_back(&*(++(i->getIterator())));
-  }
-
-  return res;
-}
-
 uint64_t klee::computeMinDistToUncovered(const KInstruction *ki,
                                          uint64_t minDistAtRA) {
   StatisticManager &sm = *theStatisticManager;
@@ -824,222 +886,27 @@ uint64_t klee::computeMinDistToUncovered(const KInstruction *ki,
   }
 }
 
-void StatsTracker::computeReachableUncovered() {
-  KModule *km = executor.kmodule.get();
-  const auto m = km->module.get();
-  static bool init = true;
-  const InstructionInfoTable &infos = *km->infos;
-  StatisticManager &sm = *theStatisticManager;
-  
-  if (init) {
-    init = false;
-
-    // Compute call targets. It would be nice to use alias information
-    // instead of assuming all indirect calls hit all escaping
-    // functions, eh?
-    for (Module::iterator fnIt = m->begin(), fn_ie = m->end(); 
-         fnIt != fn_ie; ++fnIt) {
-      for (Function::iterator bbIt = fnIt->begin(), bb_ie = fnIt->end(); 
-           bbIt != bb_ie; ++bbIt) {
-        for (BasicBlock::iterator it = bbIt->begin(), ie = bbIt->end(); 
-             it != ie; ++it) {
-          Instruction *inst = &*it;
-          if (isa<CallInst>(inst) || isa<InvokeInst>(inst)) {
-            const CallBase &cb = cast<CallBase>(*inst);
-            if (isa<InlineAsm>(cb.getCalledOperand())) {
-              // We can never call through here so assume no targets
-              // (which should be correct anyhow).
-              callTargets.insert(std::make_pair(inst,
-                                                std::vector<Function*>()));
-            } else if (Function *target = getDirectCallTarget(
-                           cb, /*moduleIsFullyLinked=*/true)) {
-              callTargets[inst].push_back(target);
-            } else {
-              callTargets[inst] =
-                std::vector<Function*>(km->escapingFunctions.begin(),
-                                       km->escapingFunctions.end());
-            }
-          }
-        }
-      }
-    }
+static uint64_t minDistToUncoveredEpoch = 0;
 
-    // Compute function callers as reflexion of callTargets.
-    for (calltargets_ty::iterator it = callTargets.begin(), 
-           ie = callTargets.end(); it != ie; ++it)
-      for (std::vector<Function*>::iterator fit = it->second.begin(), 
-             fie = it->second.end(); fit != fie; ++fit) 
-        functionCallers[*fit].push_back(it->first);
-
-    // Initialize minDistToReturn to shortest paths through
-    // functions. 0 is unreachable.
-    std::vector<Instruction *> instructions;
-    for (Module::iterator fnIt = m->begin(), fn_ie = m->end(); 
-         fnIt != fn_ie; ++fnIt) {
-      Function *fn = &*fnIt;
-      if (fnIt->isDeclaration()) {
-        if (fnIt->doesNotReturn()) {
-          functionShortestPath[fn] = 0;
-        } else {
-          functionShortestPath[fn] = 1; // whatever
-        }
-      } else {
-        functionShortestPath[fn] = 0;
-      }
-
-      // Not sure if I should bother to preorder here. XXX I should.
-      for (Function::iterator bbIt = fnIt->begin(), bb_ie = fnIt->end(); 
-           bbIt != bb_ie; ++bbIt) {
-        for (BasicBlock::iterator it = bbIt->begin(), ie = bbIt->end(); 
-             it != ie; ++it) {
-          Instruction *inst = &*it;
-          instructions.push_back(inst);
-          unsigned id = infos.getInfo(*inst).id;
-          sm.setIndexedValue(stats::minDistToReturn, 
-                             id, 
-                             isa<ReturnInst>(inst)
-                             );
-        }
-      }
-    }
-  
-    std::reverse(instructions.begin(), instructions.end());
-    
-    // I'm so lazy it's not even worklisted.
-    bool changed;
-    do {
-      changed = false;
-      for (auto it = instructions.begin(), ie = instructions.end(); it != ie;
-           ++it) {
-        Instruction *inst = *it;
-        unsigned bestThrough = 0;
-
-        if (isa<CallInst>(inst) || isa<InvokeInst>(inst)) {
-          std::vector<Function*> &targets = callTargets[inst];
-          for (std::vector<Function*>::iterator fnIt = targets.begin(),
-                 ie = targets.end(); fnIt != ie; ++fnIt) {
-            uint64_t dist = functionShortestPath[*fnIt];
-            if (dist) {
-              dist = 1+dist; // count instruction itself
-              if (bestThrough==0 || dist<bestThrough)
-                bestThrough = dist;
-            }
-          }
-        } else {
-          bestThrough = 1;
-        }
-       
-        if (bestThrough) {
-          unsigned id = infos.getInfo(*(*it)).id;
-          uint64_t best, cur = best = sm.getIndexedValue(stats::minDistToReturn, id);
-          std::vector<Instruction*> succs = getSuccs(*it);
-          for (std::vector<Instruction*>::iterator it2 = succs.begin(),
-                 ie = succs.end(); it2 != ie; ++it2) {
-            uint64_t dist = sm.getIndexedValue(stats::minDistToReturn,
-                                               infos.getInfo(*(*it2)).id);
-            if (dist) {
-              uint64_t val = bestThrough + dist;
-              if (best==0 || val<best)
-                best = val;
-            }
-          }
-          // there's a corner case here when a function only includes a single
-          // instruction (a ret). in that case, we MUST update
-          // functionShortestPath, or it will remain 0 (erroneously indicating
-          // that no return instructions are reachable)
-          Function *f = inst->getParent()->getParent();
-          if (best != cur || (inst == &*(f->begin()->begin())
-                  && functionShortestPath[f] != best)) {
-            sm.setIndexedValue(stats::minDistToReturn, id, best);
-            changed = true;
-
-            // Update shortest path if this is the entry point.
-            if (inst == &*(f->begin()->begin()))
-              functionShortestPath[f] = best;
-          }
-        }
-      }
-    } while (changed);
-  }
+uint64_t klee::getMinDistToUncoveredEpoch() {
+  return minDistToUncoveredEpoch;
+}
 
-  // compute minDistToUncovered, 0 is unreachable
-  std::vector<Instruction *> instructions;
-  for (Module::iterator fnIt = m->begin(), fn_ie = m->end(); 
-       fnIt != fn_ie; ++fnIt) {
-    // Not sure if I should bother to preorder here.
-    for (Function::iterator bbIt = fnIt->begin(), bb_ie = fnIt->end(); 
-         bbIt != bb_ie; ++bbIt) {
-      for (BasicBlock::iterator it = bbIt->begin(), ie = bbIt->end(); 
-           it != ie; ++it) {
-        Instruction *inst = &*it;
-        unsigned id = infos.getInfo(*inst).id;
-        instructions.push_back(inst);
-        sm.setIndexedValue(stats::minDistToUncovered, 
-                           id, 
-                           sm.getIndexedValue(stats::uncoveredInstructions, id));
-      }
-    }
-  }
-  
-  std::reverse(instructions.begin(), instructions.end());
-  
-  // I'm so lazy it's not even worklisted.
-  bool changed;
-  do {
-    changed = false;
-    for (std::vector<Instruction*>::iterator it = instructions.begin(),
-           ie = instructions.end(); it != ie; ++it) {
-      Instruction *inst = *it;
-      uint64_t best, cur = best = sm.getIndexedValue(stats::minDistToUncovered,
-                                                     infos.getInfo(*inst).id);
-      unsigned bestThrough = 0;
-      
-      if (isa<CallInst>(inst) || isa<InvokeInst>(inst)) {
-        std::vector<Function*> &targets = callTargets[inst];
-        for (std::vector<Function*>::iterator fnIt = targets.begin(),
-               ie = targets.end(); fnIt != ie; ++fnIt) {
-          uint64_t dist = functionShortestPath[*fnIt];
-          if (dist) {
-            dist = 1+dist; // count instruction itself
-            if (bestThrough==0 || dist<bestThrough)
-              bestThrough = dist;
-          }
-
-          if (!(*fnIt)->isDeclaration()) {
-            uint64_t calleeDist = sm.getIndexedValue(
-                stats::minDistToUncovered, infos.getFunctionInfo(*(*fnIt)).id);
-            if (calleeDist) {
-              calleeDist = 1+calleeDist; // count instruction itself
-              if (best==0 || calleeDist<best)
-                best = calleeDist;
-            }
-          }
-        }
-      } else {
-        bestThrough = 1;
-      }
-      
-      if (bestThrough) {
-        std::vector<Instruction*> succs = getSuccs(inst);
-        for (std::vector<Instruction*>::iterator it2 = succs.begin(),
-               ie = succs.end(); it2 != ie; ++it2) {
-          uint64_t dist = sm.getIndexedValue(stats::minDistToUncovered,
-                                             infos.getInfo(*(*it2)).id);
-          if (dist) {
-            uint64_t val = bestThrough + dist;
-            if (best==0 || val<best)
-              best = val;
-          }
-        }
-      }
+void StatsTracker::statisticsRestored() {
+  if (!uncoveredDistance)
+    return;
+  for (unsigned i = 0, e = theStatisticManager->getNumIndices(); i != e; ++i)
+    if (theStatisticManager->getIndexedValue(stats::coveredInstructions, i))
+      uncoveredDistance->markCovered(i);
+  computeReachableUncovered();
+}
 
-      if (best != cur) {
-        sm.setIndexedValue(stats::minDistToUncovered, infos.getInfo(*inst).id,
-                           best);
-        changed = true;
-      }
-    }
-  } while (changed);
+void StatsTracker::computeReachableUncovered() {
+  if (!uncoveredDistance)
+    uncoveredDistance = std::make_unique<UncoveredDistance>(*executor.kmodule);
+  else
+    uncoveredDistance->update();
+  ++minDistToUncoveredEpoch;
 
   for (std::set<ExecutionState*>::iterator it = executor.states.begin(),
          ie = executor.states.end(); it != ie; ++it) {
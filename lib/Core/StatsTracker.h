@@ -11,11 +11,15 @@
 #define KLEE_STATSTRACKER_H
 
 #include "CallPathManager.h"
+#include "klee/Support/BackgroundWorker.h"
 #include "klee/System/Time.h"
 
+#include <atomic>
+#include <cstdint>
 #include <memory>
 #include <set>
 #include <sqlite3.h>
+#include <vector>
 
 namespace llvm {
   class BranchInst;
@@ -29,6 +33,7 @@ namespace klee {
   class Executor;
   class InstructionInfoTable;
   class InterpreterHandler;
+  class UncoveredDistance;
   struct KInstruction;
   struct StackFrame;
 
@@ -54,6 +59,23 @@ namespace klee {
     CallPathManager callPathManager;
 
     bool updateMinDistToUncovered;
+    /// Maintains the distances to uncovered instructions, created on the
+    /// first computeReachableUncovered()
+    std::unique_ptr<UncoveredDistance> uncoveredDistance;
+
+    /// Statistics written to run.istats
+    std::vector<unsigned> istatsIDs;
+    /// Functions and instructions of the module in run.istats order
+    struct IStatsLayout;
+    std::unique_ptr<IStatsLayout> istatsLayout;
+    struct IStatsSnapshot;
+    /// Set while an istats snapshot waits to be written
+    std::atomic<bool> istatsPending{false};
+
+    /// Writes the statistics files off the interpreter thread, which only
+    /// takes snapshots. After construction, statsFile and istatsFile are
+    /// only accessed by tasks of this worker.
+    std::unique_ptr<BackgroundWorker> writer;
 
   public:
     static bool useStatistics();
@@ -63,7 +85,9 @@ namespace klee {
     void updateStateStatistics(uint64_t addend);
     void writeStatsHeader();
     void writeStatsLine();
+    void insertStatsLine(const std::vector<std::int64_t> &row);
     void writeIStats();
+    void writeIStatsSnapshot(const IStatsSnapshot &snapshot);
 
   public:
     StatsTracker(Executor &_executor, std::string _objectFilename,
@@ -90,6 +114,10 @@ namespace klee {
     // called when execution is done and stats files should be flushed
     void done();
 
+    /// Update the coverage information after the statistics were replaced
+    /// by those of a checkpoint.
+    void statisticsRestored();
+
     // process stats for a single instruction step, es is the state
     // about to be stepped
     void stepInstruction(ExecutionState &es);
@@ -103,6 +131,11 @@ namespace klee {
   uint64_t computeMinDistToUncovered(const KInstruction *ki,
                                      uint64_t minDistAtRA);
 
+  /// Return a counter that is incremented whenever computeReachableUncovered()
+  /// updates the distances to uncovered instructions, i.e. whenever results
+  /// of computeMinDistToUncovered() may have changed.
+  uint64_t getMinDistToUncoveredEpoch();
+
 }
 
 #endif /* KLEE_STATSTRACKER_H */
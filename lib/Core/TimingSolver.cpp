@@ -12,18 +12,137 @@
 #include "ExecutionState.h"
 
 #include "klee/Config/Version.h"
+#include "klee/Expr/Assignment.h"
+#include "klee/Expr/ExprUtil.h"
 #include "klee/Statistics/Statistics.h"
 #include "klee/Statistics/TimerStatIncrementer.h"
 #include "klee/Solver/Solver.h"
 #include "klee/Solver/SolverStats.h"
+#include "klee/Support/OptionCategories.h"
 
 #include "CoreStats.h"
 
+#include "llvm/Support/CommandLine.h"
+
+#include <algorithm>
+#include <set>
+
 using namespace klee;
 using namespace llvm;
 
+namespace {
+cl::opt<bool> UseStateModel(
+    "use-state-model", cl::init(true),
+    cl::desc("Keep satisfying assignments for each state, extended by the "
+             "counterexamples of its queries, and answer queries from them "
+             "where possible, e.g. whether a branch is feasible or a "
+             "possible value of an expression (default=true)"),
+    cl::cat(SolvingCat));
+
+/// The number of models kept for a state, the oldest one is dropped first
+constexpr std::size_t MaxStateModels = 4;
+
+/// Collect the constraints that read any of the given arrays, directly or
+/// through the other arrays they read, and add those arrays. A solution of
+/// these constraints extends to one of all constraints, as the others read
+/// none of the arrays; unlike a solution of all constraints, it does not
+/// require solving every independent part of them.
+void getArrayFactor(const ConstraintSet &constraints,
+                    std::vector<const Array *> &arrays,
+                    std::vector<ref<Expr>> &factor) {
+  std::vector<std::vector<const Array *>> constraintArrays;
+  for (const auto &constraint : constraints) {
+    constraintArrays.emplace_back();
+    findSymbolicObjects(constraint, constraintArrays.back());
+  }
+
+  std::set<const Array *> found(arrays.begin(), arrays.end());
+  std::vector<bool> inFactor(constraintArrays.size());
+  for (bool changed = true; changed;) {
+    changed = false;
+    for (std::size_t i = 0; i < constraintArrays.size(); ++i) {
+      const auto &reads = constraintArrays[i];
+      if (inFactor[i] ||
+          std::none_of(reads.begin(), reads.end(), [&](const Array *array) {
+            return found.count(array);
+          }))
+        continue;
+      inFactor[i] = changed = true;
+      for (const Array *array : reads)
+        if (found.insert(array).second)
+          arrays.push_back(array);
+    }
+  }
+
+  std::size_t i = 0;
+  for (const auto &constraint : constraints)
+    if (inFactor[i++])
+      factor.push_back(constraint);
+}
+
+/// Return the value of expr under the first model it can be evaluated in,
+/// or null if there is none.
+ref<ConstantExpr> evaluateInModels(const SolverQueryMetaData &metaData,
+                                   const ref<Expr> &expr) {
+  for (const auto &model : metaData.models)
+    if (ref<ConstantExpr> CE =
+            dyn_cast<ConstantExpr>(AssignmentEvaluator(*model).visit(expr)))
+      return CE;
+  return nullptr;
+}
+
+/// Find out whether expr is true in some model and false in some model.
+void evaluateInModels(const SolverQueryMetaData &metaData,
+                      const ref<Expr> &expr, bool &someTrue, bool &someFalse) {
+  someTrue = someFalse = false;
+  for (const auto &model : metaData.models) {
+    if (ref<ConstantExpr> CE =
+            dyn_cast<ConstantExpr>(AssignmentEvaluator(*model).visit(expr))) {
+      if (CE->isTrue())
+        someTrue = true;
+      else
+        someFalse = true;
+    }
+  }
+}
+} // namespace
+
 /***/
 
+bool TimingSolver::hasModels(const ConstraintSet &constraints,
+                             const SolverQueryMetaData &metaData) const {
+  return UseStateModel && constraints.isCopyOf(metaData.modelConstraints);
+}
+
+bool TimingSolver::mustBeTrueWithModel(const ConstraintSet &constraints,
+                                       const ref<Expr> &expr, bool &result,
+                                       SolverQueryMetaData &metaData,
+                                       const ref<Expr> &value) {
+  std::vector<const Array *> objects;
+  findSymbolicObjects(expr, objects);
+  if (value)
+    findSymbolicObjects(value, objects);
+  std::vector<ref<Expr>> factor;
+  getArrayFactor(constraints, objects, factor);
+
+  std::vector<std::vector<unsigned char>> values;
+  bool hasSolution;
+  if (!solver->getInitialValues(Query(ConstraintSet(factor), expr), objects,
+                                values, hasSolution))
+    return false;
+
+  result = !hasSolution;
+  if (hasSolution) {
+    auto &models = metaData.models;
+    if (models.size() == MaxStateModels)
+      models.erase(models.begin());
+    // the other arrays stay free, as their values were not computed
+    models.push_back(std::make_shared<const Assignment>(
+        objects, values, /*_allowFreeValues=*/true));
+  }
+  return true;
+}
+
 bool TimingSolver::evaluate(const ConstraintSet &constraints, ref<Expr> expr,
                             Solver::Validity &result,
                             SolverQueryMetaData &metaData) {
@@ -34,12 +153,43 @@ bool TimingSolver::evaluate(const ConstraintSet &constraints, ref<Expr> expr,
     return true;
   }
 
+  bool useModels = hasModels(constraints, metaData);
+  bool someTrue = false, someFalse = false;
+  if (useModels) {
+    evaluateInModels(metaData, expr, someTrue, someFalse);
+    if (someTrue || someFalse)
+      ++stats::queryModelHits;
+    if (someTrue && someFalse) {
+      result = Solver::Unknown;
+      return true;
+    }
+  }
+
   TimerStatIncrementer timer(stats::solverTime);
 
   if (simplifyExprs)
     expr = ConstraintManager::simplifyExpr(constraints, expr);
 
-  bool success = solver->evaluate(Query(constraints, expr), result);
+  bool success = true;
+  if (useModels) {
+    // every query that does not prove expr (or its negation) yields a model
+    // for the other answer
+    result = Solver::Unknown;
+    bool res;
+    if (!someFalse) {
+      success = mustBeTrueWithModel(constraints, expr, res, metaData);
+      if (success && res)
+        result = Solver::True;
+    }
+    if (success && result == Solver::Unknown && !someTrue) {
+      success = mustBeTrueWithModel(constraints, Expr::createIsZero(expr), res,
+                                    metaData);
+      if (success && res)
+        result = Solver::False;
+    }
+  } else {
+    success = solver->evaluate(Query(constraints, expr), result);
+  }
 
   metaData.queryCost += timer.delta();
 
@@ -55,12 +205,25 @@ bool TimingSolver::mustBeTrue(const ConstraintSet &constraints, ref<Expr> expr,
     return true;
   }
 
+  bool useModels = hasModels(constraints, metaData);
+  if (useModels) {
+    bool someTrue, someFalse;
+    evaluateInModels(metaData, expr, someTrue, someFalse);
+    if (someFalse) {
+      ++stats::queryModelHits;
+      result = false;
+      return true;
+    }
+  }
+
   TimerStatIncrementer timer(stats::solverTime);
 
   if (simplifyExprs)
     expr = ConstraintManager::simplifyExpr(constraints, expr);
 
-  bool success = solver->mustBeTrue(Query(constraints, expr), result);
+  bool success =
+      useModels ? mustBeTrueWithModel(constraints, expr, result, metaData)
+                : solver->mustBeTrue(Query(constraints, expr), result);
 
   metaData.queryCost += timer.delta();
 
@@ -90,6 +253,77 @@ bool TimingSolver::mayBeFalse(const ConstraintSet &constraints, ref<Expr> expr,
   return true;
 }
 
+bool TimingSolver::mustBeTrue(const ConstraintSet &constraints,
+                              const std::vector<ref<Expr>> &exprs,
+                              std::vector<bool> &results,
+                              SolverQueryMetaData &metaData) {
+  stats::queries += exprs.size();
+  // Fast path, to avoid timer and OS overhead.
+  if (std::all_of(exprs.begin(), exprs.end(),
+                  [](const ref<Expr> &e) { return isa<ConstantExpr>(e); })) {
+    results.clear();
+    for (const auto &e : exprs)
+      results.push_back(cast<ConstantExpr>(e)->isTrue());
+    return true;
+  }
+
+  // expressions that are false in a model cannot be valid
+  std::vector<bool> open(exprs.size(), true);
+  if (hasModels(constraints, metaData)) {
+    for (std::size_t i = 0; i < exprs.size(); ++i) {
+      bool someTrue, someFalse;
+      evaluateInModels(metaData, exprs[i], someTrue, someFalse);
+      if (someFalse) {
+        ++stats::queryModelHits;
+        open[i] = false;
+      }
+    }
+    if (std::none_of(open.begin(), open.end(), [](bool o) { return o; })) {
+      results.assign(exprs.size(), false);
+      return true;
+    }
+  }
+
+  TimerStatIncrementer timer(stats::solverTime);
+
+  std::vector<ref<Expr>> simplified;
+  simplified.reserve(exprs.size());
+  for (std::size_t i = 0; i < exprs.size(); ++i) {
+    if (open[i])
+      simplified.push_back(simplifyExprs ? ConstraintManager::simplifyExpr(
+                                               constraints, exprs[i])
+                                         : exprs[i]);
+  }
+
+  std::vector<bool> openResults;
+  bool success = solver->mustBeTrue(constraints, simplified, openResults);
+  if (success) {
+    results.clear();
+    auto it = openResults.begin();
+    for (std::size_t i = 0; i < exprs.size(); ++i)
+      results.push_back(open[i] ? *it++ : false);
+  }
+
+  metaData.queryCost += timer.delta();
+
+  return success;
+}
+
+bool TimingSolver::mayBeTrue(const ConstraintSet &constraints,
+                             const std::vector<ref<Expr>> &exprs,
+                             std::vector<bool> &results,
+                             SolverQueryMetaData &metaData) {
+  std::vector<ref<Expr>> negated;
+  negated.reserve(exprs.size());
+  for (const auto &e : exprs)
+    negated.push_back(Expr::createIsZero(e));
+
+  if (!mustBeTrue(constraints, negated, results, metaData))
+    return false;
+  results.flip();
+  return true;
+}
+
 bool TimingSolver::getValue(const ConstraintSet &constraints, ref<Expr> expr,
                             ref<ConstantExpr> &result,
                             SolverQueryMetaData &metaData) {
@@ -99,13 +333,34 @@ bool TimingSolver::getValue(const ConstraintSet &constraints, ref<Expr> expr,
     result = CE;
     return true;
   }
-  
+
+  bool useModels = hasModels(constraints, metaData);
+  if (useModels) {
+    if (ref<ConstantExpr> value = evaluateInModels(metaData, expr)) {
+      ++stats::queryModelHits;
+      result = value;
+      return true;
+    }
+  }
+
   TimerStatIncrementer timer(stats::solverTime);
 
   if (simplifyExprs)
     expr = ConstraintManager::simplifyExpr(constraints, expr);
 
-  bool success = solver->getValue(Query(constraints, expr), result);
+  bool success;
+  bool unsatisfiable = true;
+  if (useModels) {
+    // compute a model that covers expr and take the value from there
+    success = mustBeTrueWithModel(constraints,
+                                  ConstantExpr::alloc(0, Expr::Bool),
+                                  unsatisfiable, metaData, expr);
+    if (success && !unsatisfiable)
+      result = cast<ConstantExpr>(
+          AssignmentEvaluator(*metaData.models.back()).visit(expr));
+  }
+  if (unsatisfiable)
+    success = solver->getValue(Query(constraints, expr), result);
 
   metaData.queryCost += timer.delta();
 
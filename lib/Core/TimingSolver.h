@@ -30,6 +30,21 @@ public:
   std::unique_ptr<Solver> solver;
   bool simplifyExprs;
 
+private:
+  /// Return whether the models of the state with the given query meta data
+  /// satisfy exactly the given constraints.
+  bool hasModels(const ConstraintSet &,
+                 const SolverQueryMetaData &metaData) const;
+
+  /// Determine if expr is provably true under the constraints of the state
+  /// with the given query meta data. If not, the counterexample is added to
+  /// the models of the state, assigning the arrays read by expr and value
+  /// and those of the constraints connected to them (but no others, so that
+  /// only the relevant part of the constraints is solved).
+  bool mustBeTrueWithModel(const ConstraintSet &, const ref<Expr> &expr,
+                           bool &result, SolverQueryMetaData &metaData,
+                           const ref<Expr> &value = nullptr);
+
 public:
   /// TimingSolver - Construct a new timing solver.
   ///
@@ -60,6 +75,14 @@ public:
   bool mayBeFalse(const ConstraintSet &, ref<Expr>, bool &result,
                   SolverQueryMetaData &metaData);
 
+  /// Batched versions of mustBeTrue and mayBeTrue, answering all
+  /// expressions under the same constraints together.
+  bool mustBeTrue(const ConstraintSet &, const std::vector<ref<Expr>> &exprs,
+                  std::vector<bool> &results, SolverQueryMetaData &metaData);
+
+  bool mayBeTrue(const ConstraintSet &, const std::vector<ref<Expr>> &exprs,
+                 std::vector<bool> &results, SolverQueryMetaData &metaData);
+
   bool getValue(const ConstraintSet &, ref<Expr> expr,
                 ref<ConstantExpr> &result, SolverQueryMetaData &metaData);
 
@@ -0,0 +1,324 @@
+//===-- UncoveredDistance.cpp ---------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "UncoveredDistance.h"
+
+#include "CoreStats.h"
+
+#include "klee/Module/InstructionInfoTable.h"
+#include "klee/Module/KModule.h"
+#include "klee/Statistics/Statistics.h"
+#include "klee/Support/ModuleUtil.h"
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/IR/CFG.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/InlineAsm.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+
+#include <functional>
+#include <queue>
+#include <utility>
+
+using namespace klee;
+using namespace llvm;
+
+namespace {
+/// Turn per-node adjacency lists into compressed sparse row format.
+void compress(const std::vector<std::vector<unsigned>> &lists,
+              std::vector<unsigned> &begin, std::vector<unsigned> &items) {
+  begin.reserve(lists.size() + 1);
+  begin.push_back(0);
+  for (const auto &list : lists) {
+    items.insert(items.end(), list.begin(), list.end());
+    begin.push_back(items.size());
+  }
+}
+} // namespace
+
+UncoveredDistance::UncoveredDistance(const KModule &km) {
+  const InstructionInfoTable &infos = *km.infos;
+  StatisticManager &sm = *theStatisticManager;
+
+  // Number functions and instructions, the instructions of a function in
+  // order, starting with its entry.
+  DenseMap<const Function *, unsigned> functionIndex;
+  DenseMap<const Instruction *, unsigned> nodeIndex;
+  std::vector<const Instruction *> nodeInsts;
+  std::vector<std::uint64_t> declDist;
+  nodeOf.assign(infos.getMaxID(), None);
+  for (const Function &fn : *km.module) {
+    functionIndex[&fn] = functionEntry.size();
+    functionEntry.push_back(fn.isDeclaration() ? None : nodeInsts.size());
+    // 0 is unreachable, declarations are assumed to return right away
+    declDist.push_back(fn.isDeclaration() && !fn.doesNotReturn());
+    for (const Instruction &inst : instructions(fn)) {
+      const unsigned id = infos.getInfo(inst).id;
+      nodeIndex[&inst] = nodeInsts.size();
+      nodeOf[id] = nodeInsts.size();
+      statIndex.push_back(id);
+      nodeInsts.push_back(&inst);
+    }
+  }
+
+  const unsigned numNodes = nodeInsts.size();
+  entryOf.assign(numNodes, None);
+  for (unsigned f = 0; f < functionEntry.size(); ++f)
+    if (functionEntry[f] != None)
+      entryOf[functionEntry[f]] = f;
+
+  // Compute successors and call targets. It would be nice to use alias
+  // information instead of assuming all indirect calls hit all escaping
+  // functions, eh?
+  std::vector<unsigned> escaping;
+  for (const Function *fn : km.escapingFunctions)
+    escaping.push_back(functionIndex[fn]);
+
+  std::vector<std::vector<unsigned>> succLists(numNodes), predLists(numNodes);
+  std::vector<std::vector<unsigned>> calleeLists(numNodes);
+  std::vector<std::vector<unsigned>> callerLists(functionEntry.size());
+  std::vector<bool> isCall(numNodes), isReturn(numNodes);
+  for (unsigned n = 0; n < numNodes; ++n) {
+    const Instruction *inst = nodeInsts[n];
+    const BasicBlock *bb = inst->getParent();
+    if (inst == bb->getTerminator()) {
+      for (const BasicBlock *succ : successors(bb))
+        succLists[n].push_back(nodeIndex[&succ->front()]);
+    } else {
+      succLists[n].push_back(n + 1);
+    }
+    for (unsigned s : succLists[n])
+      predLists[s].push_back(n);
+
+    isReturn[n] = isa<ReturnInst>(inst);
+    if (const auto *cb = dyn_cast<CallBase>(inst)) {
+      if (!isa<CallInst>(inst) && !isa<InvokeInst>(inst))
+        continue;
+      isCall[n] = true;
+      if (isa<InlineAsm>(cb->getCalledOperand())) {
+        // We can never call through here so assume no targets
+        // (which should be correct anyhow).
+      } else if (Function *target = getDirectCallTarget(
+                     *cb, /*moduleIsFullyLinked=*/true)) {
+        calleeLists[n].push_back(functionIndex[target]);
+      } else {
+        calleeLists[n] = escaping;
+      }
+      for (unsigned f : calleeLists[n])
+        callerLists[f].push_back(n);
+    }
+  }
+  compress(succLists, succBegin, succs);
+  compress(predLists, predBegin, preds);
+  compress(calleeLists, calleeBegin, callees);
+  compress(callerLists, callerBegin, callers);
+
+  // Compute minDistToReturn, which determines the cost of passing calls.
+  std::vector<std::uint64_t> distToReturn(isReturn.begin(), isReturn.end());
+  auto functionDist = [&](unsigned f) -> std::uint64_t {
+    return functionEntry[f] == None ? declDist[f]
+                                    : distToReturn[functionEntry[f]];
+  };
+  auto computePassCost = [&](unsigned n) -> std::uint64_t {
+    if (!isCall[n])
+      return 1;
+    std::uint64_t best = 0;
+    for (unsigned i = calleeBegin[n]; i < calleeBegin[n + 1]; ++i) {
+      if (std::uint64_t d = functionDist(callees[i])) {
+        d += 1; // count instruction itself
+        if (best == 0 || d < best)
+          best = d;
+      }
+    }
+    return best;
+  };
+
+  std::vector<unsigned> worklist;
+  std::vector<bool> queued(numNodes, true);
+  for (unsigned n = 0; n < numNodes; ++n)
+    worklist.push_back(n);
+  while (!worklist.empty()) {
+    const unsigned n = worklist.back();
+    worklist.pop_back();
+    queued[n] = false;
+
+    const std::uint64_t cost = computePassCost(n);
+    if (!cost)
+      continue;
+    std::uint64_t best = distToReturn[n];
+    for (unsigned i = succBegin[n]; i < succBegin[n + 1]; ++i) {
+      if (const std::uint64_t d = distToReturn[succs[i]]) {
+        if (best == 0 || cost + d < best)
+          best = cost + d;
+      }
+    }
+    if (best == distToReturn[n])
+      continue;
+
+    distToReturn[n] = best;
+    auto enqueue = [&](unsigned m) {
+      if (!queued[m]) {
+        queued[m] = true;
+        worklist.push_back(m);
+      }
+    };
+    for (unsigned i = predBegin[n]; i < predBegin[n + 1]; ++i)
+      enqueue(preds[i]);
+    // the cost of passing calls to this function changed
+    if (entryOf[n] != None)
+      for (unsigned i = callerBegin[entryOf[n]];
+           i < callerBegin[entryOf[n] + 1]; ++i)
+        enqueue(callers[i]);
+  }
+
+  passCost.resize(numNodes);
+  for (unsigned n = 0; n < numNodes; ++n) {
+    passCost[n] = computePassCost(n);
+    sm.setIndexedValue(stats::minDistToReturn, statIndex[n], distToReturn[n]);
+  }
+
+  // Compute minDistToUncovered from scratch.
+  dist.assign(numNodes, 0);
+  nearest.assign(numNodes, None);
+  uncovered.resize(numNodes);
+  for (unsigned n = 0; n < numNodes; ++n) {
+    uncovered[n] =
+        sm.getIndexedValue(stats::uncoveredInstructions, statIndex[n]) != 0;
+    if (uncovered[n]) {
+      dist[n] = 1;
+      nearest[n] = n;
+      worklist.push_back(n);
+    }
+  }
+  propagate(worklist, nullptr);
+  for (unsigned n = 0; n < numNodes; ++n)
+    writeDist(n);
+}
+
+void UncoveredDistance::propagate(std::vector<unsigned> &worklist,
+                                  const std::vector<bool> *changeable) {
+  using Entry = std::pair<std::uint64_t, unsigned>;
+  std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> queue;
+  for (unsigned n : worklist)
+    queue.emplace(dist[n], n);
+  worklist.clear();
+
+  auto relax = [&](unsigned n, unsigned pred, std::uint64_t d) {
+    if (changeable && !(*changeable)[pred])
+      return;
+    if (dist[pred] == 0 || d < dist[pred]) {
+      dist[pred] = d;
+      nearest[pred] = nearest[n];
+      queue.emplace(d, pred);
+    }
+  };
+
+  while (!queue.empty()) {
+    const auto entry = queue.top();
+    queue.pop();
+    const unsigned n = entry.second;
+    if (entry.first != dist[n])
+      continue; // superseded by a shorter distance
+
+    for (unsigned i = predBegin[n]; i < predBegin[n + 1]; ++i) {
+      const unsigned pred = preds[i];
+      if (passCost[pred])
+        relax(n, pred, passCost[pred] + dist[n]);
+    }
+    // calls reach the entries of their targets
+    if (entryOf[n] != None)
+      for (unsigned i = callerBegin[entryOf[n]];
+           i < callerBegin[entryOf[n] + 1]; ++i)
+        relax(n, callers[i], 1 + dist[n]);
+  }
+}
+
+void UncoveredDistance::writeDist(unsigned node) const {
+  theStatisticManager->setIndexedValue(stats::minDistToUncovered,
+                                       statIndex[node], dist[node]);
+}
+
+void UncoveredDistance::markCovered(unsigned index) {
+  const unsigned node = nodeOf[index];
+  if (node != None && uncovered[node]) {
+    uncovered[node] = false;
+    covered.push_back(node);
+  }
+}
+
+void UncoveredDistance::update() {
+  if (covered.empty())
+    return;
+
+  // Distances can only grow, and only for the nodes whose nearest uncovered
+  // node was covered. Each of them is reached from that node by following
+  // the edges it was reached by backwards.
+  std::vector<bool> affected(dist.size());
+  std::vector<unsigned> affectedNodes;
+  for (unsigned n : covered) {
+    affected[n] = true;
+    affectedNodes.push_back(n);
+  }
+  covered.clear();
+
+  auto isAffected = [&](unsigned n) {
+    return !affected[n] && nearest[n] != None && !uncovered[nearest[n]];
+  };
+  for (std::size_t next = 0; next < affectedNodes.size(); ++next) {
+    const unsigned n = affectedNodes[next];
+    for (unsigned i = predBegin[n]; i < predBegin[n + 1]; ++i) {
+      const unsigned pred = preds[i];
+      if (passCost[pred] && isAffected(pred)) {
+        affected[pred] = true;
+        affectedNodes.push_back(pred);
+      }
+    }
+    if (entryOf[n] != None)
+      for (unsigned i = callerBegin[entryOf[n]];
+           i < callerBegin[entryOf[n] + 1]; ++i) {
+        const unsigned caller = callers[i];
+        if (isAffected(caller)) {
+          affected[caller] = true;
+          affectedNodes.push_back(caller);
+        }
+      }
+  }
+
+  for (unsigned n : affectedNodes) {
+    dist[n] = 0;
+    nearest[n] = None;
+  }
+
+  // Start from the unaffected neighbours, whose distances are final.
+  std::vector<unsigned> worklist;
+  for (unsigned n : affectedNodes) {
+    auto consider = [&](unsigned succ, std::uint64_t cost) {
+      if (affected[succ] || !dist[succ])
+        return;
+      if (dist[n] == 0 || cost + dist[succ] < dist[n]) {
+        dist[n] = cost + dist[succ];
+        nearest[n] = nearest[succ];
+      }
+    };
+    if (passCost[n])
+      for (unsigned i = succBegin[n]; i < succBegin[n + 1]; ++i)
+        consider(succs[i], passCost[n]);
+    for (unsigned i = calleeBegin[n]; i < calleeBegin[n + 1]; ++i)
+      if (functionEntry[callees[i]] != None)
+        consider(functionEntry[callees[i]], 1);
+    if (dist[n])
+      worklist.push_back(n);
+  }
+  propagate(worklist, &affected);
+
+  for (unsigned n : affectedNodes)
+    writeDist(n);
+}
@@ -0,0 +1,92 @@
+//===-- UncoveredDistance.h -------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_UNCOVEREDDISTANCE_H
+#define KLEE_UNCOVEREDDISTANCE_H
+
+#include <cstdint>
+#include <vector>
+
+namespace klee {
+class KModule;
+
+/// Maintains the minDistToReturn and minDistToUncovered statistics of all
+/// instructions of a module, i.e. the length of the shortest path to a
+/// return of the enclosing function and to an uncovered instruction.
+///
+/// The interprocedural control flow graph is built once and stored in
+/// compact arrays indexed by node (instruction). Distances to uncovered
+/// instructions are first computed with Dijkstra's algorithm backwards from
+/// all uncovered instructions. Afterwards, covering instructions can only
+/// increase distances, and only those of instructions whose nearest
+/// uncovered instruction was covered: these are reset and recomputed from
+/// their unaffected neighbours, leaving the rest of the module untouched.
+class UncoveredDistance {
+  static constexpr unsigned None = ~0u;
+
+  /// The statistics index of each node
+  std::vector<unsigned> statIndex;
+  /// The node of each statistics index (None for functions)
+  std::vector<unsigned> nodeOf;
+
+  /// Intraprocedural successors and predecessors of each node, in
+  /// compressed sparse row format: those of node n are at
+  /// [succBegin[n], succBegin[n + 1])
+  std::vector<unsigned> succBegin, succs;
+  std::vector<unsigned> predBegin, preds;
+  /// The functions possibly called by each node
+  std::vector<unsigned> calleeBegin, callees;
+  /// The call nodes possibly calling each function
+  std::vector<unsigned> callerBegin, callers;
+  /// The entry node of each function (None for declarations)
+  std::vector<unsigned> functionEntry;
+  /// The function entered by each node (None if none)
+  std::vector<unsigned> entryOf;
+
+  /// The cost of passing through each node to its successors, 0 if the node
+  /// can not be passed (e.g. a call to a function that does not return)
+  std::vector<std::uint64_t> passCost;
+
+  /// The distance of each node to an uncovered instruction, 0 if none is
+  /// reachable
+  std::vector<std::uint64_t> dist;
+  /// The nearest uncovered node of each node, None if none is reachable
+  std::vector<unsigned> nearest;
+  std::vector<bool> uncovered;
+
+  /// Nodes covered since the last update
+  std::vector<unsigned> covered;
+
+  void computeDistToReturn(const std::vector<bool> &isReturn,
+                           const std::vector<std::uint64_t> &declDist);
+
+  /// Run Dijkstra's algorithm backwards from the given tentative
+  /// distances, only changing the distances of nodes that are in the given
+  /// set (if any).
+  void propagate(std::vector<unsigned> &worklist,
+                 const std::vector<bool> *changeable);
+
+  void writeDist(unsigned node) const;
+
+public:
+  /// Build the control flow graph of the module and compute all distances
+  /// from the current statistics.
+  explicit UncoveredDistance(const KModule &km);
+
+  /// Record that the instruction with the given statistics index was
+  /// covered.
+  void markCovered(unsigned index);
+
+  /// Update the distances to uncovered instructions after instructions were
+  /// covered.
+  void update();
+};
+} // namespace klee
+
+#endif /* KLEE_UNCOVEREDDISTANCE_H */
@@ -0,0 +1,382 @@
+//===-- CompiledExpr.cpp --------------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "klee/Expr/CompiledExpr.h"
+
+#include "klee/Expr/Assignment.h"
+
+#include <algorithm>
+
+using namespace klee;
+
+namespace {
+/// The number of assignments evaluated together, one bit each in the masks
+/// of known values
+constexpr unsigned BatchSize = 64;
+
+inline std::uint64_t widthMask(Expr::Width w) {
+  return w >= 64 ? ~UINT64_C(0) : (UINT64_C(1) << w) - 1;
+}
+
+inline std::int64_t signExtend(std::uint64_t v, Expr::Width w) {
+  if (w >= 64)
+    return static_cast<std::int64_t>(v);
+  const unsigned shift = 64 - w;
+  return static_cast<std::int64_t>(v << shift) >> shift;
+}
+
+inline bool isMinSigned(std::uint64_t v, Expr::Width w) {
+  return v == (UINT64_C(1) << (w - 1));
+}
+} // namespace
+
+CompiledExpr::CompiledExpr(const ref<Expr> &e) {
+  ExprHashMap<unsigned> ids;
+  compile(e, ids);
+  if (!compiled) {
+    nodes.clear();
+    updates.clear();
+    arrays.clear();
+  }
+}
+
+unsigned CompiledExpr::compile(const ref<Expr> &e, ExprHashMap<unsigned> &ids) {
+  auto it = ids.find(e);
+  if (it != ids.end())
+    return it->second;
+  if (!compiled)
+    return 0;
+  if (e->getWidth() > 64) {
+    compiled = false;
+    return 0;
+  }
+
+  Node node{};
+  node.kind = e->getKind();
+  node.width = e->getWidth();
+  if (auto CE = dyn_cast<ConstantExpr>(e)) {
+    node.value = CE->getZExtValue();
+  } else if (auto RE = dyn_cast<ReadExpr>(e)) {
+    node.kids[0] = compile(RE->index, ids);
+    std::vector<Update> readUpdates;
+    for (const UpdateNode *un = RE->updates.head.get(); un;
+         un = un->next.get())
+      readUpdates.push_back(
+          Update{compile(un->index, ids), compile(un->value, ids)});
+
+    const Array *root = RE->updates.root;
+    auto ai = std::find(arrays.begin(), arrays.end(), root);
+    node.array = ai - arrays.begin();
+    if (ai == arrays.end())
+      arrays.push_back(root);
+    node.firstUpdate = updates.size();
+    node.numUpdates = readUpdates.size();
+    updates.insert(updates.end(), readUpdates.begin(), readUpdates.end());
+  } else {
+    for (unsigned i = 0, n = e->getNumKids(); i != n; ++i)
+      node.kids[i] = compile(e->getKid(i), ids);
+    if (e->getNumKids())
+      node.kidWidth = e->getKid(0)->getWidth();
+    if (auto EE = dyn_cast<ExtractExpr>(e))
+      node.value = EE->offset;
+  }
+  if (!compiled)
+    return 0;
+
+  unsigned id = nodes.size();
+  nodes.push_back(node);
+  ids.insert(std::make_pair(e, id));
+  return id;
+}
+
+void CompiledExpr::evaluate(const std::vector<const Assignment *> &assignments,
+                            std::vector<std::uint64_t> &values,
+                            std::vector<bool> &known) const {
+  const unsigned count = assignments.size();
+  values.assign(count, 0);
+  known.assign(count, false);
+  if (!compiled)
+    return;
+
+  std::uint64_t batchValues[BatchSize];
+  for (unsigned first = 0; first < count; first += BatchSize) {
+    const unsigned batch = std::min(BatchSize, count - first);
+    std::uint64_t batchKnown;
+    evaluateBatch(&assignments[first], batch, batchValues, batchKnown);
+    for (unsigned s = 0; s != batch; ++s) {
+      values[first + s] = batchValues[s];
+      known[first + s] = (batchKnown >> s) & 1;
+    }
+  }
+}
+
+void CompiledExpr::evaluateBatch(const Assignment *const *assignments,
+                                 unsigned count, std::uint64_t *result,
+                                 std::uint64_t &resultKnown) const {
+  // the values of all nodes under all assignments, node by node, and for
+  // each node the mask of assignments under which its value is known
+  std::vector<std::uint64_t> values(nodes.size() * count);
+  std::vector<std::uint64_t> known(nodes.size());
+  const std::uint64_t all = widthMask(count);
+
+  // the bytes of each array bound by each assignment, looked up only once
+  std::vector<const std::vector<unsigned char> *> bindings(arrays.size() *
+                                                           count);
+  for (unsigned a = 0; a != arrays.size(); ++a) {
+    for (unsigned s = 0; s != count; ++s) {
+      auto it = assignments[s]->bindings.find(arrays[a]);
+      if (it != assignments[s]->bindings.end())
+        bindings[a * count + s] = &it->second;
+    }
+  }
+
+  for (unsigned n = 0; n != nodes.size(); ++n) {
+    const Node &node = nodes[n];
+    std::uint64_t *v = &values[n * count];
+    const std::uint64_t *l = &values[node.kids[0] * count];
+    const std::uint64_t *r = &values[node.kids[1] * count];
+    const std::uint64_t lKnown = known[node.kids[0]];
+    const std::uint64_t bothKnown = lKnown & known[node.kids[1]];
+    const std::uint64_t mask = widthMask(node.width);
+    const Expr::Width kw = node.kidWidth;
+    std::uint64_t k = 0;
+
+    switch (node.kind) {
+    case Expr::Constant:
+      std::fill(v, v + count, node.value);
+      k = all;
+      break;
+
+    case Expr::NotOptimized:
+      std::copy(l, l + count, v);
+      k = lKnown;
+      break;
+
+    case Expr::Read: {
+      const Array *array = arrays[node.array];
+      const Update *first = updates.data() + node.firstUpdate;
+      for (unsigned s = 0; s != count; ++s) {
+        if (!((lKnown >> s) & 1))
+          continue;
+        const std::uint64_t index = l[s];
+        bool resolved = false, isKnown = false;
+        for (const Update *u = first, *ue = first + node.numUpdates; u != ue;
+             ++u) {
+          if (!((known[u->index] >> s) & 1)) {
+            // the read may or may not be of this update
+            resolved = true;
+            break;
+          }
+          if (values[u->index * count + s] == index) {
+            resolved = true;
+            isKnown = (known[u->value] >> s) & 1;
+            v[s] = values[u->value * count + s];
+            break;
+          }
+        }
+        if (!resolved) {
+          const std::vector<unsigned char> *bytes =
+              bindings[node.array * count + s];
+          if (array->isConstantArray() && index < array->size) {
+            isKnown = true;
+            v[s] = array->constantValues[index]->getZExtValue();
+          } else if (bytes && index < bytes->size()) {
+            isKnown = true;
+            v[s] = (*bytes)[index];
+          }
+        }
+        if (isKnown)
+          k |= UINT64_C(1) << s;
+      }
+      break;
+    }
+
+    case Expr::Select: {
+      const std::uint64_t *f = &values[node.kids[2] * count];
+      for (unsigned s = 0; s != count; ++s) {
+        if (!((lKnown >> s) & 1))
+          continue;
+        const unsigned chosen = l[s] ? node.kids[1] : node.kids[2];
+        v[s] = l[s] ? r[s] : f[s];
+        k |= known[chosen] & (UINT64_C(1) << s);
+      }
+      break;
+    }
+
+    case Expr::Concat: {
+      const Expr::Width rw = node.width - kw;
+      for (unsigned s = 0; s != count; ++s)
+        v[s] = (l[s] << rw) | r[s];
+      k = bothKnown;
+      break;
+    }
+    case Expr::Extract:
+      for (unsigned s = 0; s != count; ++s)
+        v[s] = (l[s] >> node.value) & mask;
+      k = lKnown;
+      break;
+    case Expr::ZExt:
+      std::copy(l, l + count, v);
+      k = lKnown;
+      break;
+    case Expr::SExt:
+      for (unsigned s = 0; s != count; ++s)
+        v[s] = static_cast<std::uint64_t>(signExtend(l[s], kw)) & mask;
+      k = lKnown;
+      break;
+    case Expr::Not:
+      for (unsigned s = 0; s != count; ++s)
+        v[s] = ~l[s] & mask;
+      k = lKnown;
+      break;
+
+    case Expr::Add:
+      for (unsigned s = 0; s != count; ++s)
+        v[s] = (l[s] + r[s]) & mask;
+      k = bothKnown;
+      break;
+    case Expr::Sub:
+      for (unsigned s = 0; s != count; ++s)
+        v[s] = (l[s] - r[s]) & mask;
+      k = bothKnown;
+      break;
+    case Expr::Mul:
+      for (unsigned s = 0; s != count; ++s)
+        v[s] = (l[s] * r[s]) & mask;
+      k = bothKnown;
+      break;
+    case Expr::And:
+      for (unsigned s = 0; s != count; ++s)
+        v[s] = l[s] & r[s];
+      k = bothKnown;
+      break;
+    case Expr::Or:
+      for (unsigned s = 0; s != count; ++s)
+        v[s] = l[s] | r[s];
+      k = bothKnown;
+      break;
+    case Expr::Xor:
+      for (unsigned s = 0; s != count; ++s)
+        v[s] = l[s] ^ r[s];
+      k = bothKnown;
+      break;
+
+    // a division by zero is not folded by Assignment::evaluate
+    case Expr::UDiv:
+    case Expr::URem:
+      for (unsigned s = 0; s != count; ++s) {
+        if (!r[s])
+          continue;
+        v[s] = node.kind == Expr::UDiv ? l[s] / r[s] : l[s] % r[s];
+        k |= UINT64_C(1) << s;
+      }
+      k &= bothKnown;
+      break;
+    case Expr::SDiv:
+    case Expr::SRem:
+      for (unsigned s = 0; s != count; ++s) {
+        if (!r[s])
+          continue;
+        if (isMinSigned(l[s], kw) && r[s] == mask) {
+          // overflows, and wraps around
+          v[s] = node.kind == Expr::SDiv ? l[s] : 0;
+        } else {
+          const std::int64_t a = signExtend(l[s], kw),
+                             b = signExtend(r[s], kw);
+          v[s] = static_cast<std::uint64_t>(node.kind == Expr::SDiv ? a / b
+                                                                    : a % b) &
+                 mask;
+        }
+        k |= UINT64_C(1) << s;
+      }
+      k &= bothKnown;
+      break;
+
+    // shifts by the width or more give all zeros or sign bits, like APInt
+    case Expr::Shl:
+      for (unsigned s = 0; s != count; ++s)
+        v[s] = r[s] < node.width ? (l[s] << r[s]) & mask : 0;
+      k = bothKnown;
+      break;
+    case Expr::LShr:
+      for (unsigned s = 0; s != count; ++s)
+        v[s] = r[s] < node.width ? l[s] >> r[s] : 0;
+      k = bothKnown;
+      break;
+    case Expr::AShr:
+      for (unsigned s = 0; s != count; ++s)
+        v[s] = static_cast<std::uint64_t>(
+                   signExtend(l[s], kw) >>
+                   std::min<std::uint64_t>(r[s], node.width - 1)) &
+               mask;
+      k = bothKnown;
+      break;
+
+    case Expr::Eq:
+      for (unsigned s = 0; s != count; ++s)
+        v[s] = l[s] == r[s];
+      k = bothKnown;
+      break;
+    case Expr::Ne:
+      for (unsigned s = 0; s != count; ++s)
+        v[s] = l[s] != r[s];
+      k = bothKnown;
+      break;
+    case Expr::Ult:
+      for (unsigned s = 0; s != count; ++s)
+        v[s] = l[s] < r[s];
+      k = bothKnown;
+      break;
+    case Expr::Ule:
+      for (unsigned s = 0; s != count; ++s)
+        v[s] = l[s] <= r[s];
+      k = bothKnown;
+      break;
+    case Expr::Ugt:
+      for (unsigned s = 0; s != count; ++s)
+        v[s] = l[s] > r[s];
+      k = bothKnown;
+      break;
+    case Expr::Uge:
+      for (unsigned s = 0; s != count; ++s)
+        v[s] = l[s] >= r[s];
+      k = bothKnown;
+      break;
+    case Expr::Slt:
+      for (unsigned s = 0; s != count; ++s)
+        v[s] = signExtend(l[s], kw) < signExtend(r[s], kw);
+      k = bothKnown;
+      break;
+    case Expr::Sle:
+      for (unsigned s = 0; s != count; ++s)
+        v[s] = signExtend(l[s], kw) <= signExtend(r[s], kw);
+      k = bothKnown;
+      break;
+    case Expr::Sgt:
+      for (unsigned s = 0; s != count; ++s)
+        v[s] = signExtend(l[s], kw) > signExtend(r[s], kw);
+      k = bothKnown;
+      break;
+    case Expr::Sge:
+      for (unsigned s = 0; s != count; ++s)
+        v[s] = signExtend(l[s], kw) >= signExtend(r[s], kw);
+      k = bothKnown;
+      break;
+
+    default:
+      // unknown under every assignment
+      break;
+    }
+    known[n] = k;
+  }
+
+  const std::uint64_t *rootValues = &values[(nodes.size() - 1) * count];
+  std::copy(rootValues, rootValues + count, result);
+  resultKnown = known.back();
+}
@@ -0,0 +1,180 @@
+//===-- ConstraintPartition.cpp -------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "klee/Expr/ConstraintPartition.h"
+
+#include "klee/Expr/ExprUtil.h"
+
+#include <algorithm>
+
+using namespace klee;
+
+namespace {
+/// Call f(array, index, isSymbolic) for all reads of symbolic arrays in e.
+template <typename F> void forEachSymbolicRead(const ref<Expr> &e, F f) {
+  std::vector<ref<ReadExpr>> reads;
+  findReads(e, /* visitUpdates= */ true, reads);
+  for (const auto &re : reads) {
+    const Array *array = re->updates.root;
+
+    // Reads of a constant array don't alias.
+    if (array->isConstantArray() && !re->updates.head)
+      continue;
+
+    if (auto CE = dyn_cast<ConstantExpr>(re->index))
+      f(array, (unsigned)CE->getZExtValue(32), false);
+    else
+      f(array, 0, true);
+  }
+}
+} // namespace
+
+unsigned ConstraintPartition::find(unsigned node) const {
+  while (parent[node] != node)
+    node = parent[node];
+  return node;
+}
+
+unsigned ConstraintPartition::findAndCompress(unsigned node) {
+  while (parent[node] != node) {
+    parent[node] = parent[parent[node]];
+    node = parent[node];
+  }
+  return node;
+}
+
+unsigned ConstraintPartition::unite(unsigned a, unsigned b) {
+  a = findAndCompress(a);
+  b = findAndCompress(b);
+  if (a == b)
+    return a;
+  if (classSize[a] < classSize[b])
+    std::swap(a, b);
+
+  parent[b] = a;
+  classSize[a] += classSize[b];
+  if (first[b] != None) {
+    if (first[a] == None)
+      first[a] = first[b];
+    else
+      next[last[a]] = first[b];
+    last[a] = last[b];
+  }
+  return a;
+}
+
+unsigned ConstraintPartition::getNode(const Array *array, unsigned index) {
+  ArrayNodes &nodes = arrays[array];
+  if (nodes.whole != None)
+    return nodes.whole;
+
+  auto it = nodes.bytes.find(index);
+  if (it != nodes.bytes.end())
+    return it->second;
+
+  const unsigned node = parent.size();
+  parent.push_back(node);
+  classSize.push_back(1);
+  first.push_back(None);
+  last.push_back(None);
+  nodes.bytes[index] = node;
+  return node;
+}
+
+unsigned ConstraintPartition::getWholeNode(const Array *array) {
+  ArrayNodes &nodes = arrays[array];
+  if (nodes.whole != None)
+    return nodes.whole;
+
+  unsigned node = parent.size();
+  parent.push_back(node);
+  classSize.push_back(1);
+  first.push_back(None);
+  last.push_back(None);
+
+  // all bytes read so far now belong to the same class
+  for (const auto &byte : nodes.bytes)
+    node = unite(node, byte.second);
+  nodes.bytes.clear();
+  nodes.whole = node;
+  return node;
+}
+
+void ConstraintPartition::add(const ref<Expr> &constraint) {
+  const unsigned index = next.size();
+  next.push_back(None);
+
+  unsigned root = None;
+  forEachSymbolicRead(constraint, [&](const Array *array, unsigned byte,
+                                      bool isSymbolic) {
+    const unsigned node =
+        isSymbolic ? getWholeNode(array) : getNode(array, byte);
+    root = root == None ? findAndCompress(node) : unite(root, node);
+  });
+  if (root == None)
+    return;
+
+  if (first[root] == None)
+    first[root] = index;
+  else
+    next[last[root]] = index;
+  last[root] = index;
+}
+
+void ConstraintPartition::findRoots(const ref<Expr> &e,
+                                    std::vector<unsigned> &roots) const {
+  forEachSymbolicRead(e, [&](const Array *array, unsigned byte,
+                             bool isSymbolic) {
+    auto it = arrays.find(array);
+    if (it == arrays.end())
+      return;
+
+    const ArrayNodes &nodes = it->second;
+    if (nodes.whole != None) {
+      roots.push_back(find(nodes.whole));
+    } else if (isSymbolic) {
+      for (const auto &node : nodes.bytes)
+        roots.push_back(find(node.second));
+    } else {
+      auto node = nodes.bytes.find(byte);
+      if (node != nodes.bytes.end())
+        roots.push_back(find(node->second));
+    }
+  });
+
+  std::sort(roots.begin(), roots.end());
+  roots.erase(std::unique(roots.begin(), roots.end()), roots.end());
+}
+
+void ConstraintPartition::getDependentConstraints(
+    const ref<Expr> &e, std::vector<std::size_t> &indices) const {
+  std::vector<unsigned> roots;
+  findRoots(e, roots);
+
+  for (auto root : roots)
+    for (unsigned i = first[root]; i != None; i = next[i])
+      indices.push_back(i);
+  std::sort(indices.begin(), indices.end());
+}
+
+void ConstraintPartition::getClasses(
+    std::vector<std::vector<std::size_t>> &classes) const {
+  for (unsigned node = 0; node < parent.size(); ++node) {
+    if (parent[node] != node || first[node] == None)
+      continue;
+
+    classes.emplace_back();
+    for (unsigned i = first[node]; i != None; i = next[i])
+      classes.back().push_back(i);
+    std::sort(classes.back().begin(), classes.back().end());
+  }
+  std::sort(classes.begin(), classes.end(),
+            [](const std::vector<std::size_t> &a,
+               const std::vector<std::size_t> &b) { return a[0] < b[0]; });
+}
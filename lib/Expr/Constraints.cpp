@@ -16,6 +16,7 @@
 #include "llvm/IR/Function.h"
 #include "llvm/Support/CommandLine.h"
 
+#include <algorithm>
 #include <map>
 
 using namespace klee;
@@ -71,22 +72,33 @@ public:
 };
 
 bool ConstraintManager::rewriteConstraints(ExprVisitor &visitor) {
-  ConstraintSet old;
-  bool changed = false;
-
-  std::swap(constraints, old);
-  for (auto &ce : old) {
+  // the constraints before the first one that changes are kept, along with
+  // the storage they share with other sets
+  std::size_t firstChanged = 0;
+  for (const auto &ce : constraints) {
+    if (visitor.visit(ce) != ce)
+      break;
+    ++firstChanged;
+  }
+  if (firstChanged == constraints.size())
+    return false;
+
+  const ConstraintSet old = constraints;
+  constraints = old.getPrefix(firstChanged);
+  std::size_t index = 0;
+  for (const auto &ce : old) {
+    if (index++ < firstChanged)
+      continue;
     ref<Expr> e = visitor.visit(ce);
 
     if (e!=ce) {
       addConstraintInternal(e); // enable further reductions
-      changed = true;
     } else {
       constraints.push_back(ce);
     }
   }
 
-  return changed;
+  return true;
 }
 
 ref<Expr> ConstraintManager::simplifyExpr(const ConstraintSet &constraints,
@@ -163,16 +175,106 @@ void ConstraintManager::addConstraint(const ref<Expr> &e) {
 ConstraintManager::ConstraintManager(ConstraintSet &_constraints)
     : constraints(_constraints) {}
 
-bool ConstraintSet::empty() const { return constraints.empty(); }
+ConstraintSet::ConstraintSet(const constraints_ty &cs) {
+  for (const auto &constraint : cs)
+    push_back(constraint);
+}
+
+bool ConstraintSet::empty() const { return count == 0; }
 
 klee::ConstraintSet::constraint_iterator ConstraintSet::begin() const {
-  return constraints.begin();
+  return const_iterator(tail.get(), 0);
 }
 
 klee::ConstraintSet::constraint_iterator ConstraintSet::end() const {
-  return constraints.end();
+  return const_iterator(tail.get(), count);
 }
 
-size_t ConstraintSet::size() const noexcept { return constraints.size(); }
+size_t ConstraintSet::size() const noexcept { return count; }
+
+void ConstraintSet::push_back(const ref<Expr> &e) {
+  const std::size_t visible = tail ? count - tail->offset : 0;
+  if (!tail || visible == ChunkSize) {
+    tail = new Chunk(tail, count);
+  } else if (visible != tail->used) {
+    // another set has appended to the shared chunk, copy the visible part
+    ref<Chunk> chunk = new Chunk(tail->parent, tail->offset);
+    std::copy_n(tail->constraints, visible, chunk->constraints);
+    chunk->used = visible;
+    tail = chunk;
+  }
 
-void ConstraintSet::push_back(const ref<Expr> &e) { constraints.push_back(e); }
+  tail->constraints[tail->used++] = e;
+  ++count;
+  hashValue ^= e->hash();
+}
+
+std::size_t ConstraintSet::getSharedPrefixSize(const ConstraintSet &other) const {
+  const Chunk *a = tail.get(), *b = other.tail.get();
+  // chunks at the same position have the same offset
+  while (a && b && a != b) {
+    if (a->offset >= b->offset)
+      a = a->parent.get();
+    else
+      b = b->parent.get();
+  }
+  if (!a || !b)
+    return 0;
+
+  // parent chunks are fully visible, only the last one is seen partially
+  const std::size_t visibleA = a == tail.get() ? count - a->offset : ChunkSize;
+  const std::size_t visibleB =
+      b == other.tail.get() ? other.count - b->offset : ChunkSize;
+  return a->offset + std::min(visibleA, visibleB);
+}
+
+std::size_t ConstraintSet::getSharedSize() const {
+  // chunks referenced only by this set (directly or through such chunks)
+  // are freed along with it, all before them stay
+  const Chunk *chunk = tail.get();
+  while (chunk && chunk->_refCount.getCount() == 1)
+    chunk = chunk->parent.get();
+  if (!chunk)
+    return 0;
+  return chunk == tail.get() ? count : chunk->offset + ChunkSize;
+}
+
+ConstraintSet ConstraintSet::getPrefix(std::size_t n) const {
+  assert(n <= count && "prefix longer than the set");
+  ConstraintSet result;
+  if (n == 0)
+    return result;
+
+  ref<Chunk> chunk = tail;
+  while (chunk->offset >= n)
+    chunk = chunk->parent;
+  result.tail = chunk;
+  result.count = n;
+  for (const auto &constraint : result)
+    result.hashValue ^= constraint->hash();
+  if (partition && partition->size() <= n)
+    result.partition = partition;
+  return result;
+}
+
+const ConstraintPartition &ConstraintSet::getPartition() const {
+  if (!partition)
+    partition = std::make_shared<ConstraintPartition>();
+  if (partition->size() == count)
+    return *partition;
+
+  if (partition.use_count() > 1)
+    partition = std::make_shared<ConstraintPartition>(*partition);
+  for (const_iterator it(tail.get(), partition->size()), ie = end(); it != ie;
+       ++it)
+    partition->add(*it);
+  return *partition;
+}
+
+bool ConstraintSet::operator==(const ConstraintSet &b) const {
+  if (count != b.count || hashValue != b.hashValue)
+    return false;
+  if (tail.get() == b.tail.get())
+    return true;
+  return std::equal(begin(), end(), b.begin());
+}
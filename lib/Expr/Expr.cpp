@@ -23,6 +23,7 @@
 
 #include <cstring>
 #include <sstream>
+#include <unordered_map>
 
 using namespace klee;
 using namespace llvm;
@@ -39,12 +40,66 @@ cl::opt<bool> ConstArrayOpt(
     cl::desc(
         "Enable an optimization involving all-constant arrays (default=false)"),
     cl::cat(klee::ExprCat));
+
+cl::opt<bool> ExprHashConsing(
+    "expr-hash-consing", cl::init(false),
+    cl::desc("Share a single node between all structurally equal expressions "
+             "(default=false)"),
+    cl::cat(klee::ExprCat));
+
+/// Weak table of all hash-consed expressions, keyed by their hash value.
+/// Expressions remove themselves on destruction. The table is never freed as
+/// expressions may outlive any static destructor.
+std::unordered_multimap<unsigned, Expr *> &getHashConsTable() {
+  static auto *table = new std::unordered_multimap<unsigned, Expr *>();
+  return *table;
+}
+
+/// Structural equality assuming that kids are hash-consed
+bool shallowEquals(const Expr &a, const Expr &b) {
+  if (a.getKind() != b.getKind() || a.getWidth() != b.getWidth() ||
+      a.getNumKids() != b.getNumKids())
+    return false;
+  for (unsigned i = 0, n = a.getNumKids(); i != n; ++i)
+    if (a.getKid(i).get() != b.getKid(i).get())
+      return false;
+  return a.compare(b) == 0;
+}
 }
 
 /***/
 
 unsigned Expr::count = 0;
 
+Expr::~Expr() {
+  Expr::count--;
+
+  auto &table = getHashConsTable();
+  if (table.empty())
+    return;
+  auto range = table.equal_range(hashValue);
+  for (auto it = range.first; it != range.second; ++it) {
+    if (it->second == this) {
+      table.erase(it);
+      return;
+    }
+  }
+}
+
+ref<Expr> Expr::createCachedExpr(const ref<Expr> &e) {
+  if (!ExprHashConsing)
+    return e;
+
+  auto &table = getHashConsTable();
+  auto range = table.equal_range(e->hash());
+  for (auto it = range.first; it != range.second; ++it) {
+    if (shallowEquals(*it->second, *e))
+      return it->second;
+  }
+  table.emplace(e->hash(), e.get());
+  return e;
+}
+
 ref<Expr> Expr::createTempRead(const Array *array, Expr::Width w) {
   UpdateList ul(array, 0);
 
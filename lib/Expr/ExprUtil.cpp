@@ -8,11 +8,14 @@
 //===----------------------------------------------------------------------===//
 
 #include "klee/Expr/ExprUtil.h"
+#include "klee/ADT/Bits.h"
+#include "klee/Expr/Constraints.h"
 #include "klee/Expr/Expr.h"
 #include "klee/Expr/ExprHashMap.h"
 #include "klee/Expr/ExprVisitor.h"
 
 #include <set>
+#include <unordered_map>
 
 using namespace klee;
 
@@ -139,3 +142,144 @@ template void klee::findSymbolicObjects<A>(A, A, std::vector<const Array*> &);
 
 typedef std::set< ref<Expr> >::iterator B;
 template void klee::findSymbolicObjects<B>(B, B, std::vector<const Array*> &);
+
+typedef ConstraintSet::const_iterator C;
+template void klee::findSymbolicObjects<C>(C, C, std::vector<const Array*> &);
+
+namespace {
+class UnsignedBoundsEvaluator {
+  typedef std::pair<uint64_t, uint64_t> Bounds;
+
+  std::unordered_map<const Expr *, Bounds> cache;
+
+  static Bounds full(Expr::Width width) {
+    return {0, bits64::maxValueOfNBits(width)};
+  }
+
+  Bounds compute(const ref<Expr> &e) {
+    const Expr::Width width = e->getWidth();
+    const uint64_t max = bits64::maxValueOfNBits(width);
+
+    switch (e->getKind()) {
+    case Expr::Constant: {
+      const uint64_t value = cast<ConstantExpr>(e)->getZExtValue();
+      return {value, value};
+    }
+
+    case Expr::ZExt:
+      return evaluate(e->getKid(0));
+
+    case Expr::SExt: {
+      // Non-negative values are not changed by a sign extension.
+      const Expr::Width srcWidth = e->getKid(0)->getWidth();
+      const Bounds src = evaluate(e->getKid(0));
+      if (src.second <= bits64::maxValueOfNBits(srcWidth - 1))
+        return src;
+      return full(width);
+    }
+
+    case Expr::Extract: {
+      const auto *ee = cast<ExtractExpr>(e);
+      const Bounds src = evaluate(ee->expr);
+      if (ee->offset == 0 && src.second <= max)
+        return src;
+      return full(width);
+    }
+
+    case Expr::Select: {
+      const Bounds t = evaluate(e->getKid(1));
+      const Bounds f = evaluate(e->getKid(2));
+      return {std::min(t.first, f.first), std::max(t.second, f.second)};
+    }
+
+    case Expr::Add: {
+      const Bounds l = evaluate(e->getKid(0));
+      const Bounds r = evaluate(e->getKid(1));
+      if (r.second > max - l.second)
+        return full(width);
+      return {l.first + r.first, l.second + r.second};
+    }
+
+    case Expr::Sub: {
+      const Bounds l = evaluate(e->getKid(0));
+      const Bounds r = evaluate(e->getKid(1));
+      if (l.first < r.second)
+        return full(width);
+      return {l.first - r.second, l.second - r.first};
+    }
+
+    case Expr::Mul: {
+      const Bounds l = evaluate(e->getKid(0));
+      const Bounds r = evaluate(e->getKid(1));
+      if (r.second != 0 && l.second > max / r.second)
+        return full(width);
+      return {l.first * r.first, l.second * r.second};
+    }
+
+    case Expr::Shl: {
+      const Bounds l = evaluate(e->getKid(0));
+      const Bounds r = evaluate(e->getKid(1));
+      if (r.first != r.second || r.first >= width ||
+          l.second > (max >> r.first))
+        return full(width);
+      return {l.first << r.first, l.second << r.first};
+    }
+
+    case Expr::LShr: {
+      const Bounds l = evaluate(e->getKid(0));
+      const Bounds r = evaluate(e->getKid(1));
+      if (r.second >= width)
+        return {0, l.second};
+      return {l.first >> r.second, l.second >> r.first};
+    }
+
+    case Expr::And: {
+      const Bounds l = evaluate(e->getKid(0));
+      const Bounds r = evaluate(e->getKid(1));
+      return {0, std::min(l.second, r.second)};
+    }
+
+    case Expr::UDiv: {
+      const Bounds l = evaluate(e->getKid(0));
+      const Bounds r = evaluate(e->getKid(1));
+      // x udiv 0 is all ones
+      if (r.first == 0)
+        return full(width);
+      return {l.first / r.second, l.second / r.first};
+    }
+
+    case Expr::URem: {
+      const Bounds l = evaluate(e->getKid(0));
+      const Bounds r = evaluate(e->getKid(1));
+      // x urem 0 is x
+      if (r.second == 0)
+        return l;
+      if (r.first == 0)
+        return {0, l.second};
+      return {0, std::min(l.second, r.second - 1)};
+    }
+
+    default:
+      return full(width);
+    }
+  }
+
+public:
+  Bounds evaluate(const ref<Expr> &e) {
+    if (e->getWidth() > Expr::Int64)
+      return full(Expr::Int64);
+
+    auto it = cache.find(e.get());
+    if (it != cache.end())
+      return it->second;
+
+    const Bounds bounds = compute(e);
+    cache.emplace(e.get(), bounds);
+    return bounds;
+  }
+};
+} // namespace
+
+std::pair<uint64_t, uint64_t> klee::getUnsignedBounds(const ref<Expr> &e) {
+  return UnsignedBoundsEvaluator().evaluate(e);
+}
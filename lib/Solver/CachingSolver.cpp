@@ -50,13 +50,7 @@ private:
 
   struct CacheEntryHash {
     unsigned operator()(const CacheEntry &ce) const {
-      unsigned result = ce.query->hash();
-
-      for (auto const &constraint : ce.constraints) {
-        result ^= constraint->hash();
-      }
-
-      return result;
+      return ce.query->hash() ^ ce.constraints.hash();
     }
   };
 
@@ -72,6 +66,9 @@ public:
 
   bool computeValidity(const Query&, Solver::Validity &result);
   bool computeTruth(const Query&, bool &isValid);
+  bool computeTruthBatch(const ConstraintSet &constraints,
+                         const std::vector<ref<Expr>> &exprs,
+                         std::vector<bool> &isValid);
   bool computeValue(const Query& query, ref<Expr> &result) {
     ++stats::queryCacheMisses;
     return solver->impl->computeValue(query, result);
@@ -79,11 +76,7 @@ public:
   bool computeInitialValues(const Query& query,
                             const std::vector<const Array*> &objects,
                             std::vector< std::vector<unsigned char> > &values,
-                            bool &hasSolution) {
-    ++stats::queryCacheMisses;
-    return solver->impl->computeInitialValues(query, objects, values, 
-                                              hasSolution);
-  }
+                            bool &hasSolution);
   SolverRunStatus getOperationStatusCode();
   char *getConstraintLog(const Query&);
   void setCoreSolverTimeout(time::Span timeout);
@@ -242,6 +235,79 @@ bool CachingSolver::computeTruth(const Query& query,
   return true;
 }
 
+bool CachingSolver::computeInitialValues(
+    const Query &query, const std::vector<const Array *> &objects,
+    std::vector<std::vector<unsigned char>> &values, bool &hasSolution) {
+  IncompleteSolver::PartialValidity cachedResult;
+  bool cacheHit = cacheLookup(query, cachedResult);
+
+  // only a valid query is answered without computing an assignment
+  if (cacheHit && cachedResult == IncompleteSolver::MustBeTrue) {
+    ++stats::queryCacheHits;
+    hasSolution = false;
+    return true;
+  }
+
+  ++stats::queryCacheMisses;
+
+  if (!solver->impl->computeInitialValues(query, objects, values,
+                                          hasSolution))
+    return false;
+
+  if (!hasSolution) {
+    cachedResult = IncompleteSolver::MustBeTrue;
+  } else if (cacheHit) {
+    cachedResult = cachedResult == IncompleteSolver::MayBeTrue
+                       ? IncompleteSolver::TrueOrFalse
+                       : cachedResult;
+  } else {
+    cachedResult = IncompleteSolver::MayBeFalse;
+  }
+
+  cacheInsert(query, cachedResult);
+  return true;
+}
+
+bool CachingSolver::computeTruthBatch(const ConstraintSet &constraints,
+                                      const std::vector<ref<Expr>> &exprs,
+                                      std::vector<bool> &isValid) {
+  isValid.assign(exprs.size(), false);
+
+  // forward all cache misses together
+  std::vector<ref<Expr>> misses;
+  std::vector<std::size_t> missIndices;
+  std::vector<bool> missCacheHit;
+  for (std::size_t i = 0; i < exprs.size(); ++i) {
+    IncompleteSolver::PartialValidity cachedResult;
+    bool cacheHit = cacheLookup(Query(constraints, exprs[i]), cachedResult);
+    if (cacheHit && cachedResult != IncompleteSolver::MayBeTrue) {
+      ++stats::queryCacheHits;
+      isValid[i] = (cachedResult == IncompleteSolver::MustBeTrue);
+    } else {
+      ++stats::queryCacheMisses;
+      misses.push_back(exprs[i]);
+      missIndices.push_back(i);
+      missCacheHit.push_back(cacheHit);
+    }
+  }
+
+  if (misses.empty())
+    return true;
+
+  std::vector<bool> missValid;
+  if (!solver->impl->computeTruthBatch(constraints, misses, missValid))
+    return false;
+
+  for (std::size_t k = 0; k < misses.size(); ++k) {
+    isValid[missIndices[k]] = missValid[k];
+    cacheInsert(Query(constraints, misses[k]),
+                missValid[k] ? IncompleteSolver::MustBeTrue
+                : missCacheHit[k] ? IncompleteSolver::TrueOrFalse
+                                  : IncompleteSolver::MayBeFalse);
+  }
+  return true;
+}
+
 SolverImpl::SolverRunStatus CachingSolver::getOperationStatusCode() {
   return solver->impl->getOperationStatusCode();
 }
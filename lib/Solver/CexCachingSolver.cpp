@@ -81,6 +81,11 @@ class CexCachingSolver : public SolverImpl {
   }
 
   bool getAssignment(const Query& query, Assignment *&result);
+
+  Assignment *insertAssignment(const Query &query, KeyType &key,
+                               const std::vector<const Array *> &objects,
+                               std::vector<std::vector<unsigned char>> &values,
+                               bool hasSolution);
   
 public:
   CexCachingSolver(std::unique_ptr<Solver> solver)
@@ -88,6 +93,9 @@ public:
   ~CexCachingSolver();
   
   bool computeTruth(const Query&, bool &isValid);
+  bool computeTruthBatch(const ConstraintSet &constraints,
+                         const std::vector<ref<Expr>> &exprs,
+                         std::vector<bool> &isValid);
   bool computeValidity(const Query&, Solver::Validity &result);
   bool computeValue(const Query&, ref<Expr> &result);
   bool computeInitialValues(const Query&,
@@ -231,7 +239,17 @@ bool CexCachingSolver::getAssignment(const Query& query, Assignment *&result) {
   if (!solver->impl->computeInitialValues(query, objects, values, 
                                           hasSolution))
     return false;
-    
+
+  result = insertAssignment(query, key, objects, values, hasSolution);
+  return true;
+}
+
+/// insertAssignment - Memoize the solution computed for a query.
+///
+/// \return The (shared) satisfying assignment, or 0 if there is none.
+Assignment *CexCachingSolver::insertAssignment(
+    const Query &query, KeyType &key, const std::vector<const Array *> &objects,
+    std::vector<std::vector<unsigned char>> &values, bool hasSolution) {
   Assignment *binding;
   if (hasSolution) {
     binding = new Assignment(objects, values);
@@ -254,10 +272,9 @@ bool CexCachingSolver::getAssignment(const Query& query, Assignment *&result) {
     binding = (Assignment*) 0;
   }
   
-  result = binding;
   cache.insert(key, binding);
 
-  return true;
+  return binding;
 }
 
 ///
@@ -306,6 +323,54 @@ bool CexCachingSolver::computeTruth(const Query& query,
   return true;
 }
 
+bool CexCachingSolver::computeTruthBatch(const ConstraintSet &constraints,
+                                         const std::vector<ref<Expr>> &exprs,
+                                         std::vector<bool> &isValid) {
+  TimerStatIncrementer t(stats::cexCacheTime);
+
+  isValid.assign(exprs.size(), false);
+
+  std::vector<ref<Expr>> misses;
+  std::vector<KeyType> missKeys;
+  std::vector<std::size_t> missIndices;
+  for (std::size_t i = 0; i < exprs.size(); ++i) {
+    KeyType key;
+    Assignment *a;
+    if (lookupAssignment(Query(constraints, exprs[i]), key, a)) {
+      isValid[i] = !a;
+    } else {
+      misses.push_back(exprs[i]);
+      missKeys.push_back(std::move(key));
+      missIndices.push_back(i);
+    }
+  }
+
+  if (misses.empty())
+    return true;
+
+  // Solve all misses together; their assignments bind the objects of all of
+  // them, which is harmless for the cached assignments.
+  std::vector< ref<Expr> > keyExprs(constraints.begin(), constraints.end());
+  for (const auto &e : misses)
+    keyExprs.push_back(Expr::createIsZero(e));
+  std::vector<const Array*> objects;
+  findSymbolicObjects(keyExprs.begin(), keyExprs.end(), objects);
+
+  std::vector<std::vector<std::vector<unsigned char>>> values;
+  std::vector<bool> hasSolution;
+  if (!solver->impl->computeInitialValuesBatch(constraints, misses, objects,
+                                               values, hasSolution))
+    return false;
+
+  for (std::size_t k = 0; k < misses.size(); ++k) {
+    Assignment *a = insertAssignment(Query(constraints, misses[k]),
+                                     missKeys[k], objects, values[k],
+                                     hasSolution[k]);
+    isValid[missIndices[k]] = !a;
+  }
+  return true;
+}
+
 bool CexCachingSolver::computeValue(const Query& query,
                                     ref<Expr> &result) {
   TimerStatIncrementer t(stats::cexCacheTime);
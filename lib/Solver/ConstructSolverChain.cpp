@@ -49,6 +49,13 @@ std::unique_ptr<Solver> constructSolverChain(
   if (UseAssignmentValidatingSolver)
     solver = createAssignmentValidatingSolver(std::move(solver));
 
+  if (!PersistentQueryCache.empty()) {
+    solver = createPersistentCachingSolver(std::move(solver),
+                                           PersistentQueryCache);
+    klee_message("Using persistent query cache %s",
+                 PersistentQueryCache.c_str());
+  }
+
   if (UseFastCexSolver)
     solver = createFastCexSolver(std::move(solver));
 
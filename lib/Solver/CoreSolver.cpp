@@ -20,6 +20,7 @@
 
 #include <string>
 #include <memory>
+#include <vector>
 
 namespace klee {
 
@@ -51,6 +52,26 @@ std::unique_ptr<Solver> createCoreSolver(CoreSolverType cst) {
     klee_message("Not compiled with Z3 support");
     return NULL;
 #endif
+  case PORTFOLIO_SOLVER: {
+    std::vector<std::unique_ptr<Solver>> backends;
+    std::vector<std::string> names;
+    for (CoreSolverType backend : PortfolioSolvers) {
+      auto solver = createCoreSolver(backend);
+      if (!solver)
+        return NULL;
+      backends.push_back(std::move(solver));
+      names.push_back(backend == STP_SOLVER       ? "stp"
+                      : backend == METASMT_SOLVER ? "metasmt"
+                                                  : "z3");
+    }
+    if (backends.size() < 2) {
+      klee_message("The portfolio solver needs at least two backends "
+                   "(-portfolio-solvers)");
+      return NULL;
+    }
+    klee_message("Using portfolio solver backend");
+    return createPortfolioSolver(std::move(backends), std::move(names));
+  }
   case NO_SOLVER:
     klee_message("Invalid solver");
     return NULL;
@@ -19,6 +19,8 @@
 
 #include "llvm/Support/raw_ostream.h"
 
+#include <algorithm>
+#include <iterator>
 #include <list>
 #include <map>
 #include <memory>
@@ -264,90 +266,49 @@ inline llvm::raw_ostream &operator<<(llvm::raw_ostream &os,
 static std::list<IndependentElementSet>*
 getAllIndependentConstraintsSets(const Query &query) {
   std::list<IndependentElementSet> *factors = new std::list<IndependentElementSet>();
+  const ConstraintPartition &partition = query.constraints.getPartition();
+  const auto constraints = query.constraints.begin();
+
+  // The query joins all classes of constraints it depends on.
+  std::vector<std::size_t> dependent;
   ConstantExpr *CE = dyn_cast<ConstantExpr>(query.expr);
   if (CE) {
     assert(CE && CE->isFalse() && "the expr should always be false and "
                                   "therefore not included in factors");
   } else {
     ref<Expr> neg = Expr::createIsZero(query.expr);
-    factors->push_back(IndependentElementSet(neg));
+    IndependentElementSet current(neg);
+    partition.getDependentConstraints(neg, dependent);
+    for (auto i : dependent)
+      current.add(IndependentElementSet(constraints[i]));
+    factors->push_back(current);
   }
 
-  for (const auto &constraint : query.constraints) {
-    // iterate through all the previously separated constraints.  Until we
-    // actually return, factors is treated as a queue of expressions to be
-    // evaluated.  If the queue property isn't maintained, then the exprs
-    // could be returned in an order different from how they came it, negatively
-    // affecting later stages.
-    factors->push_back(IndependentElementSet(constraint));
+  // Constraints that read no symbolic arrays are not part of any class, they
+  // would form factors without arrays, which are not needed for a solution.
+  std::vector<std::vector<std::size_t>> classes;
+  partition.getClasses(classes);
+  for (const auto &c : classes) {
+    if (std::binary_search(dependent.begin(), dependent.end(), c.front()))
+      continue;
+    IndependentElementSet current(constraints[c.front()]);
+    for (std::size_t i = 1; i < c.size(); ++i)
+      current.add(IndependentElementSet(constraints[c[i]]));
+    factors->push_back(current);
   }
 
-  bool doneLoop = false;
-  do {
-    doneLoop = true;
-    std::list<IndependentElementSet> *done =
-        new std::list<IndependentElementSet>;
-    while (factors->size() > 0) {
-      IndependentElementSet current = factors->front();
-      factors->pop_front();
-      // This list represents the set of factors that are separate from current.
-      // Those that are not inserted into this list (queue) intersect with
-      // current.
-      std::list<IndependentElementSet> *keep =
-          new std::list<IndependentElementSet>;
-      while (factors->size() > 0) {
-        IndependentElementSet compare = factors->front();
-        factors->pop_front();
-        if (current.intersects(compare)) {
-          if (current.add(compare)) {
-            // Means that we have added (z=y)added to (x=y)
-            // Now need to see if there are any (z=?)'s
-            doneLoop = false;
-          }
-        } else {
-          keep->push_back(compare);
-        }
-      }
-      done->push_back(current);
-      delete factors;
-      factors = keep;
-    }
-    delete factors;
-    factors = done;
-  } while (!doneLoop);
-
   return factors;
 }
 
-static 
-IndependentElementSet getIndependentConstraints(const Query& query,
-                                                std::vector< ref<Expr> > &result) {
-  IndependentElementSet eltsClosure(query.expr);
-  std::vector< std::pair<ref<Expr>, IndependentElementSet> > worklist;
-
-  for (const auto &constraint : query.constraints)
-    worklist.push_back(
-        std::make_pair(constraint, IndependentElementSet(constraint)));
-
-  // XXX This should be more efficient (in terms of low level copy stuff).
-  bool done = false;
-  do {
-    done = true;
-    std::vector< std::pair<ref<Expr>, IndependentElementSet> > newWorklist;
-    for (std::vector< std::pair<ref<Expr>, IndependentElementSet> >::iterator
-           it = worklist.begin(), ie = worklist.end(); it != ie; ++it) {
-      if (it->second.intersects(eltsClosure)) {
-        if (eltsClosure.add(it->second))
-          done = false;
-        result.push_back(it->first);
-        // Means that we have added (z=y)added to (x=y)
-        // Now need to see if there are any (z=?)'s
-      } else {
-        newWorklist.push_back(*it);
-      }
-    }
-    worklist.swap(newWorklist);
-  } while (!done);
+static
+void getIndependentConstraints(const Query& query,
+                               std::vector< ref<Expr> > &result) {
+  std::vector<std::size_t> indices;
+  query.constraints.getPartition().getDependentConstraints(query.expr,
+                                                           indices);
+  const auto constraints = query.constraints.begin();
+  for (auto i : indices)
+    result.push_back(constraints[i]);
 
   KLEE_DEBUG(
     std::set< ref<Expr> > reqset(result.begin(), result.end());
@@ -360,11 +321,7 @@ IndependentElementSet getIndependentConstraints(const Query& query,
       errs() << " " << (reqset.count(constraint) ? "(required)" : "(independent)") << "\n";
       errs() << "\telts: " << IndependentElementSet(constraint) << "\n";
     }
-    errs() << "elts closure: " << eltsClosure << "\n";
  );
-
-
-  return eltsClosure;
 }
 
 
@@ -397,6 +354,9 @@ public:
       : solver(std::move(solver)) {}
 
   bool computeTruth(const Query&, bool &isValid);
+  bool computeTruthBatch(const ConstraintSet &constraints,
+                         const std::vector<ref<Expr>> &exprs,
+                         std::vector<bool> &isValid);
   bool computeValidity(const Query&, Solver::Validity &result);
   bool computeValue(const Query&, ref<Expr> &result);
   bool computeInitialValues(const Query& query,
@@ -411,8 +371,7 @@ public:
 bool IndependentSolver::computeValidity(const Query& query,
                                         Solver::Validity &result) {
   std::vector< ref<Expr> > required;
-  IndependentElementSet eltsClosure =
-    getIndependentConstraints(query, required);
+  getIndependentConstraints(query, required);
   ConstraintSet tmp(required);
   return solver->impl->computeValidity(Query(tmp, query.expr), 
                                        result);
@@ -420,17 +379,49 @@ bool IndependentSolver::computeValidity(const Query& query,
 
 bool IndependentSolver::computeTruth(const Query& query, bool &isValid) {
   std::vector< ref<Expr> > required;
-  IndependentElementSet eltsClosure = 
-    getIndependentConstraints(query, required);
+  getIndependentConstraints(query, required);
   ConstraintSet tmp(required);
   return solver->impl->computeTruth(Query(tmp, query.expr), 
                                     isValid);
 }
 
+bool IndependentSolver::computeTruthBatch(const ConstraintSet &constraints,
+                                          const std::vector<ref<Expr>> &exprs,
+                                          std::vector<bool> &isValid) {
+  // Expressions depending on the same constraints (e.g. the cases of a
+  // switch) are forwarded together.
+  std::vector<ConstraintSet> groups;
+  std::vector<std::vector<std::size_t>> members;
+  for (std::size_t i = 0; i < exprs.size(); ++i) {
+    std::vector< ref<Expr> > required;
+    getIndependentConstraints(Query(constraints, exprs[i]), required);
+    ConstraintSet tmp(required);
+    auto it = std::find(groups.begin(), groups.end(), tmp);
+    if (it == groups.end()) {
+      groups.push_back(std::move(tmp));
+      members.emplace_back();
+      it = std::prev(groups.end());
+    }
+    members[it - groups.begin()].push_back(i);
+  }
+
+  isValid.assign(exprs.size(), false);
+  for (std::size_t g = 0; g < groups.size(); ++g) {
+    std::vector<ref<Expr>> groupExprs;
+    for (auto i : members[g])
+      groupExprs.push_back(exprs[i]);
+    std::vector<bool> groupValid;
+    if (!solver->impl->computeTruthBatch(groups[g], groupExprs, groupValid))
+      return false;
+    for (std::size_t k = 0; k < members[g].size(); ++k)
+      isValid[members[g][k]] = groupValid[k];
+  }
+  return true;
+}
+
 bool IndependentSolver::computeValue(const Query& query, ref<Expr> &result) {
   std::vector< ref<Expr> > required;
-  IndependentElementSet eltsClosure = 
-    getIndependentConstraints(query, required);
+  getIndependentConstraints(query, required);
   ConstraintSet tmp(required);
   return solver->impl->computeValue(Query(tmp, query.expr), result);
 }
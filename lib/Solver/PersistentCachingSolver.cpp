@@ -0,0 +1,456 @@
+//===-- PersistentCachingSolver.cpp - On-disk query cache -----------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "klee/Solver/Solver.h"
+
+#include "klee/Expr/Constraints.h"
+#include "klee/Expr/Expr.h"
+#include "klee/Expr/ExprPPrinter.h"
+#include "klee/Solver/IncompleteSolver.h"
+#include "klee/Solver/SolverImpl.h"
+#include "klee/Solver/SolverStats.h"
+#include "klee/Support/ErrorHandling.h"
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace klee;
+
+namespace {
+
+/// File layout: a fixed header followed by a sequence of records. Records are
+/// only ever appended (under an exclusive lock), so a later record for the
+/// same key supersedes an earlier one. Several KLEE processes can share one
+/// cache file.
+constexpr char fileMagic[8] = {'K', 'Q', 'C', 'A', 'C', 'H', 'E', '1'};
+constexpr std::uint32_t recordMagic = 0x5243514b; // "KQCR"
+
+enum RecordKind : std::uint8_t { ValidityRecord = 0, InitialValuesRecord = 1 };
+
+struct RecordHeader {
+  std::uint32_t magic;
+  std::uint8_t kind;
+  std::uint8_t padding[3];
+  std::uint64_t keyHigh;
+  std::uint64_t keyLow;
+  std::uint32_t payloadSize;
+} __attribute__((packed));
+
+struct CacheKey {
+  std::uint64_t high;
+  std::uint64_t low;
+
+  bool operator==(const CacheKey &b) const {
+    return high == b.high && low == b.low;
+  }
+};
+
+struct CacheKeyHash {
+  std::size_t operator()(const CacheKey &k) const { return k.high ^ k.low; }
+};
+
+struct CacheEntry {
+  off_t offset; ///< offset of the payload in the file
+  std::uint32_t size;
+};
+
+/// Holds an flock(2) on a file descriptor for the lifetime of the object.
+class FileLock {
+  int fd;
+
+public:
+  FileLock(int fd, int operation) : fd(fd) {
+    while (::flock(fd, operation) != 0 && errno == EINTR)
+      ;
+  }
+  ~FileLock() { ::flock(fd, LOCK_UN); }
+};
+
+class PersistentCachingSolver : public SolverImpl {
+private:
+  std::unique_ptr<Solver> solver;
+  std::string path;
+  int fd = -1;
+  /// The cache file is opened and indexed lazily on the first query
+  bool opened = false;
+  /// Size of the file prefix that has been indexed so far
+  off_t indexedSize = 0;
+  std::unordered_map<CacheKey, CacheEntry, CacheKeyHash> index;
+
+  bool open();
+  bool refreshIndex(bool truncateCorruptTail);
+  bool readPayload(const CacheKey &key, std::vector<unsigned char> &payload);
+  void append(RecordKind kind, const CacheKey &key,
+              const std::vector<unsigned char> &payload);
+
+  CacheKey computeKey(RecordKind kind, const Query &query,
+                      const std::vector<const Array *> *objects);
+
+  bool validityLookup(const Query &query,
+                      IncompleteSolver::PartialValidity &result);
+  void validityInsert(const Query &query,
+                      IncompleteSolver::PartialValidity result);
+
+public:
+  PersistentCachingSolver(std::unique_ptr<Solver> solver, std::string path)
+      : solver(std::move(solver)), path(std::move(path)) {}
+  ~PersistentCachingSolver();
+
+  bool computeValidity(const Query &, Solver::Validity &result);
+  bool computeTruth(const Query &, bool &isValid);
+  bool computeValue(const Query &query, ref<Expr> &result) {
+    return solver->impl->computeValue(query, result);
+  }
+  bool computeInitialValues(const Query &query,
+                            const std::vector<const Array *> &objects,
+                            std::vector<std::vector<unsigned char>> &values,
+                            bool &hasSolution);
+  SolverRunStatus getOperationStatusCode();
+  char *getConstraintLog(const Query &);
+  void setCoreSolverTimeout(time::Span timeout);
+};
+
+PersistentCachingSolver::~PersistentCachingSolver() {
+  if (fd >= 0)
+    ::close(fd);
+}
+
+bool PersistentCachingSolver::open() {
+  if (opened)
+    return fd >= 0;
+  opened = true;
+
+  fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    klee_warning("unable to open persistent query cache %s: %s", path.c_str(),
+                 strerror(errno));
+    return false;
+  }
+
+  {
+    FileLock lock(fd, LOCK_EX);
+    struct stat st;
+    if (::fstat(fd, &st) == 0 && st.st_size == 0) {
+      if (::write(fd, fileMagic, sizeof(fileMagic)) != sizeof(fileMagic)) {
+        klee_warning("unable to initialise persistent query cache %s",
+                     path.c_str());
+        ::close(fd);
+        fd = -1;
+        return false;
+      }
+    } else {
+      char magic[sizeof(fileMagic)];
+      if (::pread(fd, magic, sizeof(magic), 0) != sizeof(magic) ||
+          std::memcmp(magic, fileMagic, sizeof(fileMagic)) != 0) {
+        klee_warning("%s is not a persistent query cache, not using it",
+                     path.c_str());
+        ::close(fd);
+        fd = -1;
+        return false;
+      }
+    }
+  }
+
+  indexedSize = sizeof(fileMagic);
+  FileLock lock(fd, LOCK_SH);
+  refreshIndex(/*truncateCorruptTail=*/false);
+  return true;
+}
+
+/// Index all records appended (by any process) since the last refresh. The
+/// caller must hold a lock on the file.
+bool PersistentCachingSolver::refreshIndex(bool truncateCorruptTail) {
+  struct stat st;
+  if (::fstat(fd, &st) != 0)
+    return false;
+
+  while (indexedSize < st.st_size) {
+    RecordHeader header;
+    if (st.st_size - indexedSize < static_cast<off_t>(sizeof(header)) ||
+        ::pread(fd, &header, sizeof(header), indexedSize) != sizeof(header) ||
+        header.magic != recordMagic ||
+        st.st_size - indexedSize - static_cast<off_t>(sizeof(header)) <
+            static_cast<off_t>(header.payloadSize)) {
+      // A process died while appending: drop the incomplete record so that
+      // subsequent records are readable again.
+      if (truncateCorruptTail && ::ftruncate(fd, indexedSize) == 0)
+        return true;
+      return false;
+    }
+    index[{header.keyHigh, header.keyLow}] = {
+        static_cast<off_t>(indexedSize + sizeof(header)), header.payloadSize};
+    indexedSize += sizeof(header) + header.payloadSize;
+  }
+  return true;
+}
+
+bool PersistentCachingSolver::readPayload(const CacheKey &key,
+                                          std::vector<unsigned char> &payload) {
+  if (!open())
+    return false;
+
+  auto it = index.find(key);
+  if (it == index.end()) {
+    // other processes may have answered this query in the meantime
+    FileLock lock(fd, LOCK_SH);
+    refreshIndex(/*truncateCorruptTail=*/false);
+    it = index.find(key);
+    if (it == index.end())
+      return false;
+  }
+
+  payload.resize(it->second.size);
+  return ::pread(fd, payload.data(), payload.size(), it->second.offset) ==
+         static_cast<ssize_t>(payload.size());
+}
+
+void PersistentCachingSolver::append(RecordKind kind, const CacheKey &key,
+                                     const std::vector<unsigned char> &payload) {
+  if (!open())
+    return;
+
+  RecordHeader header = {};
+  header.magic = recordMagic;
+  header.kind = kind;
+  header.keyHigh = key.high;
+  header.keyLow = key.low;
+  header.payloadSize = payload.size();
+
+  std::vector<unsigned char> record(sizeof(header) + payload.size());
+  std::memcpy(record.data(), &header, sizeof(header));
+  std::memcpy(record.data() + sizeof(header), payload.data(), payload.size());
+
+  FileLock lock(fd, LOCK_EX);
+  if (!refreshIndex(/*truncateCorruptTail=*/true))
+    return;
+  if (::write(fd, record.data(), record.size()) !=
+      static_cast<ssize_t>(record.size())) {
+    // leave the partial record to be truncated by the next writer
+    klee_warning_once(0, "failed writing to persistent query cache %s",
+                      path.c_str());
+    return;
+  }
+  index[key] = {static_cast<off_t>(indexedSize + sizeof(header)),
+                header.payloadSize};
+  indexedSize += record.size();
+}
+
+/// The key is the MD5 digest of the query's KQuery representation, which is
+/// stable across runs as long as the arrays keep their names.
+CacheKey
+PersistentCachingSolver::computeKey(RecordKind kind, const Query &query,
+                                    const std::vector<const Array *> *objects) {
+  std::string text;
+  llvm::raw_string_ostream os(text);
+  os << static_cast<unsigned>(kind) << '\n';
+  if (objects) {
+    ExprPPrinter::printQuery(os, query.constraints, query.expr, nullptr,
+                             nullptr, objects->data(),
+                             objects->data() + objects->size());
+  } else {
+    ExprPPrinter::printQuery(os, query.constraints, query.expr);
+  }
+  os.flush();
+
+  llvm::MD5 hash;
+  hash.update(llvm::StringRef(text));
+  llvm::MD5::MD5Result digest;
+  hash.final(digest);
+  return {digest.high(), digest.low()};
+}
+
+/// As in the CachingSolver, a query and its negation share one entry.
+static ref<Expr> canonicalizeQuery(ref<Expr> originalQuery,
+                                   bool &negationUsed) {
+  ref<Expr> negatedQuery = Expr::createIsZero(originalQuery);
+
+  if (originalQuery.compare(negatedQuery) < 0) {
+    negationUsed = false;
+    return originalQuery;
+  } else {
+    negationUsed = true;
+    return negatedQuery;
+  }
+}
+
+bool PersistentCachingSolver::validityLookup(
+    const Query &query, IncompleteSolver::PartialValidity &result) {
+  bool negationUsed;
+  ref<Expr> canonicalQuery = canonicalizeQuery(query.expr, negationUsed);
+
+  std::vector<unsigned char> payload;
+  if (!readPayload(computeKey(ValidityRecord, query.withExpr(canonicalQuery),
+                              nullptr),
+                   payload) ||
+      payload.size() != 1)
+    return false;
+
+  auto cached = static_cast<IncompleteSolver::PartialValidity>(
+      static_cast<signed char>(payload[0]));
+  result = negationUsed ? IncompleteSolver::negatePartialValidity(cached)
+                        : cached;
+  return true;
+}
+
+void PersistentCachingSolver::validityInsert(
+    const Query &query, IncompleteSolver::PartialValidity result) {
+  bool negationUsed;
+  ref<Expr> canonicalQuery = canonicalizeQuery(query.expr, negationUsed);
+  IncompleteSolver::PartialValidity cachedResult =
+      negationUsed ? IncompleteSolver::negatePartialValidity(result) : result;
+
+  append(ValidityRecord,
+         computeKey(ValidityRecord, query.withExpr(canonicalQuery), nullptr),
+         {static_cast<unsigned char>(cachedResult)});
+}
+
+bool PersistentCachingSolver::computeValidity(const Query &query,
+                                              Solver::Validity &result) {
+  IncompleteSolver::PartialValidity cachedResult;
+  if (validityLookup(query, cachedResult)) {
+    switch (cachedResult) {
+    case IncompleteSolver::MustBeTrue:
+      result = Solver::True;
+      ++stats::queryPersistentCacheHits;
+      return true;
+    case IncompleteSolver::MustBeFalse:
+      result = Solver::False;
+      ++stats::queryPersistentCacheHits;
+      return true;
+    case IncompleteSolver::TrueOrFalse:
+      result = Solver::Unknown;
+      ++stats::queryPersistentCacheHits;
+      return true;
+    default:
+      // only partial knowledge, ask the solver
+      break;
+    }
+  }
+
+  ++stats::queryPersistentCacheMisses;
+  if (!solver->impl->computeValidity(query, result))
+    return false;
+
+  switch (result) {
+  case Solver::True:
+    cachedResult = IncompleteSolver::MustBeTrue;
+    break;
+  case Solver::False:
+    cachedResult = IncompleteSolver::MustBeFalse;
+    break;
+  default:
+    cachedResult = IncompleteSolver::TrueOrFalse;
+    break;
+  }
+  validityInsert(query, cachedResult);
+  return true;
+}
+
+bool PersistentCachingSolver::computeTruth(const Query &query, bool &isValid) {
+  IncompleteSolver::PartialValidity cachedResult;
+  bool cacheHit = validityLookup(query, cachedResult);
+
+  // a cached result of MayBeTrue forces us to check whether
+  // a False assignment exists.
+  if (cacheHit && cachedResult != IncompleteSolver::MayBeTrue) {
+    ++stats::queryPersistentCacheHits;
+    isValid = (cachedResult == IncompleteSolver::MustBeTrue);
+    return true;
+  }
+
+  ++stats::queryPersistentCacheMisses;
+  if (!solver->impl->computeTruth(query, isValid))
+    return false;
+
+  if (isValid) {
+    cachedResult = IncompleteSolver::MustBeTrue;
+  } else if (cacheHit) {
+    cachedResult = IncompleteSolver::TrueOrFalse;
+  } else {
+    cachedResult = IncompleteSolver::MayBeFalse;
+  }
+  validityInsert(query, cachedResult);
+  return true;
+}
+
+bool PersistentCachingSolver::computeInitialValues(
+    const Query &query, const std::vector<const Array *> &objects,
+    std::vector<std::vector<unsigned char>> &values, bool &hasSolution) {
+  const CacheKey key = computeKey(InitialValuesRecord, query, &objects);
+
+  // Payload: hasSolution byte, followed by the bytes of each object
+  std::vector<unsigned char> payload;
+  if (readPayload(key, payload) && !payload.empty()) {
+    std::size_t expected = 1;
+    if (payload[0])
+      for (const Array *array : objects)
+        expected += array->size;
+
+    if (payload.size() == expected) {
+      ++stats::queryPersistentCacheHits;
+      hasSolution = payload[0];
+      if (hasSolution) {
+        const unsigned char *data = payload.data() + 1;
+        values.reserve(objects.size());
+        for (const Array *array : objects) {
+          values.emplace_back(data, data + array->size);
+          data += array->size;
+        }
+      }
+      return true;
+    }
+  }
+
+  ++stats::queryPersistentCacheMisses;
+  if (!solver->impl->computeInitialValues(query, objects, values, hasSolution))
+    return false;
+
+  payload.assign(1, hasSolution);
+  if (hasSolution)
+    for (const auto &value : values)
+      payload.insert(payload.end(), value.begin(), value.end());
+  append(InitialValuesRecord, key, payload);
+  return true;
+}
+
+SolverImpl::SolverRunStatus PersistentCachingSolver::getOperationStatusCode() {
+  return solver->impl->getOperationStatusCode();
+}
+
+char *PersistentCachingSolver::getConstraintLog(const Query &query) {
+  return solver->impl->getConstraintLog(query);
+}
+
+void PersistentCachingSolver::setCoreSolverTimeout(time::Span timeout) {
+  solver->impl->setCoreSolverTimeout(timeout);
+}
+
+} // namespace
+
+std::unique_ptr<Solver>
+klee::createPersistentCachingSolver(std::unique_ptr<Solver> solver,
+                                    std::string path) {
+  return std::make_unique<Solver>(std::make_unique<PersistentCachingSolver>(
+      std::move(solver), std::move(path)));
+}
@@ -0,0 +1,390 @@
+//===-- PortfolioSolver.cpp - Race several core solvers -------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "klee/Solver/Solver.h"
+
+#include "klee/Expr/Constraints.h"
+#include "klee/Expr/Expr.h"
+#include "klee/Expr/ExprUtil.h"
+#include "klee/Solver/SolverImpl.h"
+#include "klee/Solver/SolverStats.h"
+#include "klee/Statistics/TimerStatIncrementer.h"
+#include "klee/Support/ErrorHandling.h"
+
+#include "llvm/ADT/APInt.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/Support/Errno.h"
+#include "llvm/Support/MathExtras.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <cerrno>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace klee;
+
+namespace {
+
+/// Each backend runs in a forked child process which reports its answer over
+/// a pipe: the success flag, the run status code and the serialized result.
+struct ResultHeader {
+  std::uint8_t success;
+  std::uint32_t status;
+} __attribute__((packed));
+
+/// A backend running a query in a child process.
+struct Contestant {
+  pid_t pid;
+  int fd;
+  std::string message;
+};
+
+class PortfolioSolver : public SolverImpl {
+  /// Runs a query on a backend and serializes the result into the string.
+  typedef std::function<bool(SolverImpl &, std::string &)> Task;
+
+  std::vector<std::unique_ptr<Solver>> backends;
+  std::vector<std::string> names;
+  SolverRunStatus runStatusCode;
+
+  /// Number of queries first answered by each backend, per query shape
+  std::map<std::string, std::vector<std::uint64_t>> wins;
+
+  std::string getQueryShape(const char *kind, const Query &query) const;
+
+  /// Run the task on all backends in parallel and return the result of the
+  /// first backend to succeed. The other backends are killed.
+  bool race(const char *kind, const Query &query, const Task &task,
+            std::string &result);
+
+public:
+  PortfolioSolver(std::vector<std::unique_ptr<Solver>> backends,
+                  std::vector<std::string> names)
+      : backends(std::move(backends)), names(std::move(names)),
+        runStatusCode(SOLVER_RUN_STATUS_FAILURE) {
+    assert(this->backends.size() == this->names.size());
+  }
+  ~PortfolioSolver();
+
+  bool computeValidity(const Query &, Solver::Validity &result);
+  bool computeTruth(const Query &, bool &isValid);
+  bool computeValue(const Query &, ref<Expr> &result);
+  bool computeInitialValues(const Query &query,
+                            const std::vector<const Array *> &objects,
+                            std::vector<std::vector<unsigned char>> &values,
+                            bool &hasSolution);
+  SolverRunStatus getOperationStatusCode() { return runStatusCode; }
+  char *getConstraintLog(const Query &query) {
+    return backends.front()->impl->getConstraintLog(query);
+  }
+  void setCoreSolverTimeout(time::Span timeout) {
+    for (auto &backend : backends)
+      backend->impl->setCoreSolverTimeout(timeout);
+  }
+};
+
+PortfolioSolver::~PortfolioSolver() {
+  if (wins.empty())
+    return;
+
+  std::string table;
+  llvm::raw_string_ostream os(table);
+  for (const auto &shape : wins) {
+    os << "\n  " << shape.first << ":";
+    for (std::size_t i = 0; i < names.size(); ++i)
+      os << " " << names[i] << "=" << shape.second[i];
+  }
+  klee_message("Portfolio solver wins per query shape:%s", os.str().c_str());
+}
+
+/// The shape of a query is its kind and the (logarithmic) number of its
+/// constraints and symbolic arrays.
+std::string PortfolioSolver::getQueryShape(const char *kind,
+                                           const Query &query) const {
+  std::vector<ref<Expr>> exprs(query.constraints.begin(),
+                               query.constraints.end());
+  exprs.push_back(query.expr);
+  std::vector<const Array *> arrays;
+  findSymbolicObjects(exprs.begin(), exprs.end(), arrays);
+
+  std::string shape;
+  llvm::raw_string_ostream os(shape);
+  os << kind << " constraints<=" << llvm::PowerOf2Ceil(exprs.size() - 1)
+     << " arrays<=" << llvm::PowerOf2Ceil(arrays.size());
+  return os.str();
+}
+
+bool PortfolioSolver::race(const char *kind, const Query &query,
+                           const Task &task, std::string &result) {
+  TimerStatIncrementer t(stats::queryTime);
+  runStatusCode = SOLVER_RUN_STATUS_FAILURE;
+
+  fflush(stdout);
+  fflush(stderr);
+
+  std::vector<Contestant> contestants;
+  auto killAll = [&contestants]() {
+    for (auto &c : contestants) {
+      if (c.fd < 0)
+        continue;
+      ::kill(c.pid, SIGKILL);
+      ::close(c.fd);
+      c.fd = -1;
+      while (::waitpid(c.pid, nullptr, 0) < 0 && errno == EINTR)
+        ;
+    }
+  };
+
+  for (auto &backend : backends) {
+    int fds[2];
+    if (::pipe(fds) != 0) {
+      klee_warning("pipe failed (for portfolio solver) - %s",
+                   llvm::sys::StrError(errno).c_str());
+      killAll();
+      runStatusCode = SOLVER_RUN_STATUS_FORK_FAILED;
+      return false;
+    }
+
+    pid_t pid = ::fork();
+    // - error
+    if (pid == -1) {
+      klee_warning("fork failed (for portfolio solver) - %s",
+                   llvm::sys::StrError(errno).c_str());
+      ::close(fds[0]);
+      ::close(fds[1]);
+      killAll();
+      runStatusCode = SOLVER_RUN_STATUS_FORK_FAILED;
+      return false;
+    }
+    // - child (backend)
+    if (pid == 0) {
+      ::close(fds[0]);
+      std::string payload;
+      ResultHeader header;
+      header.success = task(*backend->impl, payload);
+      header.status = backend->impl->getOperationStatusCode();
+      std::string message(reinterpret_cast<const char *>(&header),
+                          sizeof(header));
+      message += payload;
+      const char *data = message.data();
+      std::size_t remaining = message.size();
+      while (remaining) {
+        ssize_t written = ::write(fds[1], data, remaining);
+        if (written < 0 && errno == EINTR)
+          continue;
+        if (written <= 0)
+          _exit(1);
+        data += written;
+        remaining -= written;
+      }
+      _exit(0);
+    }
+    // - parent
+    ::close(fds[1]);
+    contestants.push_back({pid, fds[0], {}});
+  }
+
+  ++stats::solverQueries;
+
+  // Collect the answers as they arrive; a contestant is done at end of file.
+  std::size_t running = contestants.size();
+  while (running) {
+    std::vector<pollfd> pfds;
+    std::vector<std::size_t> indices;
+    for (std::size_t i = 0; i < contestants.size(); ++i) {
+      if (contestants[i].fd >= 0) {
+        pfds.push_back({contestants[i].fd, POLLIN, 0});
+        indices.push_back(i);
+      }
+    }
+
+    if (::poll(pfds.data(), pfds.size(), -1) < 0) {
+      if (errno == EINTR)
+        continue;
+      klee_warning("poll failed (for portfolio solver) - %s",
+                   llvm::sys::StrError(errno).c_str());
+      killAll();
+      runStatusCode = SOLVER_RUN_STATUS_WAITPID_FAILED;
+      return false;
+    }
+
+    for (std::size_t k = 0; k < pfds.size(); ++k) {
+      if (!pfds[k].revents)
+        continue;
+      auto &c = contestants[indices[k]];
+      char buffer[4096];
+      ssize_t n = ::read(c.fd, buffer, sizeof(buffer));
+      if (n < 0 && errno == EINTR)
+        continue;
+      if (n > 0) {
+        c.message.append(buffer, n);
+        continue;
+      }
+
+      // end of file (or a broken pipe): the backend is done
+      ::close(c.fd);
+      c.fd = -1;
+      --running;
+      int status;
+      while (::waitpid(c.pid, &status, 0) < 0 && errno == EINTR)
+        ;
+
+      if (c.message.size() < sizeof(ResultHeader)) {
+        runStatusCode = SOLVER_RUN_STATUS_UNEXPECTED_EXIT_CODE;
+        continue;
+      }
+      ResultHeader header;
+      std::memcpy(&header, c.message.data(), sizeof(header));
+      runStatusCode = static_cast<SolverRunStatus>(header.status);
+      if (!header.success)
+        continue;
+
+      // the first successful backend wins
+      killAll();
+      std::size_t winner = indices[k];
+      auto &counts = wins[getQueryShape(kind, query)];
+      counts.resize(backends.size());
+      ++counts[winner];
+      result = c.message.substr(sizeof(ResultHeader));
+      return true;
+    }
+  }
+
+  // all backends failed, report the status of the last one
+  if (runStatusCode == SOLVER_RUN_STATUS_INTERRUPTED)
+    raise(SIGINT);
+  return false;
+}
+
+bool PortfolioSolver::computeValidity(const Query &query,
+                                      Solver::Validity &result) {
+  std::string payload;
+  if (!race("validity", query,
+            [&query](SolverImpl &impl, std::string &out) {
+              Solver::Validity validity;
+              if (!impl.computeValidity(query, validity))
+                return false;
+              out.push_back(static_cast<char>(validity));
+              return true;
+            },
+            payload))
+    return false;
+
+  result = static_cast<Solver::Validity>(static_cast<signed char>(payload[0]));
+  return true;
+}
+
+bool PortfolioSolver::computeTruth(const Query &query, bool &isValid) {
+  std::string payload;
+  if (!race("truth", query,
+            [&query](SolverImpl &impl, std::string &out) {
+              bool valid;
+              if (!impl.computeTruth(query, valid))
+                return false;
+              out.push_back(valid);
+              return true;
+            },
+            payload))
+    return false;
+
+  isValid = payload[0];
+  if (isValid)
+    ++stats::queriesValid;
+  else
+    ++stats::queriesInvalid;
+  return true;
+}
+
+bool PortfolioSolver::computeValue(const Query &query, ref<Expr> &result) {
+  std::string payload;
+  if (!race("value", query,
+            [&query](SolverImpl &impl, std::string &out) {
+              ref<Expr> value;
+              if (!impl.computeValue(query, value))
+                return false;
+              const llvm::APInt &bits = cast<ConstantExpr>(value)->getAPValue();
+              const std::uint32_t width = bits.getBitWidth();
+              out.append(reinterpret_cast<const char *>(&width), sizeof(width));
+              out.append(reinterpret_cast<const char *>(bits.getRawData()),
+                         bits.getNumWords() * sizeof(std::uint64_t));
+              return true;
+            },
+            payload))
+    return false;
+
+  std::uint32_t width;
+  std::memcpy(&width, payload.data(), sizeof(width));
+  std::vector<std::uint64_t> words((payload.size() - sizeof(width)) /
+                                   sizeof(std::uint64_t));
+  std::memcpy(words.data(), payload.data() + sizeof(width),
+              words.size() * sizeof(std::uint64_t));
+  result = ConstantExpr::alloc(llvm::APInt(width, words));
+  return true;
+}
+
+bool PortfolioSolver::computeInitialValues(
+    const Query &query, const std::vector<const Array *> &objects,
+    std::vector<std::vector<unsigned char>> &values, bool &hasSolution) {
+  ++stats::queryCounterexamples;
+
+  std::string payload;
+  if (!race("initial-values", query,
+            [&query, &objects](SolverImpl &impl, std::string &out) {
+              std::vector<std::vector<unsigned char>> values;
+              bool hasSolution;
+              if (!impl.computeInitialValues(query, objects, values,
+                                             hasSolution))
+                return false;
+              out.push_back(hasSolution);
+              if (hasSolution)
+                for (const auto &value : values)
+                  out.append(value.begin(), value.end());
+              return true;
+            },
+            payload))
+    return false;
+
+  hasSolution = payload[0];
+  if (hasSolution) {
+    ++stats::queriesInvalid;
+    const unsigned char *data =
+        reinterpret_cast<const unsigned char *>(payload.data()) + 1;
+    values.clear();
+    values.reserve(objects.size());
+    for (const auto *object : objects) {
+      values.emplace_back(data, data + object->size);
+      data += object->size;
+    }
+  } else {
+    ++stats::queriesValid;
+  }
+  return true;
+}
+
+} // namespace
+
+std::unique_ptr<Solver>
+klee::createPortfolioSolver(std::vector<std::unique_ptr<Solver>> backends,
+                            std::vector<std::string> names) {
+  return std::make_unique<Solver>(std::make_unique<PortfolioSolver>(
+      std::move(backends), std::move(names)));
+}
@@ -79,6 +79,49 @@ bool Solver::mayBeFalse(const Query& query, bool &result) {
   return true;
 }
 
+bool Solver::mustBeTrue(const ConstraintSet &constraints,
+                        const std::vector<ref<Expr>> &exprs,
+                        std::vector<bool> &results) {
+  results.assign(exprs.size(), false);
+
+  // Maintain invariants implementations expect.
+  std::vector<ref<Expr>> queries;
+  std::vector<std::size_t> indices;
+  for (std::size_t i = 0; i < exprs.size(); ++i) {
+    assert(exprs[i]->getWidth() == Expr::Bool && "Invalid expression type!");
+    if (ConstantExpr *CE = dyn_cast<ConstantExpr>(exprs[i])) {
+      results[i] = CE->isTrue();
+    } else {
+      queries.push_back(exprs[i]);
+      indices.push_back(i);
+    }
+  }
+
+  if (queries.empty())
+    return true;
+
+  std::vector<bool> isValid;
+  if (!impl->computeTruthBatch(constraints, queries, isValid))
+    return false;
+  for (std::size_t i = 0; i < indices.size(); ++i)
+    results[indices[i]] = isValid[i];
+  return true;
+}
+
+bool Solver::mayBeTrue(const ConstraintSet &constraints,
+                       const std::vector<ref<Expr>> &exprs,
+                       std::vector<bool> &results) {
+  std::vector<ref<Expr>> negated;
+  negated.reserve(exprs.size());
+  for (const auto &e : exprs)
+    negated.push_back(Expr::createIsZero(e));
+
+  if (!mustBeTrue(constraints, negated, results))
+    return false;
+  results.flip();
+  return true;
+}
+
 bool Solver::getValue(const Query& query, ref<ConstantExpr> &result) {
   // Maintain invariants implementation expect.
   if (ConstantExpr *CE = dyn_cast<ConstantExpr>(query.expr)) {
@@ -109,6 +152,13 @@ Solver::getInitialValues(const Query& query,
   return success;
 }
 
+bool Solver::getInitialValues(const Query &query,
+                              const std::vector<const Array *> &objects,
+                              std::vector<std::vector<unsigned char>> &values,
+                              bool &hasSolution) {
+  return impl->computeInitialValues(query, objects, values, hasSolution);
+}
+
 std::pair< ref<Expr>, ref<Expr> > Solver::getRange(const Query& query) {
   ref<Expr> e = query.expr;
   Expr::Width width = e->getWidth();
@@ -51,6 +51,13 @@ cl::opt<bool> UseBranchCache("use-branch-cache", cl::init(true),
                              cl::desc("Use the branch cache (default=true)"),
                              cl::cat(SolvingCat));
 
+cl::opt<std::string> PersistentQueryCache(
+    "persistent-query-cache",
+    cl::desc("Cache the queries reaching the core solver in the given file, "
+             "which is kept across runs and may be shared by concurrent KLEE "
+             "processes (default=off)"),
+    cl::value_desc("path"), cl::cat(SolvingCat));
+
 cl::opt<bool>
     UseIndependentSolver("use-independent-solver", cl::init(true),
                          cl::desc("Use constraint independence (default=true)"),
@@ -196,9 +203,20 @@ cl::opt<CoreSolverType> CoreSolverToUse(
                clEnumValN(METASMT_SOLVER, "metasmt",
                           "metaSMT" METASMT_IS_DEFAULT_STR),
                clEnumValN(DUMMY_SOLVER, "dummy", "Dummy solver"),
-               clEnumValN(Z3_SOLVER, "z3", "Z3" Z3_IS_DEFAULT_STR)),
+               clEnumValN(Z3_SOLVER, "z3", "Z3" Z3_IS_DEFAULT_STR),
+               clEnumValN(PORTFOLIO_SOLVER, "portfolio",
+                          "Race the backends given by -portfolio-solvers")),
     cl::init(DEFAULT_CORE_SOLVER), cl::cat(SolvingCat));
 
+cl::list<CoreSolverType> PortfolioSolvers(
+    "portfolio-solvers",
+    cl::desc("Comma-separated list of the core solver backends raced by the "
+             "portfolio solver (-solver-backend=portfolio)"),
+    cl::values(clEnumValN(STP_SOLVER, "stp", "STP"),
+               clEnumValN(METASMT_SOLVER, "metasmt", "metaSMT"),
+               clEnumValN(Z3_SOLVER, "z3", "Z3")),
+    cl::CommaSeparated, cl::cat(SolvingCat));
+
 cl::opt<CoreSolverType> DebugCrossCheckCoreSolverWith(
     "debug-crosscheck-core-solver",
     cl::desc(
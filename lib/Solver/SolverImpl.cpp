@@ -28,6 +28,36 @@ bool SolverImpl::computeValidity(const Query &query, Solver::Validity &result) {
   return true;
 }
 
+bool SolverImpl::computeTruthBatch(const ConstraintSet &constraints,
+                                   const std::vector<ref<Expr>> &exprs,
+                                   std::vector<bool> &isValid) {
+  isValid.assign(exprs.size(), false);
+  for (std::size_t i = 0; i < exprs.size(); ++i) {
+    bool result;
+    if (!computeTruth(Query(constraints, exprs[i]), result))
+      return false;
+    isValid[i] = result;
+  }
+  return true;
+}
+
+bool SolverImpl::computeInitialValuesBatch(
+    const ConstraintSet &constraints, const std::vector<ref<Expr>> &exprs,
+    const std::vector<const Array *> &objects,
+    std::vector<std::vector<std::vector<unsigned char>>> &values,
+    std::vector<bool> &hasSolution) {
+  values.assign(exprs.size(), {});
+  hasSolution.assign(exprs.size(), false);
+  for (std::size_t i = 0; i < exprs.size(); ++i) {
+    bool result;
+    if (!computeInitialValues(Query(constraints, exprs[i]), objects, values[i],
+                              result))
+      return false;
+    hasSolution[i] = result;
+  }
+  return true;
+}
+
 const char *SolverImpl::getOperationStatusString(SolverRunStatus statusCode) {
   switch (statusCode) {
   case SOLVER_RUN_STATUS_SUCCESS_SOLVABLE:
@@ -27,7 +27,9 @@
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/raw_ostream.h"
 
+#include <algorithm>
 #include <memory>
+#include <unordered_set>
 
 namespace {
 // NOTE: Very useful for debugging Z3 behaviour. These files can be given to
@@ -51,6 +53,15 @@ llvm::cl::opt<unsigned>
     Z3VerbosityLevel("debug-z3-verbosity", llvm::cl::init(0),
                      llvm::cl::desc("Z3 verbosity level (default=0)"),
                      llvm::cl::cat(klee::SolvingCat));
+
+llvm::cl::opt<unsigned> Z3IncrementalSolvers(
+    "z3-incremental-solvers", llvm::cl::init(0),
+    llvm::cl::desc("Keep up to this many Z3 solvers alive between queries and "
+                   "only re-assert the constraints that differ from the "
+                   "previous query via push/pop. Note that Z3 uses a "
+                   "different internal solver in incremental mode "
+                   "(default=0 (off))"),
+    llvm::cl::cat(klee::SolvingCat));
 }
 
 #include "llvm/Support/ErrorHandling.h"
@@ -67,10 +78,50 @@ private:
   // Parameter symbols
   ::Z3_symbol timeoutParamStrSymbol;
 
+  /// A Z3 solver that is kept alive between queries (-z3-incremental-solvers).
+  /// Every constraint is asserted in its own scope, so a query sharing a
+  /// prefix of constraints with the previous one only pops the diverging
+  /// suffix and pushes its own remaining constraints.
+  struct IncrementalSolver {
+    ::Z3_solver solver = nullptr;
+    /// Constraints asserted in the solver, one scope per constraint
+    std::vector<ref<Expr>> constraints;
+    /// Constant arrays whose assertions were added in the same scope
+    std::vector<std::vector<const Array *>> scopeArrays;
+    /// Constant arrays whose assertions are currently asserted
+    std::unordered_set<const Array *> assertedArrays;
+    std::uint64_t lastUse = 0;
+  };
+  std::vector<IncrementalSolver> incrementalSolvers;
+  std::uint64_t incrementalUseCounter = 0;
+
+  IncrementalSolver &getIncrementalSolver(const ConstraintSet &constraints);
+  void assertConstantArrays(IncrementalSolver &is, const ref<Expr> &e,
+                            std::vector<const Array *> *newArrays);
+
+  /// Assert the constraints in the solver used for a series of queries
+  /// under them, either a pooled incremental solver or a fresh solver that
+  /// is set up in \a transient.
+  IncrementalSolver &beginSession(const ConstraintSet &constraints,
+                                  IncrementalSolver &transient);
+  void endSession(IncrementalSolver &transient);
+
+  /// Check a single query expression in a session. If \a scoped is set,
+  /// its assertions are dropped afterwards.
+  bool checkQuery(IncrementalSolver &is, const ref<Expr> &expr, bool scoped,
+                  const std::vector<const Array *> *objects,
+                  std::vector<std::vector<unsigned char> > *values,
+                  bool &hasSolution);
+
   bool internalRunSolver(const Query &,
                          const std::vector<const Array *> *objects,
                          std::vector<std::vector<unsigned char> > *values,
                          bool &hasSolution);
+  bool internalRunSolverBatch(
+      const ConstraintSet &constraints, const std::vector<ref<Expr>> &exprs,
+      const std::vector<const Array *> *objects,
+      std::vector<std::vector<std::vector<unsigned char>>> *values,
+      std::vector<bool> &hasSolution);
   bool validateZ3Model(::Z3_solver &theSolver, ::Z3_model &theModel);
 
 public:
@@ -86,6 +137,8 @@ public:
       timeoutInMilliSeconds = UINT_MAX;
     Z3_params_set_uint(builder->ctx, solverParameters, timeoutParamStrSymbol,
                        timeoutInMilliSeconds);
+    for (auto &is : incrementalSolvers)
+      Z3_solver_set_params(builder->ctx, is.solver, solverParameters);
   }
 
   bool computeTruth(const Query &, bool &isValid);
@@ -94,6 +147,14 @@ public:
                             const std::vector<const Array *> &objects,
                             std::vector<std::vector<unsigned char> > &values,
                             bool &hasSolution);
+  bool computeTruthBatch(const ConstraintSet &constraints,
+                         const std::vector<ref<Expr>> &exprs,
+                         std::vector<bool> &isValid);
+  bool computeInitialValuesBatch(
+      const ConstraintSet &constraints, const std::vector<ref<Expr>> &exprs,
+      const std::vector<const Array *> &objects,
+      std::vector<std::vector<std::vector<unsigned char>>> &values,
+      std::vector<bool> &hasSolution);
   SolverRunStatus
   handleSolverResponse(::Z3_solver theSolver, ::Z3_lbool satisfiable,
                        const std::vector<const Array *> *objects,
@@ -136,6 +197,8 @@ Z3SolverImpl::Z3SolverImpl()
 }
 
 Z3SolverImpl::~Z3SolverImpl() {
+  for (auto &is : incrementalSolvers)
+    Z3_solver_dec_ref(builder->ctx, is.solver);
   Z3_params_dec_ref(builder->ctx, solverParameters);
 }
 
@@ -247,44 +310,155 @@ bool Z3SolverImpl::computeInitialValues(
   return internalRunSolver(query, &objects, &values, hasSolution);
 }
 
-bool Z3SolverImpl::internalRunSolver(
-    const Query &query, const std::vector<const Array *> *objects,
-    std::vector<std::vector<unsigned char> > *values, bool &hasSolution) {
+bool Z3SolverImpl::computeTruthBatch(const ConstraintSet &constraints,
+                                     const std::vector<ref<Expr>> &exprs,
+                                     std::vector<bool> &isValid) {
+  std::vector<bool> hasSolution;
+  bool status = internalRunSolverBatch(constraints, exprs, /*objects=*/NULL,
+                                       /*values=*/NULL, hasSolution);
+  isValid = hasSolution;
+  isValid.flip();
+  return status;
+}
 
-  TimerStatIncrementer t(stats::queryTime);
-  // NOTE: Z3 will switch to using a slower solver internally if push/pop are
-  // used so for now it is likely that creating a new solver each time is the
-  // right way to go until Z3 changes its behaviour.
-  //
-  // TODO: Investigate using a custom tactic as described in
-  // https://github.com/klee/klee/issues/653
-  Z3_solver theSolver = Z3_mk_solver(builder->ctx);
-  Z3_solver_inc_ref(builder->ctx, theSolver);
-  Z3_solver_set_params(builder->ctx, theSolver, solverParameters);
+bool Z3SolverImpl::computeInitialValuesBatch(
+    const ConstraintSet &constraints, const std::vector<ref<Expr>> &exprs,
+    const std::vector<const Array *> &objects,
+    std::vector<std::vector<std::vector<unsigned char>>> &values,
+    std::vector<bool> &hasSolution) {
+  return internalRunSolverBatch(constraints, exprs, &objects, &values,
+                                hasSolution);
+}
 
-  runStatusCode = SOLVER_RUN_STATUS_FAILURE;
+Z3SolverImpl::IncrementalSolver &
+Z3SolverImpl::getIncrementalSolver(const ConstraintSet &constraints) {
+  // Pick the solver sharing the longest constraint prefix with the query.
+  // Sibling states share the constraints of their common ancestor, so this
+  // tends to route queries of related states to the same solver.
+  IncrementalSolver *best = nullptr;
+  std::size_t bestPrefix = 0;
+  for (auto &is : incrementalSolvers) {
+    auto mismatch = std::mismatch(is.constraints.begin(), is.constraints.end(),
+                                  constraints.begin(), constraints.end());
+    auto prefix =
+        static_cast<std::size_t>(mismatch.first - is.constraints.begin());
+    if (!best || prefix > bestPrefix ||
+        (prefix == bestPrefix && is.lastUse < best->lastUse)) {
+      best = &is;
+      bestPrefix = prefix;
+    }
+  }
 
-  ConstantArrayFinder constant_arrays_in_query;
-  for (auto const &constraint : query.constraints) {
-    Z3_solver_assert(builder->ctx, theSolver, builder->construct(constraint));
-    constant_arrays_in_query.visit(constraint);
+  if (!best || (bestPrefix == 0 && !best->constraints.empty() &&
+                incrementalSolvers.size() < Z3IncrementalSolvers)) {
+    incrementalSolvers.emplace_back();
+    best = &incrementalSolvers.back();
+    best->solver = Z3_mk_solver(builder->ctx);
+    Z3_solver_inc_ref(builder->ctx, best->solver);
+    Z3_solver_set_params(builder->ctx, best->solver, solverParameters);
   }
-  ++stats::solverQueries;
-  if (objects)
-    ++stats::queryCounterexamples;
 
-  Z3ASTHandle z3QueryExpr =
-      Z3ASTHandle(builder->construct(query.expr), builder->ctx);
-  constant_arrays_in_query.visit(query.expr);
+  best->lastUse = ++incrementalUseCounter;
+  return *best;
+}
 
-  for (auto const &constant_array : constant_arrays_in_query.results) {
+void Z3SolverImpl::assertConstantArrays(IncrementalSolver &is,
+                                        const ref<Expr> &e,
+                                        std::vector<const Array *> *newArrays) {
+  ConstantArrayFinder constant_arrays;
+  constant_arrays.visit(e);
+  for (auto const &constant_array : constant_arrays.results) {
+    if (is.assertedArrays.count(constant_array))
+      continue;
     assert(builder->constant_array_assertions.count(constant_array) == 1 &&
            "Constant array found in query, but not handled by Z3Builder");
     for (auto const &arrayIndexValueExpr :
          builder->constant_array_assertions[constant_array]) {
-      Z3_solver_assert(builder->ctx, theSolver, arrayIndexValueExpr);
+      Z3_solver_assert(builder->ctx, is.solver, arrayIndexValueExpr);
+    }
+    if (newArrays) {
+      is.assertedArrays.insert(constant_array);
+      newArrays->push_back(constant_array);
     }
   }
+}
+
+Z3SolverImpl::IncrementalSolver &
+Z3SolverImpl::beginSession(const ConstraintSet &constraints,
+                           IncrementalSolver &transient) {
+  if (!Z3IncrementalSolvers) {
+    // NOTE: Z3 will switch to using a slower solver internally if push/pop
+    // are used so by default a new solver is created for each query (see
+    // -z3-incremental-solvers).
+    //
+    // TODO: Investigate using a custom tactic as described in
+    // https://github.com/klee/klee/issues/653
+    transient.solver = Z3_mk_solver(builder->ctx);
+    Z3_solver_inc_ref(builder->ctx, transient.solver);
+    Z3_solver_set_params(builder->ctx, transient.solver, solverParameters);
+
+    std::vector<const Array *> arrays;
+    for (auto const &constraint : constraints) {
+      Z3_solver_assert(builder->ctx, transient.solver,
+                       builder->construct(constraint));
+      assertConstantArrays(transient, constraint, &arrays);
+    }
+    return transient;
+  }
+
+  IncrementalSolver &is = getIncrementalSolver(constraints);
+
+  // Pop the scopes of all constraints not shared with this query
+  auto mismatch = std::mismatch(is.constraints.begin(), is.constraints.end(),
+                                constraints.begin(), constraints.end());
+  auto shared =
+      static_cast<std::size_t>(mismatch.first - is.constraints.begin());
+  if (shared < is.constraints.size()) {
+    Z3_solver_pop(builder->ctx, is.solver, is.constraints.size() - shared);
+    for (auto i = shared; i < is.scopeArrays.size(); ++i)
+      for (auto const &array : is.scopeArrays[i])
+        is.assertedArrays.erase(array);
+    is.constraints.resize(shared);
+    is.scopeArrays.resize(shared);
+  }
+
+  // Push the remaining constraints of this query, one scope each
+  for (auto it = mismatch.second, ie = constraints.end(); it != ie; ++it) {
+    Z3_solver_push(builder->ctx, is.solver);
+    Z3_solver_assert(builder->ctx, is.solver, builder->construct(*it));
+    is.constraints.push_back(*it);
+    is.scopeArrays.emplace_back();
+    assertConstantArrays(is, *it, &is.scopeArrays.back());
+  }
+  return is;
+}
+
+void Z3SolverImpl::endSession(IncrementalSolver &transient) {
+  if (transient.solver)
+    Z3_solver_dec_ref(builder->ctx, transient.solver);
+  // Clear the builder's cache to prevent memory usage exploding.
+  // By using ``autoClearConstructCache=false`` and clearning now
+  // we allow Z3_ast expressions to be shared from an entire
+  // session rather than only sharing within a single call to
+  // ``builder->construct()``.
+  builder->clearConstructCache();
+}
+
+bool Z3SolverImpl::checkQuery(IncrementalSolver &is, const ref<Expr> &expr,
+                              bool scoped,
+                              const std::vector<const Array *> *objects,
+                              std::vector<std::vector<unsigned char> > *values,
+                              bool &hasSolution) {
+  runStatusCode = SOLVER_RUN_STATUS_FAILURE;
+  ++stats::solverQueries;
+  if (objects)
+    ++stats::queryCounterexamples;
+
+  if (scoped)
+    Z3_solver_push(builder->ctx, is.solver);
+  Z3ASTHandle z3QueryExpr =
+      Z3ASTHandle(builder->construct(expr), builder->ctx);
+  assertConstantArrays(is, expr, /*newArrays=*/nullptr);
 
   // KLEE Queries are validity queries i.e.
   // ∀ X Constraints(X) → query(X)
@@ -292,29 +466,24 @@ bool Z3SolverImpl::internalRunSolver(
   // negation of the equivalent i.e.
   // ∃ X Constraints(X) ∧ ¬ query(X)
   Z3_solver_assert(
-      builder->ctx, theSolver,
+      builder->ctx, is.solver,
       Z3ASTHandle(Z3_mk_not(builder->ctx, z3QueryExpr), builder->ctx));
 
   if (dumpedQueriesFile) {
     *dumpedQueriesFile << "; start Z3 query\n";
-    *dumpedQueriesFile << Z3_solver_to_string(builder->ctx, theSolver);
+    *dumpedQueriesFile << Z3_solver_to_string(builder->ctx, is.solver);
     *dumpedQueriesFile << "(check-sat)\n";
     *dumpedQueriesFile << "(reset)\n";
     *dumpedQueriesFile << "; end Z3 query\n\n";
     dumpedQueriesFile->flush();
   }
 
-  ::Z3_lbool satisfiable = Z3_solver_check(builder->ctx, theSolver);
-  runStatusCode = handleSolverResponse(theSolver, satisfiable, objects, values,
+  ::Z3_lbool satisfiable = Z3_solver_check(builder->ctx, is.solver);
+  runStatusCode = handleSolverResponse(is.solver, satisfiable, objects, values,
                                        hasSolution);
 
-  Z3_solver_dec_ref(builder->ctx, theSolver);
-  // Clear the builder's cache to prevent memory usage exploding.
-  // By using ``autoClearConstructCache=false`` and clearning now
-  // we allow Z3_ast expressions to be shared from an entire
-  // ``Query`` rather than only sharing within a single call to
-  // ``builder->construct()``.
-  builder->clearConstructCache();
+  if (scoped)
+    Z3_solver_pop(builder->ctx, is.solver, 1);
 
   if (runStatusCode == SolverImpl::SOLVER_RUN_STATUS_SUCCESS_SOLVABLE ||
       runStatusCode == SolverImpl::SOLVER_RUN_STATUS_SUCCESS_UNSOLVABLE) {
@@ -331,6 +500,49 @@ bool Z3SolverImpl::internalRunSolver(
   return false; // failed
 }
 
+bool Z3SolverImpl::internalRunSolver(
+    const Query &query, const std::vector<const Array *> *objects,
+    std::vector<std::vector<unsigned char> > *values, bool &hasSolution) {
+  TimerStatIncrementer t(stats::queryTime);
+
+  IncrementalSolver transient;
+  IncrementalSolver &is = beginSession(query.constraints, transient);
+  // The query expression of a pooled solver gets a scope that is dropped
+  // afterwards
+  bool success =
+      checkQuery(is, query.expr, /*scoped=*/Z3IncrementalSolvers > 0, objects,
+                 values, hasSolution);
+  endSession(transient);
+  return success;
+}
+
+bool Z3SolverImpl::internalRunSolverBatch(
+    const ConstraintSet &constraints, const std::vector<ref<Expr>> &exprs,
+    const std::vector<const Array *> *objects,
+    std::vector<std::vector<std::vector<unsigned char>>> *values,
+    std::vector<bool> &hasSolution) {
+  TimerStatIncrementer t(stats::queryTime);
+
+  hasSolution.assign(exprs.size(), false);
+  if (values)
+    values->assign(exprs.size(), {});
+
+  // The constraints are translated and asserted once for all expressions,
+  // each of which is checked in its own scope.
+  IncrementalSolver transient;
+  IncrementalSolver &is = beginSession(constraints, transient);
+  const bool scoped = Z3IncrementalSolvers > 0 || exprs.size() > 1;
+  bool success = true;
+  for (std::size_t i = 0; success && i < exprs.size(); ++i) {
+    bool result = false;
+    success = checkQuery(is, exprs[i], scoped, objects,
+                         values ? &(*values)[i] : nullptr, result);
+    hasSolution[i] = result;
+  }
+  endSession(transient);
+  return success;
+}
+
 SolverImpl::SolverRunStatus Z3SolverImpl::handleSolverResponse(
     ::Z3_solver theSolver, ::Z3_lbool satisfiable,
     const std::vector<const Array *> *objects,
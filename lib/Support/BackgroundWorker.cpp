@@ -0,0 +1,62 @@
+//===-- BackgroundWorker.cpp ----------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "klee/Support/BackgroundWorker.h"
+
+#include <utility>
+
+using namespace klee;
+
+BackgroundWorker::BackgroundWorker() : thread([this] { run(); }) {}
+
+BackgroundWorker::~BackgroundWorker() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  taskPosted.notify_one();
+  thread.join();
+}
+
+void BackgroundWorker::post(Task task) {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    tasks.push_back(std::move(task));
+    ++pending;
+  }
+  taskPosted.notify_one();
+}
+
+void BackgroundWorker::wait(std::size_t maxPending) {
+  std::unique_lock<std::mutex> lock(mutex);
+  tasksDone.wait(lock, [this, maxPending] { return pending <= maxPending; });
+}
+
+std::size_t BackgroundWorker::getNumPending() const {
+  std::lock_guard<std::mutex> lock(mutex);
+  return pending;
+}
+
+void BackgroundWorker::run() {
+  std::unique_lock<std::mutex> lock(mutex);
+  for (;;) {
+    taskPosted.wait(lock, [this] { return stopping || !tasks.empty(); });
+    if (tasks.empty())
+      return; // stopping and nothing left to do
+
+    Task task = std::move(tasks.front());
+    tasks.pop_front();
+    lock.unlock();
+    task();
+    lock.lock();
+
+    --pending;
+    tasksDone.notify_all();
+  }
+}
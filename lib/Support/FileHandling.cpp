@@ -21,12 +21,14 @@
 namespace klee {
 
 std::unique_ptr<llvm::raw_fd_ostream>
-klee_open_output_file(const std::string &path, std::string &error) {
+klee_open_output_file(const std::string &path, std::string &error,
+                      bool append) {
   error.clear();
   std::error_code ec;
 
-  auto f = std::make_unique<llvm::raw_fd_ostream>(path.c_str(), ec,
-                                                  llvm::sys::fs::OF_None);
+  auto f = std::make_unique<llvm::raw_fd_ostream>(
+      path.c_str(), ec,
+      append ? llvm::sys::fs::OF_Append : llvm::sys::fs::OF_None);
   if (ec)
     error = ec.message();
   if (!error.empty()) {
@@ -0,0 +1,32 @@
+// Check that a run halted after writing a checkpoint can be resumed and
+// explores the remaining paths.
+
+// RUN: %clang %s -emit-llvm %O0opt -c -o %t.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --libc=none --checkpoint-interval=1h --max-instructions=100 %t.bc 2>&1 | FileCheck -check-prefix=CHECK-HALT %s
+// RUN: test -f %t.klee-out/checkpoint
+// RUN: %klee --output-dir=%t.klee-out --libc=none --resume %t.bc 2>&1 | FileCheck -check-prefix=CHECK-RESUME %s
+// RUN: %klee --output-dir=%t.klee-out --libc=none --resume %t.bc 2>&1 | FileCheck -check-prefix=CHECK-DONE %s
+
+// CHECK-HALT: KLEE: done: completed paths = 0
+// CHECK-HALT: KLEE: done: partially completed paths = {{[1-9][0-9]*}}
+
+// CHECK-RESUME: KLEE: resuming {{[1-9][0-9]*}} states from checkpoint
+// CHECK-RESUME-NOT: dropping state
+// CHECK-RESUME: KLEE: done: completed paths = 16
+
+// CHECK-DONE: KLEE: resuming 0 states from checkpoint
+// CHECK-DONE: the checkpoint has no states left to explore
+
+#include "klee/klee.h"
+
+int main() {
+  unsigned char x[4];
+  klee_make_symbolic(x, sizeof(x), "x");
+
+  int r = 0;
+  for (int i = 0; i < 4; ++i)
+    if (x[i] > 100)
+      r += 1 << i;
+  return r;
+}
@@ -0,0 +1,46 @@
+// Check that compacting long update lists does not change the results of
+// reads at symbolic indices.
+
+// RUN: %clang %s -emit-llvm %O0opt -g -c -o %t.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --libc=none --compact-updates-threshold=4 %t.bc 2> %t.log
+// RUN: FileCheck -input-file=%t.log %s
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --libc=none --compact-updates-threshold=0 %t.bc 2> %t.log
+// RUN: FileCheck -input-file=%t.log %s
+
+// CHECK-NOT: ASSERTION FAIL
+// CHECK: KLEE: done: completed paths = 2
+
+#include "klee/klee.h"
+
+#include <assert.h>
+
+int main() {
+  unsigned char buf[16];
+  unsigned i, j, k, same, expected;
+  klee_make_symbolic(&i, sizeof(i), "i");
+  klee_make_symbolic(&j, sizeof(j), "j");
+  klee_assume(i < 16);
+  klee_assume(j < 16);
+
+  for (k = 0; k < 16; ++k)
+    buf[k] = k;
+
+  // interleave writes at symbolic and concrete indices
+  for (k = 0; k < 8; ++k) {
+    buf[i] = 100 + k;
+    buf[k] = 2 * k;
+    buf[k] = 3 * k;
+  }
+
+  // computed without branching, so that a wrong read shows up as a failing
+  // assertion instead of an additional path
+  same = (i == j) & (j != 7);
+  expected = same * 107 + (1 - same) * ((j < 8) * 3 * j + (j >= 8) * j);
+  assert(buf[j] == expected);
+
+  if (buf[j] > 50)
+    return 1;
+  return 0;
+}
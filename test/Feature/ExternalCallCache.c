@@ -0,0 +1,33 @@
+// Check that the compiled external call stubs are shared by calls with the
+// same signature and are reused from -external-call-cache-dir in later runs.
+
+// RUN: %clang %s -emit-llvm %O0opt -c -o %t.bc
+// RUN: rm -rf %t.klee-out %t.cache
+// RUN: %klee --output-dir=%t.klee-out --libc=none --external-call-cache-dir=%t.cache %t.bc 2>&1 | FileCheck %s
+// RUN: ls %t.cache | FileCheck -check-prefix=CHECK-CACHE %s
+// RUN: touch -d '2000-01-01' %t.cache/*.o
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --libc=none --external-call-cache-dir=%t.cache %t.bc 2>&1 | FileCheck %s
+// RUN: find %t.cache -newer %t.bc | FileCheck --allow-empty -check-prefix=CHECK-REUSED %s
+
+// CHECK-DAG: 12 9
+// CHECK-DAG: KLEE: done: completed paths = 1
+
+// atoi is called twice but needs only one stub
+// CHECK-CACHE: klee_dispatch_{{[0-9a-f]+}}.o
+// CHECK-CACHE-NEXT: klee_dispatch_{{[0-9a-f]+}}.o
+// CHECK-CACHE-NEXT: klee_dispatch_{{[0-9a-f]+}}.o
+// CHECK-CACHE-NOT: klee_dispatch
+
+// CHECK-REUSED-NOT: .o
+
+#include <stdio.h>
+#include <stdlib.h>
+
+int main() {
+  int a = atoi("5");
+  int b = atoi("7");
+  long c = atol("9");
+  printf("%d %ld\n", a + b, c);
+  return 0;
+}
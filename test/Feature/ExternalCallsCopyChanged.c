@@ -0,0 +1,35 @@
+// Check that states sharing the addresses of their objects see their own
+// contents in external calls when only changed objects are copied.
+
+// RUN: %clang %s -emit-llvm %O0opt -c -o %t.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --libc=none --external-calls-copy-changed %t.bc 2>&1 | FileCheck %s
+
+// CHECK-DAG: positive012 unchanged
+// CHECK-DAG: other012 unchanged
+// CHECK-DAG: KLEE: done: completed paths = 2
+
+#include "klee/klee.h"
+
+#include <stdio.h>
+#include <string.h>
+
+char buf[32];
+
+int main() {
+  char unchanged[16];
+  int x;
+  klee_make_symbolic(&x, sizeof(x), "x");
+
+  strcpy(unchanged, "unchanged");
+  if (x > 0)
+    strcpy(buf, "positive");
+  else
+    strcpy(buf, "other");
+
+  for (int i = 0; i < 3; ++i)
+    sprintf(buf + strlen(buf), "%d", i);
+
+  printf("%s %s\n", buf, unchanged);
+  return 0;
+}
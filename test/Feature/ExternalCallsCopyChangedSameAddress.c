@@ -0,0 +1,42 @@
+// Check that objects that forked states allocate at the same address after
+// the fork are copied again when only changed objects are copied, as the
+// native memory there may hold the contents of the other state.
+
+// RUN: %clang %s -emit-llvm %O0opt -c -o %t.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --search=bfs --libc=none --external-calls-copy-changed %t.bc 2>&1 | FileCheck %s
+
+// CHECK-NOT: abort failure
+// CHECK: KLEE: done: completed paths = 4
+
+#include "klee/klee.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+int main() {
+  int x, y;
+  klee_make_symbolic(&x, sizeof(x), "x");
+  klee_make_symbolic(&y, sizeof(y), "y");
+
+  // both states allocate their own object at the same address
+  char *s;
+  if (x > 0) {
+    s = malloc(8);
+    s[0] = s[1] = s[2] = s[3] = 'A';
+    s[4] = '\0';
+  } else {
+    s = malloc(8);
+    s[0] = s[1] = 'B';
+    s[2] = '\0';
+  }
+
+  size_t before = strlen(s);
+  if (y > 0)
+    x = 1;
+  else
+    x = 2;
+  if (strlen(s) != before)
+    abort();
+  return 0;
+}
@@ -0,0 +1,43 @@
+// Check that memcpy, memmove and memset are executed directly on the object
+// states without changing their results, and that calls they cannot handle
+// (here: an out of bounds copy) still go through the definitions.
+
+// RUN: %clang %s -emit-llvm %O0opt -g -c -o %t.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --libc=none %t.bc 2> %t.log
+// RUN: FileCheck -input-file=%t.log %s
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --libc=none --native-memory-functions=false %t.bc 2> %t.log
+// RUN: FileCheck -input-file=%t.log %s
+
+#include "klee/klee.h"
+
+#include <assert.h>
+#include <string.h>
+
+int main() {
+  unsigned char x[16];
+  unsigned char buf[4096];
+  klee_make_symbolic(x, sizeof(x), "x");
+
+  memcpy(buf, x, sizeof(x));
+  memset(buf + sizeof(x), x[0], sizeof(buf) - sizeof(x));
+  memset(buf + 100, 7, 10);
+  // overlapping, shift the first 50 bytes up by one
+  memmove(buf + 1, buf, 50);
+
+  assert(buf[0] == x[0] && buf[5] == x[4] && buf[16] == x[15]);
+  assert(buf[104] == 7 && buf[3000] == x[0]);
+
+  if (x[1] == 42) {
+    memcpy(buf, x, sizeof(x) + 1);
+  }
+
+  return 0;
+}
+
+// CHECK-NOT: ASSERTION FAIL
+// CHECK: memory error: out of bound pointer
+// CHECK-NOT: ASSERTION FAIL
+// CHECK: KLEE: done: completed paths = 1
+// CHECK: KLEE: done: partially completed paths = 1
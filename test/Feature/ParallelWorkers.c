@@ -0,0 +1,26 @@
+// Check that the workers of a parallel run explore all paths exactly once.
+
+// RUN: %clang %s -emit-llvm %O0opt -c -o %t.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --libc=none --parallel-workers=3 %t.bc 2>&1 | FileCheck %s
+// RUN: ls %t.klee-out/worker-0 %t.klee-out/worker-1 %t.klee-out/worker-2 | grep -c ktest | FileCheck -check-prefix=CHECK-TESTS %s
+
+// CHECK: KLEE: started 3 workers
+// CHECK: KLEE: done: completed paths = 16
+// CHECK: KLEE: done: partially completed paths = 0
+// CHECK: KLEE: done: generated tests = 16
+
+// CHECK-TESTS: 16
+
+#include "klee/klee.h"
+
+int main() {
+  unsigned char x[4];
+  klee_make_symbolic(x, sizeof(x), "x");
+
+  int r = 0;
+  for (int i = 0; i < 4; ++i)
+    if (x[i] > 100)
+      r += 1 << i;
+  return r;
+}
@@ -0,0 +1,38 @@
+// Check that queries answered from the models of a state give the same
+// results as the solver.
+
+// RUN: %clang %s -emit-llvm %O0opt -c -o %t.bc
+// RUN: rm -rf %t.klee-out %t.no-model.klee-out
+// RUN: %klee --output-dir=%t.klee-out --libc=none --use-state-model %t.bc 2>&1 | FileCheck %s
+// RUN: %klee-stats --print-columns 'QModelHits' --table-format=csv %t.klee-out | FileCheck -check-prefix=CHECK-STATS %s
+// RUN: %klee --output-dir=%t.no-model.klee-out --libc=none --use-state-model=false %t.bc 2>&1 | FileCheck %s
+
+// CHECK: KLEE: done: completed paths = 4
+
+// CHECK-STATS: QModelHits
+// CHECK-STATS-NEXT: {{[1-9][0-9]*}}
+
+#include "klee/klee.h"
+
+int main() {
+  unsigned char x, y;
+  klee_make_symbolic(&x, sizeof(x), "x");
+  klee_make_symbolic(&y, sizeof(y), "y");
+
+  int r = 0;
+  if (x > 10) {
+    if (x > 5) // always true
+      r += 1;
+    if (y == x)
+      r += 2;
+  } else if (x == 3) {
+    r += 4;
+  }
+
+  // answered from a model, does not fork
+  klee_get_value_i32(x + y);
+
+  if (r == 8) // never true
+    return 1;
+  return 0;
+}
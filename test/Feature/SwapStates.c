@@ -0,0 +1,55 @@
+// REQUIRES: not-msan
+// MSan adds additional memory that overflows the counter
+//
+// Check that states are swapped out instead of killed when we exceed our
+// memory bounds with -swap-states, and that their contents survive the
+// round trip through the swap file.
+
+// RUN: %clang %s -emit-llvm %O0opt -g -c -o %t.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --libc=none --search=bfs --max-memory=50 --swap-states %t.bc 2> %t.log
+// RUN: FileCheck -input-file=%t.log %s
+// RUN: FileCheck -check-prefix=CHECK-WRN -input-file=%t.klee-out/warnings.txt %s
+// RUN: not ls %t.klee-out/states.swap
+
+#include "klee/klee.h"
+
+#include <stdlib.h>
+
+int main() {
+  unsigned char x[7];
+  klee_make_symbolic(x, sizeof(x), "x");
+
+  // 64 states
+  unsigned char tag = 0;
+  for (int i = 0; i < 6; ++i) {
+    tag <<= 1;
+    if (x[i] > 10)
+      tag |= 1;
+  }
+
+  // each with its own 4 MB object containing concrete and symbolic bytes
+  volatile unsigned char *buf = malloc(1 << 22);
+  buf[0] = x[6];
+  buf[777777] = tag;
+
+  // that is forked once more, so that all of them are alive at the same time
+  if (x[6] > 10)
+    tag = buf[777777];
+
+  // Ensure we hit the periodic check
+  for (int j = 0; j < 20000; ++j)
+    x[0] += j;
+
+  if (buf[0] != x[6] || buf[777777] != tag)
+    klee_abort();
+
+  return 0;
+}
+
+// CHECK-WRN: WARNING: swapping out {{[0-9]+}} states (over memory cap
+// CHECK-WRN-NOT: killing
+
+// CHECK-NOT: KLEE: ERROR
+// CHECK: KLEE: done: completed paths = 128
+// CHECK: KLEE: done: partially completed paths = 0
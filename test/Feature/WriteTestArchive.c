@@ -0,0 +1,35 @@
+// Check that -write-test-archive writes all test case files into tests.ktar
+// and that the test cases can be read back from the archive.
+
+// RUN: %clang %s -emit-llvm %O0opt -g -c -o %t.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --libc=none --write-test-archive --write-kqueries %t.bc
+// RUN: not ls %t.klee-out/test000001.ktest
+// RUN: %ktest-tool %t.klee-out/tests.ktar > %t.log
+// RUN: FileCheck -check-prefix=CHECK-ARCHIVE -input-file=%t.log %s
+// RUN: %ktest-tool %t.klee-out/tests.ktar:test000002.ktest | FileCheck -check-prefix=CHECK-ENTRY %s
+// RUN: rm -rf %t.replay-out
+// RUN: %klee --output-dir=%t.replay-out --libc=none --replay-ktest-dir=%t.klee-out %t.bc 2>&1 | FileCheck -check-prefix=CHECK-REPLAY %s
+
+// CHECK-ARCHIVE-DAG: ktest file : '{{.*}}tests.ktar:test000001.ktest'
+// CHECK-ARCHIVE-DAG: ktest file : '{{.*}}tests.ktar:test000002.ktest'
+// CHECK-ARCHIVE-DAG: ktest file : '{{.*}}tests.ktar:test000003.ktest'
+
+// CHECK-ENTRY: num objects: 1
+// CHECK-ENTRY: object 0: name: 'x'
+
+// CHECK-REPLAY: KLEE: replaying: {{.*}}tests.ktar:test00000
+// CHECK-REPLAY: KLEE: replaying: {{.*}}tests.ktar:test00000
+// CHECK-REPLAY: KLEE: replaying: {{.*}}tests.ktar:test00000
+
+#include "klee/klee.h"
+
+int main() {
+  int x;
+  klee_make_symbolic(&x, sizeof(x), "x");
+  if (x > 10)
+    return 1;
+  if (x < -10)
+    return 2;
+  return 0;
+}
@@ -23,16 +23,25 @@
 #include "klee/Solver/SolverCmdLine.h"
 #include "klee/Solver/SolverImpl.h"
 #include "klee/Support/PrintVersion.h"
+#include "klee/System/Time.h"
 
 #include "llvm/ADT/StringExtras.h"
+#include "llvm/ADT/StringMap.h"
 #include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
 #include "llvm/Support/ManagedStatic.h"
 #include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/Support/Signals.h"
 
 #include <sys/stat.h>
+#include <sys/wait.h>
 #include <unistd.h>
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <sstream>
 #include <utility>
 
 using namespace llvm;
@@ -44,7 +53,7 @@ llvm::cl::opt<std::string> InputFile(llvm::cl::desc("<input query log>"),
                                      llvm::cl::Positional, llvm::cl::init("-"),
                                      llvm::cl::cat(klee::ExprCat));
 
-enum ToolActions { PrintTokens, PrintAST, PrintSMTLIBv2, Evaluate };
+enum ToolActions { PrintTokens, PrintAST, PrintSMTLIBv2, Evaluate, Benchmark };
 
 static llvm::cl::opt<ToolActions> ToolAction(
     llvm::cl::desc("Tool actions:"), llvm::cl::init(Evaluate),
@@ -55,9 +64,38 @@ static llvm::cl::opt<ToolActions> ToolAction(
                      clEnumValN(PrintAST, "print-ast",
                                 "Print parsed AST nodes from the input file."),
                      clEnumValN(Evaluate, "evaluate",
-                                "Evaluate parsed AST nodes from the input file.")),
+                                "Evaluate parsed AST nodes from the input file."),
+                     clEnumValN(Benchmark, "benchmark",
+                                "Time the queries of the input file or of all "
+                                ".kquery files in the input directory.")),
     llvm::cl::cat(klee::SolvingCat));
 
+llvm::cl::opt<unsigned> BenchmarkJobs(
+    "benchmark-jobs",
+    llvm::cl::desc("Number of processes running the benchmark, each with its "
+                   "own solver chain and caches (default=1)"),
+    llvm::cl::init(1), llvm::cl::cat(klee::SolvingCat));
+
+llvm::cl::opt<std::string> BenchmarkOutput(
+    "benchmark-output",
+    llvm::cl::desc("Write the result and time of each benchmarked query to "
+                   "this file, for use as a baseline"),
+    llvm::cl::cat(klee::SolvingCat));
+
+llvm::cl::opt<std::string> BenchmarkBaseline(
+    "benchmark-baseline",
+    llvm::cl::desc("Compare the benchmark with a file written by "
+                   "-benchmark-output and fail on changed results or "
+                   "regressions"),
+    llvm::cl::cat(klee::SolvingCat));
+
+llvm::cl::opt<double> BenchmarkRegressionFactor(
+    "benchmark-regression-factor",
+    llvm::cl::desc("Report queries that take this many times longer than in "
+                   "the baseline, ignoring queries faster than 1ms "
+                   "(default=2)"),
+    llvm::cl::init(2), llvm::cl::cat(klee::SolvingCat));
+
 enum BuilderKinds {
   DefaultBuilder,
   ConstantFoldingBuilder,
@@ -381,6 +419,287 @@ static bool printInputAsSMTLIBv2(const char *Filename,
 	return true;
 }
 
+/// The outcome of a benchmarked query
+struct BenchmarkResult {
+  std::string result;
+  std::uint64_t time; // microseconds
+};
+
+/// Solves a query, only returning the kind of result
+static const char *solveQuery(Solver &S, const QueryCommand &QC) {
+  ConstraintSet constraints(QC.Constraints);
+  if (QC.Values.empty() && QC.Objects.empty()) {
+    bool result;
+    if (!S.mustBeTrue(Query(constraints, QC.Query), result))
+      return "FAIL";
+    return result ? "VALID" : "INVALID";
+  }
+  if (!QC.Values.empty()) {
+    ref<ConstantExpr> result;
+    if (!S.getValue(Query(constraints, QC.Values[0]), result))
+      return "FAIL";
+    return "INVALID";
+  }
+  std::vector<std::vector<unsigned char>> result;
+  if (!S.getInitialValues(Query(constraints, QC.Query), QC.Objects, result))
+    return S.impl->getOperationStatusCode() ==
+                   SolverImpl::SOLVER_RUN_STATUS_TIMEOUT
+               ? "FAIL"
+               : "VALID";
+  return "INVALID";
+}
+
+static const char *const BenchmarkStatistics[] = {
+    "QueryCacheHits",           "QueryCacheMisses",
+    "QueryCexCacheHits",        "QueryCexCacheMisses",
+    "QueryPersistentCacheHits", "QueryPersistentCacheMisses",
+    "SolverQueries"};
+
+/// Runs the queries of every jobs-th file starting at job through a new
+/// solver chain. For each query, writes a line "<file>:<index> <result>
+/// <microseconds>", followed by lines "#<statistic> <value>".
+static void benchmarkFiles(const std::vector<std::string> &Files,
+                           unsigned Job, unsigned Jobs, ExprBuilder *Builder,
+                           llvm::raw_ostream &Out) {
+  std::unique_ptr<Solver> coreSolver = klee::createCoreSolver(CoreSolverToUse);
+
+  if (CoreSolverToUse != DUMMY_SOLVER) {
+    const time::Span maxCoreSolverTime(MaxCoreSolverTime);
+    if (maxCoreSolverTime) {
+      coreSolver->setCoreSolverTimeout(maxCoreSolverTime);
+    }
+  }
+
+  std::unique_ptr<Solver> S = constructSolverChain(
+      std::move(coreSolver), getQueryLogPath(ALL_QUERIES_SMT2_FILE_NAME),
+      getQueryLogPath(SOLVER_QUERIES_SMT2_FILE_NAME),
+      getQueryLogPath(ALL_QUERIES_KQUERY_FILE_NAME),
+      getQueryLogPath(SOLVER_QUERIES_KQUERY_FILE_NAME));
+
+  for (unsigned i = Job; i < Files.size(); i += Jobs) {
+    auto MBResult = MemoryBuffer::getFile(Files[i]);
+    if (!MBResult) {
+      llvm::errs() << Files[i] << ": error: "
+                   << MBResult.getError().message() << "\n";
+      continue;
+    }
+
+    std::vector<Decl*> Decls;
+    Parser *P = Parser::Create(Files[i], MBResult->get(), Builder,
+                               ClearArrayAfterQuery);
+    P->SetMaxErrors(20);
+    while (Decl *D = P->ParseTopLevelDecl())
+      Decls.push_back(D);
+
+    if (unsigned N = P->GetNumErrors()) {
+      llvm::errs() << Files[i] << ": parse failure: " << N << " errors.\n";
+    } else {
+      unsigned Index = 0;
+      for (Decl *D : Decls) {
+        if (QueryCommand *QC = dyn_cast<QueryCommand>(D)) {
+          auto start = time::getWallTime();
+          const char *result = solveQuery(*S, *QC);
+          Out << Files[i] << ':' << Index++ << ' ' << result << ' '
+              << (time::getWallTime() - start).toMicroseconds() << '\n';
+        }
+      }
+    }
+
+    for (Decl *D : Decls)
+      delete D;
+    delete P;
+  }
+
+  for (const char *name : BenchmarkStatistics)
+    if (Statistic *stat = theStatisticManager->getStatisticByName(name))
+      Out << '#' << name << ' ' << stat->getValue() << '\n';
+  Out.flush();
+}
+
+/// Reads the output of benchmarkFiles (or -benchmark-output), accumulating
+/// the statistics
+static void readBenchmarkResults(std::istream &In,
+                                 std::map<std::string, BenchmarkResult> &Results,
+                                 llvm::StringMap<std::uint64_t> *Stats) {
+  std::string line;
+  while (std::getline(In, line)) {
+    std::istringstream fields(line);
+    std::string key;
+    std::uint64_t value;
+    if (line[0] == '#') {
+      if (fields >> key >> value && Stats)
+        (*Stats)[key.substr(1)] += value;
+      continue;
+    }
+    BenchmarkResult result;
+    if (fields >> key >> result.result >> result.time)
+      Results[key] = result;
+  }
+}
+
+static void printCacheHitRate(const llvm::StringMap<std::uint64_t> &Stats,
+                              const char *Name, const char *Prefix) {
+  std::uint64_t hits = Stats.lookup(std::string(Prefix) + "Hits");
+  std::uint64_t misses = Stats.lookup(std::string(Prefix) + "Misses");
+  if (hits + misses)
+    llvm::outs() << Name << " hits = " << hits << " ("
+                 << llvm::format("%.1f", 100. * hits / (hits + misses))
+                 << "%)\n";
+}
+
+static bool runBenchmark(ExprBuilder *Builder) {
+  std::vector<std::string> Files;
+  if (llvm::sys::fs::is_directory(InputFile)) {
+    std::error_code ec;
+    for (llvm::sys::fs::directory_iterator i(InputFile, ec), e;
+         i != e && !ec; i.increment(ec))
+      if (StringRef(i->path()).endswith(".kquery"))
+        Files.push_back(i->path());
+    if (ec) {
+      llvm::errs() << InputFile << ": error: " << ec.message() << "\n";
+      return false;
+    }
+    std::sort(Files.begin(), Files.end());
+  } else {
+    Files.push_back(InputFile);
+  }
+
+  // Solvers and expressions are not thread-safe, so parallel jobs run in
+  // processes of their own and report back through pipes.
+  unsigned Jobs = std::max(1u, std::min<unsigned>(BenchmarkJobs, Files.size()));
+  std::string Output;
+  if (Jobs == 1) {
+    llvm::raw_string_ostream Out(Output);
+    benchmarkFiles(Files, 0, 1, Builder, Out);
+  } else {
+    std::vector<std::pair<pid_t, int>> Children;
+    for (unsigned Job = 0; Job < Jobs; ++Job) {
+      int fds[2];
+      if (pipe(fds) < 0) {
+        llvm::errs() << "error: unable to create pipe\n";
+        return false;
+      }
+      pid_t pid = fork();
+      if (pid < 0) {
+        llvm::errs() << "error: unable to fork\n";
+        return false;
+      }
+      if (pid == 0) {
+        close(fds[0]);
+        {
+          llvm::raw_fd_ostream Out(fds[1], /*shouldClose=*/true);
+          benchmarkFiles(Files, Job, Jobs, Builder, Out);
+        }
+        _exit(0);
+      }
+      close(fds[1]);
+      Children.emplace_back(pid, fds[0]);
+    }
+
+    for (const auto &child : Children) {
+      char buffer[4096];
+      ssize_t n;
+      while ((n = read(child.second, buffer, sizeof(buffer))) > 0)
+        Output.append(buffer, n);
+      close(child.second);
+      int status;
+      waitpid(child.first, &status, 0);
+      if (!WIFEXITED(status) || WEXITSTATUS(status)) {
+        llvm::errs() << "error: benchmark job failed\n";
+        return false;
+      }
+    }
+  }
+
+  std::map<std::string, BenchmarkResult> Results;
+  llvm::StringMap<std::uint64_t> Stats;
+  std::istringstream In(Output);
+  readBenchmarkResults(In, Results, &Stats);
+
+  if (!BenchmarkOutput.empty()) {
+    std::ofstream Out(BenchmarkOutput);
+    for (const auto &entry : Results)
+      Out << entry.first << ' ' << entry.second.result << ' '
+          << entry.second.time << '\n';
+    if (!Out) {
+      llvm::errs() << BenchmarkOutput << ": error: unable to write\n";
+      return false;
+    }
+  }
+
+  // latency histogram with decimal buckets from 100us to 10s
+  const std::uint64_t Bounds[] = {100, 1000, 10000, 100000, 1000000, 10000000};
+  const char *const Labels[] = {"< 0.1ms", "<   1ms", "<  10ms",
+                                "< 100ms", "<    1s", "<   10s", ">=  10s"};
+  unsigned Histogram[7] = {};
+  std::uint64_t TotalTime = 0;
+  unsigned Failed = 0;
+  for (const auto &entry : Results) {
+    const BenchmarkResult &r = entry.second;
+    unsigned bucket = std::upper_bound(std::begin(Bounds), std::end(Bounds),
+                                       r.time) - std::begin(Bounds);
+    ++Histogram[bucket];
+    TotalTime += r.time;
+    if (r.result == "FAIL")
+      ++Failed;
+  }
+
+  llvm::outs() << "queries = " << Results.size() << " (failed = " << Failed
+               << ")\n"
+               << "solver queries = " << Stats.lookup("SolverQueries") << '\n'
+               << "total time = "
+               << llvm::format("%.3f", TotalTime / 1000000.) << "s\n"
+               << "latency histogram:\n";
+  for (unsigned i = 0; i < 7; ++i)
+    llvm::outs() << "  " << Labels[i] << ": " << Histogram[i] << '\n';
+  printCacheHitRate(Stats, "query cache", "QueryCache");
+  printCacheHitRate(Stats, "cex cache", "QueryCexCache");
+  printCacheHitRate(Stats, "persistent cache", "QueryPersistentCache");
+
+  if (BenchmarkBaseline.empty())
+    return true;
+
+  std::ifstream BaselineIn(BenchmarkBaseline);
+  if (!BaselineIn) {
+    llvm::errs() << BenchmarkBaseline << ": error: unable to read\n";
+    return false;
+  }
+  std::map<std::string, BenchmarkResult> Baseline;
+  readBenchmarkResults(BaselineIn, Baseline, nullptr);
+
+  unsigned Compared = 0, Changed = 0, Regressions = 0;
+  std::uint64_t BaselineTime = 0, ComparedTime = 0;
+  for (const auto &entry : Results) {
+    auto it = Baseline.find(entry.first);
+    if (it == Baseline.end())
+      continue;
+    const BenchmarkResult &r = entry.second, &b = it->second;
+    ++Compared;
+    BaselineTime += b.time;
+    ComparedTime += r.time;
+    if (r.result != b.result) {
+      ++Changed;
+      llvm::outs() << "CHANGED " << entry.first << ": " << r.result
+                   << " (baseline " << b.result << ")\n";
+    } else if (std::max(r.time, b.time) >= 1000 &&
+               r.time > BenchmarkRegressionFactor * b.time) {
+      ++Regressions;
+      llvm::outs() << "REGRESSION " << entry.first << ": "
+                   << llvm::format("%.3f", r.time / 1000.) << "ms (baseline "
+                   << llvm::format("%.3f", b.time / 1000.) << "ms)\n";
+    }
+  }
+
+  llvm::outs() << "baseline: compared = " << Compared
+               << ", changed = " << Changed
+               << ", regressions = " << Regressions << ", time = "
+               << llvm::format("%.3f", ComparedTime / 1000000.)
+               << "s (baseline "
+               << llvm::format("%.3f", BaselineTime / 1000000.) << "s)\n";
+
+  return !Changed && !Regressions;
+}
+
 int main(int argc, char **argv) {
   KCommandLine::KeepOnlyCategories({&ExprCat, &SolvingCat});
 
@@ -390,16 +709,6 @@ int main(int argc, char **argv) {
   llvm::cl::SetVersionPrinter(klee::printVersion);
   llvm::cl::ParseCommandLineOptions(argc, argv);
 
-  std::string ErrorStr;
-  
-  auto MBResult = MemoryBuffer::getFileOrSTDIN(InputFile.c_str());
-  if (!MBResult) {
-    llvm::errs() << argv[0] << ": error: " << MBResult.getError().message()
-                 << "\n";
-    return 1;
-  }
-  std::unique_ptr<MemoryBuffer> &MB = *MBResult;
-  
   ExprBuilder *Builder = 0;
   switch (BuilderKind) {
   case DefaultBuilder:
@@ -416,6 +725,23 @@ int main(int argc, char **argv) {
     break;
   }
 
+  if (ToolAction == Benchmark) {
+    success = runBenchmark(Builder);
+    delete Builder;
+    llvm::llvm_shutdown();
+    return success ? 0 : 1;
+  }
+
+  std::string ErrorStr;
+  
+  auto MBResult = MemoryBuffer::getFileOrSTDIN(InputFile.c_str());
+  if (!MBResult) {
+    llvm::errs() << argv[0] << ": error: " << MBResult.getError().message()
+                 << "\n";
+    return 1;
+  }
+  std::unique_ptr<MemoryBuffer> &MB = *MBResult;
+  
   switch (ToolAction) {
   case PrintTokens:
     PrintInputTokens(MB.get());
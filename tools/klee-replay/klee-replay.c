@@ -271,6 +271,9 @@ static void usage(void) {
     "Usage: %s [option]... <executable> <ktest-file>...\n"
     "   or: %s --create-files-only <ktest-file>\n"
     "\n"
+    "A <ktest-file> can also be a test archive (all of its .ktest files are\n"
+    "replayed) or <archive>:<file>.\n"
+    "\n"
     "-r, --chroot-to-dir=DIR  use chroot jail, requires CAP_SYS_CHROOT\n"
     "-k, --keep-replay-dir    do not delete replay directory\n"
     "-h, --help               display this help and exit\n"
@@ -283,6 +286,77 @@ static void usage(void) {
 
 int keep_temps = 0;
 
+/* Replay a single test case, loaded from input_fname (NULL if it failed to
+   load); takes ownership of the test */
+static void replay_test(char *executable, const char *program,
+                        const char *input_fname, KTest *test) {
+  static unsigned num_replayed = 0;
+  int prg_argc;
+  char ** prg_argv;
+  unsigned i;
+
+  input = test;
+  if (!input) {
+    fprintf(stderr, "KLEE-REPLAY: ERROR: input file %s not valid.\n",
+            input_fname);
+    exit(1);
+  }
+
+  obj_index = 0;
+  prg_argc = input->numArgs;
+  prg_argv = input->args;
+  free(prg_argv[0]);
+  prg_argv[0] = strdup(program);
+
+  klee_init_env(&prg_argc, &prg_argv);
+
+  if (num_replayed++)
+    fputc('\n', stderr);
+  fprintf(stderr, "KLEE-REPLAY: NOTE: Test file: %s\n"
+                  "KLEE-REPLAY: NOTE: Arguments: ", input_fname);
+  for (i=0; i != (unsigned) prg_argc; ++i) {
+    char *s = prg_argv[i];
+    if (s[0]=='A' && s[1] && !s[2]) s[1] = '\0';
+    fprintf(stderr, "\"%s\" ", prg_argv[i]);
+  }
+  fputc('\n', stderr);
+
+  /* Create the input files, pipes, etc. */
+  replay_create_files(&__exe_fs);
+
+  /* Run the test case machinery in a subprocess, eventually this parent
+     process should be a script or something which shells out to the actual
+     execution tool. */
+
+  int pid = fork();
+  if (pid < 0) {
+    perror("fork");
+    _exit(66);
+  } else if (pid == 0) {
+    /* Run the executable */
+    run_monitored(executable, prg_argc, prg_argv);
+    _exit(0);
+  } else {
+    /* Wait for the executable to finish. */
+    int res, status;
+
+    do {
+      res = waitpid(pid, &status, 0);
+    } while (res < 0 && errno == EINTR);
+
+    // Delete all files in the replay directory
+    replay_delete_files();
+
+    if (res < 0) {
+      perror("waitpid");
+      _exit(66);
+    }
+
+    free(prg_argv);
+    kTest_free(input);
+  }
+}
+
 int main(int argc, char** argv) {
   int prg_argc;
   char ** prg_argv;
@@ -356,67 +430,33 @@ int main(int argc, char** argv) {
   int idx = 0;
   for (idx = optind + 1; idx != argc; ++idx) {
     char* input_fname = argv[idx];
-    unsigned i;
-
-    input = kTest_fromFile(input_fname);
-    if (!input) {
-      fprintf(stderr, "KLEE-REPLAY: ERROR: input file %s not valid.\n",
-              input_fname);
-      exit(1);
-    }
-
-    obj_index = 0;
-    prg_argc = input->numArgs;
-    prg_argv = input->args;
-    free(prg_argv[0]);
-    prg_argv[0] = strdup(argv[optind]);
-
-    klee_init_env(&prg_argc, &prg_argv);
-
-    if (idx > 2)
-      fputc('\n', stderr);
-    fprintf(stderr, "KLEE-REPLAY: NOTE: Test file: %s\n"
-                    "KLEE-REPLAY: NOTE: Arguments: ", input_fname);
-    for (i=0; i != (unsigned) prg_argc; ++i) {
-      char *s = prg_argv[i];
-      if (s[0]=='A' && s[1] && !s[2]) s[1] = '\0';
-      fprintf(stderr, "\"%s\" ", prg_argv[i]);
-    }
-    fputc('\n', stderr);
-
-    /* Create the input files, pipes, etc. */
-    replay_create_files(&__exe_fs);
-
-    /* Run the test case machinery in a subprocess, eventually this parent
-       process should be a script or something which shells out to the actual
-       execution tool. */
-
-    int pid = fork();
-    if (pid < 0) {
-      perror("fork");
-      _exit(66);
-    } else if (pid == 0) {
-      /* Run the executable */
-      run_monitored(executable, prg_argc, prg_argv);
-      _exit(0);
-    } else {
-      /* Wait for the executable to finish. */
-      int res, status;
-
-      do {
-        res = waitpid(pid, &status, 0);
-      } while (res < 0 && errno == EINTR);
 
-      // Delete all files in the replay directory
-      replay_delete_files();
-
-      if (res < 0) {
-        perror("waitpid");
-        _exit(66);
+    if (kTest_isArchive(input_fname)) {
+      /* replay all test cases in the archive */
+      unsigned i, num_names;
+      KTestArchive *archive = kTest_openArchive(input_fname);
+      if (!archive) {
+        fprintf(stderr, "KLEE-REPLAY: ERROR: test archive %s not valid.\n",
+                input_fname);
+        exit(1);
       }
-
-      free(prg_argv);
-      kTest_free(input);
+      num_names = kTest_numArchiveEntries(archive);
+      for (i = 0; i != num_names; ++i) {
+        const char *name = kTest_archiveEntryName(archive, i);
+        size_t len = strlen(name);
+        char *entry_fname;
+        if (len < 6 || strcmp(name + len - 6, ".ktest"))
+          continue;
+        entry_fname = malloc(strlen(input_fname) + len + 2);
+        sprintf(entry_fname, "%s:%s", input_fname, name);
+        replay_test(executable, argv[optind], entry_fname,
+                    kTest_fromArchive(archive, name));
+        free(entry_fname);
+      }
+      kTest_closeArchive(archive);
+    } else {
+      replay_test(executable, argv[optind], input_fname,
+                  kTest_fromFile(input_fname));
     }
   }
 
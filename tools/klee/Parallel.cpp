@@ -0,0 +1,405 @@
+//===-- Parallel.cpp ------------------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "Parallel.h"
+
+#include "klee/Support/ErrorHandling.h"
+#include "klee/System/Time.h"
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/LEB128.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iterator>
+#include <utility>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace klee;
+using namespace llvm;
+
+// A message is its type, the size of its payload (native byte order) and
+// the payload.
+
+namespace {
+enum MessageType : char {
+  // coordinator to worker
+  Explore = 'E', // paths to explore, empty for all paths
+  Share = 'S',   // request to hand over states
+  Quit = 'Q',
+  // worker to coordinator
+  Shared = 'H', // paths of the states handed over, empty if none
+  Explored = 'D' // totals of the worker after exploring its paths
+};
+
+/// How often a busy worker is asked to hand over states at most
+const time::Span ShareInterval("100ms");
+
+bool writeMessage(int fd, MessageType type, StringRef payload) {
+  std::string message(1, type);
+  const std::uint32_t size = payload.size();
+  message.append(reinterpret_cast<const char *>(&size), sizeof(size));
+  message.append(payload.begin(), payload.end());
+
+  for (const char *pos = message.data(), *end = pos + message.size();
+       pos != end;) {
+    // do not get killed by SIGPIPE if the other side is gone
+    ssize_t written = send(fd, pos, end - pos, MSG_NOSIGNAL);
+    if (written < 0) {
+      if (errno == EINTR)
+        continue;
+      return false;
+    }
+    pos += written;
+  }
+  return true;
+}
+
+bool readFully(int fd, char *buffer, std::size_t size) {
+  while (size) {
+    ssize_t n = read(fd, buffer, size);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return false;
+    buffer += n;
+    size -= n;
+  }
+  return true;
+}
+
+bool readMessage(int fd, char &type, std::string &payload) {
+  std::uint32_t size;
+  if (!readFully(fd, &type, 1) ||
+      !readFully(fd, reinterpret_cast<char *>(&size), sizeof(size)))
+    return false;
+  payload.resize(size);
+  return readFully(fd, &payload[0], size);
+}
+
+std::string encodeTotals(const ParallelTotals &totals) {
+  std::string buffer;
+  raw_string_ostream os(buffer);
+  encodeULEB128(totals.instructions, os);
+  encodeULEB128(totals.pathsCompleted, os);
+  encodeULEB128(totals.pathsExplored, os);
+  encodeULEB128(totals.generatedTests, os);
+  encodeULEB128(totals.coveredInstructions.size(), os);
+  std::uint32_t last = 0;
+  for (std::uint32_t id : totals.coveredInstructions) {
+    encodeULEB128(id - last, os);
+    last = id;
+  }
+  return os.str();
+}
+
+bool decodeTotals(StringRef buffer, ParallelTotals &totals) {
+  const auto *pos = buffer.bytes_begin(), *end = buffer.bytes_end();
+  const char *error = nullptr;
+  auto next = [&]() -> std::uint64_t {
+    unsigned n;
+    std::uint64_t value = decodeULEB128(pos, &n, end, &error);
+    pos += n;
+    return value;
+  };
+
+  totals.instructions = next();
+  totals.pathsCompleted = next();
+  totals.pathsExplored = next();
+  totals.generatedTests = next();
+  std::uint64_t numCovered = next();
+  totals.coveredInstructions.clear();
+  for (std::uint64_t i = 0, id = 0; i < numCovered && !error; ++i) {
+    id += next();
+    totals.coveredInstructions.push_back(id);
+  }
+  return !error && pos == end;
+}
+} // namespace
+
+/***/
+
+struct ParallelCoordinator::Worker {
+  pid_t pid = -1;
+  int fd = -1;
+  bool busy = false;
+  bool shareRequested = false;
+  /// Since the start of the run, zero if never asked
+  time::Span lastShareRequest;
+  ParallelTotals totals;
+
+  bool isAlive() const { return fd >= 0; }
+};
+
+ParallelCoordinator::ParallelCoordinator(std::string executable,
+                                         std::vector<std::string> workerArgs,
+                                         std::string outputDirectory)
+    : executable(std::move(executable)), workerArgs(std::move(workerArgs)),
+      outputDirectory(std::move(outputDirectory)) {}
+
+ParallelCoordinator::~ParallelCoordinator() {
+  for (Worker &worker : workers)
+    if (worker.isAlive())
+      lost(worker);
+}
+
+void ParallelCoordinator::start(unsigned index) {
+  Worker &worker = workers[index];
+  const std::string name = "worker-" + std::to_string(index);
+
+  int fds[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) < 0)
+    klee_error("cannot create socket for %s: %s", name.c_str(),
+               strerror(errno));
+
+  SmallString<128> logPath(outputDirectory);
+  sys::path::append(logPath, name + ".txt");
+  int logFd =
+      open(logPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (logFd < 0)
+    klee_error("cannot open file \"%s\": %s", logPath.c_str(),
+               strerror(errno));
+
+  SmallString<128> workerDirectory(outputDirectory);
+  sys::path::append(workerDirectory, name);
+  // in the worker, its end of the socket replaces the coordinator end
+  std::vector<std::string> args{
+      executable, "--output-dir=" + workerDirectory.str().str(),
+      "--parallel-worker-fd=" + std::to_string(fds[0])};
+  args.insert(args.end(), workerArgs.begin(), workerArgs.end());
+  std::vector<char *> argv;
+  for (std::string &arg : args)
+    argv.push_back(&arg[0]);
+  argv.push_back(nullptr);
+
+  worker.pid = fork();
+  if (worker.pid < 0)
+    klee_error("cannot start %s: %s", name.c_str(), strerror(errno));
+  if (!worker.pid) {
+    // keep interrupts of the terminal to the coordinator, which passes
+    // them on
+    setpgid(0, 0);
+    dup2(logFd, STDOUT_FILENO);
+    dup2(logFd, STDERR_FILENO);
+    // clear close-on-exec for the worker end of the socket
+    if (dup2(fds[1], fds[0]) < 0)
+      _exit(127);
+    execv(argv[0], argv.data());
+    _exit(127);
+  }
+
+  close(logFd);
+  close(fds[1]);
+  worker.fd = fds[0];
+}
+
+void ParallelCoordinator::lost(Worker &worker) {
+  close(worker.fd);
+  worker.fd = -1;
+  waitpid(worker.pid, nullptr, 0);
+}
+
+ParallelTotals ParallelCoordinator::run(unsigned numWorkers,
+                                        std::function<bool()> halted) {
+  workers.resize(numWorkers);
+  for (unsigned i = 0; i < numWorkers; ++i)
+    start(i);
+  klee_message("started %u workers", numWorkers);
+
+  // the paths that no worker explores yet, initially all paths
+  std::deque<std::string> pendingPaths(1);
+  const time::Point startTime = time::getWallTime();
+  bool stopped = false;
+  std::vector<pollfd> fds;
+  std::vector<unsigned> polled;
+  for (;;) {
+    if (!stopped && halted()) {
+      stopped = true;
+      pendingPaths.clear();
+      for (Worker &worker : workers)
+        if (worker.busy)
+          kill(worker.pid, SIGINT);
+    }
+
+    bool anyIdle = false, anyBusy = false;
+    for (unsigned i = 0; i < numWorkers; ++i) {
+      Worker &worker = workers[i];
+      if (!worker.isAlive())
+        continue;
+      if (!worker.busy && !pendingPaths.empty()) {
+        if (writeMessage(worker.fd, Explore, pendingPaths.front())) {
+          pendingPaths.pop_front();
+          worker.busy = true;
+        } else {
+          klee_warning("worker-%u exited unexpectedly", i);
+          lost(worker);
+          continue;
+        }
+      }
+      anyBusy |= worker.busy;
+      anyIdle |= !worker.busy;
+    }
+    if (!anyBusy)
+      break;
+
+    // ask the busy worker asked least recently to share its states
+    if (!stopped && anyIdle && pendingPaths.empty()) {
+      const time::Span now = time::getWallTime() - startTime;
+      Worker *donor = nullptr;
+      for (Worker &worker : workers)
+        if (worker.isAlive() && worker.busy && !worker.shareRequested &&
+            (!worker.lastShareRequest ||
+             now - worker.lastShareRequest >= ShareInterval) &&
+            (!donor || worker.lastShareRequest < donor->lastShareRequest))
+          donor = &worker;
+      if (donor) {
+        donor->shareRequested = true;
+        donor->lastShareRequest = now;
+        writeMessage(donor->fd, Share, {});
+      }
+    }
+
+    fds.clear();
+    polled.clear();
+    for (unsigned i = 0; i < numWorkers; ++i) {
+      if (workers[i].isAlive()) {
+        fds.push_back({workers[i].fd, POLLIN, 0});
+        polled.push_back(i);
+      }
+    }
+    int ready = poll(fds.data(), fds.size(),
+                     static_cast<int>(ShareInterval.toMicroseconds() / 1000));
+    if (ready < 0 && errno != EINTR)
+      klee_error("cannot poll workers: %s", strerror(errno));
+
+    for (unsigned j = 0; ready > 0 && j < fds.size(); ++j) {
+      if (!fds[j].revents)
+        continue;
+      const unsigned i = polled[j];
+      Worker &worker = workers[i];
+      char type;
+      std::string payload;
+      if (!readMessage(worker.fd, type, payload)) {
+        if (worker.busy)
+          klee_warning("worker-%u exited unexpectedly, its paths are lost", i);
+        worker.busy = false;
+        lost(worker);
+        continue;
+      }
+
+      switch (type) {
+      case Shared:
+        worker.shareRequested = false;
+        if (!payload.empty() && !stopped)
+          pendingPaths.push_back(std::move(payload));
+        break;
+      case Explored:
+        worker.busy = false;
+        if (!decodeTotals(payload, worker.totals))
+          klee_warning("invalid totals from worker-%u", i);
+        break;
+      default:
+        klee_warning("unexpected message from worker-%u", i);
+      }
+    }
+  }
+
+  if (!pendingPaths.empty())
+    klee_warning("no workers left, some paths are not explored");
+
+  // combine the totals of all workers
+  ParallelTotals totals;
+  for (Worker &worker : workers) {
+    if (worker.isAlive()) {
+      writeMessage(worker.fd, Quit, {});
+      lost(worker);
+    }
+    totals.instructions += worker.totals.instructions;
+    totals.pathsCompleted += worker.totals.pathsCompleted;
+    totals.pathsExplored += worker.totals.pathsExplored;
+    totals.generatedTests += worker.totals.generatedTests;
+    std::vector<std::uint32_t> covered;
+    std::set_union(totals.coveredInstructions.begin(),
+                   totals.coveredInstructions.end(),
+                   worker.totals.coveredInstructions.begin(),
+                   worker.totals.coveredInstructions.end(),
+                   std::back_inserter(covered));
+    totals.coveredInstructions = std::move(covered);
+  }
+  return totals;
+}
+
+/***/
+
+ParallelWorker::ParallelWorker(int fd)
+    : fd(fd), reader([this] { readMessages(); }) {}
+
+ParallelWorker::~ParallelWorker() {
+  shutdown(fd, SHUT_RDWR);
+  reader.join();
+  close(fd);
+}
+
+void ParallelWorker::readMessages() {
+  char type;
+  std::string payload;
+  while (readMessage(fd, type, payload) && type != Quit) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (type == Explore)
+      pendingPaths.push_back(std::move(payload));
+    else if (type == Share)
+      shareRequested = true;
+    received.notify_one();
+  }
+
+  // the run is over, also if the coordinator is gone
+  std::lock_guard<std::mutex> lock(mutex);
+  quit = true;
+  received.notify_one();
+}
+
+bool ParallelWorker::nextPaths(std::string &paths) {
+  std::unique_lock<std::mutex> lock(mutex);
+  for (;;) {
+    received.wait(lock, [this] {
+      return !pendingPaths.empty() || quit || shareRequested;
+    });
+    if (!pendingPaths.empty()) {
+      paths = std::move(pendingPaths.front());
+      pendingPaths.pop_front();
+      return true;
+    }
+    if (quit)
+      return false;
+
+    // nothing to hand over while idle
+    lock.unlock();
+    shareStates({});
+    lock.lock();
+  }
+}
+
+void ParallelWorker::pathsExplored(const ParallelTotals &totals) {
+  writeMessage(fd, Explored, encodeTotals(totals));
+}
+
+void ParallelWorker::shareStates(const std::string &paths) {
+  shareRequested = false;
+  writeMessage(fd, Shared, paths);
+}
@@ -0,0 +1,115 @@
+//===-- Parallel.h ----------------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_PARALLEL_H
+#define KLEE_PARALLEL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace klee {
+
+/// What the workers of a parallel run explored.
+struct ParallelTotals {
+  std::uint64_t instructions = 0;
+  std::uint64_t pathsCompleted = 0;
+  std::uint64_t pathsExplored = 0;
+  std::uint64_t generatedTests = 0;
+  /// IDs of the covered instructions, ascending
+  std::vector<std::uint32_t> coveredInstructions;
+};
+
+/// The coordinator of a parallel run (-parallel-workers). It starts klee
+/// worker processes, each with its own output directory, and hands out paths
+/// to explore. Whenever a worker is idle, it asks a busy worker to hand over
+/// some of its states, whose paths it then passes on to the idle worker (see
+/// Interpreter::setSharedPaths), until all paths are explored.
+///
+/// The workers are connected by stream sockets; a worker only depends on
+/// its socket and the program, not on the coordinator process.
+class ParallelCoordinator {
+  struct Worker;
+
+  std::string executable;
+  std::vector<std::string> workerArgs;
+  std::string outputDirectory;
+
+  std::vector<Worker> workers;
+
+  void start(unsigned index);
+  void lost(Worker &worker);
+
+public:
+  /// \param executable The klee executable to run the workers with
+  /// \param workerArgs The command line of the workers, without the
+  /// executable and output directory
+  /// \param outputDirectory The directory that contains the output
+  /// directories ("worker-<N>") and logs ("worker-<N>.txt") of the workers
+  ParallelCoordinator(std::string executable,
+                      std::vector<std::string> workerArgs,
+                      std::string outputDirectory);
+  ~ParallelCoordinator();
+
+  ParallelCoordinator(const ParallelCoordinator &) = delete;
+  ParallelCoordinator &operator=(const ParallelCoordinator &) = delete;
+
+  /// Explore all paths with the given number of workers.
+  /// \param halted Polled to stop handing out paths, after which the
+  /// workers are interrupted
+  /// \return The totals of all workers
+  ParallelTotals run(unsigned numWorkers, std::function<bool()> halted);
+};
+
+/// The connection of a worker process of a parallel run to its coordinator.
+class ParallelWorker {
+  int fd;
+
+  std::mutex mutex;
+  std::condition_variable received;
+  std::deque<std::string> pendingPaths;
+  bool quit = false;
+  std::atomic<bool> shareRequested{false};
+
+  std::thread reader;
+
+  void readMessages();
+
+public:
+  /// \param fd The socket connected to the coordinator
+  explicit ParallelWorker(int fd);
+  ~ParallelWorker();
+
+  ParallelWorker(const ParallelWorker &) = delete;
+  ParallelWorker &operator=(const ParallelWorker &) = delete;
+
+  /// Wait for the next paths to explore.
+  /// \return false if the run is over
+  bool nextPaths(std::string &paths);
+
+  /// Report that the paths are explored.
+  /// \param totals The totals of this worker so far
+  void pathsExplored(const ParallelTotals &totals);
+
+  /// Return whether the coordinator asks for states to hand over.
+  bool shouldShareStates() const { return shareRequested; }
+
+  /// Hand over the paths of some states to the coordinator.
+  void shareStates(const std::string &paths);
+};
+
+} // namespace klee
+
+#endif /* KLEE_PARALLEL_H */
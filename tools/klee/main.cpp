@@ -18,6 +18,7 @@
 #include "klee/Statistics/Statistics.h"
 #include "klee/Support/Debug.h"
 #include "klee/Support/ErrorHandling.h"
+#include "klee/Support/BackgroundWorker.h"
 #include "klee/Support/FileHandling.h"
 #include "klee/Support/ModuleUtil.h"
 #include "klee/Support/OptionCategories.h"
@@ -25,6 +26,8 @@
 #include "klee/System/Time.h"
 
 #include "klee/Support/CompilerWarning.h"
+
+#include "Parallel.h"
 DISABLE_WARNING_PUSH
 DISABLE_WARNING_DEPRECATED_DECLARATIONS
 #include "llvm/Bitcode/BitcodeReader.h"
@@ -54,11 +57,14 @@ DISABLE_WARNING_POP
 #include <sys/wait.h>
 #include <unistd.h>
 
+#include <atomic>
 #include <cerrno>
+#include <cstdlib>
 #include <ctime>
 #include <fstream>
 #include <iomanip>
 #include <iterator>
+#include <mutex>
 #include <sstream>
 
 using namespace llvm;
@@ -119,6 +125,23 @@ namespace {
                 cl::desc("Write .sym.path files for each test case (default=false)"),
                 cl::cat(TestCaseCat));
 
+  cl::opt<unsigned>
+  MaxPendingTests("max-pending-tests",
+                  cl::init(64),
+                  cl::desc("Write test case files on a background thread, "
+                           "pausing execution while more than this many test "
+                           "cases wait to be written. Set to 0 to write them "
+                           "synchronously (default=64)"),
+                  cl::cat(TestCaseCat));
+
+  cl::opt<bool>
+  WriteTestArchive("write-test-archive",
+                   cl::desc("Write all test case files into a single archive "
+                            "(tests.ktar) instead of separate files. Archive "
+                            "entries can be read as <archive>:<file> "
+                            "(default=false)"),
+                   cl::cat(TestCaseCat));
+
 
   /*** Startup options ***/
 
@@ -142,6 +165,31 @@ namespace {
             cl::init(""),
             cl::cat(StartCat));
 
+  cl::opt<bool>
+  Resume("resume",
+         cl::desc("Continue the run in the existing output directory "
+                  "(-output-dir) from its last checkpoint (see "
+                  "-checkpoint-interval) (default=false)"),
+         cl::init(false),
+         cl::cat(StartCat));
+
+  cl::opt<unsigned>
+  ParallelWorkers("parallel-workers",
+                  cl::desc("Explore in the given number of worker processes, "
+                           "which take over paths from each other when idle. "
+                           "Their output is written to worker-<N> in the "
+                           "output directory (default=0 (off))"),
+                  cl::init(0),
+                  cl::cat(StartCat));
+
+  cl::opt<int>
+  ParallelWorkerFD("parallel-worker-fd",
+                   cl::desc("Run as a worker of a parallel run, connected to "
+                            "its coordinator by the given socket"),
+                   cl::init(-1),
+                   cl::Hidden,
+                   cl::cat(StartCat));
+
   cl::opt<std::string>
   Environ("env-file",
           cl::desc("Parse environment from the given file (in \"env\" format)"),
@@ -295,6 +343,18 @@ class ExecutionState;
 
 /***/
 
+namespace {
+/// The test writer of the handler, drained on exit (e.g. by klee_error) so
+/// that pending test cases are not written while static objects such as the
+/// command line options are destroyed
+BackgroundWorker *theTestWriter = nullptr;
+
+void waitForTestWriter() {
+  if (theTestWriter)
+    theTestWriter->wait();
+}
+} // namespace
+
 class KleeHandler : public InterpreterHandler {
 private:
   Interpreter *m_interpreter;
@@ -304,7 +364,11 @@ private:
   SmallString<128> m_outputDirectory;
 
   unsigned m_numTotalTests;     // Number of tests received from the interpreter
-  unsigned m_numGeneratedTests; // Number of tests successfully generated
+  unsigned m_numSolvedTests;    // Number of tests with a solution
+  // Number of tests successfully generated, counted by the test writer
+  std::atomic<unsigned> m_numGeneratedTests;
+  // Number of tests with a solution that could not be written
+  std::atomic<unsigned> m_numLostTests;
   unsigned m_pathsCompleted; // number of completed paths
   unsigned m_pathsExplored; // number of partially explored and completed paths
 
@@ -312,44 +376,104 @@ private:
   int m_argc;
   char **m_argv;
 
+  /// The contents of a test case, taken from a terminated state
+  struct TestCase {
+    unsigned id;
+    bool hasSolution;
+    std::vector<std::pair<std::string, std::vector<unsigned char>>> solution;
+    /// Additional files by suffix
+    std::vector<std::pair<std::string, std::string>> files;
+    /// Time taken to solve for and collect the test case, not including
+    /// the time it waited to be written
+    time::Span generationTime;
+  };
+
+  /// Writes test cases off the interpreter thread (if enabled)
+  std::unique_ptr<BackgroundWorker> m_testWriter;
+
+  /// Warnings of the test writer, reported by the interpreter thread
+  std::vector<std::string> m_writeFailures;
+  std::mutex m_writeFailuresMutex;
+
+  /// Holds all test case files (if enabled)
+  KTestArchive *m_testArchive;
+
+  /// The connection to the coordinator of a parallel run (if a worker)
+  ParallelWorker *m_parallelWorker = nullptr;
+
+  void writeTestCase(const TestCase &test);
+  void writeTestFile(const std::string &suffix, unsigned id,
+                     const std::string &contents);
+  /// Records a failure to write a test case (may be called by the writer)
+  void addWriteFailure(std::string message);
+  /// Reports the failures recorded since the last call as warnings
+  void reportWriteFailures();
+
 public:
-  KleeHandler(int argc, char **argv);
+  /// \param writeTests Whether test cases are written, otherwise only the
+  /// output directory and its logs are set up (as for the coordinator of a
+  /// parallel run)
+  KleeHandler(int argc, char **argv, bool writeTests = true);
   ~KleeHandler();
 
   llvm::raw_ostream &getInfoStream() const { return *m_infoFile; }
   /// Returns the number of test cases successfully generated so far
   unsigned getNumTestCases() { return m_numGeneratedTests; }
+  /// Waits until all test cases have been written
+  void waitForTestCases() {
+    if (m_testWriter)
+      m_testWriter->wait();
+    reportWriteFailures();
+  }
   unsigned getNumPathsCompleted() { return m_pathsCompleted; }
   unsigned getNumPathsExplored() { return m_pathsExplored; }
   void incPathsCompleted() { ++m_pathsCompleted; }
   void incPathsExplored(std::uint32_t num = 1) {
     m_pathsExplored += num; }
 
+  void setParallelWorker(ParallelWorker *worker) { m_parallelWorker = worker; }
+  bool shouldShareStates() override {
+    return m_parallelWorker && m_parallelWorker->shouldShareStates();
+  }
+  void shareStates(std::string paths) override {
+    m_parallelWorker->shareStates(paths);
+  }
+
   void setInterpreter(Interpreter *i);
 
   void processTestCase(const ExecutionState  &state,
                        const char *errorMessage,
                        const char *errorSuffix);
 
+  std::string getOutputDirectory() const { return m_outputDirectory.str().str(); }
   std::string getOutputFilename(const std::string &filename);
   std::unique_ptr<llvm::raw_fd_ostream> openOutputFile(const std::string &filename);
   std::string getTestFilename(const std::string &suffix, unsigned id);
+
+  /// Take over the test numbering of the output directory to resume in.
+  void countExistingTests();
+
   std::unique_ptr<llvm::raw_fd_ostream> openTestFile(const std::string &suffix, unsigned id);
 
   // load a .path file
   static void loadPathFile(std::string name,
                            std::vector<bool> &buffer);
 
+  // find and load the .ktest files in a directory, including those stored in
+  // test archives; kTests receives nullptr for files that fail to load
   static void getKTestFilesInDir(std::string directoryPath,
-                                 std::vector<std::string> &results);
+                                 std::vector<std::string> &results,
+                                 std::vector<KTest *> &kTests);
 
   static std::string getRunTimeLibraryPath(const char *argv0);
 };
 
-KleeHandler::KleeHandler(int argc, char **argv)
+KleeHandler::KleeHandler(int argc, char **argv, bool writeTests)
     : m_interpreter(0), m_pathWriter(0), m_symPathWriter(0),
-      m_outputDirectory(), m_numTotalTests(0), m_numGeneratedTests(0),
-      m_pathsCompleted(0), m_pathsExplored(0), m_argc(argc), m_argv(argv) {
+      m_outputDirectory(), m_numTotalTests(0), m_numSolvedTests(0),
+      m_numGeneratedTests(0), m_numLostTests(0),
+      m_pathsCompleted(0), m_pathsExplored(0), m_argc(argc), m_argv(argv),
+      m_testArchive(0) {
 
   // create output directory (OutputDir or "klee-out-<i>")
   bool dir_given = OutputDir != "";
@@ -360,7 +484,17 @@ KleeHandler::KleeHandler(int argc, char **argv)
     klee_error("unable to determine absolute path: %s", ec.message().c_str());
   }
 
-  if (dir_given) {
+  if (Resume) {
+    if (!dir_given)
+      klee_error("--resume requires --output-dir");
+    if (!sys::fs::is_directory(directory))
+      klee_error("cannot resume in \"%s\": not a directory", directory.c_str());
+    if (WriteTestArchive)
+      klee_error("--resume is not supported with --write-test-archive");
+
+    m_outputDirectory = directory;
+    countExistingTests();
+  } else if (dir_given) {
     // OutputDir
     if (mkdir(directory.c_str(), 0775) < 0)
       klee_error("cannot create \"%s\": %s", directory.c_str(), strerror(errno));
@@ -408,21 +542,71 @@ KleeHandler::KleeHandler(int argc, char **argv)
 
   klee_message("output directory is \"%s\"", m_outputDirectory.c_str());
 
+  // a resumed run continues the logs of the run before
+  const char *logMode = Resume ? "a" : "w";
+
   // open warnings.txt
   std::string file_path = getOutputFilename("warnings.txt");
-  if ((klee_warning_file = fopen(file_path.c_str(), "w")) == NULL)
+  if ((klee_warning_file = fopen(file_path.c_str(), logMode)) == NULL)
     klee_error("cannot open file \"%s\": %s", file_path.c_str(), strerror(errno));
 
   // open messages.txt
   file_path = getOutputFilename("messages.txt");
-  if ((klee_message_file = fopen(file_path.c_str(), "w")) == NULL)
+  if ((klee_message_file = fopen(file_path.c_str(), logMode)) == NULL)
     klee_error("cannot open file \"%s\": %s", file_path.c_str(), strerror(errno));
 
   // open info
-  m_infoFile = openOutputFile("info");
+  file_path = getOutputFilename("info");
+  std::string error;
+  if (!(m_infoFile = klee_open_output_file(file_path, error, Resume)))
+    klee_error("cannot open file \"%s\": %s", file_path.c_str(),
+               error.c_str());
+
+  if (!writeTests)
+    return;
+
+  if (MaxPendingTests) {
+    m_testWriter = std::make_unique<BackgroundWorker>();
+    theTestWriter = m_testWriter.get();
+    std::atexit(waitForTestWriter);
+  }
+
+  if (WriteTestArchive) {
+    file_path = getOutputFilename("tests.ktar");
+    if (!(m_testArchive = kTest_createArchive(file_path.c_str())))
+      klee_error("cannot open file \"%s\": %s", file_path.c_str(),
+                 strerror(errno));
+  }
+}
+
+void KleeHandler::countExistingTests() {
+  // continue numbering after the tests of the run before, counting the ones
+  // that were written (the others only left their error files)
+  std::error_code ec;
+  for (sys::fs::directory_iterator it(m_outputDirectory, ec), ie;
+       it != ie && !ec; it.increment(ec)) {
+    StringRef name = sys::path::filename(it->path());
+    unsigned id;
+    if (name.size() < 11 || !name.startswith("test") || name[10] != '.' ||
+        name.substr(4, 6).getAsInteger(10, id))
+      continue;
+    m_numTotalTests = std::max(m_numTotalTests, id);
+    if (name.substr(11) == "ktest") {
+      ++m_numSolvedTests;
+      ++m_numGeneratedTests;
+    }
+  }
+  if (ec)
+    klee_error("cannot read \"%s\": %s", m_outputDirectory.c_str(),
+               ec.message().c_str());
 }
 
 KleeHandler::~KleeHandler() {
+  theTestWriter = nullptr;
+  m_testWriter.reset();
+  reportWriteFailures();
+  if (m_testArchive && !kTest_closeArchive(m_testArchive))
+    klee_warning("unable to write test archive index");
   delete m_pathWriter;
   delete m_symPathWriter;
   fclose(klee_warning_file);
@@ -482,70 +666,44 @@ KleeHandler::openTestFile(const std::string &suffix, unsigned id) {
 void KleeHandler::processTestCase(const ExecutionState &state,
                                   const char *errorMessage,
                                   const char *errorSuffix) {
-  if (!WriteNone) {
-    std::vector< std::pair<std::string, std::vector<unsigned char> > > out;
-    bool success = m_interpreter->getSymbolicSolution(state, out);
-
-    if (!success)
-      klee_warning("unable to get symbolic solution, losing test case");
+  reportWriteFailures();
 
+  if (!WriteNone) {
     const auto start_time = time::getWallTime();
 
-    unsigned id = ++m_numTotalTests;
-
-    if (success) {
-      KTest b;
-      b.numArgs = m_argc;
-      b.args = m_argv;
-      b.symArgvs = 0;
-      b.symArgvLen = 0;
-      b.numObjects = out.size();
-      b.objects = new KTestObject[b.numObjects];
-      assert(b.objects);
-      for (unsigned i=0; i<b.numObjects; i++) {
-        KTestObject *o = &b.objects[i];
-        o->name = const_cast<char*>(out[i].first.c_str());
-        o->numBytes = out[i].second.size();
-        o->bytes = new unsigned char[o->numBytes];
-        assert(o->bytes);
-        std::copy(out[i].second.begin(), out[i].second.end(), o->bytes);
-      }
+    // Everything that needs the state (or expressions, which may not be
+    // shared between threads) is collected here, only the files are written
+    // by the test writer.
+    TestCase test;
+    test.hasSolution = m_interpreter->getSymbolicSolution(state, test.solution);
 
-      if (!kTest_toFile(&b, getOutputFilename(getTestFilename("ktest", id)).c_str())) {
-        klee_warning("unable to write output test case, losing it");
-      } else {
-        ++m_numGeneratedTests;
-      }
+    if (!test.hasSolution)
+      klee_warning("unable to get symbolic solution, losing test case");
 
-      for (unsigned i=0; i<b.numObjects; i++)
-        delete[] b.objects[i].bytes;
-      delete[] b.objects;
-    }
+    test.id = ++m_numTotalTests;
 
-    if (errorMessage) {
-      auto f = openTestFile(errorSuffix, id);
-      if (f)
-        *f << errorMessage;
-    }
+    if (test.hasSolution)
+      ++m_numSolvedTests;
+
+    if (errorMessage)
+      test.files.emplace_back(errorSuffix, errorMessage);
 
     if (m_pathWriter) {
       std::vector<unsigned char> concreteBranches;
       m_pathWriter->readStream(m_interpreter->getPathStreamID(state),
                                concreteBranches);
-      auto f = openTestFile("path", id);
-      if (f) {
-        for (const auto &branch : concreteBranches) {
-          *f << branch << '\n';
-        }
+      std::string path;
+      raw_string_ostream f(path);
+      for (const auto &branch : concreteBranches) {
+        f << branch << '\n';
       }
+      test.files.emplace_back("path", f.str());
     }
 
     if (errorMessage || WriteKQueries) {
       std::string constraints;
       m_interpreter->getConstraintLog(state, constraints,Interpreter::KQUERY);
-      auto f = openTestFile("kquery", id);
-      if (f)
-        *f << constraints;
+      test.files.emplace_back("kquery", std::move(constraints));
     }
 
     if (WriteCVCs) {
@@ -553,61 +711,153 @@ void KleeHandler::processTestCase(const ExecutionState &state,
       // SMT-LIBv2 not CVC which is a bit confusing
       std::string constraints;
       m_interpreter->getConstraintLog(state, constraints, Interpreter::STP);
-      auto f = openTestFile("cvc", id);
-      if (f)
-        *f << constraints;
+      test.files.emplace_back("cvc", std::move(constraints));
     }
 
     if (WriteSMT2s) {
       std::string constraints;
         m_interpreter->getConstraintLog(state, constraints, Interpreter::SMTLIB2);
-        auto f = openTestFile("smt2", id);
-        if (f)
-          *f << constraints;
+        test.files.emplace_back("smt2", std::move(constraints));
     }
 
     if (m_symPathWriter) {
       std::vector<unsigned char> symbolicBranches;
       m_symPathWriter->readStream(m_interpreter->getSymbolicPathStreamID(state),
                                   symbolicBranches);
-      auto f = openTestFile("sym.path", id);
-      if (f) {
-        for (const auto &branch : symbolicBranches) {
-          *f << branch << '\n';
-        }
+      std::string path;
+      raw_string_ostream f(path);
+      for (const auto &branch : symbolicBranches) {
+        f << branch << '\n';
       }
+      test.files.emplace_back("sym.path", f.str());
     }
 
     if (WriteCov) {
       std::map<const std::string*, std::set<unsigned> > cov;
       m_interpreter->getCoveredLines(state, cov);
-      auto f = openTestFile("cov", id);
-      if (f) {
-        for (const auto &entry : cov) {
-          for (const auto &line : entry.second) {
-            *f << *entry.first << ':' << line << '\n';
-          }
+      std::string lines;
+      raw_string_ostream f(lines);
+      for (const auto &entry : cov) {
+        for (const auto &line : entry.second) {
+          f << *entry.first << ':' << line << '\n';
         }
       }
+      test.files.emplace_back("cov", f.str());
     }
 
-    if (m_numGeneratedTests == MaxTests)
-      m_interpreter->setHaltExecution(true);
+    test.generationTime = time::getWallTime() - start_time;
+
+    if (m_testWriter) {
+      // bound the memory held by pending test cases
+      m_testWriter->wait(MaxPendingTests - 1);
+      auto pending = std::make_shared<TestCase>(std::move(test));
+      m_testWriter->post([this, pending] { writeTestCase(*pending); });
+    } else {
+      writeTestCase(test);
+      reportWriteFailures();
+    }
 
-    if (WriteTestInfo) {
-      time::Span elapsed_time(time::getWallTime() - start_time);
-      auto f = openTestFile("info", id);
-      if (f)
-        *f << "Time to generate test case: " << elapsed_time << '\n';
+    // Only written tests count, so once the pending ones could reach the
+    // limit, wait for them to find out whether it was actually reached.
+    if (MaxTests && m_numSolvedTests - m_numLostTests >= MaxTests) {
+      waitForTestCases();
+      if (m_numGeneratedTests >= MaxTests)
+        m_interpreter->setHaltExecution(true);
     }
   } // if (!WriteNone)
 
   if (errorMessage && OptExitOnError) {
+    waitForTestCases();
     m_interpreter->prepareForEarlyExit();
     klee_error("EXITING ON ERROR:\n%s\n", errorMessage);
   }
 }
 
+void KleeHandler::writeTestCase(const TestCase &test) {
+  if (test.hasSolution) {
+    KTest b;
+    b.numArgs = m_argc;
+    b.args = m_argv;
+    b.symArgvs = 0;
+    b.symArgvLen = 0;
+    b.numObjects = test.solution.size();
+    b.objects = new KTestObject[b.numObjects];
+    assert(b.objects);
+    for (unsigned i=0; i<b.numObjects; i++) {
+      KTestObject *o = &b.objects[i];
+      o->name = const_cast<char*>(test.solution[i].first.c_str());
+      o->numBytes = test.solution[i].second.size();
+      o->bytes = new unsigned char[o->numBytes];
+      assert(o->bytes);
+      std::copy(test.solution[i].second.begin(), test.solution[i].second.end(),
+                o->bytes);
+    }
+
+    std::string name = getTestFilename("ktest", test.id);
+    if (!(m_testArchive
+              ? kTest_toArchive(&b, m_testArchive, name.c_str())
+              : kTest_toFile(&b, getOutputFilename(name).c_str()))) {
+      addWriteFailure("unable to write output test case, losing it");
+      ++m_numLostTests;
+    } else {
+      ++m_numGeneratedTests;
+    }
+
+    for (unsigned i=0; i<b.numObjects; i++)
+      delete[] b.objects[i].bytes;
+    delete[] b.objects;
+  }
+
+  for (const auto &file : test.files)
+    writeTestFile(file.first, test.id, file.second);
+
+  if (WriteTestInfo) {
+    std::string info;
+    raw_string_ostream f(info);
+    f << "Time to generate test case: " << test.generationTime << '\n';
+    writeTestFile("info", test.id, f.str());
+  }
+}
+
+void KleeHandler::writeTestFile(const std::string &suffix, unsigned id,
+                                const std::string &contents) {
+  std::string name = getTestFilename(suffix, id);
+  if (m_testArchive) {
+    if (!kTest_addToArchive(m_testArchive, name.c_str(), contents.data(),
+                            contents.size()))
+      addWriteFailure("unable to write " + name + " to test archive");
+    return;
+  }
+
+  // not openTestFile, which warns from whichever thread writes
+  std::string error;
+  std::string path = getOutputFilename(name);
+  auto f = klee_open_output_file(path, error);
+  if (!f) {
+    addWriteFailure("error opening file \"" + path +
+                    "\".  KLEE may have run out of file descriptors: try to "
+                    "increase the maximum number of open file descriptors by "
+                    "using ulimit (" + error + ").");
+    return;
+  }
+  *f << contents;
+}
+
+void KleeHandler::addWriteFailure(std::string message) {
+  std::lock_guard<std::mutex> lock(m_writeFailuresMutex);
+  m_writeFailures.push_back(std::move(message));
+}
+
+void KleeHandler::reportWriteFailures() {
+  std::vector<std::string> failures;
+  {
+    std::lock_guard<std::mutex> lock(m_writeFailuresMutex);
+    failures.swap(m_writeFailures);
+  }
+  for (const auto &failure : failures)
+    klee_warning("%s", failure.c_str());
+}
+
   // load a .path file
 void KleeHandler::loadPathFile(std::string name,
                                      std::vector<bool> &buffer) {
@@ -626,13 +876,26 @@ void KleeHandler::loadPathFile(std::string name,
 }
 
 void KleeHandler::getKTestFilesInDir(std::string directoryPath,
-                                     std::vector<std::string> &results) {
+                                     std::vector<std::string> &results,
+                                     std::vector<KTest *> &kTests) {
   std::error_code ec;
   llvm::sys::fs::directory_iterator i(directoryPath, ec), e;
   for (; i != e && !ec; i.increment(ec)) {
     auto f = i->path();
     if (f.size() >= 6 && f.substr(f.size()-6,f.size()) == ".ktest") {
       results.push_back(f);
+      kTests.push_back(kTest_fromFile(f.c_str()));
+    } else if (StringRef(f).endswith(".ktar") && kTest_isArchive(f.c_str())) {
+      if (KTestArchive *archive = kTest_openArchive(f.c_str())) {
+        for (unsigned j = 0, n = kTest_numArchiveEntries(archive); j < n; ++j) {
+          const char *name = kTest_archiveEntryName(archive, j);
+          if (StringRef(name).endswith(".ktest")) {
+            results.push_back(f + ':' + name);
+            kTests.push_back(kTest_fromArchive(archive, name));
+          }
+        }
+        kTest_closeArchive(archive);
+      }
     }
   }
 
@@ -989,6 +1252,17 @@ static void interrupt_handle_watchdog() {
   // just wait for the child to finish
 }
 
+static void interrupt_handle_parallel() {
+  if (!interrupted) {
+    llvm::errs() << "KLEE: ctrl-c detected, requesting workers to halt.\n";
+    sys::SetInterruptFunction(interrupt_handle_parallel);
+  } else {
+    llvm::errs() << "KLEE: ctrl-c detected, exiting.\n";
+    exit(1);
+  }
+  interrupted = true;
+}
+
 // This is a temporary hack. If the running process has access to
 // externals then it can disable interrupts, which screws up the
 // normal "nice" watchdog termination process. We try to request the
@@ -1116,6 +1390,111 @@ linkWithUclibc(StringRef libDir, std::string opt_suffix,
                FortifyPath.c_str(), errorMsg.c_str());
 }
 
+static void printDoneStats(KleeHandler &handler, std::uint64_t instructions,
+                           std::uint64_t pathsCompleted,
+                           std::uint64_t pathsExplored,
+                           std::uint64_t generatedTests,
+                           const std::string &extraStats = "") {
+  std::stringstream stats;
+  stats << '\n'
+        << "KLEE: done: total instructions = " << instructions << '\n'
+        << "KLEE: done: completed paths = " << pathsCompleted << '\n'
+        << "KLEE: done: partially completed paths = "
+        << pathsExplored - pathsCompleted << '\n'
+        << "KLEE: done: generated tests = " << generatedTests << '\n'
+        << extraStats;
+
+  bool useColors = llvm::errs().is_displayed();
+  if (useColors)
+    llvm::errs().changeColor(llvm::raw_ostream::GREEN,
+                             /*bold=*/true,
+                             /*bg=*/false);
+
+  llvm::errs() << stats.str();
+
+  if (useColors)
+    llvm::errs().resetColor();
+
+  handler.getInfoStream() << stats.str();
+}
+
+/// Return the totals a worker of a parallel run reports to its coordinator.
+static ParallelTotals getWorkerTotals(KleeHandler &handler) {
+  StatisticManager &sm = *theStatisticManager;
+  ParallelTotals totals;
+  totals.instructions = *sm.getStatisticByName("Instructions");
+  totals.pathsCompleted = handler.getNumPathsCompleted();
+  totals.pathsExplored = handler.getNumPathsExplored();
+  totals.generatedTests = handler.getNumTestCases();
+
+  // coverage is only tracked per instruction with statistics
+  const Statistic &covered = *sm.getStatisticByName("CoveredInstructions");
+  for (unsigned id = 0, n = sm.getNumIndices(); id != n; ++id)
+    if (sm.getIndexedValue(covered, id))
+      totals.coveredInstructions.push_back(id);
+  return totals;
+}
+
+/// Return the command line of the workers of a parallel run: that of the
+/// coordinator without the options it sets for each worker.
+static std::vector<std::string> getWorkerArguments(int argc, char **argv) {
+  std::vector<std::string> args;
+  bool beforeInputFile = true;
+  for (int i = 1; i < argc; ++i) {
+    StringRef arg(argv[i]);
+    if (arg == InputFile)
+      beforeInputFile = false;
+    if (beforeInputFile && arg.startswith("-")) {
+      StringRef name = arg.ltrim('-').split('=').first;
+      if (name == "parallel-workers" || name == "output-dir") {
+        if (!arg.contains('='))
+          ++i; // skip the value
+        continue;
+      }
+    }
+    args.push_back(arg.str());
+  }
+  return args;
+}
+
+/// Coordinate a parallel run (-parallel-workers).
+static int runParallel(int argc, char **argv) {
+  if (Resume || ParallelWorkerFD >= 0 || !ReplayKTestFile.empty() ||
+      !ReplayKTestDir.empty() || !ReplayPathFile.empty() ||
+      !SeedOutFile.empty() || !SeedOutDir.empty())
+    klee_error("--parallel-workers cannot be used with --resume, replaying "
+               "or seeding");
+
+  KleeHandler handler(0, nullptr, /*writeTests=*/false);
+  for (int i = 0; i < argc; i++)
+    handler.getInfoStream() << argv[i] << (i + 1 < argc ? " " : "\n");
+  handler.getInfoStream() << "PID: " << getpid() << "\n";
+
+  sys::SetInterruptFunction(interrupt_handle_parallel);
+
+  // Take any function from the execution binary but not main (as not allowed
+  // by C++ standard)
+  void *MainExecAddr = (void *)(intptr_t)runParallel;
+  ParallelCoordinator coordinator(
+      llvm::sys::fs::getMainExecutable(argv[0], MainExecAddr),
+      getWorkerArguments(argc, argv), handler.getOutputDirectory());
+
+  const time::Span maxTime(MaxTime);
+  const auto startTime = time::getWallTime();
+  ParallelTotals totals = coordinator.run(ParallelWorkers, [&] {
+    return interrupted ||
+           (maxTime && time::getWallTime() - startTime > maxTime);
+  });
+
+  std::string coverage;
+  if (!totals.coveredInstructions.empty())
+    coverage = "KLEE: done: covered instructions = " +
+               std::to_string(totals.coveredInstructions.size()) + "\n";
+  printDoneStats(handler, totals.instructions, totals.pathsCompleted,
+                 totals.pathsExplored, totals.generatedTests, coverage);
+  return 0;
+}
+
 int main(int argc, char **argv, char **envp) {
   atexit(llvm_shutdown); // Call llvm_shutdown() on exit
 
@@ -1199,6 +1578,9 @@ int main(int argc, char **argv, char **envp) {
 
   sys::SetInterruptFunction(interrupt_handle);
 
+  if (ParallelWorkers)
+    return runParallel(argc, argv);
+
   // Load the bytecode...
   std::string errorMsg;
   LLVMContext ctx;
@@ -1417,6 +1799,9 @@ int main(int argc, char **argv, char **envp) {
     interpreter->setReplayPath(&replayPath);
   }
 
+  if (Resume)
+    interpreter->setResumeFromCheckpoint(true);
+
   auto startTime = std::time(nullptr);
   { // output clock info and start time
     std::stringstream startInfo;
@@ -1432,19 +1817,21 @@ int main(int argc, char **argv, char **envp) {
     assert(SeedOutDir.empty());
 
     std::vector<std::string> kTestFiles = ReplayKTestFile;
+    std::vector<KTest*> loadedKTests;
+    for (std::vector<std::string>::iterator
+           it = ReplayKTestFile.begin(), ie = ReplayKTestFile.end();
+         it != ie; ++it)
+      loadedKTests.push_back(kTest_fromFile(it->c_str()));
     for (std::vector<std::string>::iterator
            it = ReplayKTestDir.begin(), ie = ReplayKTestDir.end();
          it != ie; ++it)
-      KleeHandler::getKTestFilesInDir(*it, kTestFiles);
+      KleeHandler::getKTestFilesInDir(*it, kTestFiles, loadedKTests);
     std::vector<KTest*> kTests;
-    for (std::vector<std::string>::iterator
-           it = kTestFiles.begin(), ie = kTestFiles.end();
-         it != ie; ++it) {
-      KTest *out = kTest_fromFile(it->c_str());
-      if (out) {
+    for (unsigned i = 0; i < kTestFiles.size(); ++i) {
+      if (KTest *out = loadedKTests[i]) {
         kTests.push_back(out);
       } else {
-        klee_warning("unable to open: %s\n", (*it).c_str());
+        klee_warning("unable to open: %s\n", kTestFiles[i].c_str());
       }
     }
 
@@ -1489,15 +1876,13 @@ int main(int argc, char **argv, char **envp) {
            it = SeedOutDir.begin(), ie = SeedOutDir.end();
          it != ie; ++it) {
       std::vector<std::string> kTestFiles;
-      KleeHandler::getKTestFilesInDir(*it, kTestFiles);
-      for (std::vector<std::string>::iterator
-             it2 = kTestFiles.begin(), ie = kTestFiles.end();
-           it2 != ie; ++it2) {
-        KTest *out = kTest_fromFile(it2->c_str());
-        if (!out) {
-          klee_error("unable to open: %s\n", (*it2).c_str());
+      std::vector<KTest *> kTests;
+      KleeHandler::getKTestFilesInDir(*it, kTestFiles, kTests);
+      for (unsigned i = 0; i < kTestFiles.size(); ++i) {
+        if (!kTests[i]) {
+          klee_error("unable to open: %s\n", kTestFiles[i].c_str());
         }
-        seeds.push_back(out);
+        seeds.push_back(kTests[i]);
       }
       if (kTestFiles.empty()) {
         klee_error("seeds directory is empty: %s\n", (*it).c_str());
@@ -1516,7 +1901,20 @@ int main(int argc, char **argv, char **envp) {
       }
     }
 
-    interpreter->runFunctionAsMain(entryFn, pArgc, pArgv, pEnvp);
+    if (ParallelWorkerFD >= 0) {
+      ParallelWorker worker(ParallelWorkerFD);
+      handler->setParallelWorker(&worker);
+      std::string paths;
+      while (worker.nextPaths(paths)) {
+        interpreter->setSharedPaths(&paths);
+        interpreter->runFunctionAsMain(entryFn, pArgc, pArgv, pEnvp);
+        worker.pathsExplored(getWorkerTotals(*handler));
+      }
+      interpreter->setSharedPaths(nullptr);
+      handler->setParallelWorker(nullptr);
+    } else {
+      interpreter->runFunctionAsMain(entryFn, pArgc, pArgv, pEnvp);
+    }
 
     while (!seeds.empty()) {
       kTest_free(seeds.back());
@@ -1524,6 +1922,9 @@ int main(int argc, char **argv, char **envp) {
     }
   }
 
+  // test cases refer to the arguments, which are freed below
+  handler->waitForTestCases();
+
   auto endTime = std::time(nullptr);
   { // output end and elapsed time
     std::uint32_t h;
@@ -1580,29 +1981,8 @@ int main(int argc, char **argv, char **envp) {
     << "KLEE: done: invalid queries = " << queriesInvalid << "\n"
     << "KLEE: done: query cex = " << queryCounterexamples << "\n";
 
-  std::stringstream stats;
-  stats << '\n'
-        << "KLEE: done: total instructions = " << instructions << '\n'
-        << "KLEE: done: completed paths = " << handler->getNumPathsCompleted()
-        << '\n'
-        << "KLEE: done: partially completed paths = "
-        << handler->getNumPathsExplored() - handler->getNumPathsCompleted()
-        << '\n'
-        << "KLEE: done: generated tests = " << handler->getNumTestCases()
-        << '\n';
-
-  bool useColors = llvm::errs().is_displayed();
-  if (useColors)
-    llvm::errs().changeColor(llvm::raw_ostream::GREEN,
-                             /*bold=*/true,
-                             /*bg=*/false);
-
-  llvm::errs() << stats.str();
-
-  if (useColors)
-    llvm::errs().resetColor();
-
-  handler->getInfoStream() << stats.str();
+  printDoneStats(*handler, instructions, handler->getNumPathsCompleted(),
+                 handler->getNumPathsExplored(), handler->getNumTestCases());
 
   delete handler;
 
@@ -0,0 +1,73 @@
+//===-- BackgroundWorkerTest.cpp ------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "klee/Support/BackgroundWorker.h"
+
+#include "gtest/gtest.h"
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace klee;
+
+namespace {
+
+TEST(BackgroundWorkerTest, RunsTasksInOrderOffThread) {
+  std::vector<int> order;
+  std::thread::id taskThread;
+  {
+    BackgroundWorker worker;
+    for (int i = 0; i < 100; ++i)
+      worker.post([&order, &taskThread, i] {
+        order.push_back(i);
+        taskThread = std::this_thread::get_id();
+      });
+    worker.wait();
+    ASSERT_EQ(0u, worker.getNumPending());
+    ASSERT_EQ(100u, order.size());
+  }
+
+  for (int i = 0; i < 100; ++i)
+    ASSERT_EQ(i, order[i]);
+  ASSERT_NE(std::this_thread::get_id(), taskThread);
+}
+
+TEST(BackgroundWorkerTest, WaitsForPendingTasksBelowBound) {
+  std::mutex gate;
+  std::unique_lock<std::mutex> closed(gate);
+  std::atomic<int> count{0};
+  BackgroundWorker worker;
+  for (int i = 0; i < 10; ++i)
+    worker.post([&gate, &count] {
+      std::lock_guard<std::mutex> lock(gate);
+      ++count;
+    });
+  ASSERT_EQ(10u, worker.getNumPending());
+
+  closed.unlock();
+  worker.wait(4);
+  ASSERT_LE(worker.getNumPending(), 4u);
+  ASSERT_GE(count.load(), 6);
+  worker.wait();
+  ASSERT_EQ(10, count.load());
+}
+
+TEST(BackgroundWorkerTest, DestructorRunsRemainingTasks) {
+  int count = 0;
+  {
+    BackgroundWorker worker;
+    for (int i = 0; i < 10; ++i)
+      worker.post([&count] { ++count; });
+  }
+  ASSERT_EQ(10, count);
+}
+
+} // namespace
@@ -0,0 +1,95 @@
+//===-- CopyOnWriteArrayTest.cpp --------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "klee/ADT/CopyOnWriteArray.h"
+
+#include "gtest/gtest.h"
+
+#include <cstdint>
+#include <vector>
+
+using namespace klee;
+
+namespace {
+
+TEST(CopyOnWriteArrayTest, CopiesAreIndependent) {
+  CopyOnWriteArray<std::uint8_t, 16> a(100, 7);
+  EXPECT_EQ(7u, a.getNumChunks());
+
+  CopyOnWriteArray<std::uint8_t, 16> b(a);
+  b.set(42, 1);
+  a.set(99, 2);
+
+  for (unsigned i = 0; i < 100; ++i) {
+    EXPECT_EQ(i == 99 ? 2 : 7, a[i]);
+    EXPECT_EQ(i == 42 ? 1 : 7, b[i]);
+  }
+}
+
+TEST(CopyOnWriteArrayTest, BufferRoundTrip) {
+  CopyOnWriteArray<std::uint8_t, 8> a(20);
+  std::vector<std::uint8_t> buffer(20);
+  a.copyTo(buffer.data());
+  EXPECT_TRUE(a.equals(buffer.data()));
+  EXPECT_FALSE(a.copyFrom(buffer.data()));
+
+  CopyOnWriteArray<std::uint8_t, 8> b(a);
+  buffer[19] = 5;
+  EXPECT_FALSE(b.equals(buffer.data()));
+  EXPECT_TRUE(b.copyFrom(buffer.data()));
+  EXPECT_TRUE(b.equals(buffer.data()));
+  EXPECT_EQ(0, a[19]);
+  EXPECT_EQ(5, b[19]);
+}
+
+TEST(CopyOnWriteArrayTest, NonTrivialElements) {
+  CopyOnWriteArray<std::vector<int>, 4> a(10);
+  a.getWriteable(3).push_back(1);
+  CopyOnWriteArray<std::vector<int>, 4> b(a);
+  b.getWriteable(3).push_back(2);
+  EXPECT_EQ(1u, a[3].size());
+  EXPECT_EQ(2u, b[3].size());
+  b.fill({});
+  EXPECT_TRUE(b[3].empty());
+  EXPECT_EQ(1u, a[3].size());
+}
+
+TEST(CopyOnWriteArrayTest, ReleaseExclusiveChunks) {
+  CopyOnWriteArray<std::uint8_t, 16> a(40, 3);
+  a.set(20, 9);
+  CopyOnWriteArray<std::uint8_t, 16> b(a);
+  b.set(35, 4);
+  EXPECT_FALSE(b.isChunkExclusive(0));
+  EXPECT_FALSE(b.isChunkExclusive(1));
+  EXPECT_TRUE(b.isChunkExclusive(2));
+  EXPECT_EQ(32u, b.getChunkBegin(2));
+  EXPECT_EQ(8u, b.getChunkSize(2));
+
+  std::vector<std::uint8_t> chunk(b.getChunkSize(2));
+  for (unsigned i = 0; i < chunk.size(); ++i)
+    chunk[i] = b[32 + i];
+  b.releaseChunk(2);
+  b.restoreChunk(2, chunk.data());
+  for (unsigned i = 0; i < 40; ++i) {
+    EXPECT_EQ(i == 20 ? 9 : 3, a[i]);
+    EXPECT_EQ(i == 20 ? 9 : i == 35 ? 4 : 3, b[i]);
+  }
+}
+
+TEST(CopyOnWriteArrayTest, BitArray) {
+  CopyOnWriteBitArray a(1000, true);
+  CopyOnWriteBitArray b(a);
+  b.unset(500);
+  a.set(501, false);
+  EXPECT_TRUE(a.get(500));
+  EXPECT_FALSE(a.get(501));
+  EXPECT_FALSE(b.get(500));
+  EXPECT_TRUE(b.get(501));
+}
+} // namespace
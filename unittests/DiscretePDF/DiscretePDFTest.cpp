@@ -56,3 +56,23 @@ TEST(DiscretePDFTest, Rotatation) {
   ASSERT_EQ(1, testTree.getWeight(1));
   ASSERT_EQ(2, testTree.getWeight(2));
 }
+
+TEST(DiscretePDFTest, UpdateAll) {
+  DiscretePDF<int> testTree;
+
+  for (auto i = 0; i < 100; ++i)
+    testTree.insert(i, 1);
+
+  // only the last item has weight
+  testTree.updateAll([](int i) { return i == 99 ? 1. : 0.; });
+  ASSERT_EQ(99, testTree.choose(0));
+  ASSERT_EQ(99, testTree.choose(0.5));
+  ASSERT_EQ(0, testTree.getWeight(42));
+
+  testTree.updateAll([](int i) { return i; });
+  for (auto i = 0; i < 100; ++i)
+    ASSERT_EQ(i, testTree.getWeight(i));
+  // the sums are consistent again: item 1 covers [0, 1) of a total of 4950
+  ASSERT_EQ(1, testTree.choose(0.5 / 4950));
+  ASSERT_EQ(99, testTree.choose(0.9999));
+}
@@ -0,0 +1,149 @@
+//===-- CompiledExprTest.cpp ----------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "gtest/gtest.h"
+
+#include "klee/Expr/ArrayCache.h"
+#include "klee/Expr/Assignment.h"
+#include "klee/Expr/CompiledExpr.h"
+#include "klee/Expr/Expr.h"
+
+#include <vector>
+
+using namespace klee;
+
+namespace {
+
+static ArrayCache ac;
+
+/// Check that the compiled expression agrees with Assignment::evaluate
+/// under each assignment where its value is known, and return under how
+/// many assignments that is.
+unsigned checkAgainstAssignments(const ref<Expr> &e,
+                                 std::vector<Assignment> &assignments) {
+  std::vector<const Assignment *> pointers;
+  for (const Assignment &a : assignments)
+    pointers.push_back(&a);
+
+  CompiledExpr compiled(e);
+  EXPECT_TRUE(compiled.isCompiled());
+  std::vector<std::uint64_t> values;
+  std::vector<bool> known;
+  compiled.evaluate(pointers, values, known);
+  EXPECT_EQ(values.size(), assignments.size());
+  EXPECT_EQ(known.size(), assignments.size());
+
+  unsigned numKnown = 0;
+  for (unsigned i = 0; i != assignments.size(); ++i) {
+    if (!known[i])
+      continue;
+    ++numKnown;
+    ref<Expr> expected = assignments[i].evaluate(e);
+    ConstantExpr *CE = dyn_cast<ConstantExpr>(expected);
+    EXPECT_TRUE(CE != nullptr) << "assignment " << i;
+    if (CE) {
+      EXPECT_EQ(values[i], CE->getZExtValue()) << "assignment " << i;
+    }
+  }
+  return numKnown;
+}
+
+TEST(CompiledExprTest, AgreesWithAssignment) {
+  const Array *a = ac.CreateArray("a", 4);
+  const Array *b = ac.CreateArray("b", 1);
+  std::vector<ref<ConstantExpr>> constVals;
+  for (unsigned i = 0; i != 8; ++i)
+    constVals.push_back(ConstantExpr::create(3 * i + 1, Expr::Int8));
+  const Array *table =
+      ac.CreateArray("table", constVals.size(), constVals.data(),
+                     constVals.data() + constVals.size());
+
+  // more assignments than fit in one batch; some leave b unbound, and some
+  // bind only part of a
+  std::vector<Assignment> assignments;
+  for (unsigned i = 0; i != 150; ++i) {
+    Assignment assignment(/*_allowFreeValues=*/true);
+    std::vector<unsigned char> bytes = {
+        static_cast<unsigned char>(i * 37), static_cast<unsigned char>(i),
+        static_cast<unsigned char>(i % 3 ? 0 : 0x80),
+        static_cast<unsigned char>(255 - i)};
+    if (i % 11 == 5)
+      bytes.resize(2);
+    assignment.bindings[a] = bytes;
+    if (i % 7)
+      assignment.bindings[b] = {static_cast<unsigned char>(i % 9)};
+    assignments.push_back(assignment);
+  }
+
+  ref<Expr> x = Expr::createTempRead(a, Expr::Int32);
+  ref<Expr> x0 = Expr::createTempRead(a, Expr::Int8);
+  ref<Expr> y = ZExtExpr::create(Expr::createTempRead(b, Expr::Int8),
+                                 Expr::Int32);
+  ref<Expr> c100 = ConstantExpr::create(100, Expr::Int32);
+
+  // known wherever a is fully bound
+  EXPECT_EQ(checkAgainstAssignments(UltExpr::create(c100, x), assignments),
+            136u);
+  EXPECT_GT(checkAgainstAssignments(
+                SltExpr::create(x, AddExpr::create(y, c100)), assignments),
+            0u);
+  EXPECT_GT(checkAgainstAssignments(UDivExpr::create(x, y), assignments), 0u);
+  EXPECT_GT(checkAgainstAssignments(
+                SRemExpr::create(x, SubExpr::create(y, c100)), assignments),
+            0u);
+  EXPECT_GT(checkAgainstAssignments(AShrExpr::create(x, y), assignments), 0u);
+  EXPECT_GT(checkAgainstAssignments(
+                ShlExpr::create(x0, ExtractExpr::create(y, 0, 8)), assignments),
+            0u);
+  EXPECT_GT(checkAgainstAssignments(
+                SExtExpr::create(ExtractExpr::create(x, 16, 16), Expr::Int64),
+                assignments),
+            0u);
+  EXPECT_GT(checkAgainstAssignments(
+                SelectExpr::create(
+                    EqExpr::create(y, ConstantExpr::create(0, Expr::Int32)),
+                    ConstantExpr::create(1, Expr::Int32),
+                    MulExpr::create(x, y)),
+                assignments),
+            0u);
+
+  // reads from a constant array, with updates at a concrete and a symbolic
+  // index
+  ref<Expr> index = ExtractExpr::create(x, 0, 3);
+  UpdateList ul(table, nullptr);
+  ul.extend(ConstantExpr::create(2, Expr::Int32),
+            ConstantExpr::create(99, Expr::Int8));
+  EXPECT_GT(checkAgainstAssignments(
+                ReadExpr::create(ul, ZExtExpr::create(index, Expr::Int32)),
+                assignments),
+            0u);
+  ul.extend(y, ExtractExpr::create(x, 8, 8));
+  EXPECT_GT(checkAgainstAssignments(
+                ReadExpr::create(ul, ZExtExpr::create(index, Expr::Int32)),
+                assignments),
+            0u);
+}
+
+TEST(CompiledExprTest, WideExpressions) {
+  const Array *a = ac.CreateArray("wide", 8);
+  ref<Expr> wide = ZExtExpr::create(Expr::createTempRead(a, Expr::Int64), 128);
+
+  CompiledExpr compiled(
+      UltExpr::create(MulExpr::create(wide, wide), ConstantExpr::alloc(7, 128)));
+  EXPECT_FALSE(compiled.isCompiled());
+
+  Assignment assignment(/*_allowFreeValues=*/true);
+  assignment.bindings[a] = std::vector<unsigned char>(8, 0);
+  std::vector<std::uint64_t> values;
+  std::vector<bool> known;
+  compiled.evaluate({&assignment}, values, known);
+  ASSERT_EQ(known.size(), 1u);
+  EXPECT_FALSE(known[0]);
+}
+} // namespace
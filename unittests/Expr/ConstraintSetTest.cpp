@@ -0,0 +1,169 @@
+//===-- ConstraintSetTest.cpp ---------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "gtest/gtest.h"
+
+#include "klee/Expr/ArrayCache.h"
+#include "klee/Expr/Constraints.h"
+#include "klee/Expr/Expr.h"
+
+#include <vector>
+
+using namespace klee;
+
+namespace {
+
+ArrayCache ac;
+
+std::vector<ref<Expr>> makeConstraints(const char *name, unsigned n) {
+  const Array *array = ac.CreateArray(name, 256);
+  UpdateList ul(array, nullptr);
+  std::vector<ref<Expr>> result;
+  for (unsigned i = 0; i < n; ++i)
+    result.push_back(UltExpr::create(
+        ReadExpr::create(ul, ConstantExpr::create(i % 256, Expr::Int32)),
+        ConstantExpr::create(i / 256 + 1, Expr::Int8)));
+  return result;
+}
+
+std::vector<ref<Expr>> toVector(const ConstraintSet &cs) {
+  return std::vector<ref<Expr>>(cs.begin(), cs.end());
+}
+
+TEST(ConstraintSetTest, ForkedSetsDiverge) {
+  const auto cs = makeConstraints("a", 100);
+  const unsigned split = ConstraintSet::ChunkSize + 5;
+
+  ConstraintSet parent;
+  for (unsigned i = 0; i < split; ++i)
+    parent.push_back(cs[i]);
+
+  // both sets append to the shared last chunk
+  ConstraintSet child = parent;
+  for (unsigned i = split; i < 80; ++i)
+    parent.push_back(cs[i]);
+  for (unsigned i = 90; i > 80; --i)
+    child.push_back(cs[i]);
+
+  std::vector<ref<Expr>> expectedParent(cs.begin(), cs.begin() + 80);
+  std::vector<ref<Expr>> expectedChild(cs.begin(), cs.begin() + split);
+  for (unsigned i = 90; i > 80; --i)
+    expectedChild.push_back(cs[i]);
+
+  EXPECT_EQ(parent.size(), expectedParent.size());
+  EXPECT_EQ(toVector(parent), expectedParent);
+  EXPECT_EQ(child.size(), expectedChild.size());
+  EXPECT_EQ(toVector(child), expectedChild);
+
+  EXPECT_EQ(parent.getSharedPrefixSize(child), ConstraintSet::ChunkSize);
+  EXPECT_EQ(child.getSharedPrefixSize(parent), ConstraintSet::ChunkSize);
+  EXPECT_EQ(parent.getSharedPrefixSize(parent), parent.size());
+  EXPECT_EQ(parent.getSharedPrefixSize(ConstraintSet()), 0u);
+}
+
+TEST(ConstraintSetTest, HashAndEquality) {
+  const auto cs = makeConstraints("b", 70);
+
+  ConstraintSet a(cs), b;
+  for (const auto &e : cs)
+    b.push_back(e);
+
+  unsigned expectedHash = 0;
+  for (const auto &e : cs)
+    expectedHash ^= e->hash();
+  EXPECT_EQ(a.hash(), expectedHash);
+  EXPECT_EQ(b.hash(), expectedHash);
+  EXPECT_EQ(a.getSharedPrefixSize(b), 0u);
+  EXPECT_TRUE(a == b);
+
+  ConstraintSet c = a;
+  EXPECT_TRUE(a == c);
+  c.push_back(cs[0]);
+  EXPECT_FALSE(a == c);
+  EXPECT_EQ(c.getSharedPrefixSize(a), a.size());
+
+  EXPECT_TRUE(ConstraintSet() == ConstraintSet());
+  EXPECT_EQ(ConstraintSet().hash(), 0u);
+}
+
+TEST(ConstraintSetTest, RewritingKeepsSharedPrefix) {
+  const auto cs = makeConstraints("r", 300);
+  ConstraintSet parent(cs);
+  EXPECT_EQ(toVector(parent), cs);
+
+  // an equality that rewrites nothing leaves the constraints shared
+  ConstraintSet child = parent;
+  const Array *other = ac.CreateArray("s", 4);
+  ref<Expr> unrelated = EqExpr::create(
+      ConstantExpr::create(7, Expr::Int8),
+      ReadExpr::create(UpdateList(other, nullptr),
+                       ConstantExpr::create(0, Expr::Int32)));
+  ConstraintManager(child).addConstraint(unrelated);
+  EXPECT_EQ(child.size(), cs.size() + 1);
+  EXPECT_EQ(child.getSharedPrefixSize(parent), parent.size());
+
+  // rewriting a constraint keeps the chunks before it
+  const unsigned rewritten = 3 * ConstraintSet::ChunkSize + 5;
+  child = parent;
+  ref<Expr> byte = cs[rewritten]->getKid(0);
+  ConstraintManager(child).addConstraint(
+      EqExpr::create(ConstantExpr::create(0, Expr::Int8), byte));
+  EXPECT_EQ(child.size(), cs.size());
+  EXPECT_EQ(child.getSharedPrefixSize(parent), 3 * ConstraintSet::ChunkSize);
+  std::vector<ref<Expr>> expected(cs);
+  expected.erase(expected.begin() + rewritten);
+  expected.push_back(EqExpr::create(ConstantExpr::create(0, Expr::Int8), byte));
+  EXPECT_EQ(toVector(child), expected);
+}
+
+TEST(ConstraintSetTest, Partition) {
+  const Array *a = ac.CreateArray("p", 8);
+  const Array *b = ac.CreateArray("q", 8);
+  UpdateList ula(a, nullptr), ulb(b, nullptr);
+  auto read = [](const UpdateList &ul, ref<Expr> index) {
+    return ReadExpr::create(ul, index);
+  };
+  auto byte = [](unsigned i) { return ConstantExpr::create(i, Expr::Int32); };
+  auto zero = ConstantExpr::create(0, Expr::Int8);
+
+  ConstraintSet cs;
+  cs.push_back(EqExpr::create(read(ula, byte(0)), zero));                 // 0
+  cs.push_back(EqExpr::create(read(ula, byte(1)), read(ulb, byte(0))));   // 1
+  cs.push_back(EqExpr::create(read(ulb, byte(1)), zero));                 // 2
+  cs.push_back(EqExpr::create(read(ula, byte(2)), zero));                 // 3
+
+  ConstraintSet forked = cs;
+  std::vector<std::vector<std::size_t>> classes;
+  cs.getPartition().getClasses(classes);
+  EXPECT_EQ(classes, (std::vector<std::vector<std::size_t>>{{0}, {1}, {2}, {3}}));
+
+  // a symbolic index joins all bytes of the array
+  const auto idx = ZExtExpr::create(read(ulb, byte(1)), Expr::Int32);
+  cs.push_back(EqExpr::create(read(ula, idx), zero));                     // 4
+  classes.clear();
+  cs.getPartition().getClasses(classes);
+  EXPECT_EQ(classes, (std::vector<std::vector<std::size_t>>{{0, 1, 2, 3, 4}}));
+
+  // the forked set is not affected
+  std::vector<std::size_t> indices;
+  forked.getPartition().getDependentConstraints(
+      EqExpr::create(read(ulb, byte(0)), zero), indices);
+  EXPECT_EQ(indices, (std::vector<std::size_t>{1}));
+
+  indices.clear();
+  forked.getPartition().getDependentConstraints(
+      EqExpr::create(read(ula, idx), zero), indices);
+  EXPECT_EQ(indices, (std::vector<std::size_t>{0, 1, 2, 3}));
+
+  indices.clear();
+  forked.getPartition().getDependentConstraints(
+      EqExpr::create(read(ula, byte(5)), zero), indices);
+  EXPECT_TRUE(indices.empty());
+}
+} // namespace
@@ -12,6 +12,9 @@
 
 #include "klee/Expr/ArrayCache.h"
 #include "klee/Expr/Expr.h"
+#include "klee/Expr/ExprUtil.h"
+
+#include "llvm/Support/CommandLine.h"
 
 using namespace klee;
 
@@ -264,4 +267,99 @@ TEST(ExprTest, ReadExprFoldingSymbolicIndexUpdate) {
     EXPECT_EQ(Expr::Read, read.get()->getKind());
   }
 }
+
+TEST(ExprTest, HashConsing) {
+  auto *hashConsing = static_cast<llvm::cl::opt<bool> *>(
+      llvm::cl::getRegisteredOptions()["expr-hash-consing"]);
+  ASSERT_NE(hashConsing, nullptr);
+  hashConsing->setValue(true);
+
+  ArrayCache ac;
+  const Array *array = ac.CreateArray("arr", 4);
+  auto build = [&]() {
+    ref<Expr> read = Expr::createTempRead(array, Expr::Int32);
+    return AddExpr::create(
+        MulExpr::create(ConstantExpr::create(3, Expr::Int32), read), read);
+  };
+
+  ref<Expr> a = build();
+  ref<Expr> b = build();
+  EXPECT_EQ(a.get(), b.get());
+  EXPECT_EQ(a->getKid(1).get(), b->getKid(1).get());
+
+  // the table is weak: dead expressions are removed and can be rebuilt
+  const unsigned count = Expr::count;
+  a = nullptr;
+  b = nullptr;
+  EXPECT_LT(Expr::count, count);
+  ref<Expr> c = build();
+  EXPECT_EQ(Expr::Add, c->getKind());
+  EXPECT_EQ(c.get(), build().get());
+
+  // float constants are the integer constants of their bits
+  ref<ConstantExpr> f = ConstantExpr::alloc(llvm::APFloat(1.5));
+  EXPECT_EQ(f.get(), ConstantExpr::alloc(llvm::APFloat(1.5)).get());
+  EXPECT_EQ(f.get(),
+            ConstantExpr::alloc(llvm::APFloat(1.5).bitcastToAPInt()).get());
+  f = nullptr;
+
+  hashConsing->setValue(false);
+  EXPECT_NE(c.get(), build().get());
+  EXPECT_EQ(c, build());
+}
+
+TEST(ExprTest, UnsignedBounds) {
+  ArrayCache ac;
+  const Array *array = ac.CreateArray("arr", 8);
+  ref<Expr> base = ConstantExpr::create(0x1000, Expr::Int64);
+  ref<Expr> idx = ZExtExpr::create(Expr::createTempRead(array, Expr::Int8),
+                                   Expr::Int64);
+
+  // base + 4 * idx
+  ref<Expr> ptr = AddExpr::create(
+      base, MulExpr::create(ConstantExpr::create(4, Expr::Int64), idx));
+  EXPECT_EQ(std::make_pair(UINT64_C(0x1000), UINT64_C(0x1000 + 4 * 255)),
+            getUnsignedBounds(ptr));
+
+  // base + (idx % 16)
+  ptr = AddExpr::create(
+      base, URemExpr::create(idx, ConstantExpr::create(16, Expr::Int64)));
+  EXPECT_EQ(std::make_pair(UINT64_C(0x1000), UINT64_C(0x100F)),
+            getUnsignedBounds(ptr));
+
+  // the full 64-bit read may wrap around
+  ptr = AddExpr::create(base, Expr::createTempRead(array, Expr::Int64));
+  EXPECT_EQ(std::make_pair(UINT64_C(0), UINT64_MAX), getUnsignedBounds(ptr));
+
+  ref<Expr> cond = EqExpr::create(idx, ConstantExpr::create(0, Expr::Int64));
+  ptr = SelectExpr::create(cond, ConstantExpr::create(8, Expr::Int64),
+                           ConstantExpr::create(32, Expr::Int64));
+  EXPECT_EQ(std::make_pair(UINT64_C(8), UINT64_C(32)), getUnsignedBounds(ptr));
+
+  // 1000 / idx, where idx may be zero and x udiv 0 is all ones
+  ref<Expr> quotient =
+      UDivExpr::create(ConstantExpr::create(1000, Expr::Int64), idx);
+  EXPECT_EQ(std::make_pair(UINT64_C(0), UINT64_MAX),
+            getUnsignedBounds(quotient));
+
+  // 1000 / (idx + 1) cannot divide by zero
+  quotient = UDivExpr::create(
+      ConstantExpr::create(1000, Expr::Int64),
+      AddExpr::create(idx, ConstantExpr::create(1, Expr::Int64)));
+  EXPECT_EQ(std::make_pair(UINT64_C(1000 / 256), UINT64_C(1000)),
+            getUnsignedBounds(quotient));
+
+  // 1000 % idx, where idx may be zero and x urem 0 is x
+  ref<Expr> remainder =
+      URemExpr::create(ConstantExpr::create(1000, Expr::Int64), idx);
+  EXPECT_EQ(std::make_pair(UINT64_C(0), UINT64_C(1000)),
+            getUnsignedBounds(remainder));
+
+  // 1000 % (idx + 1) cannot divide by zero
+  remainder = URemExpr::create(
+      ConstantExpr::create(1000, Expr::Int64),
+      AddExpr::create(idx, ConstantExpr::create(1, Expr::Int64)));
+  EXPECT_EQ(std::make_pair(UINT64_C(0), UINT64_C(255)),
+            getUnsignedBounds(remainder));
+}
 }
@@ -17,7 +17,9 @@
 
 #include "llvm/ADT/StringExtras.h"
 
+#include <cstdio>
 #include <iostream>
+#include <unistd.h>
 
 using namespace klee;
 
@@ -167,4 +169,47 @@ TEST(SolverTest, Evaluation) {
   testOpcode<SgeExpr>(*solver);
 }
 
+TEST(SolverTest, PersistentCache) {
+  char path[] = "/tmp/klee-persistent-cache-XXXXXX";
+  int fd = mkstemp(path);
+  ASSERT_GE(fd, 0);
+  close(fd);
+  std::remove(path);
+
+  const Array *array = ac.CreateArray("persistent", 1);
+  ref<Expr> x = Expr::createTempRead(array, Expr::Int8);
+  ConstraintSet constraints({UltExpr::create(getConstant(10, Expr::Int8), x)});
+  Query greaterThan5(constraints,
+                     UltExpr::create(getConstant(5, Expr::Int8), x));
+  Query equals42(constraints, EqExpr::create(getConstant(42, Expr::Int8), x));
+  std::vector<const Array *> objects{array};
+  std::vector<std::vector<unsigned char>> values;
+
+  {
+    auto solver = createPersistentCachingSolver(
+        klee::createCoreSolver(CoreSolverToUse), path);
+    bool res;
+    ASSERT_TRUE(solver->mustBeTrue(greaterThan5, res));
+    EXPECT_TRUE(res);
+    ASSERT_TRUE(solver->getInitialValues(equals42.negateExpr(), objects,
+                                         values));
+  }
+
+  // the dummy solver fails every query: all answers come from the file
+  auto solver = createPersistentCachingSolver(createDummySolver(), path);
+  bool res;
+  ASSERT_TRUE(solver->mustBeTrue(greaterThan5, res));
+  EXPECT_TRUE(res);
+  ASSERT_TRUE(solver->mustBeFalse(greaterThan5.negateExpr(), res));
+  EXPECT_TRUE(res);
+  std::vector<std::vector<unsigned char>> cachedValues;
+  ASSERT_TRUE(solver->getInitialValues(equals42.negateExpr(), objects,
+                                       cachedValues));
+  EXPECT_EQ(values, cachedValues);
+  EXPECT_EQ(cachedValues[0][0], 42);
+  EXPECT_FALSE(solver->mayBeTrue(equals42, res));
+
+  std::remove(path);
+}
+
 }
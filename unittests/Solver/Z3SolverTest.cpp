@@ -19,6 +19,8 @@
 #include "klee/Expr/Expr.h"
 #include "klee/Solver/Solver.h"
 
+#include "llvm/Support/CommandLine.h"
+
 #include <memory>
 
 using namespace klee;
@@ -69,3 +71,139 @@ TEST_F(Z3SolverTest, GetConstraintLog) {
   ASSERT_STRNE(Occurence, nullptr);
   free(ConstraintsString);
 }
+
+TEST(Z3IncrementalSolverTest, ReusesAndDropsConstraintPrefixes) {
+  auto &options = llvm::cl::getRegisteredOptions();
+  auto *incrementalSolvers = static_cast<llvm::cl::opt<unsigned> *>(
+      options["z3-incremental-solvers"]);
+  ASSERT_NE(incrementalSolvers, nullptr);
+  incrementalSolvers->setValue(2);
+
+  std::unique_ptr<Solver> solver(createCoreSolver(CoreSolverType::Z3_SOLVER));
+  solver->setCoreSolverTimeout(time::Span("10s"));
+
+  const Array *array = AC.CreateArray("x", 1);
+  const ref<Expr> x = Expr::createTempRead(array, Expr::Int8);
+  auto byte = [](uint64_t v) { return ConstantExpr::alloc(v, Expr::Int8); };
+
+  const ref<Expr> gt10 = UltExpr::create(byte(10), x);
+  const ref<Expr> lt20 = UltExpr::create(x, byte(20));
+  const ref<Expr> gt200 = UltExpr::create(byte(200), x);
+  const ref<Expr> lt5 = UltExpr::create(x, byte(5));
+
+  bool result;
+  ConstraintSet prefix({gt10});
+  ASSERT_TRUE(solver->mustBeTrue(Query(prefix, UltExpr::create(byte(5), x)),
+                                 result));
+  EXPECT_TRUE(result);
+
+  // extend the prefix
+  ConstraintSet lower({gt10, lt20});
+  ASSERT_TRUE(solver->mustBeTrue(Query(lower, EqExpr::create(x, byte(15))),
+                                 result));
+  EXPECT_FALSE(result);
+  ASSERT_TRUE(solver->mustBeTrue(Query(lower, UltExpr::create(x, byte(21))),
+                                 result));
+  EXPECT_TRUE(result);
+
+  // sibling: the previously asserted x < 20 must be popped
+  ConstraintSet upper({gt10, gt200});
+  ASSERT_TRUE(solver->mayBeTrue(Query(upper, EqExpr::create(x, byte(250))),
+                                result));
+  EXPECT_TRUE(result);
+
+  // unrelated constraints
+  ConstraintSet small({lt5});
+  ASSERT_TRUE(solver->mayBeTrue(Query(small, gt10), result));
+  EXPECT_FALSE(result);
+
+  std::vector<const Array *> objects{array};
+  std::vector<std::vector<unsigned char>> values;
+  ASSERT_TRUE(solver->getInitialValues(Query(lower, ConstantExpr::alloc(0, Expr::Bool)),
+                                       objects, values));
+  ASSERT_EQ(values.size(), 1u);
+  EXPECT_GT(values[0][0], 10);
+  EXPECT_LT(values[0][0], 20);
+
+  incrementalSolvers->setValue(0);
+}
+
+TEST_F(Z3SolverTest, BatchedQueries) {
+  const Array *xArray = AC.CreateArray("bx", 1);
+  const Array *yArray = AC.CreateArray("by", 1);
+  const ref<Expr> x = Expr::createTempRead(xArray, Expr::Int8);
+  const ref<Expr> y = Expr::createTempRead(yArray, Expr::Int8);
+  auto byte = [](uint64_t v) { return ConstantExpr::alloc(v, Expr::Int8); };
+
+  ConstraintSet constraints({UltExpr::create(byte(10), x),
+                             UltExpr::create(x, byte(20)),
+                             EqExpr::create(y, byte(3))});
+  const std::vector<ref<Expr>> exprs{
+      EqExpr::create(x, byte(5)),       EqExpr::create(x, byte(15)),
+      EqExpr::create(x, byte(19)),      EqExpr::create(y, byte(4)),
+      ConstantExpr::alloc(1, Expr::Bool), UltExpr::create(x, byte(21))};
+  const std::vector<bool> mayBeTrue{false, true, true, false, true, true};
+  const std::vector<bool> mustBeTrue{false, false, false, false, true, true};
+
+  std::unique_ptr<Solver> chain = createIndependentSolver(createCachingSolver(
+      createCexCachingSolver(createCoreSolver(CoreSolverType::Z3_SOLVER))));
+  for (Solver *solver : {Z3Solver_.get(), chain.get()}) {
+    // ask twice so that the second round is answered by the caches
+    for (unsigned round = 0; round < 2; ++round) {
+      std::vector<bool> results;
+      ASSERT_TRUE(solver->mayBeTrue(constraints, exprs, results));
+      EXPECT_EQ(mayBeTrue, results);
+      ASSERT_TRUE(solver->mustBeTrue(constraints, exprs, results));
+      EXPECT_EQ(mustBeTrue, results);
+    }
+  }
+}
+
+TEST(PortfolioSolverTest, FirstSuccessfulBackendAnswers) {
+  // the dummy solver always fails, so Z3 has to provide every answer
+  std::vector<std::unique_ptr<Solver>> backends;
+  backends.push_back(createDummySolver());
+  backends.push_back(createCoreSolver(CoreSolverType::Z3_SOLVER));
+  std::unique_ptr<Solver> solver =
+      createPortfolioSolver(std::move(backends), {"dummy", "z3"});
+  solver->setCoreSolverTimeout(time::Span("10s"));
+
+  const Array *array = AC.CreateArray("px", 2);
+  const ref<Expr> x = Expr::createTempRead(array, Expr::Int16);
+  auto word = [](uint64_t v) { return ConstantExpr::alloc(v, Expr::Int16); };
+  ConstraintSet constraints({UltExpr::create(word(1000), x),
+                             UltExpr::create(x, word(1003))});
+
+  bool result;
+  ASSERT_TRUE(solver->mustBeTrue(
+      Query(constraints, UltExpr::create(word(1000), x)), result));
+  EXPECT_TRUE(result);
+  ASSERT_TRUE(solver->mayBeTrue(
+      Query(constraints, EqExpr::create(x, word(1001))), result));
+  EXPECT_TRUE(result);
+
+  Solver::Validity validity;
+  ASSERT_TRUE(solver->evaluate(
+      Query(constraints, EqExpr::create(x, word(5))), validity));
+  EXPECT_EQ(Solver::False, validity);
+
+  ref<ConstantExpr> value;
+  ASSERT_TRUE(solver->getValue(Query(constraints, x), value));
+  EXPECT_GT(value->getZExtValue(), 1000u);
+  EXPECT_LT(value->getZExtValue(), 1003u);
+
+  std::vector<const Array *> objects{array};
+  std::vector<std::vector<unsigned char>> values;
+  ASSERT_TRUE(solver->getInitialValues(
+      Query(constraints, ConstantExpr::alloc(0, Expr::Bool)), objects, values));
+  ASSERT_EQ(1u, values.size());
+  ASSERT_EQ(2u, values[0].size());
+
+  // no backend succeeds
+  backends.clear();
+  backends.push_back(createDummySolver());
+  backends.push_back(createDummySolver());
+  solver = createPortfolioSolver(std::move(backends), {"dummy1", "dummy2"});
+  EXPECT_FALSE(solver->mustBeTrue(
+      Query(constraints, UltExpr::create(word(1000), x)), result));
+}
@@ -0,0 +1,150 @@
+//===-- StateSwapperTest.cpp ----------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#define KLEE_UNITTEST
+
+#include "gtest/gtest.h"
+
+#include "Core/Context.h"
+#include "Core/ExecutionState.h"
+#include "Core/Memory.h"
+#include "Core/MemoryManager.h"
+#include "Core/StateSwapper.h"
+
+#include "klee/Expr/ArrayCache.h"
+#include "klee/Expr/Constraints.h"
+#include "klee/Expr/Expr.h"
+#include "klee/System/MemoryUsage.h"
+
+#include "llvm/Support/raw_ostream.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace klee;
+
+namespace {
+
+ArrayCache ac;
+
+ref<Expr> byteConstraint(const Array *array, unsigned index) {
+  ref<Expr> byte = ReadExpr::create(UpdateList(array, nullptr),
+                                    ConstantExpr::create(index, Expr::Int32));
+  return UltExpr::create(byte, ConstantExpr::create(index + 100, Expr::Int8));
+}
+
+std::vector<std::string> printConstraints(const ConstraintSet &constraints) {
+  std::vector<std::string> result;
+  for (const auto &constraint : constraints) {
+    std::string str;
+    llvm::raw_string_ostream os(str);
+    constraint->print(os);
+    result.push_back(os.str());
+  }
+  return result;
+}
+
+std::vector<std::string> printObject(const ObjectState &os) {
+  std::vector<std::string> result;
+  for (unsigned i = 0; i != os.size; ++i) {
+    std::string str;
+    llvm::raw_string_ostream out(str);
+    os.read8(i)->print(out);
+    result.push_back(out.str());
+  }
+  return result;
+}
+
+TEST(StateSwapperTest, SwapsOutOnlyExclusiveContents) {
+  Context::initialize(/*IsLittleEndian=*/true, Expr::Int64);
+  const Array *array = ac.CreateArray("arr", 128);
+  const unsigned bigSize = 1 << 20;
+  // provides the array cache for flushing symbolic object contents
+  MemoryManager memory(&ac);
+  auto *sharedMO = new MemoryObject(0x10000, 8192, 8, false, true, false,
+                                    nullptr, &memory);
+  auto *bigMO = new MemoryObject(0x100000, bigSize, 8, false, true, false,
+                                 nullptr, &memory);
+  auto *smallMO = new MemoryObject(0x20000, 16, 8, false, true, false,
+                                   nullptr, &memory);
+
+  ExecutionState root;
+  for (unsigned i = 0; i != 40; ++i)
+    root.addConstraint(byteConstraint(array, i));
+  auto *sharedOS = new ObjectState(sharedMO);
+  sharedOS->initializeToZero();
+  root.addressSpace.bindObject(sharedMO, sharedOS);
+
+  // the child shares the first 40 constraints and the shared object
+  std::unique_ptr<ExecutionState> child(root.branch());
+  for (unsigned i = 40; i != 80; ++i)
+    child->addConstraint(byteConstraint(array, i));
+  child->addressSpace.getWriteable(sharedMO, sharedOS)->write8(5000, 42);
+
+  auto *bigOS = new ObjectState(bigMO);
+  for (unsigned i = 0; i != bigSize; ++i)
+    bigOS->write8(i, i * 7);
+  child->addressSpace.bindObject(bigMO, bigOS);
+
+  auto *smallOS = new ObjectState(smallMO);
+  smallOS->initializeToZero();
+  smallOS->write(3, Expr::createTempRead(array, Expr::Int8));
+  smallOS->write(ExtractExpr::create(Expr::createTempRead(array, Expr::Int32),
+                                     0, Expr::Int32),
+                 ConstantExpr::create(1, Expr::Int8));
+  child->addressSpace.bindObject(smallMO, smallOS);
+
+  const std::vector<std::string> constraints =
+      printConstraints(child->constraints);
+  const std::vector<std::string> small = printObject(*smallOS);
+  const std::vector<std::string> rootConstraints =
+      printConstraints(root.constraints);
+
+  StateSwapper swapper(::testing::TempDir() + "StateSwapperTest.swap");
+  const unsigned exprsBefore = Expr::count;
+  const std::size_t usageBefore = util::GetTotalMallocUsage();
+  ASSERT_TRUE(swapper.swapOut(*child));
+  EXPECT_TRUE(swapper.isSwappedOut(*child));
+
+  // the exclusive constraints and the contents of the owned objects are
+  // freed, nothing the root still references is
+  EXPECT_LE(Expr::count + 40, exprsBefore);
+  EXPECT_GE(usageBefore, util::GetTotalMallocUsage() + bigSize / 2);
+  EXPECT_TRUE(child->constraints.empty());
+  EXPECT_EQ(nullptr, child->addressSpace.findObject(bigMO));
+  EXPECT_EQ(nullptr, child->addressSpace.findObject(smallMO));
+  EXPECT_EQ(rootConstraints, printConstraints(root.constraints));
+
+  swapper.swapIn(*child);
+  EXPECT_FALSE(swapper.isSwappedOut(*child));
+
+  // shared constraints are linked back rather than duplicated, exclusive
+  // ones are recreated once
+  EXPECT_EQ(exprsBefore, Expr::count);
+  EXPECT_EQ(constraints, printConstraints(child->constraints));
+  EXPECT_EQ(40u, child->constraints.getSharedPrefixSize(root.constraints));
+
+  const ObjectState *big = child->addressSpace.findObject(bigMO);
+  ASSERT_NE(nullptr, big);
+  for (unsigned i = 0; i < bigSize; i += 4093)
+    EXPECT_EQ(static_cast<std::uint8_t>(i * 7),
+              cast<ConstantExpr>(big->read8(i))->getZExtValue());
+  const ObjectState *smallIn = child->addressSpace.findObject(smallMO);
+  ASSERT_NE(nullptr, smallIn);
+  EXPECT_EQ(small, printObject(*smallIn));
+  EXPECT_EQ(42u, cast<ConstantExpr>(child->addressSpace.findObject(sharedMO)
+                                        ->read8(5000))
+                     ->getZExtValue());
+  EXPECT_EQ(0u, cast<ConstantExpr>(root.addressSpace.findObject(sharedMO)
+                                       ->read8(5000))
+                    ->getZExtValue());
+}
+} // namespace
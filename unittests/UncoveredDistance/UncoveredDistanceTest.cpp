@@ -0,0 +1,296 @@
+//===-- UncoveredDistanceTest.cpp -----------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "gtest/gtest.h"
+
+#include "Core/CoreStats.h"
+#include "Core/UncoveredDistance.h"
+
+#include "klee/Module/Cell.h"
+#include "klee/Module/InstructionInfoTable.h"
+#include "klee/Module/KModule.h"
+#include "klee/Statistics/Statistics.h"
+#include "klee/Support/ModuleUtil.h"
+
+#include "llvm/AsmParser/Parser.h"
+#include "llvm/IR/CFG.h"
+#include "llvm/IR/InlineAsm.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/SourceMgr.h"
+
+#include <map>
+#include <memory>
+#include <vector>
+
+using namespace klee;
+using namespace llvm;
+
+namespace {
+
+const char *TestModule = R"IR(
+declare void @abort() noreturn
+declare i32 @ext(i32)
+
+define i32 @g(i32 %x) {
+entry:
+  %c = icmp sgt i32 %x, 10
+  br i1 %c, label %big, label %small
+big:
+  %y = call i32 @ext(i32 %x)
+  ret i32 %y
+small:
+  ret i32 0
+}
+
+define void @fail() {
+  call void @abort()
+  unreachable
+}
+
+define i32 @f(i32 %n) {
+entry:
+  br label %loop
+loop:
+  %i = phi i32 [ 0, %entry ], [ %i1, %body ]
+  %c = icmp slt i32 %i, %n
+  br i1 %c, label %body, label %exit
+body:
+  %v = call i32 @g(i32 %i)
+  %i1 = add i32 %i, 1
+  br label %loop
+exit:
+  %z = icmp eq i32 %n, 42
+  br i1 %z, label %bad, label %done
+bad:
+  call void @fail()
+  unreachable
+done:
+  ret i32 %n
+}
+
+define i32 @main(i32 %argc) {
+entry:
+  %r = call i32 @f(i32 %argc)
+  %fp = select i1 true, i32 (i32)* @g, i32 (i32)* @f
+  %s = call i32 %fp(i32 %r)
+  ret i32 %s
+}
+)IR";
+
+/// Computes both distances of every instruction from scratch with a naive
+/// fixpoint iteration, as StatsTracker did before distances were maintained
+/// incrementally (0 means unreachable).
+class ReferenceDistances {
+  const KModule &km;
+
+public:
+  std::map<const Instruction *, std::uint64_t> distToReturn, distToUncovered;
+
+  explicit ReferenceDistances(const KModule &km) : km(km) {}
+
+  std::vector<const Instruction *> successorsOf(const Instruction &inst) {
+    std::vector<const Instruction *> result;
+    const BasicBlock *bb = inst.getParent();
+    if (&inst == bb->getTerminator()) {
+      for (const BasicBlock *succ : successors(bb))
+        result.push_back(&succ->front());
+    } else {
+      result.push_back(inst.getNextNode());
+    }
+    return result;
+  }
+
+  std::vector<const Function *> calleesOf(const Instruction &inst) {
+    std::vector<const Function *> result;
+    if (!isa<CallInst>(inst) && !isa<InvokeInst>(inst))
+      return result;
+    const auto &cb = cast<CallBase>(inst);
+    if (isa<InlineAsm>(cb.getCalledOperand()))
+      return result;
+    if (Function *target =
+            getDirectCallTarget(cb, /*moduleIsFullyLinked=*/true))
+      result.push_back(target);
+    else
+      result.assign(km.escapingFunctions.begin(), km.escapingFunctions.end());
+    return result;
+  }
+
+  std::uint64_t passCost(const Instruction &inst) {
+    if (!isa<CallInst>(inst) && !isa<InvokeInst>(inst))
+      return 1;
+    std::uint64_t best = 0;
+    for (const Function *f : calleesOf(inst)) {
+      std::uint64_t d = f->isDeclaration()
+                            ? !f->doesNotReturn()
+                            : distToReturn[&f->front().front()];
+      if (d && (best == 0 || d + 1 < best))
+        best = d + 1;
+    }
+    return best;
+  }
+
+  void compute() {
+    StatisticManager &sm = *theStatisticManager;
+    std::vector<const Instruction *> insts;
+    for (const Function &fn : *km.module)
+      for (const Instruction &inst : instructions(fn))
+        insts.push_back(&inst);
+
+    distToReturn.clear();
+    for (const Instruction *inst : insts)
+      distToReturn[inst] = isa<ReturnInst>(inst);
+    for (bool changed = true; changed;) {
+      changed = false;
+      for (const Instruction *inst : insts) {
+        const std::uint64_t cost = passCost(*inst);
+        if (!cost)
+          continue;
+        std::uint64_t &d = distToReturn[inst];
+        for (const Instruction *succ : successorsOf(*inst)) {
+          const std::uint64_t sd = distToReturn[succ];
+          if (sd && (d == 0 || cost + sd < d)) {
+            d = cost + sd;
+            changed = true;
+          }
+        }
+      }
+    }
+
+    distToUncovered.clear();
+    for (const Instruction *inst : insts)
+      distToUncovered[inst] =
+          sm.getIndexedValue(stats::uncoveredInstructions,
+                             km.infos->getInfo(*inst).id) != 0;
+    for (bool changed = true; changed;) {
+      changed = false;
+      auto relax = [&](std::uint64_t &d, std::uint64_t candidate) {
+        if (d == 0 || candidate < d) {
+          d = candidate;
+          changed = true;
+        }
+      };
+      for (const Instruction *inst : insts) {
+        std::uint64_t &d = distToUncovered[inst];
+        if (const std::uint64_t cost = passCost(*inst))
+          for (const Instruction *succ : successorsOf(*inst))
+            if (const std::uint64_t sd = distToUncovered[succ])
+              relax(d, cost + sd);
+        for (const Function *f : calleesOf(*inst))
+          if (!f->isDeclaration())
+            if (const std::uint64_t ed = distToUncovered[&f->front().front()])
+              relax(d, 1 + ed);
+      }
+    }
+  }
+};
+
+class UncoveredDistanceTest : public ::testing::Test {
+protected:
+  LLVMContext ctx;
+  KModule km;
+
+  void SetUp() override {
+    // manifest() would otherwise write assembly.ll through a handler
+    auto &options = cl::getRegisteredOptions();
+    static_cast<cl::opt<bool> *>(options["output-source"])->setValue(false);
+
+    SMDiagnostic error;
+    km.module = parseAssemblyString(TestModule, error, ctx);
+    ASSERT_TRUE(km.module) << error.getMessage().str();
+    km.manifest(nullptr, false);
+
+    StatisticManager &sm = *theStatisticManager;
+    sm.useIndexedStats(km.infos->getMaxID());
+    for (const Function &fn : *km.module)
+      for (const Instruction &inst : instructions(fn))
+        sm.setIndexedValue(stats::uncoveredInstructions,
+                           km.infos->getInfo(inst).id, 1);
+  }
+
+  unsigned idOf(const Instruction &inst) { return km.infos->getInfo(inst).id; }
+
+  void cover(UncoveredDistance &ud, const Instruction &inst) {
+    theStatisticManager->setIndexedValue(stats::uncoveredInstructions,
+                                         idOf(inst), 0);
+    ud.markCovered(idOf(inst));
+  }
+
+  void cover(UncoveredDistance &ud, const Function &fn) {
+    for (const Instruction &inst : instructions(fn))
+      cover(ud, inst);
+  }
+
+  void cover(UncoveredDistance &ud, const BasicBlock &bb) {
+    for (const Instruction &inst : bb)
+      cover(ud, inst);
+  }
+
+  const BasicBlock &block(const char *function, const char *name) {
+    for (const BasicBlock &bb : *km.module->getFunction(function))
+      if (bb.getName() == name)
+        return bb;
+    abort();
+  }
+
+  /// Check the distances of all instructions against the reference.
+  void check(const char *when) {
+    ReferenceDistances reference(km);
+    reference.compute();
+    StatisticManager &sm = *theStatisticManager;
+    for (const Function &fn : *km.module) {
+      for (const Instruction &inst : instructions(fn)) {
+        const unsigned id = idOf(inst);
+        EXPECT_EQ(reference.distToReturn[&inst],
+                  sm.getIndexedValue(stats::minDistToReturn, id))
+            << when << ": " << fn.getName().str() << ": " << inst.getName().str();
+        EXPECT_EQ(reference.distToUncovered[&inst],
+                  sm.getIndexedValue(stats::minDistToUncovered, id))
+            << when << ": " << fn.getName().str() << ": " << inst.getName().str();
+      }
+    }
+  }
+};
+
+TEST_F(UncoveredDistanceTest, IncrementalUpdatesMatchFullRecomputation) {
+  UncoveredDistance ud(km);
+  check("initially");
+
+  // a callee that is covered after the first pass
+  cover(ud, *km.module->getFunction("g"));
+  ud.update();
+  check("after covering g");
+
+  cover(ud, km.module->getFunction("main")->getEntryBlock());
+  cover(ud, block("f", "entry"));
+  cover(ud, block("f", "loop"));
+  ud.update();
+  check("after covering the loop head");
+
+  cover(ud, block("f", "body"));
+  cover(ud, block("f", "exit"));
+  cover(ud, block("f", "done"));
+  ud.update();
+  check("after covering all but the failure path");
+
+  // the nearest uncovered instruction is now the call to @fail
+  const Instruction &exitBranch = *block("f", "exit").getTerminator();
+  EXPECT_EQ(2u, theStatisticManager->getIndexedValue(stats::minDistToUncovered,
+                                                     idOf(exitBranch)));
+
+  cover(ud, block("f", "bad"));
+  cover(ud, *km.module->getFunction("fail"));
+  ud.update();
+  check("after covering everything");
+  EXPECT_EQ(0u, theStatisticManager->getIndexedValue(stats::minDistToUncovered,
+                                                     idOf(exitBranch)));
+}
+} // namespace